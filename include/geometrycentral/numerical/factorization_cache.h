@@ -0,0 +1,94 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_solvers.h"
+
+#include <memory>
+#include <string>
+
+// A process-wide cache of matrix factorizations, so that independent algorithms which factor identical matrices (for
+// instance, the cotan Laplacian of the same mesh) share a single factorization.
+//
+// Matrices are identified by a hash of their sparsity structure and values, and verified to be exactly equal before a
+// cached factorization is reused. Solvers are returned as reference-counted handles: a solver stays alive as long as
+// any handle to it exists, even after it has been evicted from the cache. The cache itself retains the most recently
+// used solvers, evicting the least recently used ones when the total memory exceeds a budget.
+//
+// Optionally, factorizations can also be cached on disk, so that they persist across runs of a program (see
+// setFactorizationDiskCacheDirectory()).
+//
+// The cache is meant for factorizations which are used repeatedly, by long-lived objects. One-off solves should
+// construct a solver directly, rather than pinning their factorization in the cache.
+
+namespace geometrycentral {
+
+// A handle to a solver which may be shared with other callers. Handles only expose solves, which are safe to run
+// concurrently (see LinearSolver), so the shared factorization and its options cannot be changed through a handle.
+template <typename S>
+class SharedSolver {
+public:
+  SharedSolver() {}
+  explicit SharedSolver(std::shared_ptr<S> solver_) : solver(std::move(solver_)) {}
+
+  template <typename T>
+  Vector<T> solve(const Vector<T>& rhs) const {
+    return solver->solve(rhs);
+  }
+  template <typename T>
+  void solve(Vector<T>& x, const Vector<T>& rhs) const {
+    solver->solve(x, rhs);
+  }
+  template <typename T>
+  void solve(DenseMatrix<T>& x, const DenseMatrix<T>& rhs) const {
+    solver->solve(x, rhs);
+  }
+
+  size_t memoryUsage() const { return solver->memoryUsage(); }
+
+  explicit operator bool() const { return static_cast<bool>(solver); }
+  bool operator==(const SharedSolver& other) const { return solver == other.solver; }
+  bool operator!=(const SharedSolver& other) const { return solver != other.solver; }
+
+private:
+  std::shared_ptr<S> solver;
+};
+
+// Get a solver for the matrix, reusing a cached factorization of an identical matrix if there is one
+template <typename T>
+SharedSolver<PositiveDefiniteSolver<T>> cachedPositiveDefiniteSolver(SparseMatrix<T>& mat);
+template <typename T>
+SharedSolver<SquareSolver<T>> cachedSquareSolver(SparseMatrix<T>& mat);
+
+// A hash of the sparsity structure and values of a matrix
+template <typename T>
+size_t hashMatrix(const SparseMatrix<T>& mat);
+
+// The memory budget for the cache, in bytes. Setting a budget of 0 disables caching (new solvers are still returned,
+// but not retained).
+void setFactorizationCacheBudget(size_t bytes);
+size_t getFactorizationCacheBudget();
+
+// Memory currently retained by the cache, in bytes
+size_t getFactorizationCacheMemoryUsage();
+
+// Drop all cached solvers (existing handles remain valid)
+void clearFactorizationCache();
+
+// A directory in which to cache factorizations on disk. When a matrix is not found in memory, a factorization saved in
+// this directory is loaded if there is one, and otherwise the newly computed factorization is saved there. The
+// directory must already exist. Set an empty string (the default) to disable the disk cache.
+// Note: files are never deleted, so the directory grows with the number of distinct matrices factored.
+void setFactorizationDiskCacheDirectory(std::string directory);
+std::string getFactorizationDiskCacheDirectory();
+
+// Statistics about cache usage, for the whole process
+struct FactorizationCacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+  size_t nEntries = 0;
+  size_t diskHits = 0;   // misses in memory which were loaded from disk
+  size_t diskWrites = 0; // factorizations saved to disk
+};
+FactorizationCacheStats getFactorizationCacheStats();
+
+} // namespace geometrycentral
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Helpers for reading and writing matrix factorizations, in a simple versioned binary format. Each file begins with a
+// header identifying the kind of factorization, the scalar type, and the matrix dimensions, followed by the arrays
+// which make up the factorization. These are used to implement save() and load() for the solvers in linear_solvers.h.
+// Data is stored in the native byte order, so files should not be moved between big- and little-endian machines.
+
+namespace geometrycentral {
+
+enum class FactorizationKind : uint32_t { LDLT = 1, LU = 2, QR = 3 };
+
+// Bump this whenever the format changes; files with a different version are rejected
+const uint32_t FACTORIZATION_FILE_VERSION = 1;
+
+// A short name for a kind of factorization with a scalar type, such as "ldlt_f64" (used to name cache files)
+template <typename T>
+std::string factorizationTypeName(FactorizationKind kind);
+
+// Write/read the header. Reading throws if the file is not a factorization of the expected kind and scalar type.
+template <typename T>
+void writeFactorizationHeader(std::ostream& out, FactorizationKind kind, size_t nRows, size_t nCols);
+template <typename T>
+void readFactorizationHeader(std::istream& in, FactorizationKind kind, size_t& nRows, size_t& nCols);
+
+// Write/read the pieces of a factorization. Reading throws on truncated input.
+template <typename T>
+void writeSparseMatrix(std::ostream& out, const SparseMatrix<T>& mat);
+template <typename T>
+SparseMatrix<T> readSparseMatrix(std::istream& in);
+
+template <typename T>
+void writeVector(std::ostream& out, const Vector<T>& vec);
+template <typename T>
+Vector<T> readVector(std::istream& in);
+
+void writeIndexVector(std::ostream& out, const std::vector<int64_t>& inds);
+std::vector<int64_t> readIndexVector(std::istream& in);
+
+void writeFlag(std::ostream& out, uint64_t flag);
+uint64_t readFlag(std::istream& in);
+
+} // namespace geometrycentral
@@ -4,8 +4,11 @@
 
 #include "Eigen/Sparse"
 
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <tuple>
 
 // This disables various safety checks in linear algebra code and solvers
 // #define GC_NLINALG_DEBUG
@@ -24,6 +27,25 @@ Vector<T> smallestEigenvectorPositiveDefinite(SparseMatrix<T>& energyMatrix, Spa
 template <typename T>
 std::vector<Vector<T>> smallestKEigenvectorsPositiveDefinite(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& massMatrix,
                                                              size_t kEigenvalues, size_t nIterations = 50);
+
+// Computes the k smallest eigenpairs of A x = lambda M x all at once, via block LOBPCG preconditioned with a single
+// factorization of A. Returns the eigenvalues in increasing order, and the corresponding M-orthonormal eigenvectors as
+// the columns of a matrix. Iterates until each relative residual is below tol, and throws std::runtime_error if that
+// takes more than maxIterations.
+template <typename T>
+std::tuple<Vector<double>, DenseMatrix<T>> smallestKEigenpairsPositiveDefinite(SparseMatrix<T>& energyMatrix,
+                                                                                SparseMatrix<T>& massMatrix,
+                                                                                size_t kEigenvalues, double tol = 1e-8,
+                                                                                size_t maxIterations = 100);
+
+// Extends a set of smallest eigenpairs (as computed above) with the next kAdditional eigenpairs, which are appended to
+// `eigenvalues` and `eigenvectors`. The existing eigenpairs are not recomputed. Returns false if the new eigenpairs did
+// not converge to tol within maxIterations, in which case the (unconverged) last iterates are appended.
+template <typename T>
+bool extendSmallestKEigenpairsPositiveDefinite(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& massMatrix,
+                                               Vector<double>& eigenvalues, DenseMatrix<T>& eigenvectors,
+                                               size_t kAdditional, double tol = 1e-8, size_t maxIterations = 100);
+
 template <typename T>
 std::vector<Vector<T>> smallestKEigenvectorsPositiveDefiniteTol(SparseMatrix<T>& energyMatrix,
                                                                 SparseMatrix<T>& massMatrix, size_t kEigenvalues,
@@ -55,6 +77,10 @@ template <typename T>
 double residual(const SparseMatrix<T>& matrix, const Vector<T>& lhs, const Vector<T>& rhs);
 
 // Base class for all linear solvers
+//
+// The direct solvers (Solver, SquareSolver, and PositiveDefiniteSolver) are safe to use from several threads at once:
+// any number of threads may call solve() on the same solver concurrently, since the factorization is not modified by
+// solves. Other member functions, such as updateFactorization(), must not run concurrently with anything else.
 template <typename T>
 class LinearSolver {
 
@@ -69,6 +95,7 @@ public:
   virtual void solve(Vector<T>& x, const Vector<T>& rhs) = 0;
 
 protected:
+  LinearSolver(size_t nRows_, size_t nCols_) : nRows(nRows_), nCols(nCols_) {} // (used when loading from a file)
   size_t nRows, nCols;
 };
 
@@ -91,25 +118,87 @@ public:
   // Gets the rank of the system
   size_t rank();
 
+  // Save the factorization to a file, from which load() constructs an equivalent solver without refactoring the matrix.
+  // A loaded solver solves the normal equations with the saved triangular factor, followed by a step of refinement.
+  // Note: only full rank systems can be saved. With Suitesparse, the triangular factor is recomputed when saving.
+  void save(std::string filename);
+  void save(std::ostream& out);
+  static std::unique_ptr<Solver<T>> load(std::string filename);
+  static std::unique_ptr<Solver<T>> load(std::istream& in);
+
 protected:
+  Solver(size_t nRows, size_t nCols);
   bool underdetermined;
   std::unique_ptr<QRSolverInternals<T>> internals;
 };
 
+// Precision of the factorization held by a solver. In mixed precision, the matrix is factored in single precision
+// (halving the memory used by the factor), and full accuracy is recovered by iterative refinement.
+enum class FactorPrecision { Full = 0, Mixed };
+
+// Structure of the factorization held by a PositiveDefiniteSolver. A simplicial LDL^T factorization is computed column
+// by column. A supernodal LL^T factorization groups columns with identical structure into dense blocks, which is much
+// faster for large matrices, but requires the matrix to be strictly positive definite. (For complex matrices, these
+// are LDL^H and LL^H.)
+// Note: supernodal factorizations require Suitesparse; otherwise the factorization is always simplicial.
+enum class FactorStructure { Simplicial = 0, Supernodal };
+
 template <typename T>
 struct PSDSolverInternals; // hide implementation details
 template <typename T>
 class PositiveDefiniteSolver final : public LinearSolver<T> {
 
 public:
-  PositiveDefiniteSolver(SparseMatrix<T>& mat);
+  PositiveDefiniteSolver(SparseMatrix<T>& mat, FactorPrecision precision = FactorPrecision::Full,
+                         FactorStructure structure = FactorStructure::Simplicial);
   ~PositiveDefiniteSolver();
 
   // Solve!
   void solve(Vector<T>& x, const Vector<T>& rhs) override;
   Vector<T> solve(const Vector<T>& rhs) override;
 
+  // Solve for several right hand sides at once, one per column of rhs. This is faster than solving for each column in
+  // turn, since the factor is traversed once for the whole block.
+  void solve(DenseMatrix<T>& x, const DenseMatrix<T>& rhs);
+
+  // Update the factorization after a sparse change to the matrix, so that it factors (mat + delta). The change should
+  // be confined to a few rows and columns (e.g. those of a handful of moved vertices). When it is cheap to do so, the
+  // existing factor is modified in place via a low-rank update/downdate; otherwise the matrix is refactored, reusing
+  // the symbolic analysis if the sparsity pattern did not change. Returns true if a low-rank update was used.
+  // Note: low-rank updates require Suitesparse, a real matrix, and a simplicial factorization; otherwise the matrix is
+  // always refactored.
+  bool updateFactorization(SparseMatrix<T>& delta);
+
+  // The structure of the factorization in use (mixed precision and loaded factorizations are always simplicial)
+  FactorStructure factorStructure();
+
+  // True if solves use a single precision factorization with iterative refinement. Solves for which refinement stalls
+  // fall back on a full precision factorization (see lastSolveUsedFullPrecision), but later solves still try single
+  // precision first. This is only false in mixed precision mode if the matrix could not be factored in single precision
+  // at all.
+  bool usesMixedPrecision();
+
+  // Approximate memory held by the solver (mostly the factorization), in bytes
+  size_t memoryUsage();
+
+  // Save the factorization to a file, from which load() constructs an equivalent solver without refactoring the matrix.
+  // Files are interchangeable between the Suitesparse and Eigen versions.
+  void save(std::string filename);
+  void save(std::ostream& out);
+  static std::unique_ptr<PositiveDefiniteSolver<T>> load(std::string filename);
+  static std::unique_ptr<PositiveDefiniteSolver<T>> load(std::istream& in);
+
+  // Options for mixed precision solves
+  double refinementTolerance = 1e-10;  // relative residual ||Ax - b|| / ||b|| at which to stop refining
+  size_t maxRefinementIterations = 10; // fall back on full precision if the tolerance is not reached in this many steps
+
+  // Statistics from the most recent call to solve() (or one of them, if solves are concurrent)
+  std::atomic<size_t> lastRefinementIterations{0};
+  std::atomic<bool> lastSolveUsedFullPrecision{false}; // true if refinement stalled, and the solve fell back on full
+                                                       // precision
+
 protected:
+  PositiveDefiniteSolver(size_t nRows, size_t nCols);
   std::unique_ptr<PSDSolverInternals<T>> internals;
 };
 
@@ -126,9 +215,106 @@ public:
   void solve(Vector<T>& x, const Vector<T>& rhs) override;
   Vector<T> solve(const Vector<T>& rhs) override;
 
+  // Solve for several right hand sides, one per column of rhs. Without Suitesparse, the factor is traversed once for the
+  // whole block; UMFPACK solves the columns one at a time.
+  void solve(DenseMatrix<T>& x, const DenseMatrix<T>& rhs);
+
+  // Approximate memory held by the solver (mostly the factorization), in bytes
+  size_t memoryUsage();
+
+  // Save the factorization to a file, from which load() constructs an equivalent solver without refactoring the matrix.
+  // Files are interchangeable between the Suitesparse and Eigen versions.
+  void save(std::string filename);
+  void save(std::ostream& out);
+  static std::unique_ptr<SquareSolver<T>> load(std::string filename);
+  static std::unique_ptr<SquareSolver<T>> load(std::istream& in);
+
 protected:
+  SquareSolver(size_t nRows, size_t nCols);
+
   // Implementation-specific quantities
   std::unique_ptr<SquareSolverInternals<T>> internals;
 };
 
+// Solves square systems subject to Dirichlet (fixed value) constraints. Given a set of constrained indices, finds x such
+// that x_i = values_i at each constrained index, and (A x)_i = rhs_i at each unconstrained index. The block of A
+// coupling unconstrained indices is factored once on construction (via the factorization cache, so it is shared with
+// any other solver of the same block), after which solving with new values and right hand sides costs only a
+// back-substitution.
+// Note: only instantiated for float, double, and std::complex<double>
+template <typename T>
+struct DirichletSolverInternals; // hide implementation details
+template <typename T>
+class DirichletSolver {
+
+public:
+  // If positiveDefinite is true, the unconstrained block of the matrix must be symmetric (Hermitian) positive definite,
+  // and an LDLT factorization is used; otherwise, an LU factorization is used.
+  DirichletSolver(SparseMatrix<T>& mat, const Vector<bool>& isConstrained, bool positiveDefinite = true);
+  ~DirichletSolver();
+
+  // Solve! Both vectors have the full size of the system. Entries of `rhs` at constrained indices and entries of
+  // `values` at unconstrained indices are ignored.
+  Vector<T> solve(const Vector<T>& rhs, const Vector<T>& values);
+  void solve(Vector<T>& x, const Vector<T>& rhs, const Vector<T>& values);
+
+  // Solve with zero right hand side, e.g. for harmonic interpolation of boundary values
+  Vector<T> solveHomogeneous(const Vector<T>& values);
+
+  // Solve many problems at once, one per column, with a single block solve against the factorization
+  DenseMatrix<T> solve(const DenseMatrix<T>& rhs, const DenseMatrix<T>& values);
+
+  // Precompute the (dense) response of the unconstrained entries to each constrained value, A_UU^-1 A_UC. Afterwards,
+  // solves with new values cost a dense product rather than a back-substitution. Only worthwhile when there are few
+  // constrained indices, and many sets of values to solve with.
+  void precomputeConstraintResponse();
+
+  size_t nConstrained();
+  size_t nUnconstrained();
+
+  // The decomposition of the matrix into unconstrained (A) and constrained (B) blocks
+  const BlockDecompositionResult<T>& blockDecomposition();
+
+protected:
+  size_t N;
+  std::unique_ptr<DirichletSolverInternals<T>> internals;
+};
+
+// Iterative solver for symmetric (Hermitian) positive (semi-)definite systems, using a smoothed-aggregation algebraic
+// multigrid hierarchy as a preconditioner for conjugate gradients. Intended for very large Laplacian-like systems
+// (cotan Laplacian, connection Laplacian, heat operators), where the fill of a direct factorization becomes
+// prohibitive.
+// Note: only instantiated for double and std::complex<double>
+template <typename T>
+struct AMGSolverInternals; // hide implementation details
+template <typename T>
+class AlgebraicMultigridSolver final : public LinearSolver<T> {
+
+public:
+  AlgebraicMultigridSolver(SparseMatrix<T>& mat);
+  ~AlgebraicMultigridSolver();
+
+  // Solve! (preconditioned conjugate gradients, to within `tolerance`). Throws std::runtime_error if the residual is
+  // not below the tolerance after maxIterations; x then holds the last iterate, and the statistics below are set.
+  void solve(Vector<T>& x, const Vector<T>& rhs) override;
+  Vector<T> solve(const Vector<T>& rhs) override;
+
+  // Apply a single V-cycle, approximating x = A^-1 rhs. Use this to precondition some other iterative method.
+  void applyPreconditioner(Vector<T>& x, const Vector<T>& rhs);
+
+  // Number of levels in the hierarchy (including the finest)
+  size_t nLevels();
+
+  // Options
+  double tolerance = 1e-8;    // relative residual ||Ax - b|| / ||b|| at which to stop iterating
+  size_t maxIterations = 500; // give up after this many iterations
+
+  // Statistics from the most recent call to solve()
+  size_t lastIterations = 0;
+  double lastRelativeResidual = 0.;
+
+protected:
+  std::unique_ptr<AMGSolverInternals<T>> internals;
+};
+
 } // namespace geometrycentral
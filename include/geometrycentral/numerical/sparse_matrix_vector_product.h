@@ -0,0 +1,74 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+
+#include <vector>
+
+// Fast sparse matrix-vector products. Eigen's product with a column-major SparseMatrix<T> is single-threaded and
+// scatters into the output; when the same matrix is applied many times (as in iterative solvers and power iterations),
+// it pays to convert it once to a row-oriented layout, which can be split across threads and vectorized.
+
+namespace geometrycentral {
+
+// Layouts for PackedSparseMatrix
+//  - Auto: SELL for real matrices, and CSR for complex ones (whose larger entries gain less from the SIMD lanes).
+//  - CSR: compressed sparse rows.
+//  - SELL: "SELL-C-sigma" (Kreutzer et al. 2014). Rows are sorted by length within windows of sigma rows, and grouped
+//    into slices of C rows which are stored column-by-column (padded to the longest row in the slice), so that the C
+//    rows of a slice are processed together in SIMD lanes.
+enum class SpMVLayout { Auto = 0, CSR, SELL };
+
+// The number of threads used by sparse matrix-vector products (0, the default, means one per hardware thread). Small
+// products always run on a single thread, since starting threads would cost more than it saves.
+void setSpMVThreadCount(size_t nThreads);
+size_t getSpMVThreadCount();
+
+// A sparse matrix stored for repeated products with vectors
+// Note: only instantiated for float, double, and std::complex<double>
+template <typename T>
+class PackedSparseMatrix {
+
+public:
+  PackedSparseMatrix();
+  PackedSparseMatrix(const SparseMatrix<T>& mat, SpMVLayout layout = SpMVLayout::Auto);
+
+  // y = A x. x and y must not be the same vector.
+  void multiply(Vector<T>& y, const Vector<T>& x) const;
+  Vector<T> operator*(const Vector<T>& x) const;
+
+  size_t rows() const { return nRows; }
+  size_t cols() const { return nCols; }
+  size_t nonZeros() const { return nNonZeros; }
+  SpMVLayout layout() const { return storageLayout; } // (never Auto)
+
+  // Memory held by the matrix in bytes, including any padding
+  size_t memoryUsage() const;
+
+  // Parameters of the SELL layout
+  static const size_t SELL_C = 8;       // rows per slice
+  static const size_t SELL_SIGMA = 256; // rows are sorted by length within windows of this many rows
+
+private:
+  size_t nRows = 0;
+  size_t nCols = 0;
+  size_t nNonZeros = 0;
+  SpMVLayout storageLayout = SpMVLayout::CSR;
+
+  // CSR
+  Eigen::SparseMatrix<T, Eigen::RowMajor> csr;
+
+  // SELL
+  std::vector<size_t> sliceStart;  // offset of each slice in the arrays below (plus one past the end)
+  std::vector<int> sliceFullWidth; // length of the shortest row in each slice (entries before it have no padding)
+  std::vector<int> sellCols;       // column index of each entry (padding is -1, and never read)
+  std::vector<T> sellValues;       // value of each entry (padding is 0)
+  std::vector<int> sellRows;       // original index of each row, in sorted order
+  std::vector<int> sellLengths;    // length of each row, in sorted order (0 for the missing rows of the last slice)
+};
+
+// Compute y = A x for a compressed matrix, using several threads when the matrix is large. Prefer a PackedSparseMatrix
+// when applying the same matrix many times. x and y must not be the same vector.
+template <typename T>
+void sparseMatrixVectorProduct(const SparseMatrix<T>& A, const Vector<T>& x, Vector<T>& y);
+
+} // namespace geometrycentral
@@ -1,11 +1,12 @@
 #pragma once
 
-#include "geometrycentral/surface/edge_length_geometry.h"
-#include "geometrycentral/surface/geometry.h"
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/intrinsic_geometry_interface.h"
 #include "geometrycentral/utilities/utilities.h"
+#include "geometrycentral/utilities/vector2.h"
 
 #include <cmath>
-#include <queue>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -94,39 +95,102 @@ struct GeodesicKeyPoint {
   double pos;
 };
 
+// Stateful class. Computes exact polyhedral geodesic distance from a set of source vertices, by propagating windows
+// (intervals of edges, along with the unfolded position of the source which reaches them in a straight line) across
+// faces in order of distance, as in Mitchell, Mount & Papadimitriou (1987), using the filter of Xin & Wang (2009) to
+// discard windows which cannot carry a shortest path. Saddle and boundary vertices become pseudo-sources, from which
+// new windows are propagated.
+//
+// Windows are held in a pool, and the queue orders small (distance, slot) entries rather than whole windows. The pool,
+// the queues and the per-element state all keep their storage between queries, so repeated queries do not allocate
+// once these have grown to their working size. Only the state of the vertices and halfedges a query touched is reset
+// before the next one. Queries can stop early, at a maximum distance or once a set of target vertices has been reached,
+// in which case they cost time proportional to the region reached rather than the size of the mesh.
 class ExactPolyhedralGeodesics {
 
 public:
-  ExactPolyhedralGeodesics(EdgeLengthGeometry* geom_);
+  // === Constructors
+  ExactPolyhedralGeodesics(IntrinsicGeometryInterface& geom);
 
+
+  // === Methods
+
+  // Add a source for computeDistance()
   void addSource(Vertex v);
-  VertexData<double> computeDistance(Vertex v);
+  void clearSources();
+
+  // Solve for distance from the sources added with addSource()
   VertexData<double> computeDistance();
 
+  // Solve for distance from a single vertex, or from a collection of vertices (ignoring any added with addSource())
+  VertexData<double> computeDistance(Vertex v);
+  VertexData<double> computeDistance(const std::vector<Vertex>& sourceVerts);
+
+  // As above, but return only the vertices which were reached, in order of increasing distance. With an early exit,
+  // this costs nothing per vertex which was not reached.
+  std::vector<std::pair<Vertex, double>> computeDistanceReached(const std::vector<Vertex>& sourceVerts);
+
+
+  // === Options and parameters
+
+  // Stop once every window left is farther than this distance. Vertices beyond it are not reached, and get infinite
+  // distance.
+  double maxDistance = std::numeric_limits<double>::infinity();
+
+  // If nonempty, stop once the distance to all of these vertices is final. Vertices whose distance is not yet final
+  // at that point are not reached, and get infinite distance.
+  std::vector<Vertex> targets;
+
+
+  // === Statistics, for the last query
+  size_t numOfWinGen = 0;      // windows generated
+  size_t maxWinQSize = 0;      // the most windows queued at once
+  size_t maxPseudoQSize = 0;   // the most pseudo-sources queued at once
+  size_t totalCalcVertNum = 0; // vertices touched (given a tentative distance)
+  size_t windowMemory = 0;     // bytes held by the window pool and the queues
+  double propagationTime = 0.; // seconds spent propagating windows
+
+
 private:
-  HalfedgeMesh* mesh;
-  EdgeLengthGeometry* geom;
+  // === Members
+  HalfedgeMesh& mesh;
+
+  // Geometry, copied at construction
+  EdgeData<double> edgeLengths;
+  VertexData<char> isSaddle; // saddle and boundary vertices, around which shortest paths can bend
 
   std::vector<Vertex> srcVerts;
   HalfedgeData<SplitInfo> splitInfos;
   VertexData<VertInfo> vertInfos;
-  std::priority_queue<Window> winQ;
-  std::priority_queue<PseudoWindow> pseudoSrcQ;
-
-  std::vector<Window> storedWindows;
-  std::vector<Face> keptFaces;
-  HalfedgeData<std::list<Window>> allWindows;
-  bool keptAllWindows = false;
 
-  // stats
-  int numOfWinGen;
-  int maxWinQSize, maxPseudoQSize;
-  int totalCalcVertNum;
-  double geodesicRadius;
-  bool geodesicRadiusReached;
+  // Windows in the pool, with a list of free slots. winQ is a heap of (minDist, slot) with the smallest distance on top,
+  // and pseudoSrcQ a heap of pseudo-windows.
+  std::vector<Window> windowPool;
+  std::vector<size_t> freeWindowSlots;
+  std::vector<std::pair<double, size_t>> winQ;
+  std::vector<PseudoWindow> pseudoSrcQ;
+  void pushWindow(const Window& win);
+  void popWindow(Window& win);
+  void pushPseudoWindow(const PseudoWindow& pseudoWin);
+  void popPseudoWindow();
+
+  // Every vertex and halfedge whose state differs from the initial state, and the distance below which the distance
+  // at touched vertices is final
+  std::vector<Vertex> touchedVertices;
+  std::vector<Halfedge> touchedHalfedges;
+  double finalDistance;
+  void setVertexDistance(Vertex v, double dist);
+
+  // Per-target flags, the number of targets not yet given a distance, the largest distance given to a target so far,
+  // and (once every target has a distance) that as an upper bound on the largest distance to a target
+  VertexData<char> isTarget;
+  size_t nTargetsUnreached;
+  double targetDistanceMax;
+  double targetDistanceBound;
 
   void clear();
-  void initialize();
+  void initialize(const std::vector<Vertex>& sourceVerts);
+  void propagate(const std::vector<Vertex>& sourceVerts);
   void propogateWindow(const Window& win);
   void generateSubWinsForPseudoSrc(const PseudoWindow& pseudoWin);
   void generateSubWinsForPseudoSrcFromWindow(const PseudoWindow& pseudoWin, Halfedge& startHe, Halfedge& endHe);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/heat_method_distance.h"
+#include "geometrycentral/surface/intrinsic_geometry_interface.h"
+
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace geometrycentral {
+namespace surface {
+
+// Stateful class. Builds up a set of samples at vertices, each new sample at the vertex farthest from those so far,
+// while tracking the geodesic Voronoi partition of the samples (the nearest sample to each vertex). Distances come from
+// the heat method.
+
+class FarthestPointSampler {
+
+public:
+  // === Constructors
+  FarthestPointSampler(IntrinsicGeometryInterface& geom, double tCoef = 1.0);
+  FarthestPointSampler(IntrinsicGeometryInterface& geom, HeatMethodDistanceSolver& solver);
+
+
+  // === Methods
+
+  // Add a sample at the vertex farthest from the current samples (the first vertex, if there are none yet), and return
+  // it. Throws if the mesh has no vertices.
+  Vertex addSample();
+
+  // Add a sample at the given vertex
+  void addSample(Vertex v);
+
+  // Add n samples, each at the vertex farthest from the current samples, and return them
+  std::vector<Vertex> addSamples(size_t n);
+
+  // The samples, in the order they were added
+  const std::vector<Vertex>& getSamples() const { return samples; }
+
+  // The distance from each vertex to the nearest sample (infinite before any samples), and the largest such distance
+  // (zero on a mesh with no vertices)
+  const VertexData<double>& getDistance() const { return distance; }
+  double coveringRadius();
+
+  // The index of the nearest sample to each vertex, i.e. the Voronoi cell it belongs to (INVALID_IND before any samples)
+  const VertexData<size_t>& getLabels() const { return labels; }
+
+  // Pairs of adjacent Voronoi cells (i, j) with i < j, in sorted order. Two cells are adjacent if an edge connects them.
+  std::vector<std::pair<size_t, size_t>> cellAdjacency() const;
+
+
+  // === Options and parameters
+
+  // Update distances from a new sample only within the ball it could affect (a ball of radius equal to the covering
+  // radius), whenever that ball covers less than localAreaFraction of the surface (see LocalRegionGrower)
+  bool localUpdates = true;
+  double localAreaFraction = LocalRegionGrower::defaultLocalAreaFraction;
+
+  // Statistics, over the life of the sampler
+  size_t nGlobalSolves = 0;
+  size_t nLocalSolves = 0;
+
+
+private:
+  // === Members
+  IntrinsicGeometryInterface& geom;
+  HalfedgeMesh& mesh;
+  std::unique_ptr<HeatMethodDistanceSolver> ownedSolver;
+  HeatMethodDistanceSolver& solver;
+  double surfaceArea;
+
+  std::vector<Vertex> samples;
+  VertexData<double> distance;
+  VertexData<size_t> labels;
+
+  // Distances to the nearest sample, largest first. Entries are not removed when a distance decreases, so stale entries
+  // (whose distance no longer matches) are skipped when they reach the top.
+  typedef std::pair<double, Vertex> Entry;
+  std::priority_queue<Entry> farthest;
+  void initialize();
+  void updateDistance(Vertex v, double d, size_t iSample);
+  void popStaleEntries();
+  void rebuildQueue();
+};
+
+} // namespace surface
+} // namespace geometrycentral
@@ -1,9 +1,12 @@
 #pragma once
 
-#include "geometrycentral/surface/geometry.h"
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/intrinsic_geometry_interface.h"
+#include "geometrycentral/utilities/indexed_heap.h"
 #include "geometrycentral/utilities/utilities.h"
 
 #include <cmath>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -11,13 +14,143 @@
 namespace geometrycentral {
 namespace surface {
 
-VertexData<double> FMMDistance(Geometry<Euclidean>* geometry,
+// One-off functions to compute distance with the fast marching method, from vertices with initial distances
+VertexData<double> FMMDistance(IntrinsicGeometryInterface& geom,
                                const std::vector<std::pair<Vertex, double>>& initialDistances);
 
-VertexData<double> FMMDistance(HalfedgeMesh* mesh, const std::vector<std::pair<Vertex, double>>& initialDistances,
-                               const EdgeData<double>& edgeLengths, const HalfedgeData<double>& oppAngles);
+VertexData<double> FMMDistance(HalfedgeMesh& mesh, const std::vector<std::pair<Vertex, double>>& initialDistances,
+                               const EdgeData<double>& edgeLengths, const CornerData<double>& cornerAngles);
 
+// The distance to the third vertex C of a triangle, given the distances dA and dB to the other two vertices, the
+// lengths a = |CB| and b = |CA|, and the angle theta at C
 double eikonalDistanceSubroutine(double a, double b, double theta, double dA, double dB);
 
+
+// Stateful class. Computes distance with the fast marching method (Kimmel & Sethian 1998), marching a front outwards
+// from the sources in order of increasing distance, and updating each vertex from the triangles it shares with two
+// vertices behind the front.
+//
+// The mesh connectivity and geometry are packed into flat per-vertex arrays at construction, and all of the per-query
+// state (including the queue) is allocated once and reset lazily, touching only the vertices the previous query
+// reached. Queries can stop early, at a maximum distance or once a set of target vertices has been reached, in which
+// case they cost time proportional to the number of vertices reached rather than the size of the mesh.
+//
+// computeDistanceParallel() solves the same discrete problem with the fast iterative method (Jeong & Whitaker 2008)
+// instead, which updates a whole band of active vertices at once, and so can be split across threads.
+class FastMarchingDistanceSolver {
+
+public:
+  // === Constructors
+  FastMarchingDistanceSolver(IntrinsicGeometryInterface& geom);
+  FastMarchingDistanceSolver(HalfedgeMesh& mesh, const EdgeData<double>& edgeLengths,
+                             const CornerData<double>& cornerAngles);
+
+
+  // === Methods
+
+  // Solve for distance from a single vertex
+  VertexData<double> computeDistance(const Vertex& sourceVert);
+
+  // Solve for distance from a collection of vertices
+  VertexData<double> computeDistance(const std::vector<Vertex>& sourceVerts);
+
+  // Solve for distance from vertices with initial distances
+  VertexData<double> computeDistance(const std::vector<std::pair<Vertex, double>>& initialDistances);
+
+  // As above, but return only the vertices which were reached, in order of increasing distance. With an early exit,
+  // this costs nothing per vertex which was not reached.
+  std::vector<std::pair<Vertex, double>>
+  computeDistanceReached(const std::vector<std::pair<Vertex, double>>& initialDistances);
+
+  // Solve for distance from vertices with initial distances, with the fast iterative method on nThreads threads. Each
+  // vertex is updated with the same local solve as in fast marching, and the result matches computeDistance() up to
+  // roundoff. Respects maxDistance, but not targets.
+  VertexData<double> computeDistanceParallel(const std::vector<std::pair<Vertex, double>>& initialDistances);
+
+
+  // === Options and parameters
+
+  // Stop once the front passes this distance. Vertices beyond it are not reached, and get infinite distance.
+  double maxDistance = std::numeric_limits<double>::infinity();
+
+  // If nonempty, stop once all of these vertices have been reached
+  std::vector<Vertex> targets;
+
+  // Threads used by computeDistanceParallel() (0 means one per hardware thread)
+  size_t nThreads = 0;
+
+  // computeDistanceParallel() only updates active vertices within this many mean edge lengths of the nearest one in
+  // each round, and defers the rest. Narrower bands waste fewer updates on vertices which are not yet nearly settled,
+  // but leave less work in each round to split across threads.
+  double bandWidth = 4.;
+
+  // Statistics, for the last query
+  size_t nReached = 0; // vertices whose distance was finalized
+  size_t nUpdates = 0; // tentative distances which were lowered (each one a decrease-key in the queue)
+  size_t nRounds = 0;  // for computeDistanceParallel(), rounds of updates to the active vertices
+
+
+private:
+  // === Members
+  HalfedgeMesh& mesh;
+  VertexData<size_t> vertexIndices;
+  std::vector<Vertex> vertices; // by index
+
+  // Packed connectivity and geometry. Vertex i has neighbors [neighborStart[i], neighborStart[i+1]) and triangles
+  // [triangleStart[i], triangleStart[i+1]).
+  struct Neighbor {
+    size_t vertex;
+    double length;
+  };
+  struct Triangle {
+    size_t vertexA, vertexB; // the other two vertices
+    double lengthA, lengthB; // lengths of the edges to them
+    double lengthAB;         // length of the opposite edge
+    double angleA, angleB;   // interior angles at them
+    double angle;            // interior angle at this vertex
+  };
+  std::vector<size_t> neighborStart, triangleStart;
+  std::vector<Neighbor> neighbors;
+  std::vector<Triangle> triangles;
+  void buildTables(const EdgeData<double>& edgeLengths, const CornerData<double>& cornerAngles,
+                   const VertexData<size_t>& vertexIndices);
+
+  // Per-query state
+  std::vector<double> distance;
+  std::vector<char> finalized;
+  std::vector<size_t> touched; // every vertex whose state differs from the initial state
+  std::vector<size_t> reached; // finalized vertices, in order
+  std::vector<char> isTarget;
+  IndexedMinHeap frontier;
+  void march(const std::vector<std::pair<Vertex, double>>& initialDistances);
+  void update(size_t iV, double newDist);
+  void resetState();
+
+  // Per-query state for the fast iterative method. Each round solves at the active vertices in the band from the
+  // current distances, then commits the results; vertices which improved stay active, and those which stopped
+  // improving activate their neighbors, on probation (dropped if they do not improve). Per-chunk lists are merged
+  // between rounds. Neighbors are gathered while committing, so a round needs three barriers: before solving, before
+  // committing, and before merging.
+  struct ActiveChunk {
+    std::vector<size_t> improved, deferred, newlyTouched;
+    std::vector<std::pair<size_t, double>> neighbors; // of settled vertices, with the settled vertex's distance
+    double minImproved = std::numeric_limits<double>::infinity();
+    size_t nUpdates = 0;
+  };
+  std::vector<size_t> active;
+  std::vector<char> onProbation;   // for each active vertex
+  std::vector<double> newDistance; // for each active vertex
+  std::vector<size_t> activeRound; // the last round in which each vertex was active
+  size_t round = 0;
+  double bandLimit; // active vertices farther than this are deferred to a later round
+  double meanEdgeLength;
+  std::vector<ActiveChunk> chunks;
+  void marchParallel(const std::vector<std::pair<Vertex, double>>& initialDistances);
+  void solveActive(size_t start, size_t end);
+  void commitActive(size_t start, size_t end, ActiveChunk& chunk);
+  void mergeActive();
+  double solveAt(size_t iV) const; // the smallest distance to iV through any edge or triangle at it
+};
+
 } // namespace surface
 } // namespace geometrycentral
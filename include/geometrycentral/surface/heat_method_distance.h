@@ -7,9 +7,20 @@
 #include "geometrycentral/surface/halfedge_mesh.h"
 #include "geometrycentral/surface/surface_point.h"
 #include "geometrycentral/surface/intrinsic_geometry_interface.h"
+#include "geometrycentral/surface/signpost_intrinsic_triangulation.h"
 
+#include "geometrycentral/numerical/factorization_cache.h"
 #include "geometrycentral/numerical/linear_solvers.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 namespace geometrycentral {
 namespace surface {
 
@@ -17,15 +28,121 @@ namespace surface {
 VertexData<double> heatMethodDistance(IntrinsicGeometryInterface& geom, Vertex v);
 
 
+// Distances from many sources, quantized to 16 bits per entry. Row i holds the distances from source i to every
+// vertex, stored as integer multiples of a per-row scale, so entries are accurate to (max distance in the row) / 65535.
+struct QuantizedDistanceMatrix {
+  size_t nSources = 0;
+  size_t nVertices = 0;
+  std::vector<uint16_t> values; // row-major, nSources x nVertices
+  std::vector<float> scale;     // per source
+
+  double operator()(size_t iSource, size_t iVert) const {
+    return scale[iSource] * values[iSource * nVertices + iVert];
+  }
+  Vector<float> row(size_t iSource) const;
+  size_t memoryUsage() const; // in bytes
+};
+
+
 // Stateful class. Allows efficient repeated solves
 
+// What triangulation to perform the computation on:
+//  - Original: the input triangulation
+//  - IntrinsicDelaunay: an intrinsic Delaunay triangulation of the input, found by edge flips
+//  - IntrinsicDelaunayRefine: an intrinsic Delaunay triangulation, refined to have no angles smaller than 25 degrees
+//    (not supported for meshes with boundary)
 enum class ComputeTriangulation { Original = 0, IntrinsicDelaunay, IntrinsicDelaunayRefine };
 
+// The triangulation used for computation by solvers which take a ComputeTriangulation option. For the intrinsic
+// options, this holds a signpost intrinsic triangulation of the input. Every input vertex is also a vertex of the
+// intrinsic triangulation, so input vertices map to vertices, and values are interpolated back to the input simply by
+// reading them at those vertices.
+class ComputeTriangulationDomain {
+
+public:
+  ComputeTriangulationDomain(IntrinsicGeometryInterface& inputGeom, ComputeTriangulation computeTri);
+
+  std::unique_ptr<SignpostIntrinsicTriangulation> intrinsicTri; // null for ComputeTriangulation::Original
+  IntrinsicGeometryInterface& geom; // the geometry to compute on (the input geometry, or intrinsicTri)
+  HalfedgeMesh& mesh;
+
+  // The vertex of the compute triangulation at each input vertex, and its index there
+  VertexData<Vertex> computeVertex;
+  VertexData<size_t> computeIndex;
+
+  // The input vertex at each vertex of the compute triangulation, by index (null for vertices inserted by refinement)
+  std::vector<Vertex> inputVertex;
+
+  // Values at input vertices (ordered by input vertex index), from values at the vertices of the compute triangulation
+  template <typename T>
+  Vector<T> toInput(const Vector<T>& valuesOnCompute) const;
+
+private:
+  std::vector<size_t> interpolationInds; // compute index for each input vertex index (empty if the same triangulation)
+};
+
+// A region of a triangulation around some seed vertices, for solving problems locally. Vertices are listed by index,
+// starting with the nInterior vertices found by the search; the rest are the other vertices of faces touching those.
+struct LocalRegion {
+  std::vector<size_t> vertices;
+  size_t nInterior = 0;
+  std::vector<size_t> faces;                     // by face index
+  std::vector<size_t> faceVertices;              // position in vertices of corner i of faces[k], at 3 * k + i
+  std::unordered_map<size_t, size_t> localIndex; // position in vertices, by vertex index
+};
+
+// Grows local regions on a triangulation, from a copy of its connectivity and edge lengths. Growing does not modify the
+// grower, so several threads may grow regions at once.
+//
+// LocalRegionGrower finds such regions, for the queries within a radius of HeatMethodDistanceSolver and
+// VectorHeatMethodSolver. Factoring the systems for a region costs much more per vertex than solving with the global
+// factorization, so local solves only pay off for regions covering a small part of the mesh; the constants below
+// encode this, and are shared by everything which chooses between local and global solves.
+class LocalRegionGrower {
+
+public:
+  LocalRegionGrower() {}
+  LocalRegionGrower(IntrinsicGeometryInterface& geom);
+
+  // Collect the vertices within (roughly) geodesic distance growRadius of the seeds, given by vertex index. The search
+  // measures distance along edges, which is never shorter than geodesic distance and often longer (paths zigzag), so
+  // it runs to graphDistanceSlack * growRadius to catch vertices which are geodesically within the radius.
+  void grow(const std::vector<size_t>& seeds, double growRadius, LocalRegion& region) const;
+
+  // Solve on a region around the seeds which contains the ball of the given radius. solveLocal(region) solves on the
+  // region and returns the smallest distance of the solution at the region's boundary vertices (those from nInterior
+  // on). The region starts a little past the radius, so that the boundary conditions do not disturb the result inside
+  // it, and grows while the ball still reaches its boundary. Returns false once the region holds more than
+  // globalFallbackFraction of the vertices without the ball fitting, in which case the caller should solve globally.
+  template <typename SolveLocal>
+  bool growAndSolve(const std::vector<size_t>& seeds, double radius, LocalRegion& region, SolveLocal solveLocal) const;
+
+  double graphDistanceSlack = 1.25;
+
+  // Regions larger than this fraction of the vertices are solved globally instead. Regions get this large when the
+  // ball is large, or when the local solution is poor near the region boundary (so the ball never seems to fit).
+  static constexpr double globalFallbackFraction = 1. / 32.;
+
+  // The default for callers which decide up front, from the area of a ball, whether to solve on a region around it
+  // (as FarthestPointSampler and SurfaceCenterSolver do): only balls covering less than this fraction of the surface.
+  static constexpr double defaultLocalAreaFraction = 0.02;
+
+private:
+  double meanEdgeLength = 0.;
+  std::vector<size_t> neighborStart; // the edges out of vertex i go to neighbors[neighborStart[i] : neighborStart[i+1]]
+  std::vector<size_t> neighbors;
+  std::vector<double> neighborDist;
+  std::vector<size_t> vertexFaceStart; // likewise for the faces at each vertex
+  std::vector<size_t> vertexFaces;
+  std::vector<size_t> faceVertices; // corner i of face f (the tail of the i'th halfedge from f.halfedge()) at 3 * f + i
+};
+
 class HeatMethodDistanceSolver {
 
 public:
   // === Constructor
-  HeatMethodDistanceSolver(IntrinsicGeometryInterface& geom, double tCoef = 1.0);
+  HeatMethodDistanceSolver(IntrinsicGeometryInterface& geom, double tCoef = 1.0,
+                           ComputeTriangulation computeTri = ComputeTriangulation::Original);
 
 
   // === Methods
@@ -42,6 +159,42 @@ public:
   // Solve for distance from a collection of surface points
   VertexData<double> computeDistance(const std::vector<SurfacePoint>& sourcePoints);
 
+  // Solve for distance from each of many independent sources, returning a matrix with one row per source (indexed by
+  // vertex index). Sources are processed in blocks of batchBlockSize, solving for a whole block at once.
+  DenseMatrix<float> computeDistanceBatch(const std::vector<Vertex>& sourceVerts);
+  DenseMatrix<float> computeDistanceBatch(const std::vector<SurfacePoint>& sourcePoints);
+
+  // As above, but storing the result in a quarter of the space of a double matrix
+  QuantizedDistanceMatrix computeDistanceBatchQuantized(const std::vector<Vertex>& sourceVerts);
+  QuantizedDistanceMatrix computeDistanceBatchQuantized(const std::vector<SurfacePoint>& sourcePoints);
+
+  // Solve for distance only within maxRadius of the source, returning each vertex in that ball with its distance (in no
+  // particular order). The problems are solved on a region grown around the source, enlarged until it contains the
+  // ball, so the cost depends on the size of the ball rather than the mesh. If the region grows past a small fraction of
+  // the mesh, the distance is computed over the whole mesh instead.
+  std::vector<std::pair<Vertex, double>> computeDistanceWithinRadius(const Vertex& sourceVert, double maxRadius);
+  std::vector<std::pair<Vertex, double>> computeDistanceWithinRadius(const SurfacePoint& sourcePoint,
+                                                                     double maxRadius);
+
+
+  // === The steps of the heat method, for variants which replace some of them. Values are per vertex of the compute
+  // triangulation, by index (for ComputeTriangulation::Original, the vertex indices of the input).
+
+  // The vertices where heat is placed for the sources, with their weights
+  std::vector<std::pair<size_t, double>> sourceVertexWeights(const std::vector<SurfacePoint>& sourcePoints) const;
+
+  // The divergence of the normalized gradient of a heat distribution
+  void normalizedGradientDivergence(const Vector<double>& heat, Vector<double>& divergence);
+
+  // Integrate a divergence, by solving a Poisson problem, to get distance up to a constant
+  Vector<double> integrateDivergence(const Vector<double>& divergence);
+
+  // Shift distance (up to a constant) to put zero at the sources
+  void shiftToSources(const std::vector<SurfacePoint>& sourcePoints, Vector<double>& dist) const;
+
+  // The time used for heat flow (tCoef * mean_edge_length^2)
+  double heatFlowTime() const { return shortTime; }
+
 
   // === Options and parameters
 
@@ -50,27 +203,162 @@ public:
 
 
   // what triangulation to perform the computation on
-  // TODO not supported yet
-  const ComputeTriangulation computeTri = ComputeTriangulation::Original;
+  const ComputeTriangulation computeTri;
+
+  // Options for batched solves
+  size_t batchBlockSize = 64; // number of sources solved for at once (each block holds a few nVertices x size matrices)
+  size_t nThreads = 0;        // threads used for per-source work (0 means one per hardware thread)
 
 
 private:
-  
   // === Members
 
   // Basics
   HalfedgeMesh& mesh;
   IntrinsicGeometryInterface& geom;
+  ComputeTriangulationDomain domain; // the triangulation which the systems are built on
 
   // Parameters
-  double shortTime;   // the actual time used for heat flow computed from tCoef
+  double meanEdgeLength; // on the compute triangulation
+  double shortTime;      // the actual time used for heat flow computed from tCoef
+
+  // Solvers (shared with other algorithms via the factorization cache), built on first use. Each is built exactly once
+  // even if several threads need it at the same time, and builds take turns with the geometry.
+  SharedSolver<PositiveDefiniteSolver<double>> heatSolver;
+  SharedSolver<PositiveDefiniteSolver<double>> poissonSolver;
+  std::once_flag heatSolverOnce, poissonSolverOnce;
+  std::mutex geometryMutex;
+  void ensureHaveHeatSolver();
+  void ensureHavePoissonSolver();
+
+  // Input edge lengths, copied at construction so that solves do not touch the geometry's caches
+  EdgeData<double> edgeLengths;
 
-  // Solvers
-  std::unique_ptr<PositiveDefiniteSolver<double>> heatSolver;
-  std::unique_ptr<PositiveDefiniteSolver<double>> poissonSolver;
-  
+  // Packed per-face coefficients for the normalized gradient and its divergence. Corner i of face f (the tail of the
+  // i'th halfedge from f.halfedge()) is stored at i * nFaces + f, so that the loop over faces vectorizes.
+  struct FaceOperators {
+    size_t nFaces = 0;
+    std::vector<size_t> cornerVertex; // vertex index at each corner
+    std::vector<double> gradX, gradY; // the gradient direction in a face is sum_i u_i (gradX_i, gradY_i)
+    std::vector<double> divX, divY;   // the divergence of a unit field X at corner i is dot((divX_i, divY_i), X)
+    std::vector<double> cotanWeight;  // cotan weight of the halfedge from corner i to corner i+1
+    std::vector<double> edgeLength;   // length of that halfedge
+    std::vector<double> faceArea;     // per face
+    std::vector<size_t> vertexCornerStart; // the corners at each vertex, in vertexCorners[start[v] : start[v+1]]
+    std::vector<size_t> vertexCorners;
+  } faceOps;
+  void buildFaceOperators();
+
+  // Helpers
+  void sourceHeat(const std::vector<SurfacePoint>& sourcePoints, Vector<double>& rhs) const;
+  void normalizedGradientDivergence(const Vector<double>& heat, Vector<double>& divergence, size_t nKernelThreads);
+  size_t kernelThreads() const; // threads to split the per-face work of a single solve over (more on larger meshes)
+  double sourceDistanceShift(const std::vector<SurfacePoint>& sourcePoints,
+                             const std::function<double(size_t)>& distAtComputeIndex) const;
+
+  // Local solves, on regions of the compute triangulation
+  LocalRegionGrower regionGrower;
+  void solveLocalDistance(const std::vector<SurfacePoint>& sourcePoints,
+                          const std::vector<std::pair<size_t, double>>& seeds, const LocalRegion& region,
+                          Vector<double>& dist);
+
+  // Solve for each source in blocks, passing each distance vector to store(iSource, dist). Calls to store() may come
+  // from several threads at once.
+  void computeDistanceBatch(const std::vector<SurfacePoint>& sourcePoints,
+                            const std::function<void(size_t, const Vector<double>&)>& store);
+};
+
+
+
+// Stateful class. Approximates heat method distance quickly, by computing the heat flow in closed form in a truncated
+// Laplace-Beltrami eigenbasis, rather than by solving a linear system. The normalization and integration steps are
+// those of the heat method. The eigenbasis is required from the geometry (so it may be shared with other users, or
+// loaded from disk), and copied; after that, each solve is a few passes over the copy plus the usual per-face work.
+//
+// A small basis cannot resolve a short heat flow, so the flow runs for longer the smaller the basis, and the result is
+// smoother than the heat method's. Use more eigenpairs for more accurate distance.
+class SpectralHeatMethodDistanceSolver {
+
+public:
+  // === Constructor
+  SpectralHeatMethodDistanceSolver(IntrinsicGeometryInterface& geom, size_t nEigenpairs = 100, double tCoef = 1.0,
+                                   double truncationTimeCoef = 0.5);
+
+
+  // === Methods (as for HeatMethodDistanceSolver)
+
+  // Solve for distance from a single vertex
+  VertexData<double> computeDistance(const Vertex& sourceVert);
+
+  // Solve for distance from a collection of vertices
+  VertexData<double> computeDistance(const std::vector<Vertex>& sourceVerts);
+
+  // Solve for distance from a single surface point
+  VertexData<double> computeDistance(const SurfacePoint& sourcePoint);
+
+  // Solve for distance from a collection of surface points
+  VertexData<double> computeDistance(const std::vector<SurfacePoint>& sourcePoints);
+
+  // Flow heat from an initial distribution (a density per unit area) for time t, in closed form in the eigenbasis
+  VertexData<double> computeHeatFlow(const VertexData<double>& initial, double t);
+
+  // The time used for heat flow by computeDistance()
+  double heatFlowTime() const { return heatTime; }
+
+
+  // === Options and parameters
+
+  const size_t nEigenpairs; // the size of the eigenbasis (at most the number of vertices)
+  const double tCoef;       // as for HeatMethodDistanceSolver, though small bases use longer times
+
+  // Heat flows for at least truncationTimeCoef * sqrt(area / lambda_max), where lambda_max is the largest eigenvalue in
+  // the basis, so that the truncation error does not swamp the heat far from the source. default: 0.5
+  const double truncationTimeCoef;
+
+  // Integrate the normalized gradient in the eigenbasis too, rather than with a sparse Poisson solve. No linear systems
+  // are factored at all, but the distance is smoothed further.
+  bool spectralPoisson = false;
+
+
+private:
+  // === Members
+  HalfedgeMesh& mesh;
+  IntrinsicGeometryInterface& geom;
+  HeatMethodDistanceSolver distanceSolver; // for the normalization and integration steps
+
+  // The eigenbasis, with the eigenvectors stored by vertex (row-major), and the lumped mass of each vertex
+  Vector<double> eigenvalues;
+  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> eigenvectors;
+  Vector<double> vertexMass;
+  size_t firstNonzero; // the first eigenpair with a nonzero eigenvalue
+
+  double heatTime;           // the time used for heat flow
+  Vector<double> heatFilter; // exp(-lambda_i heatTime), per eigenpair
 };
 
 
+template <typename SolveLocal>
+bool LocalRegionGrower::growAndSolve(const std::vector<size_t>& seeds, double radius, LocalRegion& region,
+                                     SolveLocal solveLocal) const {
+  size_t nVertices = neighborStart.empty() ? 0 : neighborStart.size() - 1;
+  double growRadius = std::max(1.2 * radius, radius + 2. * meanEdgeLength);
+  while (true) {
+    grow(seeds, growRadius, region);
+    if (solveLocal(region) >= radius) return true;
+    if (region.vertices.size() > globalFallbackFraction * nVertices) return false;
+    growRadius *= 1.5;
+  }
+}
+
+template <typename T>
+Vector<T> ComputeTriangulationDomain::toInput(const Vector<T>& valuesOnCompute) const {
+  if (interpolationInds.empty()) return valuesOnCompute;
+  Vector<T> valuesOnInput(interpolationInds.size());
+  for (size_t i = 0; i < interpolationInds.size(); i++) {
+    valuesOnInput[i] = valuesOnCompute[interpolationInds[i]];
+  }
+  return valuesOnInput;
+}
+
 } // namespace surface
 } // namespace geometrycentral
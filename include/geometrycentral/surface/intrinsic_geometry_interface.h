@@ -4,9 +4,13 @@
 #include "geometrycentral/surface/halfedge_mesh.h"
 #include "geometrycentral/utilities/vector2.h"
 
+#include <Eigen/Dense>
 #include <Eigen/SparseCore>
 
 #include <complex>
+#include <cstdint>
+#include <string>
+#include <utility>
 
 namespace geometrycentral {
 namespace surface {
@@ -126,6 +130,24 @@ public:
   void requireDECOperators();
   void unrequireDECOperators();
 
+
+  // == Spectral quantities
+
+  // Laplace-Beltrami eigenbasis: the smallest eigenpairs of (cotanLaplacian, vertexLumpedMassMatrix), with eigenvalues
+  // in increasing order and mass-orthonormal eigenvectors as columns. Requiring more eigenpairs than are currently held
+  // extends the basis, without recomputing the existing eigenpairs. May hold more than k eigenpairs, if a larger basis
+  // was required previously (and has not since been released by every require and purged).
+  Eigen::VectorXd laplaceBeltramiEigenvalues;
+  Eigen::MatrixXd laplaceBeltramiEigenvectors;
+  void requireLaplaceBeltramiEigenbasis(size_t k);
+  void unrequireLaplaceBeltramiEigenbasis();
+
+  // Save the current eigenbasis to a file, or load a previously-saved eigenbasis (which must have been computed on
+  // this same geometry). Loading makes subsequent requireLaplaceBeltramiEigenbasis() calls free, up to the size of the
+  // loaded basis. Throws std::runtime_error if the file is for another geometry, or is truncated or corrupt.
+  void writeLaplaceBeltramiEigenbasis(std::string filename);
+  void readLaplaceBeltramiEigenbasis(std::string filename);
+
 protected:
   // == Lengths, areas, and angles
 
@@ -215,6 +237,19 @@ protected:
   std::array<Eigen::SparseMatrix<double>*, 8> DECOperatorArray;
   DependentQuantityD<std::array<Eigen::SparseMatrix<double>*, 8>> DECOperatorsQ;
   virtual void computeDECOperators();
+
+
+  // == Spectral quantities
+
+  // Laplace-Beltrami eigenbasis
+  // Note: like the DEC operators, this quantity manages multiple members, grouped in a pair
+  size_t laplaceBeltramiEigenbasisSize = 0; // most eigenpairs required since the basis was last not required at all
+  std::pair<Eigen::VectorXd*, Eigen::MatrixXd*> laplaceBeltramiEigenbasisPair;
+  DependentQuantityD<std::pair<Eigen::VectorXd*, Eigen::MatrixXd*>> laplaceBeltramiEigenbasisQ;
+  virtual void computeLaplaceBeltramiEigenbasis();
+
+  // A hash of the edge lengths (and so of the Laplacian), used to validate eigenbases loaded from disk
+  uint64_t laplaceBeltramiEigenbasisFingerprint();
 };
 
 } // namespace surface
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/intrinsic_geometry_interface.h"
+
+#include <functional>
+#include <vector>
+
+namespace geometrycentral {
+namespace surface {
+
+// One-off functions to compute descriptors at every vertex (one row per vertex), with default scales
+DenseMatrix<double> heatKernelSignature(IntrinsicGeometryInterface& geom, size_t nScales = 100,
+                                        size_t nEigenpairs = 300);
+DenseMatrix<double> waveKernelSignature(IntrinsicGeometryInterface& geom, size_t nScales = 100,
+                                        size_t nEigenpairs = 300);
+
+
+// Stateful class. Computes spectral descriptors at every vertex from the Laplace-Beltrami eigenbasis, which is
+// required from the geometry (so it is shared with anything else using it, and can be loaded from disk).
+//
+// The descriptors are, for an eigenbasis (lambda_i, phi_i):
+//  - Heat kernel signature (Sun et al. 2009), at times t:
+//      HKS(v, t) = sum_i exp(-lambda_i t) phi_i(v)^2
+//  - Wave kernel signature (Aubry et al. 2011), at log-energies e with bandwidth sigma:
+//      WKS(v, e) = sum_i w_i(e) phi_i(v)^2 / sum_i w_i(e),  where w_i(e) = exp(-(e - log lambda_i)^2 / (2 sigma^2))
+//    and the sums skip the zero eigenvalues.
+// Both are evaluated for all scales at once, as a product of the squared eigenvectors with a table of filter weights.
+
+class SpectralDescriptorSolver {
+
+public:
+  // === Constructors
+  SpectralDescriptorSolver(IntrinsicGeometryInterface& geom, size_t nEigenpairs = 300);
+  ~SpectralDescriptorSolver();
+
+
+  // === Methods
+
+  // Compute descriptors at every vertex, with a column for each scale
+  DenseMatrix<double> computeHeatKernelSignature(const std::vector<double>& times);
+  DenseMatrix<double> computeWaveKernelSignature(const std::vector<double>& logEnergies, double sigma);
+
+  // As above, but rather than returning a (nVertices x nScales) matrix, pass the descriptors to consume() in blocks of
+  // consecutive vertices: consume(firstVertex, block), where the rows of block are the descriptors of vertices
+  // firstVertex, firstVertex + 1, ... Blocks are passed in order, from the calling thread.
+  void computeHeatKernelSignature(const std::vector<double>& times,
+                                  const std::function<void(size_t, const DenseMatrix<double>&)>& consume);
+  void computeWaveKernelSignature(const std::vector<double>& logEnergies, double sigma,
+                                  const std::function<void(size_t, const DenseMatrix<double>&)>& consume);
+
+  // Default scales, spread over the range the eigenbasis resolves:
+  //  - HKS: times logarithmically spaced from 4 ln(10) / lambda_max to 4 ln(10) / lambda_min (Sun et al.)
+  //  - WKS: log-energies evenly spaced from log lambda_min + 2 sigma to log lambda_max - 2 sigma, with sigma 7 times
+  //    the spacing (Aubry et al.)
+  // where lambda_min is the smallest nonzero eigenvalue.
+  std::vector<double> defaultHeatKernelTimes(size_t nScales);
+  std::vector<double> defaultWaveKernelLogEnergies(size_t nScales);
+  double defaultWaveKernelSigma(size_t nScales);
+
+
+  // === Options and parameters
+
+  size_t blockSize = 4096; // number of vertices evaluated at once (also the size of the blocks passed to consume())
+  size_t nThreads = 0;     // threads over which blocks are split (0 means one per hardware thread)
+
+
+private:
+  // === Members
+  IntrinsicGeometryInterface& geom;
+  size_t nEigenpairs;
+
+  // The range of nonzero eigenvalues
+  size_t firstNonzero;
+  double minEigenvalue, maxEigenvalue;
+
+  // Evaluate sum_i weights(i, j) phi_i(v)^2 for every vertex and column j, in blocks, either into one matrix or passing
+  // each block on to consume()
+  DenseMatrix<double> evaluate(const DenseMatrix<double>& weights);
+  void evaluate(const DenseMatrix<double>& weights,
+                const std::function<void(size_t, const DenseMatrix<double>&)>& consume);
+  DenseMatrix<double> heatKernelWeights(const std::vector<double>& times);
+  DenseMatrix<double> waveKernelWeights(const std::vector<double>& logEnergies, double sigma);
+};
+
+} // namespace surface
+} // namespace geometrycentral
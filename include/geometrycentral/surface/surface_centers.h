@@ -3,6 +3,10 @@
 #include "geometrycentral/surface/intrinsic_geometry_interface.h"
 #include "geometrycentral/surface/vector_heat_method.h"
 
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace geometrycentral {
 namespace surface {
 
@@ -16,5 +20,77 @@ SurfacePoint findCenter(IntrinsicGeometryInterface& geom, const VertexData<doubl
 SurfacePoint findCenter(IntrinsicGeometryInterface& geom, VectorHeatMethodSolver& solver,
                         const VertexData<double>& distribution, int p = 2);
 
+
+// Stateful class. Finds many centers on the same surface, sharing one vector heat solver.
+
+class SurfaceCenterSolver {
+
+public:
+  // === Constructors
+  SurfaceCenterSolver(IntrinsicGeometryInterface& geom);
+  SurfaceCenterSolver(IntrinsicGeometryInterface& geom, VectorHeatMethodSolver& solver);
+  ~SurfaceCenterSolver();
+
+
+  // === Methods
+
+  // Find a center of a distribution, starting next to the vertex with the most mass, or from the given point
+  SurfacePoint findCenter(const VertexData<double>& distribution, int p = 2);
+  SurfacePoint findCenter(const VertexData<double>& distribution, const SurfacePoint& initialGuess, int p = 2);
+
+  // Find a center of each of many distributions. The iterations for all of the distributions advance together, so
+  // that the log maps they need in each round are computed by batched solves. An invalid (default-constructed) initial
+  // guess means to start next to the vertex with the most mass.
+  std::vector<SurfacePoint> findCenters(const std::vector<VertexData<double>>& distributions, int p = 2);
+  std::vector<SurfacePoint> findCenters(const std::vector<VertexData<double>>& distributions,
+                                        const std::vector<SurfacePoint>& initialGuesses, int p = 2);
+
+
+  // === Options and parameters
+
+  int maxIters = 100;
+
+  // Use log maps within a radius of the distribution's support (rather than over the whole surface), as long as that
+  // ball covers less than localAreaFraction of the surface (see LocalRegionGrower). A center which outgrows the ball
+  // uses global log maps from then on.
+  bool restrictToSupport = true;
+  double localAreaFraction = LocalRegionGrower::defaultLocalAreaFraction;
+
+  // Statistics from the last call, summed over all distributions
+  size_t nIterations = 0;   // accepted steps
+  size_t nLogMaps = 0;      // log maps at points, computed over the whole surface
+  size_t nLocalLogMaps = 0; // log maps at points, computed within a radius
+
+
+private:
+  // === Members
+  IntrinsicGeometryInterface& geom;
+  HalfedgeMesh& mesh;
+  std::unique_ptr<VectorHeatMethodSolver> ownedSolver;
+  VectorHeatMethodSolver& solver;
+
+  double surfaceArea;
+  double meshDiameter;
+
+  // The state of one center as it is iterated
+  struct CenterState;
+
+  // Helpers
+  void initialize(CenterState& state, const VertexData<double>& distribution, const SurfacePoint& initialGuess,
+                  int p);
+  double graphRadius(const CenterState& state);
+  void setPending(CenterState& state, SurfacePoint point);
+  void propose(CenterState& state);
+  void evaluate(CenterState& state, const std::function<Vector2(size_t)>& logMapAtSupport);
+  bool evaluateLocal(CenterState& state);
+  void switchToGlobal(CenterState& state);
+  void evaluateGlobal(const std::vector<CenterState*>& states);
+
+  // Scratch space for local log maps, reset after each use
+  VertexData<Vector2> localLogMap;
+  VertexData<char> localHits;
+  VertexData<double> graphDist;
+};
+
 } // namespace surface
 } // namespace geometrycentral
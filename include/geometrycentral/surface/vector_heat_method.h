@@ -1,5 +1,6 @@
 #pragma once
 
+#include "geometrycentral/numerical/factorization_cache.h"
 #include "geometrycentral/numerical/linear_solvers.h"
 #include "geometrycentral/surface/halfedge_mesh.h"
 #include "geometrycentral/surface/heat_method_distance.h"
@@ -9,20 +10,39 @@
 #include "geometrycentral/utilities/vector3.h"
 
 #include <complex>
+#include <functional>
 #include <memory>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 namespace geometrycentral {
 namespace surface {
 
+// Log maps from many sources, stored as separate arrays of x and y coordinates. Row i holds the log map from source i
+// at every vertex (row-major, nSources x nVertices), in the tangent basis of the source vertex.
+struct LogMapMatrix {
+  size_t nSources = 0;
+  size_t nVertices = 0;
+  std::vector<float> x;
+  std::vector<float> y;
+
+  Vector2 operator()(size_t iSource, size_t iVert) const {
+    size_t i = iSource * nVertices + iVert;
+    return Vector2{x[i], y[i]};
+  }
+  size_t memoryUsage() const; // in bytes
+};
+
+
 // Stateful class. Allows efficient repeated solves
 
 class VectorHeatMethodSolver {
 
 public:
   // === Constructor
-  VectorHeatMethodSolver(IntrinsicGeometryInterface& geom, double tCoef = 1.0);
+  VectorHeatMethodSolver(IntrinsicGeometryInterface& geom, double tCoef = 1.0,
+                         ComputeTriangulation computeTri = ComputeTriangulation::Original);
 
 
   // === Scalar Extension
@@ -41,6 +61,19 @@ public:
   VertexData<Vector2> computeLogMap(const Vertex& sourceVert, double vertexDistanceShift = 0.);
   VertexData<Vector2> computeLogMap(const SurfacePoint& sourceP);
 
+  // Log maps from each of many source vertices. Sources are processed in blocks of batchBlockSize, solving for the
+  // radial and horizontal fields of a whole block at once. The result matches computeLogMap() up to float rounding,
+  // except that near the cut locus of a source, where the log map's direction is ill-conditioned, directions may
+  // differ noticeably (lengths still agree).
+  LogMapMatrix computeLogMapBatch(const std::vector<Vertex>& sourceVerts);
+
+  // The log map only within maxRadius of the source, returning each vertex in that ball with its coordinates (in no
+  // particular order). The problems are solved on a patch grown around the source, enlarged until it contains the
+  // ball, so the cost depends on the size of the ball rather than the mesh. For a surface point, the coordinates are in
+  // the tangent space of the vertex, edge, or face, as in computeLogMap().
+  std::vector<std::pair<Vertex, Vector2>> computeLogMapWithinRadius(const Vertex& sourceVert, double maxRadius);
+  std::vector<std::pair<Vertex, Vector2>> computeLogMapWithinRadius(const SurfacePoint& sourceP, double maxRadius);
+
 
   // === Options and parameters
   const double tCoef; // the time parameter used for heat flow, measured as time = tCoef * mean_edge_length^2
@@ -48,8 +81,11 @@ public:
 
 
   // what triangulation to perform the computation on
-  // TODO not supported yet
-  const ComputeTriangulation computeTri = ComputeTriangulation::Original;
+  const ComputeTriangulation computeTri;
+
+  // Options for log maps
+  size_t batchBlockSize = 32; // number of sources solved for at once (each block holds a few nVertices x size matrices)
+  size_t nThreads = 0;        // threads used for per-source work (0 means one per hardware thread)
 
 
 private:
@@ -58,22 +94,67 @@ private:
   // Basics
   HalfedgeMesh& mesh;
   IntrinsicGeometryInterface& geom;
+  ComputeTriangulationDomain domain; // the triangulation which the systems are built on
 
   // Parameters
-  double shortTime; // the actual time used for heat flow computed from tCoef
+  double meanEdgeLength; // on the compute triangulation
+  double shortTime;      // the actual time used for heat flow computed from tCoef
 
-  // Solvers
-  std::unique_ptr<PositiveDefiniteSolver<double>> scalarHeatSolver;
-  std::unique_ptr<LinearSolver<std::complex<double>>> vectorHeatSolver;
-  std::unique_ptr<PositiveDefiniteSolver<double>> poissonSolver;
+  // Solvers (shared with other algorithms via the factorization cache)
+  SharedSolver<PositiveDefiniteSolver<double>> scalarHeatSolver;
+  SharedSolver<SquareSolver<std::complex<double>>> vectorHeatSolver;
+  SharedSolver<PositiveDefiniteSolver<double>> poissonSolver;
   SparseMatrix<double> massMat;
 
+  // Packed coefficients for log maps, on the compute triangulation, so that queries do not touch the geometry's caches
+  struct LogMapOperators {
+    // The right hand side for the radial field from vertex i is ballCenter[i] at i, plus ballValues[k] at
+    // ballVertices[k] for k in [ballStart[i], ballStart[i+1])
+    std::vector<std::complex<double>> ballCenter;
+    std::vector<size_t> ballStart;
+    std::vector<size_t> ballVertices;
+    std::vector<std::complex<double>> ballValues;
+
+    // Per halfedge, for integrating the radial field
+    std::vector<size_t> tail, tip;
+    std::vector<std::complex<double>> tipToTail;  // transports a vector at the tip to the tangent space at the tail
+    std::vector<std::complex<double>> edgeVector; // the halfedge vector in the tangent space at the tail
+    std::vector<double> cotanWeight;              // of the edge
+
+    // Per halfedge, for building problems on patches. Exterior halfedges have no face, and zero weight and area.
+    std::vector<size_t> twin, face;
+    std::vector<double> length;
+    std::vector<double> halfedgeCotanWeight; // of the halfedge alone (cotanWeight is the sum over the edge)
+    std::vector<double> faceArea;            // of the halfedge's face
+    std::vector<size_t> faceHalfedges;       // the three halfedges of each face
+    std::vector<size_t> outgoingStart;       // the outgoing halfedges of vertex i are in
+    std::vector<size_t> outgoing;            // outgoing[outgoingStart[i] : outgoingStart[i+1]]
+
+    LocalRegionGrower regionGrower; // grows patches for local solves
+  };
+  std::unique_ptr<LogMapOperators> logMapOps;
+
   // Helpers
   void ensureHaveScalarHeatSolver();
   void ensureHaveVectorHeatSolver();
   void ensureHavePoissonSolver();
-
-  void addVertexOutwardBall(Vertex v, Vector<std::complex<double>>& distGradRHS);
+  void ensureHaveLogMapOperators();
+
+  // Log maps at the vertices of the compute triangulation, from the vertices with the given (compute) indices, in
+  // blocks. Passes each log map to store(iSource, logMap); calls to store() may come from several threads at once.
+  void computeLogMapBatch(const std::vector<size_t>& sourceInds, double vertexDistanceShift,
+                          const std::function<void(size_t, const Vector<std::complex<double>>&)>& store);
+  std::vector<VertexData<Vector2>> computeLogMaps(const std::vector<Vertex>& sourceVerts,
+                                                  double vertexDistanceShift = 0.);
+
+  // Log maps from the given sources, on a patch of the compute triangulation
+  void solveLocalLogMaps(const std::vector<size_t>& sourceInds, const LocalRegion& patch,
+                         DenseMatrix<std::complex<double>>& logMaps);
+
+  // The combination sum_j coefs[j] * (log map from source j) within maxRadius, where the sources are vertices of the
+  // compute triangulation. The log maps from all of the sources are solved for on one patch.
+  std::vector<std::pair<Vertex, Vector2>> computeLocalLogMap(const std::vector<size_t>& sourceInds,
+                                                             const std::vector<Vector2>& coefs, double maxRadius);
 };
 
 
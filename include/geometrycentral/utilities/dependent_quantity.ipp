@@ -56,6 +56,19 @@ void clearBuffer(Eigen::SparseMatrix<F>* buffer) {
   *buffer = Eigen::SparseMatrix<F>();
 }
 
+// Eigen dense matrices
+template <typename F, int R, int C, int O, int MR, int MC>
+void clearBuffer(Eigen::Matrix<F, R, C, O, MR, MC>* buffer) {
+  *buffer = Eigen::Matrix<F, R, C, O, MR, MC>();
+}
+
+// Pair of any otherwise clearable types
+template <typename A, typename B>
+void clearBuffer(std::pair<A*, B*>* buffer) {
+  clearBuffer(buffer->first);
+  clearBuffer(buffer->second);
+}
+
 // Array of any otherwise clearable type
 template <typename A, size_t N>
 void clearBuffer(std::array<A*, N>* buffer) {
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace geometrycentral {
+
+// A min-heap of items 0..n-1, keyed by doubles, which tracks where each item sits so that keys can be decreased in
+// place (rather than pushing duplicate entries and skipping stale ones later). Each node has 4 children, which makes
+// the heap shallower than a binary heap, and the children of a node share a cache line or two.
+//
+// All storage is allocated at construction, so one heap can be reused for many searches over the same items; clear()
+// takes time proportional to the number of items currently held.
+class IndexedMinHeap {
+
+public:
+  IndexedMinHeap(size_t nItems = 0) : position(nItems, std::numeric_limits<size_t>::max()) { heap.reserve(nItems); }
+
+  // Number of items the heap was constructed for
+  size_t capacity() const { return position.size(); }
+
+  size_t size() const { return heap.size(); }
+  bool empty() const { return heap.empty(); }
+  bool contains(size_t item) const { return position[item] != NOT_HELD; }
+
+  // The item with the smallest key, and its key
+  size_t topItem() const { return heap.front().second; }
+  double topKey() const { return heap.front().first; }
+  double key(size_t item) const { return heap[position[item]].first; }
+
+  // Insert an item which is not held, or lower the key of one which is. Returns false (doing nothing) if the item is
+  // held with a key no greater than this one.
+  bool insertOrDecrease(size_t item, double k) {
+    size_t i = position[item];
+    if (i == NOT_HELD) {
+      i = heap.size();
+      heap.emplace_back(k, item);
+    } else if (k < heap[i].first) {
+      heap[i].first = k;
+    } else {
+      return false;
+    }
+    siftUp(i);
+    return true;
+  }
+
+  // Remove and return the item with the smallest key
+  size_t pop() {
+    size_t top = heap.front().second;
+    position[top] = NOT_HELD;
+    Entry last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+      heap.front() = last;
+      position[last.second] = 0;
+      siftDown(0);
+    }
+    return top;
+  }
+
+  // Remove all items
+  void clear() {
+    for (const Entry& e : heap) {
+      position[e.second] = NOT_HELD;
+    }
+    heap.clear();
+  }
+
+private:
+  typedef std::pair<double, size_t> Entry; // (key, item)
+  static const size_t ARITY = 4;
+  static const size_t NOT_HELD = std::numeric_limits<size_t>::max();
+
+  std::vector<Entry> heap;
+  std::vector<size_t> position; // index in heap of each item, or NOT_HELD
+
+  void siftUp(size_t i) {
+    Entry e = heap[i];
+    while (i > 0) {
+      size_t parent = (i - 1) / ARITY;
+      if (!(e.first < heap[parent].first)) break;
+      heap[i] = heap[parent];
+      position[heap[i].second] = i;
+      i = parent;
+    }
+    heap[i] = e;
+    position[e.second] = i;
+  }
+
+  void siftDown(size_t i) {
+    Entry e = heap[i];
+    size_t n = heap.size();
+    while (true) {
+      size_t first = ARITY * i + 1;
+      if (first >= n) break;
+      size_t last = std::min(first + ARITY, n);
+      size_t best = first;
+      for (size_t c = first + 1; c < last; c++) {
+        if (heap[c].first < heap[best].first) best = c;
+      }
+      if (!(heap[best].first < e.first)) break;
+      heap[i] = heap[best];
+      position[heap[i].second] = i;
+      i = best;
+    }
+    heap[i] = e;
+    position[e.second] = i;
+  }
+};
+
+} // namespace geometrycentral
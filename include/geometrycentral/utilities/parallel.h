@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimal helpers for splitting loops across threads. Work is divided into contiguous chunks up front, and each chunk
+// runs on its own thread (the first on the calling thread). Threads are kept alive between calls in a shared pool, so
+// that loops which run many times (like the sparse products in an iterative solver) don't pay to start threads each time.
+
+namespace geometrycentral {
+
+// The number of hardware threads (at least 1)
+inline size_t hardwareThreadCount() { return std::max<size_t>(1, std::thread::hardware_concurrency()); }
+
+// A pool of worker threads, each of which runs one task at a time. Every task gets a worker to itself (a new one is
+// started when none is idle), so tasks launched together always run concurrently; this keeps tasks which wait on each
+// other (as with a ThreadBarrier) and nested parallel loops from deadlocking. Idle workers are kept until exit. Tasks
+// must not throw (parallelForChunks() catches exceptions within its tasks, and passes them to the caller).
+class WorkerPool {
+public:
+  static WorkerPool& instance() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    for (std::unique_ptr<Worker>& w : workers) {
+      w->wake.notify_one();
+    }
+    for (std::unique_ptr<Worker>& w : workers) {
+      w->thread.join();
+    }
+  }
+
+  // Run task on an idle worker, and return immediately
+  void launch(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (idle.empty()) {
+      workers.emplace_back(new Worker());
+      Worker* w = workers.back().get();
+      w->thread = std::thread([this, w] { workerLoop(w); });
+      idle.push_back(w);
+    }
+    Worker* w = idle.back();
+    idle.pop_back();
+    w->task = std::move(task);
+    w->hasTask = true;
+    w->wake.notify_one();
+  }
+
+private:
+  struct Worker {
+    std::thread thread;
+    std::function<void()> task;
+    bool hasTask = false;
+    std::condition_variable wake;
+  };
+
+  WorkerPool() {}
+
+  void workerLoop(Worker* w) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      w->wake.wait(lock, [&] { return w->hasTask || stopping; });
+      if (!w->hasTask) return;
+      std::function<void()> task = std::move(w->task);
+      w->hasTask = false;
+      lock.unlock();
+      task();
+      lock.lock();
+      idle.push_back(w);
+    }
+  }
+
+  std::mutex mutex;
+  bool stopping = false;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<Worker*> idle;
+};
+
+// Run f(iChunk) for each iChunk in [0, nChunks), on separate threads. If any chunk throws, the other chunks still run
+// to completion, and then the first exception thrown is rethrown on the calling thread. (Chunks which wait on each
+// other, as with a ThreadBarrier, should abort the barrier when they throw, so that the others are not left waiting.)
+template <typename F>
+void parallelForChunks(size_t nChunks, F f) {
+  if (nChunks == 0) return;
+  if (nChunks == 1) {
+    f(0);
+    return;
+  }
+
+  // Count down the chunks, keeping the first exception
+  std::mutex doneMutex;
+  std::condition_variable doneCondition;
+  size_t nRemaining = nChunks;
+  std::exception_ptr firstError;
+  auto runChunk = [&](size_t iChunk) {
+    std::exception_ptr error;
+    try {
+      f(iChunk);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(doneMutex);
+    if (error && !firstError) firstError = error;
+    if (--nRemaining == 0) doneCondition.notify_one();
+  };
+
+  WorkerPool& pool = WorkerPool::instance();
+  for (size_t iChunk = 1; iChunk < nChunks; iChunk++) {
+    pool.launch([&runChunk, iChunk] { runChunk(iChunk); });
+  }
+  runChunk(0);
+
+  // The workers refer to this frame, so wait for all of them before returning or throwing
+  std::unique_lock<std::mutex> lock(doneMutex);
+  doneCondition.wait(lock, [&] { return nRemaining == 0; });
+  if (firstError) std::rethrow_exception(firstError);
+}
+
+// Run f(start, end) on contiguous ranges covering [0, nItems), split over at most nThreads threads (0 means one per
+// hardware thread). Useful when items take roughly equal work.
+template <typename F>
+void parallelForRanges(size_t nItems, size_t nThreads, F f) {
+  if (nThreads == 0) nThreads = hardwareThreadCount();
+  size_t nChunks = std::max<size_t>(1, std::min(nThreads, nItems));
+  parallelForChunks(nChunks, [&](size_t iChunk) { f(nItems * iChunk / nChunks, nItems * (iChunk + 1) / nChunks); });
+}
+
+// Run f(i) for each i in [0, nItems), as above
+template <typename F>
+void parallelFor(size_t nItems, size_t nThreads, F f) {
+  parallelForRanges(nItems, nThreads, [&](size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+      f(i);
+    }
+  });
+}
+
+// Blocks threads calling wait() until all nThreads of them have, then releases them together. Reusable, so that the
+// threads of a parallelForChunks() can step through rounds of work in lockstep without being respawned each round.
+//
+// Waiting threads first spin for a while, since rounds of a lockstep loop are often far shorter than the time it takes
+// to put a thread to sleep and wake it again, and then block. When there are more threads than hardware threads, a
+// spinning thread would only delay the ones it is waiting for, so they block right away.
+//
+// A thread which cannot reach the barrier (say, because it threw) should call abort(), which releases every thread
+// waiting now or later; wait() returns false when it was released by abort() rather than by every thread arriving, and
+// the threads should then stop.
+class ThreadBarrier {
+public:
+  ThreadBarrier(size_t nThreads_)
+      : nThreads(nThreads_), spinCount(nThreads_ <= hardwareThreadCount() ? 1 << 14 : 0) {}
+
+  bool wait() {
+    size_t round = nRounds.load(std::memory_order_acquire);
+    if (aborted.load(std::memory_order_acquire)) return false;
+    if (nWaiting.fetch_add(1, std::memory_order_acq_rel) + 1 == nThreads) {
+      nWaiting.store(0, std::memory_order_relaxed);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        nRounds.store(round + 1, std::memory_order_release);
+      }
+      released.notify_all();
+      return true;
+    }
+
+    auto isReleased = [&] {
+      return nRounds.load(std::memory_order_acquire) != round || aborted.load(std::memory_order_acquire);
+    };
+    for (size_t i = 0; i < spinCount && !isReleased(); i++) {
+    }
+    if (!isReleased()) {
+      std::unique_lock<std::mutex> lock(mutex);
+      released.wait(lock, isReleased);
+    }
+    return nRounds.load(std::memory_order_acquire) != round;
+  }
+
+  void abort() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      aborted.store(true, std::memory_order_release);
+    }
+    released.notify_all();
+  }
+
+private:
+  const size_t nThreads;
+  const size_t spinCount;
+  std::atomic<size_t> nWaiting{0};
+  std::atomic<size_t> nRounds{0};
+  std::atomic<bool> aborted{false};
+  std::mutex mutex;
+  std::condition_variable released;
+};
+
+} // namespace geometrycentral
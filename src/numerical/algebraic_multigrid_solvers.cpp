@@ -0,0 +1,518 @@
+#include "geometrycentral/numerical/linear_solvers.h"
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
+#include "geometrycentral/utilities/parallel.h"
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace Eigen;
+
+// Smoothed aggregation algebraic multigrid, following
+//   > "Algebraic multigrid by smoothed aggregation for second and fourth order elliptic problems". Vanek, Mandel, and
+//   Brezina. Computing 1996.
+// The hierarchy is used as a preconditioner for conjugate gradients. All smoothing is done with Chebyshev polynomials
+// in D^-1 A, so that each level only ever needs sparse matrix-vector products. The setup (strength of connection,
+// power iterations and the Galerkin products) is split across the same threads as the sparse matrix-vector products.
+
+namespace geometrycentral {
+
+namespace {
+
+// One level of the multigrid hierarchy
+template <typename T>
+struct AMGLevel {
+  SparseMatrix<T> A;  // the operator at this level
+  SparseMatrix<T> P;  // prolongation from the next-coarser level (empty on the coarsest level)
+  SparseMatrix<T> R;  // restriction to the next-coarser level, always P^H
+  Vector<T> invDiag;  // inverse of the diagonal of A
+  double lambdaMax;   // (over-)estimate of the largest eigenvalue of D^-1 A
+
+  // The same operators, packed for the repeated products in each cycle
+  PackedSparseMatrix<T> packedA, packedP, packedR;
+};
+
+} // namespace
+
+template <typename T>
+struct AMGSolverInternals {
+  std::vector<AMGLevel<T>> levels;
+
+  // The coarsest level is solved densely, via a pseudoinverse so that singular operators (like the Laplacian) are
+  // handled gracefully. If coarsening stalls while the level is still large, it is smoothed instead (empty here).
+  DenseMatrix<T> coarsePseudoinverse;
+
+  // Parameters
+  size_t coarsestSize = 256;        // stop coarsening once a level has this few unknowns
+  size_t maxDenseCoarseSize = 2048; // largest coarsest level which is pseudoinverted densely
+  size_t coarseSmootherDegree = 16; // degree of the Chebyshev smoother used in place of the dense coarse solve
+  size_t maxLevels = 25;            // hard limit on the depth of the hierarchy
+  double strengthThreshold = 0.08;  // threshold for strong connections at the finest level, halved on each level
+  double minCoarseningRatio = 0.8;  // stop coarsening if a level does not shrink by at least this factor
+  size_t nCandidateRelaxations = 8; // smoothing steps used to build the near-nullspace candidate
+  size_t smootherDegree = 3;        // degree of the Chebyshev smoother
+};
+
+// Helpers
+namespace {
+
+// Threads for setting up a level with this many nonzeros. Small levels are set up on the calling thread, since starting
+// threads would cost more than it saves.
+size_t setupThreadCount(size_t nNonZeros) {
+  const size_t minNonZerosPerThread = 1 << 16;
+  return std::max<size_t>(1, std::min(getSpMVThreadCount(), nNonZeros / minNonZerosPerThread));
+}
+
+// C = A B, for compressed matrices. The columns of C are split across threads; each thread accumulates a column in a
+// dense scratch vector (touching only the rows which appear in it), and the pieces are concatenated at the end.
+template <typename T>
+SparseMatrix<T> sparseProduct(const SparseMatrix<T>& A, const SparseMatrix<T>& B) {
+  size_t nRows = A.rows();
+  size_t nCols = B.cols();
+  size_t nThreads = std::min<size_t>(setupThreadCount(A.nonZeros() + B.nonZeros()), std::max<size_t>(nCols, 1));
+
+  struct Piece {
+    std::vector<int> colSize;
+    std::vector<int> rowInds;
+    std::vector<T> values;
+  };
+  std::vector<Piece> pieces(nThreads);
+  parallelForChunks(nThreads, [&](size_t iChunk) {
+    Piece& piece = pieces[iChunk];
+    std::vector<T> accum(nRows, T(0.));
+    std::vector<char> occupied(nRows, false);
+    std::vector<int> rows;
+    for (size_t j = nCols * iChunk / nThreads; j < nCols * (iChunk + 1) / nThreads; j++) {
+      rows.clear();
+      for (typename SparseMatrix<T>::InnerIterator itB(B, j); itB; ++itB) {
+        T b = itB.value();
+        for (typename SparseMatrix<T>::InnerIterator itA(A, itB.row()); itA; ++itA) {
+          int i = itA.row();
+          if (!occupied[i]) {
+            occupied[i] = true;
+            rows.push_back(i);
+          }
+          accum[i] += itA.value() * b;
+        }
+      }
+      std::sort(rows.begin(), rows.end());
+      for (int i : rows) {
+        piece.rowInds.push_back(i);
+        piece.values.push_back(accum[i]);
+        accum[i] = T(0.);
+        occupied[i] = false;
+      }
+      piece.colSize.push_back(rows.size());
+    }
+  });
+
+  std::vector<int> outer{0};
+  std::vector<int> inner;
+  std::vector<T> values;
+  for (const Piece& piece : pieces) {
+    for (int n : piece.colSize) outer.push_back(outer.back() + n);
+    inner.insert(inner.end(), piece.rowInds.begin(), piece.rowInds.end());
+    values.insert(values.end(), piece.values.begin(), piece.values.end());
+  }
+  return Eigen::Map<const SparseMatrix<T>>(nRows, nCols, values.size(), outer.data(), inner.data(), values.data());
+}
+
+template <typename T>
+Vector<T> inverseDiagonal(const SparseMatrix<T>& A) {
+  Vector<T> diag = A.diagonal();
+  Vector<T> invDiag(diag.rows());
+  for (long i = 0; i < diag.rows(); i++) {
+    // Entirely-zero rows get no smoothing at all
+    invDiag(i) = (std::abs(diag(i)) > 0.) ? (T(1.) / diag(i)) : T(0.);
+  }
+  return invDiag;
+}
+
+// Power iteration on D^-1 A. Returns a slight overestimate, as needed by the smoothers.
+template <typename T>
+double estimateLambdaMax(const SparseMatrix<T>& A, const Vector<T>& invDiag, size_t nIterations = 15) {
+  size_t N = A.rows();
+  if (N == 0) return 1.;
+
+  Vector<T> x = Vector<T>::Random(N);
+  x /= x.norm();
+  double lambda = 1.;
+  Vector<T> Ax;
+  for (size_t iIter = 0; iIter < nIterations; iIter++) {
+    sparseMatrixVectorProduct(A, x, Ax);
+    Vector<T> y = invDiag.cwiseProduct(Ax);
+    double yNorm = y.norm();
+    if (yNorm == 0.) break;
+    lambda = yNorm;
+    x = y / yNorm;
+  }
+
+  return 1.1 * lambda;
+}
+
+// Greedy aggregation of strongly-connected unknowns. Returns the aggregate of each unknown (or INVALID_IND for
+// isolated unknowns, which do not need a coarse correction), and the number of aggregates.
+template <typename T>
+std::vector<size_t> aggregate(const SparseMatrix<T>& A, double theta, size_t& nAggregates) {
+  size_t N = A.rows();
+  Vector<T> diag = A.diagonal();
+
+  // Build the strength-of-connection graph, in compressed form, with ranges of unknowns split across threads. Because
+  // A is Hermitian, the entries of column i are exactly the neighbors of i.
+  size_t nThreads = setupThreadCount(A.nonZeros());
+  std::vector<std::vector<size_t>> chunkInds(nThreads);
+  std::vector<std::vector<double>> chunkVals(nThreads);
+  std::vector<size_t> strongCount(N, 0);
+  parallelForChunks(nThreads, [&](size_t iChunk) {
+    for (size_t i = N * iChunk / nThreads; i < N * (iChunk + 1) / nThreads; i++) {
+      for (typename SparseMatrix<T>::InnerIterator it(A, i); it; ++it) {
+        size_t j = it.row();
+        if (j == i) continue;
+        double val = std::abs(it.value());
+        if (val > 0. && val >= theta * std::sqrt(std::abs(diag(i)) * std::abs(diag(j)))) {
+          chunkInds[iChunk].push_back(j);
+          chunkVals[iChunk].push_back(val);
+          strongCount[i]++;
+        }
+      }
+    }
+  });
+  std::vector<size_t> strongStart(N + 1, 0);
+  for (size_t i = 0; i < N; i++) {
+    strongStart[i + 1] = strongStart[i] + strongCount[i];
+  }
+  std::vector<size_t> strongInds;
+  std::vector<double> strongVals;
+  strongInds.reserve(strongStart[N]);
+  strongVals.reserve(strongStart[N]);
+  for (size_t iChunk = 0; iChunk < nThreads; iChunk++) {
+    strongInds.insert(strongInds.end(), chunkInds[iChunk].begin(), chunkInds[iChunk].end());
+    strongVals.insert(strongVals.end(), chunkVals[iChunk].begin(), chunkVals[iChunk].end());
+  }
+
+  std::vector<size_t> aggInd(N, INVALID_IND);
+  nAggregates = 0;
+
+  // Phase 1: make an aggregate from each unknown whose strong neighborhood is entirely unaggregated
+  for (size_t i = 0; i < N; i++) {
+    if (aggInd[i] != INVALID_IND || strongStart[i] == strongStart[i + 1]) continue;
+
+    bool allFree = true;
+    for (size_t k = strongStart[i]; k < strongStart[i + 1]; k++) {
+      if (aggInd[strongInds[k]] != INVALID_IND) {
+        allFree = false;
+        break;
+      }
+    }
+    if (!allFree) continue;
+
+    aggInd[i] = nAggregates;
+    for (size_t k = strongStart[i]; k < strongStart[i + 1]; k++) {
+      aggInd[strongInds[k]] = nAggregates;
+    }
+    nAggregates++;
+  }
+
+  // Phase 2: attach leftover unknowns to the aggregate they are most strongly connected to
+  std::vector<size_t> phase1AggInd = aggInd;
+  for (size_t i = 0; i < N; i++) {
+    if (aggInd[i] != INVALID_IND) continue;
+
+    double bestVal = -1.;
+    for (size_t k = strongStart[i]; k < strongStart[i + 1]; k++) {
+      size_t j = strongInds[k];
+      if (phase1AggInd[j] != INVALID_IND && strongVals[k] > bestVal) {
+        bestVal = strongVals[k];
+        aggInd[i] = phase1AggInd[j];
+      }
+    }
+  }
+
+  // Phase 3: any remaining connected unknowns form new aggregates with their free neighbors
+  for (size_t i = 0; i < N; i++) {
+    if (aggInd[i] != INVALID_IND || strongStart[i] == strongStart[i + 1]) continue;
+
+    aggInd[i] = nAggregates;
+    for (size_t k = strongStart[i]; k < strongStart[i + 1]; k++) {
+      size_t j = strongInds[k];
+      if (aggInd[j] == INVALID_IND) {
+        aggInd[j] = nAggregates;
+      }
+    }
+    nAggregates++;
+  }
+
+  return aggInd;
+}
+
+// Build the tentative (unsmoothed) prolongator by restricting the near-nullspace candidate to each aggregate. Also
+// computes the candidate on the coarse level.
+template <typename T>
+SparseMatrix<T> tentativeProlongator(const std::vector<size_t>& aggInd, size_t nAggregates, const Vector<T>& candidate,
+                                     Vector<T>& coarseCandidate) {
+  size_t N = aggInd.size();
+
+  std::vector<double> aggNorm2(nAggregates, 0.);
+  std::vector<size_t> aggSize(nAggregates, 0);
+  for (size_t i = 0; i < N; i++) {
+    if (aggInd[i] == INVALID_IND) continue;
+    aggNorm2[aggInd[i]] += std::norm(candidate(i));
+    aggSize[aggInd[i]]++;
+  }
+
+  std::vector<Eigen::Triplet<T>> triplets;
+  triplets.reserve(N);
+  for (size_t i = 0; i < N; i++) {
+    size_t iAgg = aggInd[i];
+    if (iAgg == INVALID_IND) continue;
+    if (aggNorm2[iAgg] > 0.) {
+      triplets.emplace_back(i, iAgg, candidate(i) / std::sqrt(aggNorm2[iAgg]));
+    } else {
+      triplets.emplace_back(i, iAgg, T(1. / std::sqrt(aggSize[iAgg])));
+    }
+  }
+
+  coarseCandidate = Vector<T>(nAggregates);
+  for (size_t iAgg = 0; iAgg < nAggregates; iAgg++) {
+    coarseCandidate(iAgg) = (aggNorm2[iAgg] > 0.) ? T(std::sqrt(aggNorm2[iAgg])) : T(std::sqrt(aggSize[iAgg]));
+  }
+
+  SparseMatrix<T> Ptent(N, nAggregates);
+  Ptent.setFromTriplets(triplets.begin(), triplets.end());
+  return Ptent;
+}
+
+// Chebyshev polynomial smoothing of A x = b, preconditioned with the diagonal.
+template <typename T>
+void chebyshevSmooth(const AMGLevel<T>& level, Vector<T>& x, const Vector<T>& b, size_t degree) {
+  double upper = level.lambdaMax;
+  double lower = upper / 30.;
+  double theta = 0.5 * (upper + lower);
+  double delta = 0.5 * (upper - lower);
+  double sigma = theta / delta;
+  double rho = 1. / sigma;
+
+  Vector<T> r = level.invDiag.cwiseProduct(b - level.packedA * x);
+  Vector<T> d = r / theta;
+  for (size_t k = 0; k < degree; k++) {
+    x += d;
+    if (k + 1 == degree) break;
+
+    r -= level.invDiag.cwiseProduct(level.packedA * d);
+    double rhoNew = 1. / (2. * sigma - rho);
+    d = (rhoNew * rho) * d + (2. * rhoNew / delta) * r;
+    rho = rhoNew;
+  }
+}
+
+template <typename T>
+void vCycle(const AMGSolverInternals<T>& internals, size_t iLevel, Vector<T>& x, const Vector<T>& b) {
+
+  // Coarsest level: solve directly, or smooth if it is too large to invert
+  if (iLevel + 1 == internals.levels.size()) {
+    if (internals.coarsePseudoinverse.size() > 0) {
+      x = internals.coarsePseudoinverse * b;
+    } else {
+      chebyshevSmooth(internals.levels[iLevel], x, b, internals.coarseSmootherDegree);
+    }
+    return;
+  }
+
+  const AMGLevel<T>& level = internals.levels[iLevel];
+
+  // Pre-smooth
+  chebyshevSmooth(level, x, b, internals.smootherDegree);
+
+  // Coarse-grid correction
+  Vector<T> coarseRHS = level.packedR * Vector<T>(b - level.packedA * x);
+  Vector<T> coarseX = Vector<T>::Zero(coarseRHS.rows());
+  vCycle(internals, iLevel + 1, coarseX, coarseRHS);
+  x += level.packedP * coarseX;
+
+  // Post-smooth
+  chebyshevSmooth(level, x, b, internals.smootherDegree);
+}
+
+} // namespace
+
+
+template <typename T>
+AlgebraicMultigridSolver<T>::AlgebraicMultigridSolver(SparseMatrix<T>& mat)
+    : LinearSolver<T>(mat), internals(new AMGSolverInternals<T>()) {
+
+  // Check some sanity
+  if (this->nRows != this->nCols) {
+    throw std::logic_error("Matrix must be square");
+  }
+#ifndef GC_NLINALG_DEBUG
+  checkFinite(mat);
+  checkHermitian(mat);
+#endif
+
+  mat.makeCompressed();
+
+  // === Build the hierarchy
+  std::vector<AMGLevel<T>>& levels = internals->levels;
+  levels.emplace_back();
+  levels.back().A = mat;
+
+  // The near-nullspace candidate begins as a constant vector. A few relaxation steps on A x = 0 make it smooth with
+  // respect to A, which matters for operators like the connection Laplacian where constants are not low-energy.
+  Vector<T> candidate = Vector<T>::Ones(this->nRows);
+
+  double theta = internals->strengthThreshold;
+  while (true) {
+    AMGLevel<T>& level = levels.back();
+    size_t N = level.A.rows();
+    level.invDiag = inverseDiagonal(level.A);
+    level.lambdaMax = estimateLambdaMax(level.A, level.invDiag);
+
+    if (N <= internals->coarsestSize || levels.size() >= internals->maxLevels) break;
+
+    if (levels.size() == 1) {
+      double omega = 4. / (3. * level.lambdaMax);
+      Vector<T> Acandidate;
+      for (size_t iRelax = 0; iRelax < internals->nCandidateRelaxations; iRelax++) {
+        sparseMatrixVectorProduct(level.A, candidate, Acandidate);
+        candidate -= omega * level.invDiag.cwiseProduct(Acandidate);
+      }
+    }
+
+    // Group unknowns in to aggregates
+    size_t nAggregates;
+    std::vector<size_t> aggInd = aggregate(level.A, theta, nAggregates);
+    if (nAggregates == 0 || nAggregates > internals->minCoarseningRatio * N) break;
+
+    // Build the prolongator, by smoothing the tentative prolongator with one step of damped Jacobi
+    Vector<T> coarseCandidate;
+    SparseMatrix<T> Ptent = tentativeProlongator(aggInd, nAggregates, candidate, coarseCandidate);
+    double omega = 4. / (3. * level.lambdaMax);
+    SparseMatrix<T> smoothing = level.invDiag.asDiagonal() * sparseProduct(level.A, Ptent);
+    level.P = Ptent - omega * smoothing;
+    level.R = level.P.adjoint();
+
+    // Galerkin coarse operator
+    SparseMatrix<T> AP = sparseProduct(level.A, level.P);
+    SparseMatrix<T> coarseA = sparseProduct(level.R, AP);
+
+    levels.emplace_back();
+    levels.back().A = coarseA;
+    candidate = coarseCandidate;
+    theta *= 0.5;
+  }
+
+  parallelFor(levels.size(), getSpMVThreadCount(), [&](size_t iLevel) {
+    AMGLevel<T>& level = levels[iLevel];
+    level.packedA = PackedSparseMatrix<T>(level.A);
+    level.packedP = PackedSparseMatrix<T>(level.P);
+    level.packedR = PackedSparseMatrix<T>(level.R);
+  });
+
+  // === Pseudoinvert the coarsest level, unless coarsening stalled while it was still large (in which case dense
+  // factorization would cost cubic time and quadratic memory, and the level is smoothed instead)
+  if (static_cast<size_t>(levels.back().A.rows()) > internals->maxDenseCoarseSize) return;
+  DenseMatrix<T> coarseA = levels.back().A;
+  Eigen::SelfAdjointEigenSolver<DenseMatrix<T>> eigSolver(coarseA);
+  if (eigSolver.info() != Eigen::Success) {
+    throw std::runtime_error("AMG coarse level eigendecomposition failed");
+  }
+  Vector<double> evals = eigSolver.eigenvalues();
+  double evalScale = evals.cwiseAbs().maxCoeff();
+  Vector<T> invEvals(evals.rows());
+  for (long i = 0; i < evals.rows(); i++) {
+    invEvals(i) = (std::abs(evals(i)) > 1e-12 * evalScale) ? T(1. / evals(i)) : T(0.);
+  }
+  const DenseMatrix<T>& evecs = eigSolver.eigenvectors();
+  internals->coarsePseudoinverse = evecs * invEvals.asDiagonal() * evecs.adjoint();
+}
+
+template <typename T>
+AlgebraicMultigridSolver<T>::~AlgebraicMultigridSolver() {}
+
+template <typename T>
+size_t AlgebraicMultigridSolver<T>::nLevels() {
+  return internals->levels.size();
+}
+
+template <typename T>
+void AlgebraicMultigridSolver<T>::applyPreconditioner(Vector<T>& x, const Vector<T>& rhs) {
+  if ((size_t)rhs.rows() != this->nRows) {
+    throw std::logic_error("Vector is not the right length");
+  }
+  x = Vector<T>::Zero(this->nRows);
+  vCycle(*internals, 0, x, rhs);
+}
+
+template <typename T>
+Vector<T> AlgebraicMultigridSolver<T>::solve(const Vector<T>& rhs) {
+  Vector<T> out;
+  solve(out, rhs);
+  return out;
+}
+
+template <typename T>
+void AlgebraicMultigridSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
+
+  size_t N = this->nRows;
+
+  // Check some sanity
+  if ((size_t)rhs.rows() != N) {
+    throw std::logic_error("Vector is not the right length");
+  }
+#ifndef GC_NLINALG_DEBUG
+  checkFinite(rhs);
+#endif
+
+  const PackedSparseMatrix<T>& A = internals->levels.front().packedA;
+
+  // Preconditioned conjugate gradients
+  x = Vector<T>::Zero(N);
+  lastIterations = 0;
+  lastRelativeResidual = 0.;
+  double rhsNorm = rhs.norm();
+  if (rhsNorm == 0.) return;
+
+  Vector<T> r = rhs;
+  Vector<T> z;
+  applyPreconditioner(z, r);
+  Vector<T> p = z;
+  double rz = std::real(r.dot(z));
+
+  lastRelativeResidual = 1.;
+  for (size_t iIter = 0; iIter < maxIterations; iIter++) {
+    Vector<T> Ap = A * p;
+    double alpha = rz / std::real(p.dot(Ap));
+    x += alpha * p;
+    r -= alpha * Ap;
+
+    lastIterations = iIter + 1;
+    lastRelativeResidual = r.norm() / rhsNorm;
+    if (!std::isfinite(lastRelativeResidual)) {
+      throw std::runtime_error("AMG solve diverged");
+    }
+    if (lastRelativeResidual < tolerance) break;
+
+    applyPreconditioner(z, r);
+    double rzNew = std::real(r.dot(z));
+    p = z + (rzNew / rz) * p;
+    rz = rzNew;
+  }
+
+  if (!(lastRelativeResidual < tolerance)) {
+    throw std::runtime_error("AMG solve did not converge: relative residual " + std::to_string(lastRelativeResidual) +
+                             " after " + std::to_string(lastIterations) + " iterations");
+  }
+}
+
+
+// Explicit instantiations
+template class AlgebraicMultigridSolver<double>;
+template class AlgebraicMultigridSolver<std::complex<double>>;
+
+} // namespace geometrycentral
@@ -0,0 +1,190 @@
+#include "geometrycentral/numerical/linear_solvers.h"
+
+#include "geometrycentral/numerical/factorization_cache.h"
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+
+using namespace Eigen;
+
+namespace geometrycentral {
+
+template <typename T>
+struct DirichletSolverInternals {
+  // The decomposition into unconstrained (A) and constrained (B) indices. Only the AA and AB blocks are built, which are
+  // all that is needed to solve.
+  BlockDecompositionResult<T> decomp;
+
+  // Factorization of the unconstrained block AA (shared through the factorization cache), one of the two kinds
+  SharedSolver<PositiveDefiniteSolver<T>> positiveDefiniteSolver;
+  SharedSolver<SquareSolver<T>> squareSolver;
+  template <typename V>
+  void solve(V& x, const V& rhs) const {
+    if (positiveDefiniteSolver) {
+      positiveDefiniteSolver.solve(x, rhs);
+    } else {
+      squareSolver.solve(x, rhs);
+    }
+  }
+
+  // Optionally, AA^-1 AB
+  DenseMatrix<T> constraintResponse;
+  bool haveConstraintResponse = false;
+};
+
+template <typename T>
+DirichletSolver<T>::DirichletSolver(SparseMatrix<T>& mat, const Vector<bool>& isConstrained, bool positiveDefinite)
+    : N(mat.rows()), internals(new DirichletSolverInternals<T>()) {
+
+  // Check some sanity
+  if (mat.rows() != mat.cols()) {
+    throw std::logic_error("Matrix must be square");
+  }
+  if ((size_t)isConstrained.rows() != N) {
+    throw std::logic_error("Constraint mask is not the right length");
+  }
+
+  Vector<bool> isUnconstrained = isConstrained.unaryExpr([](bool b) { return !b; });
+  internals->decomp = blockDecomposeSquare(mat, isUnconstrained, false);
+
+  if (nUnconstrained() == 0) return; // nothing to factor, every entry is determined by the constraints
+
+  if (positiveDefinite) {
+    internals->positiveDefiniteSolver = cachedPositiveDefiniteSolver(internals->decomp.AA);
+  } else {
+    internals->squareSolver = cachedSquareSolver(internals->decomp.AA);
+  }
+}
+
+template <typename T>
+DirichletSolver<T>::~DirichletSolver() {}
+
+template <typename T>
+void DirichletSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs, const Vector<T>& values) {
+
+  // Check some sanity
+  if ((size_t)rhs.rows() != N || (size_t)values.rows() != N) {
+    throw std::logic_error("Vector is not the right length");
+  }
+
+  BlockDecompositionResult<T>& decomp = internals->decomp;
+  Vector<T> rhsA, rhsB, valuesA, valuesB;
+  decomposeVector(decomp, rhs, rhsA, rhsB);
+  decomposeVector(decomp, values, valuesA, valuesB);
+
+  Vector<T> xA;
+  if (nUnconstrained() == 0) {
+    xA = Vector<T>(0);
+  } else if (internals->haveConstraintResponse) {
+    internals->solve(xA, rhsA);
+    xA -= internals->constraintResponse * valuesB;
+  } else {
+    Vector<T> reducedRhs = rhsA - decomp.AB * valuesB;
+    internals->solve(xA, reducedRhs);
+  }
+
+  x = reassembleVector(decomp, xA, valuesB);
+}
+
+template <typename T>
+Vector<T> DirichletSolver<T>::solve(const Vector<T>& rhs, const Vector<T>& values) {
+  Vector<T> x;
+  solve(x, rhs, values);
+  return x;
+}
+
+template <typename T>
+Vector<T> DirichletSolver<T>::solveHomogeneous(const Vector<T>& values) {
+
+  // Check some sanity
+  if ((size_t)values.rows() != N) {
+    throw std::logic_error("Vector is not the right length");
+  }
+
+  // With a precomputed response, no back-substitution is needed at all
+  if (internals->haveConstraintResponse) {
+    BlockDecompositionResult<T>& decomp = internals->decomp;
+    Vector<T> valuesA, valuesB;
+    decomposeVector(decomp, values, valuesA, valuesB);
+    Vector<T> xA = -internals->constraintResponse * valuesB;
+    return reassembleVector(decomp, xA, valuesB);
+  }
+
+  return solve(Vector<T>::Zero(N), values);
+}
+
+template <typename T>
+DenseMatrix<T> DirichletSolver<T>::solve(const DenseMatrix<T>& rhs, const DenseMatrix<T>& values) {
+
+  // Check some sanity
+  if ((size_t)rhs.rows() != N || (size_t)values.rows() != N || rhs.cols() != values.cols()) {
+    throw std::logic_error("Matrix is not the right size");
+  }
+
+  // Gather the unconstrained rows of the right hand sides and the constrained rows of the values
+  BlockDecompositionResult<T>& decomp = internals->decomp;
+  size_t K = rhs.cols();
+  DenseMatrix<T> rhsA(nUnconstrained(), K);
+  DenseMatrix<T> valuesB(nConstrained(), K);
+  for (size_t i = 0; i < nUnconstrained(); i++) {
+    rhsA.row(i) = rhs.row(decomp.origIndsA[i]);
+  }
+  for (size_t i = 0; i < nConstrained(); i++) {
+    valuesB.row(i) = values.row(decomp.origIndsB[i]);
+  }
+
+  // Solve for all columns with a single block solve
+  DenseMatrix<T> xA(nUnconstrained(), K);
+  if (nUnconstrained() > 0) {
+    if (internals->haveConstraintResponse) {
+      internals->solve(xA, rhsA);
+      xA -= internals->constraintResponse * valuesB;
+    } else {
+      DenseMatrix<T> reducedRhs = rhsA - decomp.AB * valuesB;
+      internals->solve(xA, reducedRhs);
+    }
+  }
+
+  DenseMatrix<T> x(N, K);
+  for (size_t i = 0; i < nUnconstrained(); i++) {
+    x.row(decomp.origIndsA[i]) = xA.row(i);
+  }
+  for (size_t i = 0; i < nConstrained(); i++) {
+    x.row(decomp.origIndsB[i]) = valuesB.row(i);
+  }
+  return x;
+}
+
+template <typename T>
+void DirichletSolver<T>::precomputeConstraintResponse() {
+  if (internals->haveConstraintResponse) return;
+
+  BlockDecompositionResult<T>& decomp = internals->decomp;
+  internals->constraintResponse = DenseMatrix<T>(nUnconstrained(), nConstrained());
+  if (nUnconstrained() > 0 && nConstrained() > 0) {
+    DenseMatrix<T> coupling = decomp.AB;
+    internals->solve(internals->constraintResponse, coupling);
+  }
+  internals->haveConstraintResponse = true;
+}
+
+template <typename T>
+size_t DirichletSolver<T>::nConstrained() {
+  return internals->decomp.origIndsB.rows();
+}
+
+template <typename T>
+size_t DirichletSolver<T>::nUnconstrained() {
+  return internals->decomp.origIndsA.rows();
+}
+
+template <typename T>
+const BlockDecompositionResult<T>& DirichletSolver<T>::blockDecomposition() {
+  return internals->decomp;
+}
+
+
+// Explicit instantiations
+template class DirichletSolver<float>;
+template class DirichletSolver<double>;
+template class DirichletSolver<std::complex<double>>;
+
+} // namespace geometrycentral
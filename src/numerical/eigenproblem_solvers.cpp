@@ -1,6 +1,11 @@
 #include "geometrycentral/numerical/linear_solvers.h"
 
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
+
+#include <Eigen/Eigenvalues>
+
+#include <limits>
 
 
 using namespace Eigen;
@@ -11,22 +16,100 @@ namespace geometrycentral {
 // Helper
 namespace {
 
+// Norms with respect to a mass matrix, packed for repeated products (as in the power iterations below)
 template <typename T>
-double norm(const Vector<T>& x, const SparseMatrix<T>& massMatrix) {
+double norm(const Vector<T>& x, const PackedSparseMatrix<T>& massMatrix) {
   return std::sqrt(std::abs(x.dot(massMatrix * x)));
 }
-template double norm(const Vector<double>& x, const SparseMatrix<double>& massMatrix);
-template double norm(const Vector<float>& x, const SparseMatrix<float>& massMatrix);
-template double norm(const Vector<std::complex<double>>& x, const SparseMatrix<std::complex<double>>& massMatrix);
 
 template <typename T>
-void normalize(Vector<T>& x, SparseMatrix<T>& massMatrix) {
+void normalize(Vector<T>& x, const PackedSparseMatrix<T>& massMatrix) {
   double scale = norm(x, massMatrix);
   x /= scale;
 }
-template void normalize(Vector<double>& x, SparseMatrix<double>& massMatrix);
-template void normalize(Vector<float>& x, SparseMatrix<float>& massMatrix);
-template void normalize(Vector<std::complex<double>>& x, SparseMatrix<std::complex<double>>& massMatrix);
+
+// Gram matrix blocks[i]^H B blocks[j] for a basis stored as a list of blocks of columns, without ever assembling the
+// full basis
+template <typename T>
+DenseMatrix<T> blockGram(const std::vector<const DenseMatrix<T>*>& blocks, const SparseMatrix<T>& B) {
+  size_t q = 0;
+  std::vector<size_t> offsets;
+  for (const DenseMatrix<T>* b : blocks) {
+    offsets.push_back(q);
+    q += b->cols();
+  }
+
+  DenseMatrix<T> G(q, q);
+  for (size_t j = 0; j < blocks.size(); j++) {
+    DenseMatrix<T> BSj = B * (*blocks[j]);
+    for (size_t i = 0; i <= j; i++) {
+      DenseMatrix<T> Gij = blocks[i]->adjoint() * BSj;
+      G.block(offsets[i], offsets[j], Gij.rows(), Gij.cols()) = Gij;
+      if (i != j) {
+        G.block(offsets[j], offsets[i], Gij.cols(), Gij.rows()) = Gij.adjoint();
+      }
+    }
+  }
+  return G;
+}
+
+// Linear combination sum_i blocks[i] * C_i, where C_i are consecutive row blocks of C beginning at row startRow
+template <typename T>
+DenseMatrix<T> combineBlocks(const std::vector<const DenseMatrix<T>*>& blocks, const DenseMatrix<T>& C,
+                             size_t startRow) {
+  DenseMatrix<T> out = DenseMatrix<T>::Zero(blocks.front()->rows(), C.cols());
+  size_t offset = startRow;
+  for (const DenseMatrix<T>* b : blocks) {
+    out += (*b) * C.block(offset, 0, b->cols(), C.cols());
+    offset += b->cols();
+  }
+  return out;
+}
+
+// Make the columns of U orthonormal with respect to M, and M-orthogonal to the columns of each (M-orthonormal) block
+// in `against`. Columns which are (nearly) linearly dependent are dropped. Uses two passes of block Gram-Schmidt, each
+// followed by an orthonormalization via the eigendecomposition of the Gram matrix (SVQB).
+template <typename T>
+void orthonormalizeBlock(DenseMatrix<T>& U, const std::vector<const DenseMatrix<T>*>& against,
+                         const SparseMatrix<T>& massMatrix) {
+  typedef typename Eigen::NumTraits<T>::Real RealT;
+  RealT dropThresh = 1e4 * std::numeric_limits<RealT>::epsilon();
+
+  for (int iPass = 0; iPass < 2; iPass++) {
+    if (U.cols() == 0) return;
+
+    // Project out the other blocks
+    DenseMatrix<T> MU = massMatrix * U;
+    for (const DenseMatrix<T>* V : against) {
+      U -= (*V) * (V->adjoint() * MU);
+    }
+    MU = massMatrix * U;
+
+    // Scale to unit diagonal
+    DenseMatrix<T> G = U.adjoint() * MU;
+    size_t q = G.rows();
+    Vector<T> d(q);
+    for (size_t i = 0; i < q; i++) {
+      RealT g = std::real(G(i, i));
+      d(i) = (g > 0) ? T(1. / std::sqrt(g)) : T(0.);
+    }
+    DenseMatrix<T> Gs = d.asDiagonal() * G * d.asDiagonal();
+    Gs = 0.5 * (Gs + DenseMatrix<T>(Gs.adjoint()));
+
+    // Orthonormalize, keeping only well-conditioned directions
+    Eigen::SelfAdjointEigenSolver<DenseMatrix<T>> gramEig(Gs);
+    const Vector<RealT>& gramEvals = gramEig.eigenvalues();
+    std::vector<size_t> keep;
+    for (size_t i = 0; i < q; i++) {
+      if (gramEvals(i) > dropThresh * gramEvals.maxCoeff()) keep.push_back(i);
+    }
+    DenseMatrix<T> Z(q, keep.size());
+    for (size_t j = 0; j < keep.size(); j++) {
+      Z.col(j) = d.asDiagonal() * gramEig.eigenvectors().col(keep[j]) / T(std::sqrt(gramEvals(keep[j])));
+    }
+    U = U * Z;
+  }
+}
 } // namespace
 
 
@@ -38,16 +121,17 @@ Vector<T> smallestEigenvectorPositiveDefinite(SparseMatrix<T>& energyMatrix, Spa
 
   size_t N = energyMatrix.rows();
   PositiveDefiniteSolver<T> solver(energyMatrix);
+  PackedSparseMatrix<T> massPacked(massMatrix);
 
   Vector<T> u = Vector<T>::Random(N);
   Vector<T> x = u;
   for (size_t iIter = 0; iIter < nIterations; iIter++) {
 
     // Solve
-    solver.solve(x, massMatrix * u);
+    solver.solve(x, massPacked * u);
 
     // Re-normalize
-    normalize(x, massMatrix);
+    normalize(x, massPacked);
 
     // Update
     u = x;
@@ -60,38 +144,174 @@ template <typename T>
 std::vector<Vector<T>> smallestKEigenvectorsPositiveDefinite(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& massMatrix,
                                                              size_t kEigenvalues, size_t nIterations) {
 
+  // nIterations is a budget rather than a requirement, so eigenvectors which have not fully converged are returned
+  Vector<double> evals;
+  DenseMatrix<T> evecs;
+  extendSmallestKEigenpairsPositiveDefinite(energyMatrix, massMatrix, evals, evecs, kEigenvalues, 1e-8, nIterations);
+
   std::vector<Vector<T>> res;
+  for (size_t kEig = 0; kEig < kEigenvalues; kEig++) {
+    res.push_back(evecs.col(kEig));
+  }
+  return res;
+}
 
-  size_t N = energyMatrix.rows();
-  PositiveDefiniteSolver<T> solver(energyMatrix);
+template <typename T>
+std::tuple<Vector<double>, DenseMatrix<T>> smallestKEigenpairsPositiveDefinite(SparseMatrix<T>& energyMatrix,
+                                                                                SparseMatrix<T>& massMatrix,
+                                                                                size_t kEigenvalues, double tol,
+                                                                                size_t maxIterations) {
+  Vector<double> evals;
+  DenseMatrix<T> evecs(energyMatrix.rows(), 0);
+  if (!extendSmallestKEigenpairsPositiveDefinite(energyMatrix, massMatrix, evals, evecs, kEigenvalues, tol,
+                                                 maxIterations)) {
+    throw std::runtime_error("eigensolver did not converge to tolerance " + std::to_string(tol) + " after " +
+                             std::to_string(maxIterations) + " iterations");
+  }
+  return std::make_tuple(evals, evecs);
+}
 
-  auto projectOutPreviousVectors = [&](Vector<T>& x) {
-    for (Vector<T>& v : res) {
-      T proj = ((v.dot(massMatrix * x)));
-      x -= proj * v;
-    }
+template <typename T>
+bool extendSmallestKEigenpairsPositiveDefinite(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& massMatrix,
+                                               Vector<double>& eigenvalues, DenseMatrix<T>& eigenvectors,
+                                               size_t kAdditional, double tol, size_t maxIterations) {
+
+  // Block LOBPCG, following
+  //   > "Toward the optimal preconditioned eigensolver: Locally optimal block preconditioned conjugate gradient
+  //   method". Knyazev. SIAM J. Sci. Comput. 2001.
+  // The preconditioner is a (very slightly shifted) factorization of the energy matrix, which is computed once and
+  // shared by all eigenpairs. Any already-known eigenvectors are deflated by keeping the iteration M-orthogonal to
+  // them.
+
+  typedef typename Eigen::NumTraits<T>::Real RealT;
+
+  size_t N = energyMatrix.rows();
+  size_t nKnown = eigenvectors.cols();
+  if (nKnown > 0 && ((size_t)eigenvectors.rows() != N || (size_t)eigenvalues.rows() != nKnown)) {
+    throw std::logic_error("known eigenpairs do not match the dimensions of the problem");
+  }
+  if (nKnown + kAdditional > N) {
+    throw std::logic_error("cannot compute more eigenpairs than the dimension of the matrix");
+  }
+  if (nKnown == 0) {
+    eigenvalues = Vector<double>(0);
+    eigenvectors = DenseMatrix<T>(N, 0);
+  }
+  if (kAdditional == 0) return true;
+
+  // Append to the known eigenpairs
+  auto appendEigenpairs = [&](const Vector<double>& newEvals, const DenseMatrix<T>& newEvecs) {
+    eigenvalues.conservativeResize(nKnown + kAdditional);
+    eigenvalues.tail(kAdditional) = newEvals;
+    eigenvectors.conservativeResize(N, nKnown + kAdditional);
+    eigenvectors.rightCols(kAdditional) = newEvecs;
   };
 
-  for (size_t kEig = 0; kEig < kEigenvalues; kEig++) {
+  // No point asking for more accuracy than the arithmetic can give
+  tol = std::max(tol, 100. * std::numeric_limits<RealT>::epsilon());
 
-    Vector<T> u = Vector<T>::Random(N);
-    projectOutPreviousVectors(u);
-    Vector<T> x = u;
-    for (size_t iIter = 0; iIter < nIterations; iIter++) {
-      // Solve
-      solver.solve(x, massMatrix * u);
+  // A few extra guard vectors in the block speed convergence of the last wanted eigenpairs
+  size_t blockSize = std::min(N - nKnown, kAdditional + std::max<size_t>(5, kAdditional / 10));
 
-      projectOutPreviousVectors(x);
-      normalize(x, massMatrix);
+  // For small problems relative to the block size, just solve densely
+  if (N <= 4 * (nKnown + blockSize)) {
+    DenseMatrix<T> denseA = energyMatrix;
+    DenseMatrix<T> denseM = massMatrix;
+    Eigen::GeneralizedSelfAdjointEigenSolver<DenseMatrix<T>> denseEig(denseA, denseM);
+    if (denseEig.info() != Eigen::Success) {
+      throw std::runtime_error("dense eigensolve failed");
+    }
+    appendEigenpairs(denseEig.eigenvalues().segment(nKnown, kAdditional).template cast<double>(),
+                     denseEig.eigenvectors().middleCols(nKnown, kAdditional));
+    return true;
+  }
 
-      // Update
-      u = x;
+  // Factor the preconditioner. The energy matrix is often singular (e.g. a Laplacian), so shift it by a tiny multiple
+  // of the mass matrix.
+  double shift = 1e-8 * std::abs(energyMatrix.diagonal().sum()) / std::abs(massMatrix.diagonal().sum());
+  SparseMatrix<T> shiftedMatrix = energyMatrix + T(shift) * massMatrix;
+  PositiveDefiniteSolver<T> solver(shiftedMatrix);
+
+  // Initial block
+  const DenseMatrix<T>& knownEvecs = eigenvectors;
+  DenseMatrix<T> X = DenseMatrix<T>::Random(N, blockSize);
+  orthonormalizeBlock(X, {&knownEvecs}, massMatrix);
+  if ((size_t)X.cols() < blockSize) {
+    throw std::runtime_error("eigensolver initial basis is rank deficient");
+  }
+
+  DenseMatrix<T> W(N, 0); // preconditioned residuals
+  DenseMatrix<T> P(N, 0); // search directions
+  Vector<double> evals;
+  bool converged = false;
+  for (size_t iIter = 0; true; iIter++) {
+
+    // Rayleigh-Ritz on span[X, W, P]. The blocks are kept mutually M-orthonormal, so this is a standard eigenproblem.
+    std::vector<const DenseMatrix<T>*> blocks{&X};
+    std::vector<const DenseMatrix<T>*> directionBlocks;
+    if (W.cols() > 0) directionBlocks.push_back(&W);
+    if (P.cols() > 0) directionBlocks.push_back(&P);
+    blocks.insert(blocks.end(), directionBlocks.begin(), directionBlocks.end());
+
+    DenseMatrix<T> H = blockGram(blocks, energyMatrix);
+    H = 0.5 * (H + DenseMatrix<T>(H.adjoint()));
+    Eigen::SelfAdjointEigenSolver<DenseMatrix<T>> ritzEig(H);
+    if (ritzEig.info() != Eigen::Success) {
+      throw std::runtime_error("eigensolver Rayleigh-Ritz step failed");
     }
+    evals = ritzEig.eigenvalues().head(blockSize).template cast<double>();
+    DenseMatrix<T> C = ritzEig.eigenvectors().leftCols(blockSize);
 
-    res.push_back(x);
+    DenseMatrix<T> newX = combineBlocks(blocks, C, 0);
+    if (!directionBlocks.empty()) {
+      P = combineBlocks(directionBlocks, C, blockSize);
+    }
+    X = newX;
+
+    // Residuals
+    DenseMatrix<T> MX = massMatrix * X;
+    DenseMatrix<T> R = energyMatrix * X - MX * evals.template cast<T>().asDiagonal();
+    // (residuals are measured against the largest eigenvalue in the block, so that eigenvalues which are zero, like that
+    // of the constant vector of a Laplacian, can converge too)
+    double evalScale = std::max(evals.cwiseAbs().maxCoeff(), std::numeric_limits<double>::min());
+    std::vector<size_t> activeInds;
+    bool wantedConverged = true;
+    for (size_t j = 0; j < blockSize; j++) {
+      double relResidual = R.col(j).norm() / ((std::abs(evals(j)) + evalScale) * MX.col(j).norm());
+      if (!(relResidual < tol)) {
+        activeInds.push_back(j);
+        if (j < kAdditional) wantedConverged = false;
+      }
+    }
+    if (wantedConverged) {
+      converged = true;
+      break;
+    }
+    if (iIter >= maxIterations) break;
+
+    // Precondition the residuals of the active (not yet converged) vectors
+    size_t nActive = activeInds.size();
+    W.resize(N, nActive);
+    for (size_t j = 0; j < nActive; j++) {
+      Vector<T> w;
+      solver.solve(w, R.col(activeInds[j]));
+      W.col(j) = w;
+    }
+    orthonormalizeBlock(W, {&knownEvecs, &X}, massMatrix);
+
+    // Only the active search directions are retained
+    if (P.cols() > 0) {
+      DenseMatrix<T> activeP(N, nActive);
+      for (size_t j = 0; j < nActive; j++) {
+        activeP.col(j) = P.col(activeInds[j]);
+      }
+      P = activeP;
+      orthonormalizeBlock(P, {&knownEvecs, &X, &W}, massMatrix);
+    }
   }
 
-  return res;
+  appendEigenpairs(evals.head(kAdditional), X.leftCols(kAdditional));
+  return converged;
 }
 
 template <typename T>
@@ -103,10 +323,11 @@ std::vector<Vector<T>> smallestKEigenvectorsPositiveDefiniteTol(SparseMatrix<T>&
 
   size_t N = energyMatrix.rows();
   PositiveDefiniteSolver<T> solver(energyMatrix);
+  PackedSparseMatrix<T> massPacked(massMatrix);
 
   auto projectOutPreviousVectors = [&](Vector<T>& x) {
     for (Vector<T>& v : res) {
-      T proj = ((v.dot(massMatrix * x)));
+      T proj = ((v.dot(massPacked * x)));
       x -= proj * v;
     }
   };
@@ -118,10 +339,10 @@ std::vector<Vector<T>> smallestKEigenvectorsPositiveDefiniteTol(SparseMatrix<T>&
     double residual = eigenvectorResidual(energyMatrix, massMatrix, x);
     while (residual > tol) {
       // Solve
-      solver.solve(x, massMatrix * u);
+      solver.solve(x, massPacked * u);
 
       projectOutPreviousVectors(x);
-      normalize(x, massMatrix);
+      normalize(x, massPacked);
 
       // Update
       u = x;
@@ -141,16 +362,17 @@ Vector<T> smallestEigenvectorSquare(SparseMatrix<T>& energyMatrix, SparseMatrix<
 
   size_t N = energyMatrix.rows();
   SquareSolver<T> solver(energyMatrix);
+  PackedSparseMatrix<T> massPacked(massMatrix);
 
   Vector<T> u = Vector<T>::Random(N);
   Vector<T> x = u;
   for (size_t iIter = 0; iIter < nIterations; iIter++) {
 
     // Solve
-    solver.solve(x, massMatrix * u);
+    solver.solve(x, massPacked * u);
 
     // Re-normalize
-    normalize(x, massMatrix);
+    normalize(x, massPacked);
 
     // Update
     u = x;
@@ -164,12 +386,14 @@ Vector<T> largestEigenvector(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& mas
 
   size_t N = massMatrix.rows();
   PositiveDefiniteSolver<T> solver(massMatrix);
+  PackedSparseMatrix<T> energyPacked(energyMatrix);
+  PackedSparseMatrix<T> massPacked(massMatrix);
 
   Vector<T> u = Vector<T>::Random(N);
   Vector<T> x = u;
   for (size_t iIter = 0; iIter < nIterations; iIter++) {
-    solver.solve(x, energyMatrix * u);
-    normalize(x, massMatrix);
+    solver.solve(x, energyPacked * u);
+    normalize(x, massPacked);
     u = x;
   }
 
@@ -179,9 +403,13 @@ Vector<T> largestEigenvector(SparseMatrix<T>& energyMatrix, SparseMatrix<T>& mas
 // Measure L2 residual
 template <typename T>
 double eigenvectorResidual(const SparseMatrix<T>& energyMatrix, const SparseMatrix<T>& massMatrix, const Vector<T>& v) {
-  T candidateEigenvalue = v.dot(energyMatrix * v);
-  Vector<T> err = energyMatrix * v - candidateEigenvalue * massMatrix * v;
-  return norm(err, massMatrix);
+  Vector<T> Ev, Mv, Merr;
+  sparseMatrixVectorProduct(energyMatrix, v, Ev);
+  sparseMatrixVectorProduct(massMatrix, v, Mv);
+  T candidateEigenvalue = v.dot(Ev);
+  Vector<T> err = Ev - candidateEigenvalue * Mv;
+  sparseMatrixVectorProduct(massMatrix, err, Merr);
+  return std::sqrt(std::abs(err.dot(Merr)));
 }
 
 // Explicit instantiations
@@ -205,6 +433,32 @@ smallestKEigenvectorsPositiveDefinite(SparseMatrix<std::complex<double>>& energy
                                       size_t nIterations);
 
 
+template std::tuple<Vector<double>, DenseMatrix<float>>
+smallestKEigenpairsPositiveDefinite(SparseMatrix<float>& energyMatrix, SparseMatrix<float>& massMatrix,
+                                    size_t kEigenvalues, double tol, size_t maxIterations);
+template std::tuple<Vector<double>, DenseMatrix<double>>
+smallestKEigenpairsPositiveDefinite(SparseMatrix<double>& energyMatrix, SparseMatrix<double>& massMatrix,
+                                    size_t kEigenvalues, double tol, size_t maxIterations);
+template std::tuple<Vector<double>, DenseMatrix<std::complex<double>>>
+smallestKEigenpairsPositiveDefinite(SparseMatrix<std::complex<double>>& energyMatrix,
+                                    SparseMatrix<std::complex<double>>& massMatrix, size_t kEigenvalues, double tol,
+                                    size_t maxIterations);
+
+template bool extendSmallestKEigenpairsPositiveDefinite(SparseMatrix<float>& energyMatrix,
+                                                        SparseMatrix<float>& massMatrix, Vector<double>& eigenvalues,
+                                                        DenseMatrix<float>& eigenvectors, size_t kAdditional,
+                                                        double tol, size_t maxIterations);
+template bool extendSmallestKEigenpairsPositiveDefinite(SparseMatrix<double>& energyMatrix,
+                                                        SparseMatrix<double>& massMatrix, Vector<double>& eigenvalues,
+                                                        DenseMatrix<double>& eigenvectors, size_t kAdditional,
+                                                        double tol, size_t maxIterations);
+template bool extendSmallestKEigenpairsPositiveDefinite(SparseMatrix<std::complex<double>>& energyMatrix,
+                                                        SparseMatrix<std::complex<double>>& massMatrix,
+                                                        Vector<double>& eigenvalues,
+                                                        DenseMatrix<std::complex<double>>& eigenvectors,
+                                                        size_t kAdditional, double tol, size_t maxIterations);
+
+
 template std::vector<Vector<float>> smallestKEigenvectorsPositiveDefiniteTol(SparseMatrix<float>& energyMatrix,
                                                                              SparseMatrix<float>& massMatrix,
                                                                              size_t kEigenvalues, double tol);
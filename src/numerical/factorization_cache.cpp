@@ -0,0 +1,288 @@
+#include "geometrycentral/numerical/factorization_cache.h"
+
+#include "geometrycentral/numerical/factorization_io.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <typeindex>
+#include <typeinfo>
+
+namespace geometrycentral {
+
+namespace {
+
+// One cached solver
+struct FactorizationCacheEntry {
+  std::type_index solverType; // distinguishes solver types, including the scalar type
+  size_t hash;
+  std::shared_ptr<void> matrix; // copy of the factored matrix, to verify that matches are exact
+  std::shared_ptr<void> solver;
+  size_t bytes;
+};
+
+struct FactorizationCache {
+  std::mutex mutex;
+  std::list<FactorizationCacheEntry> entries; // ordered from most to least recently used
+  size_t budget = size_t(1) << 30;            // 1 GB
+  size_t usage = 0;
+  std::string diskDirectory; // empty if the disk cache is disabled
+  FactorizationCacheStats stats;
+};
+
+// The process-wide cache (initialization of function-local statics is thread-safe)
+FactorizationCache& factorizationCache() {
+  static FactorizationCache cache;
+  return cache;
+}
+
+// Must be called with the mutex held
+void evictToBudget(FactorizationCache& cache) {
+  while (cache.usage > cache.budget && !cache.entries.empty()) {
+    cache.usage -= cache.entries.back().bytes;
+    cache.entries.pop_back();
+    cache.stats.evictions++;
+  }
+}
+
+// Are two compressed matrices exactly equal?
+template <typename T>
+bool matricesEqual(const SparseMatrix<T>& A, const SparseMatrix<T>& B) {
+  if (A.rows() != B.rows() || A.cols() != B.cols() || A.nonZeros() != B.nonZeros()) return false;
+  return std::equal(A.outerIndexPtr(), A.outerIndexPtr() + A.outerSize() + 1, B.outerIndexPtr()) &&
+         std::equal(A.innerIndexPtr(), A.innerIndexPtr() + A.nonZeros(), B.innerIndexPtr()) &&
+         std::equal(A.valuePtr(), A.valuePtr() + A.nonZeros(), B.valuePtr());
+}
+
+// Find a matching entry and mark it as most recently used. Must be called with the mutex held.
+template <typename S, typename T>
+std::shared_ptr<S> findCachedSolver(FactorizationCache& cache, std::type_index solverType, size_t hash,
+                                    const SparseMatrix<T>& mat) {
+  for (auto it = cache.entries.begin(); it != cache.entries.end(); ++it) {
+    if (it->solverType != solverType || it->hash != hash) continue;
+    if (!matricesEqual(*std::static_pointer_cast<SparseMatrix<T>>(it->matrix), mat)) continue;
+    cache.entries.splice(cache.entries.begin(), cache.entries, it);
+    return std::static_pointer_cast<S>(it->solver);
+  }
+  return nullptr;
+}
+
+// Files in the disk cache hold a copy of the factored matrix (to verify that matches are exact), followed by the saved
+// solver. They are named by the hash of the matrix and the type of the factorization.
+template <typename T>
+std::string diskCacheFilename(const std::string& directory, size_t hash, FactorizationKind kind) {
+  std::ostringstream name;
+  name << directory << "/" << std::hex << static_cast<uint64_t>(hash) << "_" << factorizationTypeName<T>(kind)
+       << ".gcfact";
+  return name.str();
+}
+
+// Returns null if there is no usable file
+template <typename S, typename T>
+std::shared_ptr<S> loadSolverFromDisk(const std::string& filename, const SparseMatrix<T>& mat) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) return nullptr;
+  try {
+    SparseMatrix<T> savedMat = readSparseMatrix<T>(in);
+    if (!matricesEqual(savedMat, mat)) return nullptr; // a hash collision
+    return std::shared_ptr<S>(S::load(in));
+  } catch (const std::exception&) {
+    // An unreadable file (e.g. from an older version) is treated as a miss, and will be overwritten
+    return nullptr;
+  }
+}
+
+// Returns true on success. Failures are not fatal, since the disk cache is only an optimization.
+template <typename S, typename T>
+bool saveSolverToDisk(const std::string& filename, const SparseMatrix<T>& mat, S& solver) {
+
+  // Write to a temporary file, then move it into place, so that concurrent readers (including other processes) never
+  // see a partially written file
+  std::random_device randomDevice;
+  std::ostringstream tmpName;
+  tmpName << filename << ".tmp" << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << "_"
+          << randomDevice();
+  std::string tmpFilename = tmpName.str();
+
+  bool success = false;
+  {
+    std::ofstream out(tmpFilename, std::ios::binary);
+    if (!out) return false;
+    try {
+      writeSparseMatrix(out, mat);
+      solver.save(out);
+      out.close();
+      success = static_cast<bool>(out);
+    } catch (const std::exception&) {
+      success = false;
+    }
+  }
+  if (success) {
+    success = std::rename(tmpFilename.c_str(), filename.c_str()) == 0;
+  }
+  if (!success) {
+    std::remove(tmpFilename.c_str());
+  }
+  return success;
+}
+
+template <typename S, typename T>
+std::shared_ptr<S> cachedSolver(SparseMatrix<T>& mat, FactorizationKind kind) {
+
+  mat.makeCompressed();
+  size_t hash = hashMatrix(mat);
+  std::type_index solverType(typeid(S));
+  FactorizationCache& cache = factorizationCache();
+  std::string diskDirectory;
+
+  { // Look for an existing factorization
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    std::shared_ptr<S> solver = findCachedSolver<S>(cache, solverType, hash, mat);
+    if (solver) {
+      cache.stats.hits++;
+      return solver;
+    }
+    cache.stats.misses++;
+    diskDirectory = cache.diskDirectory;
+  }
+
+  // Load or factor (without holding the lock, so other threads can use the cache meanwhile)
+  std::shared_ptr<S> solver;
+  bool loaded = false, saved = false;
+  if (!diskDirectory.empty()) {
+    std::string filename = diskCacheFilename<T>(diskDirectory, hash, kind);
+    solver = loadSolverFromDisk<S>(filename, mat);
+    loaded = (solver != nullptr);
+    if (!loaded) {
+      solver = std::make_shared<S>(mat);
+      saved = saveSolverToDisk(filename, mat, *solver);
+    }
+  } else {
+    solver = std::make_shared<S>(mat);
+  }
+  std::shared_ptr<SparseMatrix<T>> matCopy = std::make_shared<SparseMatrix<T>>(mat);
+  size_t bytes = solver->memoryUsage() + mat.nonZeros() * (sizeof(T) + sizeof(int));
+
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  if (loaded) cache.stats.diskHits++;
+  if (saved) cache.stats.diskWrites++;
+
+  // Another thread may have factored the same matrix in the meantime
+  std::shared_ptr<S> existing = findCachedSolver<S>(cache, solverType, hash, mat);
+  if (existing) return existing;
+
+  cache.entries.push_front(FactorizationCacheEntry{solverType, hash, matCopy, solver, bytes});
+  cache.usage += bytes;
+  evictToBudget(cache);
+
+  return solver;
+}
+
+// 64-bit FNV-1a, over raw bytes
+void hashBytes(uint64_t& h, const void* data, size_t nBytes) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < nBytes; i++) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+}
+
+} // namespace
+
+template <typename T>
+size_t hashMatrix(const SparseMatrix<T>& mat) {
+  uint64_t h = 14695981039346656037ull;
+  int64_t dims[3] = {mat.rows(), mat.cols(), mat.nonZeros()};
+  hashBytes(h, dims, sizeof(dims));
+
+  // Structure and values, column by column (which also handles uncompressed matrices)
+  for (int j = 0; j < mat.outerSize(); j++) {
+    int start = mat.outerIndexPtr()[j];
+    int nEntries = mat.isCompressed() ? mat.outerIndexPtr()[j + 1] - start : mat.innerNonZeroPtr()[j];
+    hashBytes(h, &nEntries, sizeof(int));
+    hashBytes(h, mat.innerIndexPtr() + start, nEntries * sizeof(int));
+    hashBytes(h, mat.valuePtr() + start, nEntries * sizeof(T));
+  }
+
+  return static_cast<size_t>(h);
+}
+
+template <typename T>
+SharedSolver<PositiveDefiniteSolver<T>> cachedPositiveDefiniteSolver(SparseMatrix<T>& mat) {
+  return SharedSolver<PositiveDefiniteSolver<T>>(cachedSolver<PositiveDefiniteSolver<T>>(mat, FactorizationKind::LDLT));
+}
+
+template <typename T>
+SharedSolver<SquareSolver<T>> cachedSquareSolver(SparseMatrix<T>& mat) {
+  return SharedSolver<SquareSolver<T>>(cachedSolver<SquareSolver<T>>(mat, FactorizationKind::LU));
+}
+
+void setFactorizationCacheBudget(size_t bytes) {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.budget = bytes;
+  evictToBudget(cache);
+}
+
+size_t getFactorizationCacheBudget() {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return cache.budget;
+}
+
+size_t getFactorizationCacheMemoryUsage() {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return cache.usage;
+}
+
+void clearFactorizationCache() {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.entries.clear();
+  cache.usage = 0;
+}
+
+void setFactorizationDiskCacheDirectory(std::string directory) {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.diskDirectory = directory;
+}
+
+std::string getFactorizationDiskCacheDirectory() {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  return cache.diskDirectory;
+}
+
+FactorizationCacheStats getFactorizationCacheStats() {
+  FactorizationCache& cache = factorizationCache();
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  FactorizationCacheStats stats = cache.stats;
+  stats.nEntries = cache.entries.size();
+  return stats;
+}
+
+
+// Explicit instantiations
+template size_t hashMatrix(const SparseMatrix<float>& mat);
+template size_t hashMatrix(const SparseMatrix<double>& mat);
+template size_t hashMatrix(const SparseMatrix<std::complex<double>>& mat);
+
+template SharedSolver<PositiveDefiniteSolver<float>> cachedPositiveDefiniteSolver(SparseMatrix<float>& mat);
+template SharedSolver<PositiveDefiniteSolver<double>> cachedPositiveDefiniteSolver(SparseMatrix<double>& mat);
+template SharedSolver<PositiveDefiniteSolver<std::complex<double>>>
+cachedPositiveDefiniteSolver(SparseMatrix<std::complex<double>>& mat);
+
+template SharedSolver<SquareSolver<float>> cachedSquareSolver(SparseMatrix<float>& mat);
+template SharedSolver<SquareSolver<double>> cachedSquareSolver(SparseMatrix<double>& mat);
+template SharedSolver<SquareSolver<std::complex<double>>> cachedSquareSolver(SparseMatrix<std::complex<double>>& mat);
+
+} // namespace geometrycentral
@@ -0,0 +1,270 @@
+#include "geometrycentral/numerical/factorization_io.h"
+
+#include <complex>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace geometrycentral {
+
+namespace {
+
+const char FACTORIZATION_FILE_MAGIC[8] = {'G', 'C', 'F', 'A', 'C', 'T', 'O', 'R'};
+
+// Tags identifying the scalar type in the header
+template <typename T>
+uint32_t scalarTypeTag();
+template <>
+uint32_t scalarTypeTag<float>() {
+  return 1;
+}
+template <>
+uint32_t scalarTypeTag<double>() {
+  return 2;
+}
+template <>
+uint32_t scalarTypeTag<std::complex<float>>() {
+  return 3;
+}
+template <>
+uint32_t scalarTypeTag<std::complex<double>>() {
+  return 4;
+}
+
+// Short names for the scalar types
+template <typename T>
+std::string scalarTypeName();
+template <>
+std::string scalarTypeName<float>() {
+  return "f32";
+}
+template <>
+std::string scalarTypeName<double>() {
+  return "f64";
+}
+template <>
+std::string scalarTypeName<std::complex<float>>() {
+  return "c64";
+}
+template <>
+std::string scalarTypeName<std::complex<double>>() {
+  return "c128";
+}
+
+template <typename V>
+void writeRaw(std::ostream& out, const V* data, size_t count) {
+  out.write(reinterpret_cast<const char*>(data), count * sizeof(V));
+  if (!out) throw std::runtime_error("failed to write factorization");
+}
+
+template <typename V>
+void readRaw(std::istream& in, V* data, size_t count) {
+  in.read(reinterpret_cast<char*>(data), count * sizeof(V));
+  if (!in) throw std::runtime_error("failed to read factorization (file truncated?)");
+}
+
+// Check that a count read from a file is plausible before allocating for it: it must fit in the index type, and (if
+// the stream can tell) that many entries of the given size must remain in the stream
+void checkReadCount(std::istream& in, uint64_t count, size_t entrySize) {
+  if (count > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+    throw std::runtime_error("corrupt factorization file (size out of range)");
+  }
+  std::streampos pos = in.tellg();
+  if (pos == std::streampos(-1)) return;
+  in.seekg(0, std::ios::end);
+  std::streampos end = in.tellg();
+  in.seekg(pos);
+  if (end == std::streampos(-1) || !in) {
+    in.clear();
+    in.seekg(pos);
+    return;
+  }
+  if (static_cast<uint64_t>(end - pos) < count * entrySize) {
+    throw std::runtime_error("failed to read factorization (file truncated?)");
+  }
+}
+
+} // namespace
+
+template <typename T>
+std::string factorizationTypeName(FactorizationKind kind) {
+  switch (kind) {
+  case FactorizationKind::LDLT:
+    return "ldlt_" + scalarTypeName<T>();
+  case FactorizationKind::LU:
+    return "lu_" + scalarTypeName<T>();
+  case FactorizationKind::QR:
+    return "qr_" + scalarTypeName<T>();
+  }
+  return "unknown_" + scalarTypeName<T>();
+}
+
+template <typename T>
+void writeFactorizationHeader(std::ostream& out, FactorizationKind kind, size_t nRows, size_t nCols) {
+  writeRaw(out, FACTORIZATION_FILE_MAGIC, 8);
+  uint32_t tags[3] = {FACTORIZATION_FILE_VERSION, static_cast<uint32_t>(kind), scalarTypeTag<T>()};
+  writeRaw(out, tags, 3);
+  uint64_t dims[2] = {nRows, nCols};
+  writeRaw(out, dims, 2);
+}
+
+template <typename T>
+void readFactorizationHeader(std::istream& in, FactorizationKind kind, size_t& nRows, size_t& nCols) {
+  char magic[8];
+  readRaw(in, magic, 8);
+  if (std::memcmp(magic, FACTORIZATION_FILE_MAGIC, 8) != 0) {
+    throw std::runtime_error("not a factorization file");
+  }
+  uint32_t tags[3];
+  readRaw(in, tags, 3);
+  if (tags[0] != FACTORIZATION_FILE_VERSION) {
+    throw std::runtime_error("factorization file has unsupported version " + std::to_string(tags[0]));
+  }
+  if (tags[1] != static_cast<uint32_t>(kind)) {
+    throw std::runtime_error("factorization file holds a different kind of factorization");
+  }
+  if (tags[2] != scalarTypeTag<T>()) {
+    throw std::runtime_error("factorization file holds a different scalar type");
+  }
+  uint64_t dims[2];
+  readRaw(in, dims, 2);
+  nRows = dims[0];
+  nCols = dims[1];
+}
+
+template <typename T>
+void writeSparseMatrix(std::ostream& out, const SparseMatrix<T>& mat) {
+  if (!mat.isCompressed()) {
+    SparseMatrix<T> matCompressed = mat;
+    matCompressed.makeCompressed();
+    writeSparseMatrix(out, matCompressed);
+    return;
+  }
+  uint64_t dims[3] = {static_cast<uint64_t>(mat.rows()), static_cast<uint64_t>(mat.cols()),
+                      static_cast<uint64_t>(mat.nonZeros())};
+  writeRaw(out, dims, 3);
+  writeRaw(out, mat.outerIndexPtr(), mat.outerSize() + 1);
+  writeRaw(out, mat.innerIndexPtr(), mat.nonZeros());
+  writeRaw(out, mat.valuePtr(), mat.nonZeros());
+}
+
+template <typename T>
+SparseMatrix<T> readSparseMatrix(std::istream& in) {
+  uint64_t dims[3];
+  readRaw(in, dims, 3);
+  checkReadCount(in, dims[0], 0);
+  checkReadCount(in, dims[1], 0);
+  checkReadCount(in, dims[2], sizeof(int) + sizeof(T));
+  if (dims[0] != 0 && dims[2] / dims[0] > dims[1]) {
+    throw std::runtime_error("corrupt sparse matrix in factorization file (too many entries)");
+  }
+  checkReadCount(in, dims[1] + 1, sizeof(int));
+
+  SparseMatrix<T> mat(dims[0], dims[1]);
+  mat.resizeNonZeros(dims[2]);
+  readRaw(in, mat.outerIndexPtr(), mat.outerSize() + 1);
+  readRaw(in, mat.innerIndexPtr(), dims[2]);
+  readRaw(in, mat.valuePtr(), dims[2]);
+
+  // Validate the structure, so that a corrupt file cannot produce out of bounds accesses later: outer indices must
+  // run from 0 to the number of entries without decreasing, and inner indices must be in range and increasing within
+  // each column
+  const int* outer = mat.outerIndexPtr();
+  const int* inner = mat.innerIndexPtr();
+  int nRows = static_cast<int>(dims[0]);
+  if (outer[0] != 0 || outer[mat.outerSize()] != static_cast<int>(dims[2])) {
+    throw std::runtime_error("corrupt sparse matrix in factorization file");
+  }
+  for (int j = 0; j < mat.outerSize(); j++) {
+    if (outer[j + 1] < outer[j]) {
+      throw std::runtime_error("corrupt sparse matrix in factorization file (outer indices decrease)");
+    }
+  }
+  for (int j = 0; j < mat.outerSize(); j++) {
+    for (int p = outer[j]; p < outer[j + 1]; p++) {
+      if (inner[p] < 0 || inner[p] >= nRows || (p > outer[j] && inner[p] <= inner[p - 1])) {
+        throw std::runtime_error("corrupt sparse matrix in factorization file (bad inner index)");
+      }
+    }
+  }
+  return mat;
+}
+
+template <typename T>
+void writeVector(std::ostream& out, const Vector<T>& vec) {
+  uint64_t size = vec.size();
+  writeRaw(out, &size, 1);
+  writeRaw(out, vec.data(), size);
+}
+
+template <typename T>
+Vector<T> readVector(std::istream& in) {
+  uint64_t size;
+  readRaw(in, &size, 1);
+  checkReadCount(in, size, sizeof(T));
+  Vector<T> vec(size);
+  readRaw(in, vec.data(), size);
+  return vec;
+}
+
+void writeIndexVector(std::ostream& out, const std::vector<int64_t>& inds) {
+  uint64_t size = inds.size();
+  writeRaw(out, &size, 1);
+  writeRaw(out, inds.data(), size);
+}
+
+std::vector<int64_t> readIndexVector(std::istream& in) {
+  uint64_t size;
+  readRaw(in, &size, 1);
+  checkReadCount(in, size, sizeof(int64_t));
+  std::vector<int64_t> inds(size);
+  readRaw(in, inds.data(), size);
+  return inds;
+}
+
+void writeFlag(std::ostream& out, uint64_t flag) { writeRaw(out, &flag, 1); }
+
+uint64_t readFlag(std::istream& in) {
+  uint64_t flag;
+  readRaw(in, &flag, 1);
+  return flag;
+}
+
+// Explicit instantiations
+template std::string factorizationTypeName<float>(FactorizationKind kind);
+template void writeFactorizationHeader<float>(std::ostream& out, FactorizationKind kind, size_t nRows, size_t nCols);
+template void readFactorizationHeader<float>(std::istream& in, FactorizationKind kind, size_t& nRows, size_t& nCols);
+template void writeSparseMatrix(std::ostream& out, const SparseMatrix<float>& mat);
+template SparseMatrix<float> readSparseMatrix(std::istream& in);
+template void writeVector(std::ostream& out, const Vector<float>& vec);
+template Vector<float> readVector(std::istream& in);
+
+template std::string factorizationTypeName<double>(FactorizationKind kind);
+template void writeFactorizationHeader<double>(std::ostream& out, FactorizationKind kind, size_t nRows, size_t nCols);
+template void readFactorizationHeader<double>(std::istream& in, FactorizationKind kind, size_t& nRows, size_t& nCols);
+template void writeSparseMatrix(std::ostream& out, const SparseMatrix<double>& mat);
+template SparseMatrix<double> readSparseMatrix(std::istream& in);
+template void writeVector(std::ostream& out, const Vector<double>& vec);
+template Vector<double> readVector(std::istream& in);
+
+template std::string factorizationTypeName<std::complex<float>>(FactorizationKind kind);
+template void writeFactorizationHeader<std::complex<float>>(std::ostream& out, FactorizationKind kind, size_t nRows,
+                                                            size_t nCols);
+template void readFactorizationHeader<std::complex<float>>(std::istream& in, FactorizationKind kind, size_t& nRows,
+                                                           size_t& nCols);
+template void writeSparseMatrix(std::ostream& out, const SparseMatrix<std::complex<float>>& mat);
+template SparseMatrix<std::complex<float>> readSparseMatrix(std::istream& in);
+template void writeVector(std::ostream& out, const Vector<std::complex<float>>& vec);
+template Vector<std::complex<float>> readVector(std::istream& in);
+
+template std::string factorizationTypeName<std::complex<double>>(FactorizationKind kind);
+template void writeFactorizationHeader<std::complex<double>>(std::ostream& out, FactorizationKind kind, size_t nRows,
+                                                             size_t nCols);
+template void readFactorizationHeader<std::complex<double>>(std::istream& in, FactorizationKind kind, size_t& nRows,
+                                                            size_t& nCols);
+template void writeSparseMatrix(std::ostream& out, const SparseMatrix<std::complex<double>>& mat);
+template SparseMatrix<std::complex<double>> readSparseMatrix(std::istream& in);
+template void writeVector(std::ostream& out, const Vector<std::complex<double>>& vec);
+template Vector<std::complex<double>> readVector(std::istream& in);
+
+} // namespace geometrycentral
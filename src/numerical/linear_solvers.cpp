@@ -1,6 +1,7 @@
 #include "geometrycentral/numerical/linear_solvers.h"
 
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
 #include "geometrycentral/utilities/vector2.h"
 
 
@@ -15,7 +16,9 @@ template class LinearSolver<std::complex<double>>;
 
 template <typename T>
 double residual(const SparseMatrix<T>& matrix, const Vector<T>& lhs, const Vector<T>& rhs) {
-  Vector<T> residVec = matrix * lhs - rhs;
+  Vector<T> residVec;
+  sparseMatrixVectorProduct(matrix, lhs, residVec);
+  residVec -= rhs;
   double resid = std::abs((residVec.conjugate().transpose() * residVec)(0));
   return std::sqrt(resid);
 }
@@ -1,28 +1,477 @@
 #include "geometrycentral/numerical/linear_solvers.h"
 
+#include "geometrycentral/numerical/factorization_io.h"
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 
 #ifdef GC_HAVE_SUITESPARSE
 #include "geometrycentral/numerical/suitesparse_utilities.h"
 #endif
 
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
 using namespace Eigen;
 using std::cout;
 using std::endl;
 
 namespace geometrycentral {
 
+// Type helper. The type used for the factorization in mixed precision mode: 'float' if T == 'double', and
+// 'std::complex<float>' if T == 'std::complex<double>'.
+template <typename T>
+struct PSDLowPrecisionType {
+  typedef T type;
+};
+template <>
+struct PSDLowPrecisionType<double> {
+  typedef float type;
+};
+template <>
+struct PSDLowPrecisionType<std::complex<double>> {
+  typedef std::complex<float> type;
+};
+
+// A factorization P A P^T = L D L^H, held explicitly. This is the form in which factorizations are saved, and loaded
+// solvers solve with it directly.
+template <typename S>
+struct ExplicitLDLT {
+  std::vector<int64_t> order; // row/column i of P A P^T is row/column order[i] of A
+  SparseMatrix<S> L;          // unit lower triangular (the diagonal, if present, is ignored)
+  Vector<S> D;
+
+  void solve(Vector<S>& x, const Vector<S>& rhs) const {
+    size_t N = order.size();
+    Vector<S> y(N);
+    for (size_t i = 0; i < N; i++) y[i] = rhs[order[i]];
+    L.template triangularView<Eigen::UnitLower>().solveInPlace(y);
+    y = y.cwiseQuotient(D);
+    L.adjoint().template triangularView<Eigen::UnitUpper>().solveInPlace(y);
+    x.resize(N);
+    for (size_t i = 0; i < N; i++) x[order[i]] = y[i];
+  }
+
+  size_t memoryUsage() const {
+    return L.nonZeros() * (sizeof(S) + sizeof(int)) + D.size() * sizeof(S) + order.size() * sizeof(int64_t);
+  }
+};
+
 template <typename T>
 struct PSDSolverInternals {
+  typedef typename PSDLowPrecisionType<T>::type LowT;
+
+  SparseMatrix<T> mat;                // the matrix which is currently factored (needed to refactor after updates)
+  bool symbolicAnalysisValid = false; // false if the pattern of mat changed since the symbolic analysis
+  FactorStructure structure = FactorStructure::Simplicial; // requested structure of full precision factorizations
+
+  // Mixed precision mode always uses Eigen's factorization, since Suitesparse only factors in double precision. If
+  // refinement stalls during a solve, that solve falls back on a full precision factorization, which is computed the
+  // first time it is needed (guarded by the mutex, since solves may be concurrent) and kept alongside the single
+  // precision one until the next refactorization. Later solves still try single precision first.
+  std::atomic<bool> mixedPrecision{false};
+  std::atomic<bool> haveFullPrecisionFallback{false};
+  std::mutex precisionFallbackMutex;
+  std::unique_ptr<Eigen::SimplicialLDLT<SparseMatrix<LowT>>> lowPrecisionSolver;
+
+  // Factorizations loaded from a file, used in place of the ones above until the matrix is refactored
+  std::unique_ptr<ExplicitLDLT<T>> loadedFactor;
+  std::unique_ptr<ExplicitLDLT<LowT>> loadedLowPrecisionFactor;
 #ifdef GC_HAVE_SUITESPARSE
   CholmodContext context;
   cholmod_sparse* cMat = nullptr;
   cholmod_factor* factorization = nullptr;
+
+  // Cost estimates from the symbolic analysis, used to choose between low-rank updates and refactoring
+  double factorFlops = 0.;
+  double factorNonzeros = 0.;
+  size_t nUpdatesSinceFactor = 0;
 #else
   Eigen::SimplicialLDLT<SparseMatrix<T>> solver;
 #endif
 };
 
+namespace {
+
+// Factor internals.mat in full precision. The symbolic analysis (ordering and elimination tree) from a previous
+// factorization is reused if the sparsity pattern has not changed since.
+template <typename T>
+void factorFullPrecision(PSDSolverInternals<T>& internals) {
+
+  internals.loadedFactor.reset();
+
+  // Suitesparse version
+#ifdef GC_HAVE_SUITESPARSE
+
+  // Convert suitesparse format
+  if (internals.cMat != nullptr) {
+    cholmod_l_free_sparse(&internals.cMat, internals.context);
+  }
+  internals.cMat = toCholmod(internals.mat, internals.context, SType::SYMMETRIC);
+
+  // Factor
+  if (internals.structure == FactorStructure::Supernodal) {
+    internals.context.setSupernodal(); // supernodal factorizations are always LLt
+    internals.context.setLL();
+  } else {
+    internals.context.setSimplicial(); // must use simplicial for LDLt
+    internals.context.setLDL();        // ensure we get an LDLt internals.factorization
+  }
+  if (!internals.symbolicAnalysisValid || internals.factorization == nullptr) {
+    if (internals.factorization != nullptr) {
+      cholmod_l_free_factor(&internals.factorization, internals.context);
+    }
+    internals.factorization = cholmod_l_analyze(internals.cMat, internals.context);
+    internals.factorFlops = internals.context.context.fl;
+    internals.factorNonzeros = internals.context.context.lnz;
+  }
+  bool success = (bool)cholmod_l_factorize(internals.cMat, internals.factorization, internals.context);
+  internals.symbolicAnalysisValid = true;
+  internals.nUpdatesSinceFactor = 0;
+
+  if (!success) {
+    throw std::runtime_error("failure in cholmod_l_factorize");
+  }
+  if (internals.context.context.status == CHOLMOD_NOT_POSDEF) {
+    throw std::runtime_error("matrix is not positive definite");
+  }
+
+  // Eigen version
+#else
+  if (internals.symbolicAnalysisValid) {
+    internals.solver.factorize(internals.mat);
+  } else {
+    internals.solver.compute(internals.mat);
+  }
+  if (internals.solver.info() != Eigen::Success) {
+    std::cerr << "Solver internals->factorization error: " << internals.solver.info() << std::endl;
+    throw std::invalid_argument("Solver internals->factorization failed");
+  }
+  internals.symbolicAnalysisValid = true;
+#endif
+}
+
+// Factor internals.mat, in the precision requested by internals.mixedPrecision
+template <typename T>
+void factorPositiveDefinite(PSDSolverInternals<T>& internals) {
+
+  internals.loadedLowPrecisionFactor.reset();
+
+  // Mixed precision version
+  if (internals.mixedPrecision) {
+    internals.loadedFactor.reset();
+    if (internals.haveFullPrecisionFallback) {
+      // The fallback factors the old matrix; it is recomputed if a solve needs it again
+      internals.haveFullPrecisionFallback = false;
+#ifdef GC_HAVE_SUITESPARSE
+      cholmod_l_free_factor(&internals.factorization, internals.context);
+#endif
+    }
+    typedef typename PSDSolverInternals<T>::LowT LowT;
+    SparseMatrix<LowT> lowMat = internals.mat.template cast<LowT>();
+    if (!internals.lowPrecisionSolver) {
+      internals.lowPrecisionSolver.reset(new Eigen::SimplicialLDLT<SparseMatrix<LowT>>());
+      internals.symbolicAnalysisValid = false;
+    }
+    if (internals.symbolicAnalysisValid) {
+      internals.lowPrecisionSolver->factorize(lowMat);
+    } else {
+      internals.lowPrecisionSolver->compute(lowMat);
+    }
+    if (internals.lowPrecisionSolver->info() == Eigen::Success && internals.lowPrecisionSolver->vectorD().allFinite()) {
+      internals.symbolicAnalysisValid = true;
+      return;
+    }
+
+    // The matrix cannot be factored in single precision (e.g. its entries are out of range); use full precision
+    internals.mixedPrecision = false;
+    internals.symbolicAnalysisValid = false;
+  }
+
+  internals.lowPrecisionSolver.reset();
+  factorFullPrecision(internals);
+}
+
+#ifdef GC_HAVE_SUITESPARSE
+// Workspace for Cholmod solves, one per thread, so that several threads can solve with the same factorization at once.
+// The work arrays are reused between solves of the same size.
+struct CholmodSolveWorkspace {
+  CholmodContext context;
+  cholmod_dense* Y = nullptr;
+  cholmod_dense* E = nullptr;
+
+  ~CholmodSolveWorkspace() {
+    if (Y != nullptr) cholmod_l_free_dense(&Y, context);
+    if (E != nullptr) cholmod_l_free_dense(&E, context);
+  }
+};
+
+CholmodSolveWorkspace& threadSolveWorkspace() {
+  static thread_local CholmodSolveWorkspace workspace;
+  return workspace;
+}
+#endif
+
+// Does the sparsity pattern of A (which must be compressed) contain every entry of B?
+template <typename T>
+bool patternContains(const SparseMatrix<T>& A, const SparseMatrix<T>& B) {
+  for (int j = 0; j < B.outerSize(); j++) {
+    const int* colBegin = A.innerIndexPtr() + A.outerIndexPtr()[j];
+    const int* colEnd = A.innerIndexPtr() + A.outerIndexPtr()[j + 1];
+    for (typename SparseMatrix<T>::InnerIterator it(B, j); it; ++it) {
+      if (!std::binary_search(colBegin, colEnd, static_cast<int>(it.row()))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#ifdef GC_HAVE_SUITESPARSE
+
+// Try to apply the change delta to a real factorization as a low-rank update/downdate. Returns false if a
+// refactorization is expected to be cheaper, or if the update failed (in which case the caller must refactor).
+template <typename T>
+bool lowRankUpdateReal(PSDSolverInternals<T>& internals, SparseMatrix<double>& delta) {
+
+  // Refactor periodically anyway, so that roundoff does not accumulate over long sequences of updates
+  const size_t maxUpdatesBetweenFactorizations = 32;
+  if (internals.nUpdatesSinceFactor >= maxUpdatesBetweenFactorizations) return false;
+
+  // Crossover heuristic: each rank-1 update touches (at most) every entry of the factor along a path in the
+  // elimination tree, so a rank-r update costs roughly r * nnz(L), versus the flop count of a full factorization
+  auto updateIsCheaper = [&](size_t rank) {
+    const double updateCostFactor = 4.;
+    return updateCostFactor * rank * internals.factorNonzeros < internals.factorFlops;
+  };
+
+  // Gather the rows/columns touched by the change
+  size_t N = delta.rows();
+  std::vector<long long int> supportInd(N, -1);
+  std::vector<size_t> support;
+  for (int j = 0; j < delta.outerSize(); j++) {
+    for (SparseMatrix<double>::InnerIterator it(delta, j); it; ++it) {
+      if (it.value() == 0.) continue;
+      for (size_t i : {static_cast<size_t>(it.row()), static_cast<size_t>(it.col())}) {
+        if (supportInd[i] == -1) {
+          supportInd[i] = 1;
+          support.push_back(i);
+        }
+      }
+    }
+  }
+  if (support.empty()) return true; // nothing to do
+  if (!updateIsCheaper(support.size())) return false;
+  std::sort(support.begin(), support.end());
+  for (size_t iS = 0; iS < support.size(); iS++) {
+    supportInd[support[iS]] = iS;
+  }
+
+  // Split the (symmetric, indefinite) change restricted to its support as C+ C+^T - C- C-^T, via an eigendecomposition
+  // of the small dense block
+  size_t S = support.size();
+  DenseMatrix<double> block = DenseMatrix<double>::Zero(S, S);
+  for (int j = 0; j < delta.outerSize(); j++) {
+    for (SparseMatrix<double>::InnerIterator it(delta, j); it; ++it) {
+      if (it.value() == 0.) continue;
+      block(supportInd[it.row()], supportInd[it.col()]) += it.value();
+    }
+  }
+  block = 0.5 * (block + block.transpose()).eval();
+  SelfAdjointEigenSolver<DenseMatrix<double>> eig(block);
+  double maxAbsEval = eig.eigenvalues().cwiseAbs().maxCoeff();
+  double dropTol = 1e-14 * maxAbsEval;
+  std::vector<Eigen::Triplet<double>> plusTriplets, minusTriplets;
+  size_t nPlus = 0, nMinus = 0;
+  for (size_t k = 0; k < S; k++) {
+    double lambda = eig.eigenvalues()(k);
+    if (std::abs(lambda) <= dropTol) continue;
+    std::vector<Eigen::Triplet<double>>& triplets = (lambda > 0) ? plusTriplets : minusTriplets;
+    size_t& col = (lambda > 0) ? nPlus : nMinus;
+    double scale = std::sqrt(std::abs(lambda));
+    for (size_t iS = 0; iS < S; iS++) {
+      triplets.emplace_back(support[iS], col, scale * eig.eigenvectors()(iS, k));
+    }
+    col++;
+  }
+  if (!updateIsCheaper(nPlus + nMinus)) return false;
+
+  // Apply the update, then the downdate (so the intermediate matrix remains positive definite)
+  cholmod_factor* L = internals.factorization;
+  auto applyUpdown = [&](bool update, std::vector<Eigen::Triplet<double>>& triplets, size_t rank) -> bool {
+    if (rank == 0) return true;
+    SparseMatrix<double> C(N, rank);
+    C.setFromTriplets(triplets.begin(), triplets.end());
+    cholmod_sparse* cC = toCholmod(C, internals.context, SType::UNSYMMETRIC);
+
+    // The factorization is of P A P^T, so the update must be permuted as well
+    cholmod_sparse* cCPerm =
+        cholmod_l_submatrix(cC, (SuiteSparse_long*)L->Perm, L->n, nullptr, -1, true, true, internals.context);
+    bool success = (bool)cholmod_l_updown(update, cCPerm, L, internals.context);
+    cholmod_l_free_sparse(&cCPerm, internals.context);
+    cholmod_l_free_sparse(&cC, internals.context);
+    return success && internals.context.context.status != CHOLMOD_NOT_POSDEF;
+  };
+  bool success = applyUpdown(true, plusTriplets, nPlus) && applyUpdown(false, minusTriplets, nMinus);
+
+  if (!success) {
+    // The factorization may be partially modified; the caller must refactor
+    internals.nUpdatesSinceFactor = maxUpdatesBetweenFactorizations;
+    return false;
+  }
+
+  internals.nUpdatesSinceFactor++;
+  return true;
+}
+
+template <typename T>
+bool lowRankUpdatePositiveDefinite(PSDSolverInternals<T>& internals, SparseMatrix<T>& delta) {
+  return false; // cholmod_updown only supports real factorizations
+}
+bool lowRankUpdatePositiveDefinite(PSDSolverInternals<double>& internals, SparseMatrix<double>& delta) {
+  return lowRankUpdateReal(internals, delta);
+}
+bool lowRankUpdatePositiveDefinite(PSDSolverInternals<float>& internals, SparseMatrix<float>& delta) {
+  SparseMatrix<double> deltaD = delta.cast<double>(); // Suitesparse always stores real values in double precision
+  return lowRankUpdateReal(internals, deltaD);
+}
+
+#endif
+
+// Solve with the single precision factorization, then iteratively refine the solution against the full precision
+// matrix. Returns false if refinement stalls before reaching the tolerance.
+template <typename T>
+bool solveMixedPrecision(PSDSolverInternals<T>& internals, Vector<T>& x, const Vector<T>& rhs, double tol,
+                         size_t maxIterations, size_t& nIterations) {
+  typedef typename PSDSolverInternals<T>::LowT LowT;
+
+  // Solve with the low precision factorization. The right hand side is normalized first, so that tiny residuals do not
+  // underflow in single precision.
+  auto lowPrecisionSolve = [&](const Vector<T>& b) -> Vector<T> {
+    double scale = b.norm();
+    if (scale == 0.) return Vector<T>(Vector<T>::Zero(b.rows()));
+    Vector<LowT> bLow = (b / scale).template cast<LowT>();
+    Vector<LowT> xLow;
+    if (internals.loadedLowPrecisionFactor) {
+      internals.loadedLowPrecisionFactor->solve(xLow, bLow);
+    } else {
+      xLow = internals.lowPrecisionSolver->solve(bLow);
+    }
+    return Vector<T>(scale * xLow.template cast<T>());
+  };
+
+  nIterations = 0;
+  double rhsNorm = rhs.norm();
+  x = lowPrecisionSolve(rhs);
+  if (rhsNorm == 0.) return true;
+  Vector<T> r = rhs - internals.mat * x;
+  double relResidual = r.norm() / rhsNorm;
+
+  while (relResidual > tol) {
+    if (nIterations >= maxIterations) return false;
+
+    x += lowPrecisionSolve(r);
+    r = rhs - internals.mat * x;
+    nIterations++;
+
+    // Each step should reduce the residual by a constant factor; if it does not, refinement has stalled (this is
+    // also false for NaN residuals)
+    double newRelResidual = r.norm() / rhsNorm;
+    if (!(newRelResidual < 0.5 * relResidual)) return false;
+    relResidual = newRelResidual;
+  }
+
+  return true;
+}
+
+// Extract the factorization held by an Eigen solver
+template <typename S>
+ExplicitLDLT<S> explicitFactor(const Eigen::SimplicialLDLT<SparseMatrix<S>>& solver) {
+  ExplicitLDLT<S> factor;
+  factor.L = solver.matrixL().nestedExpression();
+  factor.D = solver.vectorD();
+  size_t N = factor.D.size();
+  factor.order.resize(N);
+  for (size_t i = 0; i < N; i++) {
+    size_t iPerm = solver.permutationP().size() == 0 ? i : solver.permutationP().indices()[i];
+    factor.order[iPerm] = i;
+  }
+  return factor;
+}
+
+#ifdef GC_HAVE_SUITESPARSE
+// Extract the factorization held by Cholmod
+template <typename T>
+ExplicitLDLT<T> explicitFactor(cholmod_factor* factorization, CholmodContext& context) {
+  typedef typename SOLVER_ENTRYTYPE<T>::type EntryT;
+
+  // Convert a copy of the factor to a simplicial LDL^T one, then to a sparse matrix holding D on the diagonal
+  cholmod_factor* factorCopy = cholmod_l_copy_factor(factorization, context);
+  cholmod_l_change_factor(factorCopy->xtype, false, false, true, true, factorCopy, context);
+  cholmod_sparse* cL = cholmod_l_factor_to_sparse(factorCopy, context);
+  if (cL == nullptr) {
+    cholmod_l_free_factor(&factorCopy, context);
+    throw std::runtime_error("failed to extract the Cholmod factorization");
+  }
+
+  ExplicitLDLT<T> factor;
+  size_t N = cL->nrow;
+  factor.D = Vector<T>::Zero(N);
+  factor.order.resize(N);
+  SuiteSparse_long* Lp = (SuiteSparse_long*)cL->p;
+  SuiteSparse_long* Li = (SuiteSparse_long*)cL->i;
+  EntryT* Lx = (EntryT*)cL->x;
+  std::vector<Eigen::Triplet<T>> triplets;
+  for (size_t j = 0; j < N; j++) {
+    factor.order[j] = ((SuiteSparse_long*)factorization->Perm)[j];
+    for (SuiteSparse_long p = Lp[j]; p < Lp[j + 1]; p++) {
+      size_t i = Li[p];
+      if (i == j) {
+        factor.D[j] = static_cast<T>(Lx[p]);
+      } else if (i > j) {
+        triplets.emplace_back(i, j, static_cast<T>(Lx[p]));
+      }
+    }
+  }
+  factor.L = SparseMatrix<T>(N, N);
+  factor.L.setFromTriplets(triplets.begin(), triplets.end());
+
+  cholmod_l_free_sparse(&cL, context);
+  cholmod_l_free_factor(&factorCopy, context);
+  return factor;
+}
+#endif
+
+template <typename S>
+void writeExplicitFactor(std::ostream& out, const ExplicitLDLT<S>& factor) {
+  writeIndexVector(out, factor.order);
+  writeSparseMatrix(out, factor.L);
+  writeVector(out, factor.D);
+}
+
+template <typename S>
+std::unique_ptr<ExplicitLDLT<S>> readExplicitFactor(std::istream& in, size_t N) {
+  std::unique_ptr<ExplicitLDLT<S>> factor(new ExplicitLDLT<S>());
+  factor->order = readIndexVector(in);
+  factor->L = readSparseMatrix<S>(in);
+  factor->D = readVector<S>(in);
+  bool valid = factor->order.size() == N && (size_t)factor->L.rows() == N && (size_t)factor->L.cols() == N &&
+               (size_t)factor->D.size() == N;
+  for (int64_t i : factor->order) {
+    valid = valid && i >= 0 && (size_t)i < N;
+  }
+  if (!valid) {
+    throw std::runtime_error("corrupt factorization file");
+  }
+  return factor;
+}
+
+} // namespace
+
 template <typename T>
 PositiveDefiniteSolver<T>::~PositiveDefiniteSolver() {
 #ifdef GC_HAVE_SUITESPARSE
@@ -37,7 +486,8 @@ PositiveDefiniteSolver<T>::~PositiveDefiniteSolver() {
 }
 
 template <typename T>
-PositiveDefiniteSolver<T>::PositiveDefiniteSolver(SparseMatrix<T>& mat)
+PositiveDefiniteSolver<T>::PositiveDefiniteSolver(SparseMatrix<T>& mat, FactorPrecision precision,
+                                                  FactorStructure structure)
     : LinearSolver<T>(mat), internals(new PSDSolverInternals<T>()) {
 
 
@@ -45,84 +495,155 @@ PositiveDefiniteSolver<T>::PositiveDefiniteSolver(SparseMatrix<T>& mat)
   if (this->nRows != this->nCols) {
     throw std::logic_error("Matrix must be square");
   }
-  size_t N = this->nRows;
 #ifndef GC_NLINALG_DEBUG
   checkFinite(mat);
   checkHermitian(mat);
 #endif
 
   mat.makeCompressed();
+  internals->mat = mat;
 
-  // Suitesparse version
-#ifdef GC_HAVE_SUITESPARSE
+  // (for float matrices, the full precision is already single precision)
+  typedef typename PSDSolverInternals<T>::LowT LowT;
+  internals->mixedPrecision = (precision == FactorPrecision::Mixed) && !std::is_same<T, LowT>::value;
+  internals->structure = structure;
 
-  // Convert suitesparse format
-  if (internals->cMat != nullptr) {
-    cholmod_l_free_sparse(&internals->cMat, internals->context);
-  }
-  internals->cMat = toCholmod(mat, internals->context, SType::SYMMETRIC);
+  factorPositiveDefinite(*internals);
+};
 
-  // Factor
-  internals->context.setSimplicial(); // must use simplicial for LDLt
-  internals->context.setLDL();        // ensure we get an LDLt internals->factorization
-  internals->factorization = cholmod_l_analyze(internals->cMat, internals->context);
-  bool success = (bool)cholmod_l_factorize(internals->cMat, internals->factorization, internals->context);
+template <typename T>
+PositiveDefiniteSolver<T>::PositiveDefiniteSolver(size_t nRows, size_t nCols)
+    : LinearSolver<T>(nRows, nCols), internals(new PSDSolverInternals<T>()) {}
 
-  if(!success) {
-    throw std::runtime_error("failure in cholmod_l_factorize");
+template <typename T>
+Vector<T> PositiveDefiniteSolver<T>::solve(const Vector<T>& rhs) {
+  Vector<T> out;
+  solve(out, rhs);
+  return out;
+}
+
+template <typename T>
+void PositiveDefiniteSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
+
+  size_t N = this->nRows;
+
+  // Check some sanity
+  if ((size_t)rhs.rows() != N) {
+    throw std::logic_error("Vector is not the right length");
   }
-  if(internals->context.context.status == CHOLMOD_NOT_POSDEF) {
-    throw std::runtime_error("matrix is not positive definite");
+#ifndef GC_NLINALG_DEBUG
+  checkFinite(rhs);
+#endif
+
+  // Mixed precision version
+  if (internals->mixedPrecision) {
+    size_t nIterations = 0;
+    bool converged =
+        solveMixedPrecision(*internals, x, rhs, refinementTolerance, maxRefinementIterations, nIterations);
+    lastRefinementIterations = nIterations;
+    lastSolveUsedFullPrecision = !converged;
+    if (converged) return;
+
+    // Refinement stalled, so the single precision factorization is not accurate enough for this right hand side. Solve
+    // it again in full precision, factoring the matrix in full precision if no other solve has done so yet. The
+    // symbolic analysis of the single precision factorization does not carry over.
+    if (!internals->haveFullPrecisionFallback) {
+      std::lock_guard<std::mutex> lock(internals->precisionFallbackMutex);
+      if (!internals->haveFullPrecisionFallback) {
+        internals->symbolicAnalysisValid = false;
+        factorFullPrecision(*internals);
+        internals->haveFullPrecisionFallback = true;
+      }
+    }
+  } else {
+    lastRefinementIterations = 0;
+    lastSolveUsedFullPrecision = false;
   }
 
-  
+  // Loaded version
+  if (internals->loadedFactor) {
+    internals->loadedFactor->solve(x, rhs);
+    return;
+  }
+
+  // Suitesparse version
+#ifdef GC_HAVE_SUITESPARSE
+
+  // The factorization is only read, and everything else lives in this thread's workspace
+  CholmodSolveWorkspace& workspace = threadSolveWorkspace();
+
+  // Convert input to suitesparse format
+  cholmod_dense* inVec = toCholmod(rhs, workspace.context);
+
+  // Solve
+  cholmod_dense* outVec = nullptr;
+  cholmod_l_solve2(CHOLMOD_A, internals->factorization, inVec, nullptr, &outVec, nullptr, &workspace.Y, &workspace.E,
+                   workspace.context);
+
+  // Convert back
+  toEigen(outVec, workspace.context, x);
+
+  // Free
+  cholmod_l_free_dense(&outVec, workspace.context);
+  cholmod_l_free_dense(&inVec, workspace.context);
 
   // Eigen version
 #else
-  internals->solver.compute(mat);
+  // Solve
+  x = internals->solver.solve(rhs);
   if (internals->solver.info() != Eigen::Success) {
-    std::cerr << "Solver internals->factorization error: " << internals->solver.info() << std::endl;
-    throw std::invalid_argument("Solver internals->factorization failed");
+    std::cerr << "Solver error: " << internals->solver.info() << std::endl;
+    throw std::invalid_argument("Solve failed");
   }
 #endif
-};
-
-template <typename T>
-Vector<T> PositiveDefiniteSolver<T>::solve(const Vector<T>& rhs) {
-  Vector<T> out;
-  solve(out, rhs);
-  return out;
 }
 
 template <typename T>
-void PositiveDefiniteSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
+void PositiveDefiniteSolver<T>::solve(DenseMatrix<T>& x, const DenseMatrix<T>& rhs) {
 
   size_t N = this->nRows;
+  size_t K = rhs.cols();
 
   // Check some sanity
   if ((size_t)rhs.rows() != N) {
-    throw std::logic_error("Vector is not the right length");
+    throw std::logic_error("Matrix is not the right size");
   }
 #ifndef GC_NLINALG_DEBUG
   checkFinite(rhs);
 #endif
 
+  // Mixed precision and loaded factorizations solve one column at a time
+  if (internals->mixedPrecision || internals->loadedFactor) {
+    x.resize(N, K);
+    Vector<T> xCol;
+    for (size_t j = 0; j < K; j++) {
+      solve(xCol, rhs.col(j));
+      x.col(j) = xCol;
+    }
+    return;
+  }
+  lastRefinementIterations = 0;
+  lastSolveUsedFullPrecision = false;
 
   // Suitesparse version
 #ifdef GC_HAVE_SUITESPARSE
 
+  CholmodSolveWorkspace& workspace = threadSolveWorkspace();
+
   // Convert input to suitesparse format
-  cholmod_dense* inVec = toCholmod(rhs, internals->context);
+  cholmod_dense* inMat = toCholmod(rhs, workspace.context);
 
   // Solve
-  cholmod_dense* outVec = cholmod_l_solve(CHOLMOD_A, internals->factorization, inVec, internals->context);
+  cholmod_dense* outMat = nullptr;
+  cholmod_l_solve2(CHOLMOD_A, internals->factorization, inMat, nullptr, &outMat, nullptr, &workspace.Y, &workspace.E,
+                   workspace.context);
 
   // Convert back
-  toEigen(outVec, internals->context, x);
+  toEigen(outMat, workspace.context, x);
 
   // Free
-  cholmod_l_free_dense(&outVec, internals->context);
-  cholmod_l_free_dense(&inVec, internals->context);
+  cholmod_l_free_dense(&outMat, workspace.context);
+  cholmod_l_free_dense(&inMat, workspace.context);
 
   // Eigen version
 #else
@@ -135,6 +656,162 @@ void PositiveDefiniteSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
 #endif
 }
 
+template <typename T>
+bool PositiveDefiniteSolver<T>::updateFactorization(SparseMatrix<T>& delta) {
+
+  // Check some sanity
+  if ((size_t)delta.rows() != this->nRows || (size_t)delta.cols() != this->nCols) {
+    throw std::logic_error("Matrix update is not the right size");
+  }
+#ifndef GC_NLINALG_DEBUG
+  checkFinite(delta);
+  checkHermitian(delta);
+#endif
+
+  delta.makeCompressed();
+  bool samePattern = patternContains(internals->mat, delta);
+
+  // Try a low-rank update of the existing factor
+  bool updated = false;
+#ifdef GC_HAVE_SUITESPARSE
+  if (!internals->mixedPrecision && internals->factorization != nullptr && !internals->factorization->is_super) {
+    updated = lowRankUpdatePositiveDefinite(*internals, delta);
+  }
+#endif
+
+  // Update the stored matrix, keeping the pattern (and thus the symbolic analysis) whenever possible
+  if (samePattern) {
+    for (int j = 0; j < delta.outerSize(); j++) {
+      for (typename SparseMatrix<T>::InnerIterator it(delta, j); it; ++it) {
+        internals->mat.coeffRef(it.row(), it.col()) += it.value();
+      }
+    }
+  } else {
+    internals->mat += delta;
+    internals->mat.makeCompressed();
+    internals->symbolicAnalysisValid = false;
+  }
+
+  if (!updated) {
+    factorPositiveDefinite(*internals);
+  }
+
+  return updated;
+}
+
+template <typename T>
+bool PositiveDefiniteSolver<T>::usesMixedPrecision() {
+  return internals->mixedPrecision;
+}
+
+template <typename T>
+FactorStructure PositiveDefiniteSolver<T>::factorStructure() {
+#ifdef GC_HAVE_SUITESPARSE
+  if (!internals->mixedPrecision && !internals->loadedFactor && internals->factorization != nullptr &&
+      internals->factorization->is_super) {
+    return FactorStructure::Supernodal;
+  }
+#endif
+  return FactorStructure::Simplicial;
+}
+
+template <typename T>
+size_t PositiveDefiniteSolver<T>::memoryUsage() {
+  typedef typename PSDSolverInternals<T>::LowT LowT;
+  size_t bytes = internals->mat.nonZeros() * (sizeof(T) + sizeof(int));
+  if (internals->loadedFactor) {
+    return bytes + internals->loadedFactor->memoryUsage();
+  }
+  if (internals->mixedPrecision) {
+    if (internals->loadedLowPrecisionFactor) {
+      bytes += internals->loadedLowPrecisionFactor->memoryUsage();
+    } else {
+      size_t nnzL = internals->lowPrecisionSolver->matrixL().nestedExpression().nonZeros();
+      bytes += nnzL * (sizeof(LowT) + sizeof(int));
+    }
+    if (!internals->haveFullPrecisionFallback) return bytes;
+  }
+#ifdef GC_HAVE_SUITESPARSE
+  cholmod_factor* factor = internals->factorization;
+  if (factor->is_super) {
+    bytes += factor->xsize * sizeof(typename SOLVER_ENTRYTYPE<T>::type) + factor->ssize * sizeof(SuiteSparse_long);
+  } else {
+    bytes += factor->nzmax * (sizeof(typename SOLVER_ENTRYTYPE<T>::type) + sizeof(SuiteSparse_long));
+  }
+#else
+  bytes += internals->solver.matrixL().nestedExpression().nonZeros() * (sizeof(T) + sizeof(int));
+#endif
+  return bytes;
+}
+
+template <typename T>
+void PositiveDefiniteSolver<T>::save(std::string filename) {
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("could not open file " + filename + " for writing");
+  }
+  save(out);
+}
+
+template <typename T>
+void PositiveDefiniteSolver<T>::save(std::ostream& out) {
+  writeFactorizationHeader<T>(out, FactorizationKind::LDLT, this->nRows, this->nCols);
+  writeFlag(out, internals->mixedPrecision);
+  writeSparseMatrix(out, internals->mat);
+
+  // Mixed precision version
+  if (internals->mixedPrecision) {
+    if (internals->loadedLowPrecisionFactor) {
+      writeExplicitFactor(out, *internals->loadedLowPrecisionFactor);
+    } else {
+      writeExplicitFactor(out, explicitFactor(*internals->lowPrecisionSolver));
+    }
+    return;
+  }
+
+  if (internals->loadedFactor) {
+    writeExplicitFactor(out, *internals->loadedFactor);
+    return;
+  }
+#ifdef GC_HAVE_SUITESPARSE
+  writeExplicitFactor(out, explicitFactor<T>(internals->factorization, internals->context));
+#else
+  writeExplicitFactor(out, explicitFactor(internals->solver));
+#endif
+}
+
+template <typename T>
+std::unique_ptr<PositiveDefiniteSolver<T>> PositiveDefiniteSolver<T>::load(std::string filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("could not open file " + filename + " for reading");
+  }
+  return load(in);
+}
+
+template <typename T>
+std::unique_ptr<PositiveDefiniteSolver<T>> PositiveDefiniteSolver<T>::load(std::istream& in) {
+  typedef typename PSDSolverInternals<T>::LowT LowT;
+
+  size_t nRows, nCols;
+  readFactorizationHeader<T>(in, FactorizationKind::LDLT, nRows, nCols);
+  std::unique_ptr<PositiveDefiniteSolver<T>> solver(new PositiveDefiniteSolver<T>(nRows, nCols));
+  PSDSolverInternals<T>& internals = *solver->internals;
+
+  internals.mixedPrecision = readFlag(in) != 0;
+  internals.mat = readSparseMatrix<T>(in);
+  if ((size_t)internals.mat.rows() != nRows || (size_t)internals.mat.cols() != nCols) {
+    throw std::runtime_error("corrupt factorization file");
+  }
+  if (internals.mixedPrecision) {
+    internals.loadedLowPrecisionFactor = readExplicitFactor<LowT>(in, nRows);
+  } else {
+    internals.loadedFactor = readExplicitFactor<T>(in, nRows);
+  }
+
+  return solver;
+}
+
 template <typename T>
 Vector<T> solvePositiveDefinite(SparseMatrix<T>& A, const Vector<T>& rhs) {
   PositiveDefiniteSolver<T> s(A);
@@ -1,5 +1,6 @@
 #include "geometrycentral/numerical/linear_solvers.h"
 
+#include "geometrycentral/numerical/factorization_io.h"
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 
 #ifdef GC_HAVE_SUITESPARSE
@@ -8,13 +9,54 @@
 #include <cholmod.h>
 #endif
 
+#include <fstream>
 
 using namespace Eigen;
 
 namespace geometrycentral {
 
+// The triangular factor of M P = Q R, held explicitly along with M, where M is the matrix for overdetermined systems
+// and its adjoint for underdetermined ones. The orthogonal factor Q is not stored; instead, solves use the normal
+// equations (M P)^H (M P) = R^H R. This is the form in which factorizations are saved, and loaded solvers solve with it
+// directly.
+template <typename T>
+struct ExplicitQR {
+  SparseMatrix<T> M;
+  SparseMatrix<T> R;             // square upper triangular, with sorted columns
+  std::vector<int64_t> colOrder; // column j of M P is column colOrder[j] of M
+
+  // x = (M^H M)^-1 g
+  Vector<T> normalSolve(const Vector<T>& g) const {
+    size_t N = colOrder.size();
+    Vector<T> y(N);
+    for (size_t j = 0; j < N; j++) y[j] = g[colOrder[j]];
+    R.adjoint().template triangularView<Eigen::Lower>().solveInPlace(y);
+    R.template triangularView<Eigen::Upper>().solveInPlace(y);
+    Vector<T> x(N);
+    for (size_t j = 0; j < N; j++) x[colOrder[j]] = y[j];
+    return x;
+  }
+
+  // Least squares solution for overdetermined systems, minimum norm solution for underdetermined ones. The normal
+  // equations square the condition number, so one step of refinement is applied (the "corrected semi-normal
+  // equations").
+  void solve(Vector<T>& x, const Vector<T>& rhs, bool underdetermined) const {
+    if (underdetermined) {
+      x = M * normalSolve(rhs);
+      Vector<T> r = rhs - M.adjoint() * x;
+      x += M * normalSolve(r);
+    } else {
+      x = normalSolve(M.adjoint() * rhs);
+      Vector<T> r = rhs - M * x;
+      x += normalSolve(M.adjoint() * r);
+    }
+  }
+};
+
 template <typename T>
 struct QRSolverInternals {
+  std::unique_ptr<ExplicitQR<T>> loadedFactor; // a factorization loaded from a file, used in place of the one below
+
   // Implementation-specific quantities
 #ifdef GC_HAVE_SUITESPARSE
   CholmodContext context;
@@ -24,9 +66,19 @@ struct QRSolverInternals {
   double zero_tolerance = -2; // (use default)
 #else
   Eigen::SparseQR<SparseMatrix<T>, Eigen::COLAMDOrdering<int>> solver;
+  SparseMatrix<T> mat; // (retained so that the factorization can be saved)
 #endif
 };
 
+#ifdef GC_HAVE_SUITESPARSE
+namespace {
+CholmodContext& threadSolveContext() {
+  static thread_local CholmodContext context;
+  return context;
+}
+} // namespace
+#endif
+
 template <typename T>
 Solver<T>::~Solver() {
 #ifdef GC_HAVE_SUITESPARSE
@@ -117,6 +169,7 @@ Solver<T>::Solver(SparseMatrix<T>& mat) : LinearSolver<T>(mat), internals(new QR
     throw std::logic_error("Eigen's sparse QR solver doesn't like underdetermined systems");
   }
 
+  internals->mat = mat;
   internals->solver.setPivotThreshold(0.);
   internals->solver.compute(mat);
   if (internals->solver.info() != Eigen::Success) {
@@ -126,6 +179,10 @@ Solver<T>::Solver(SparseMatrix<T>& mat) : LinearSolver<T>(mat), internals(new QR
 #endif
 };
 
+template <typename T>
+Solver<T>::Solver(size_t nRows, size_t nCols)
+    : LinearSolver<T>(nRows, nCols), underdetermined(nRows < nCols), internals(new QRSolverInternals<T>()) {}
+
 template <typename T>
 Vector<T> Solver<T>::solve(const Vector<T>& rhs) {
   Vector<T> out;
@@ -144,11 +201,21 @@ void Solver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
   checkFinite(rhs);
 #endif
 
+  // Loaded version
+  if (internals->loadedFactor) {
+    internals->loadedFactor->solve(x, rhs, underdetermined);
+    return;
+  }
+
 // Suitesparse version
 #ifdef GC_HAVE_SUITESPARSE
 
+  // The factorization is only read, and everything else uses this thread's context, so that several threads can solve
+  // at once
+  CholmodContext& context = threadSolveContext();
+
   // Convert input to suitesparse format
-  cholmod_dense* inVec = toCholmod(rhs, internals->context);
+  cholmod_dense* inVec = toCholmod(rhs, context);
   cholmod_dense* outVec;
 
   // Solve
@@ -158,33 +225,32 @@ void Solver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
 
     // solve y = R^-T b
     cholmod_dense* y = SuiteSparseQR_solve<typename SOLVER_ENTRYTYPE<T>::type>(
-        SPQR_RTX_EQUALS_B, internals->factorization, inVec, internals->context);
+        SPQR_RTX_EQUALS_B, internals->factorization, inVec, context);
 
     // compute x = Q*y
-    outVec = SuiteSparseQR_qmult<typename SOLVER_ENTRYTYPE<T>::type>(SPQR_QX, internals->factorization, y,
-                                                                     internals->context);
-    cholmod_l_free_dense(&y, internals->context);
+    outVec = SuiteSparseQR_qmult<typename SOLVER_ENTRYTYPE<T>::type>(SPQR_QX, internals->factorization, y, context);
+    cholmod_l_free_dense(&y, context);
 
   } else {
 
     // compute y = Q^T b
     cholmod_dense* y = SuiteSparseQR_qmult<typename SOLVER_ENTRYTYPE<T>::type>(SPQR_QTX, internals->factorization,
-                                                                               inVec, internals->context);
+                                                                               inVec, context);
 
     // solve x = R^-1 y
     // TODO what is this E doing here?
     outVec = SuiteSparseQR_solve<typename SOLVER_ENTRYTYPE<T>::type>(SPQR_RETX_EQUALS_B, internals->factorization, y,
-                                                                     internals->context);
+                                                                     context);
 
-    cholmod_l_free_dense(&y, internals->context);
+    cholmod_l_free_dense(&y, context);
   }
 
   // Convert back
-  toEigen(outVec, internals->context, x);
+  toEigen(outVec, context, x);
 
   // Free
-  cholmod_l_free_dense(&outVec, internals->context);
-  cholmod_l_free_dense(&inVec, internals->context);
+  cholmod_l_free_dense(&outVec, context);
+  cholmod_l_free_dense(&inVec, context);
 
 // Eigen version
 #else
@@ -207,6 +273,9 @@ Vector<T> solve(SparseMatrix<T>& A, const Vector<T>& rhs) {
 
 template <typename T>
 size_t Solver<T>::rank() {
+  if (internals->loadedFactor) {
+    return internals->loadedFactor->R.rows(); // (only full rank factorizations are saved)
+  }
 #ifdef GC_HAVE_SUITESPARSE
   return internals->factorization->rank;
 #else
@@ -214,6 +283,129 @@ size_t Solver<T>::rank() {
 #endif
 }
 
+namespace {
+
+#ifdef GC_HAVE_SUITESPARSE
+// Copy a Cholmod sparse matrix
+template <typename T>
+SparseMatrix<T> sparseFromCholmod(cholmod_sparse* cMat) {
+  typedef typename SOLVER_ENTRYTYPE<T>::type EntryT;
+  SuiteSparse_long* p = (SuiteSparse_long*)cMat->p;
+  SuiteSparse_long* i = (SuiteSparse_long*)cMat->i;
+  EntryT* x = (EntryT*)cMat->x;
+  std::vector<Eigen::Triplet<T>> triplets;
+  for (size_t j = 0; j < cMat->ncol; j++) {
+    SuiteSparse_long end = cMat->packed ? p[j + 1] : p[j] + ((SuiteSparse_long*)cMat->nz)[j];
+    for (SuiteSparse_long k = p[j]; k < end; k++) {
+      triplets.emplace_back(i[k], j, static_cast<T>(x[k]));
+    }
+  }
+  SparseMatrix<T> mat(cMat->nrow, cMat->ncol);
+  mat.setFromTriplets(triplets.begin(), triplets.end());
+  return mat;
+}
+#endif
+
+} // namespace
+
+template <typename T>
+void Solver<T>::save(std::string filename) {
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("could not open file " + filename + " for writing");
+  }
+  save(out);
+}
+
+template <typename T>
+void Solver<T>::save(std::ostream& out) {
+
+  // Get the explicit factorization
+  ExplicitQR<T> factor;
+  if (internals->loadedFactor) {
+    factor = *internals->loadedFactor;
+  } else {
+    size_t N = underdetermined ? this->nRows : this->nCols;
+    if (rank() < N) {
+      throw std::logic_error("only full rank QR factorizations can be saved");
+    }
+
+#ifdef GC_HAVE_SUITESPARSE
+    // The triangular factor cannot be read back out of the factorization object, so it is computed again, without Q
+    typedef typename SOLVER_ENTRYTYPE<T>::type EntryT;
+    cholmod_sparse* cM = underdetermined ? internals->cMatTrans : internals->cMat;
+    cholmod_sparse* cR = nullptr;
+    SuiteSparse_long* E = nullptr;
+    const int ordering = 7;
+    SuiteSparse_long rank =
+        SuiteSparseQR<EntryT>(ordering, internals->zero_tolerance, 0, cM, &cR, &E, internals->context);
+    if (cR == nullptr || (size_t)rank < N) {
+      if (cR != nullptr) cholmod_l_free_sparse(&cR, internals->context);
+      if (E != nullptr) cholmod_l_free(N, sizeof(SuiteSparse_long), E, internals->context);
+      throw std::runtime_error("failed to compute triangular factor to save");
+    }
+    factor.M = sparseFromCholmod<T>(cM);
+    factor.R = sparseFromCholmod<T>(cR).topLeftCorner(N, N);
+    factor.colOrder.resize(N);
+    for (size_t j = 0; j < N; j++) {
+      factor.colOrder[j] = (E == nullptr) ? j : E[j];
+    }
+    cholmod_l_free_sparse(&cR, internals->context);
+    if (E != nullptr) cholmod_l_free(N, sizeof(SuiteSparse_long), E, internals->context);
+#else
+    // (sorting the columns of R, by way of a row-major copy)
+    Eigen::SparseMatrix<T, Eigen::RowMajor> rowMajorR = internals->solver.matrixR().topLeftCorner(N, N);
+    factor.M = internals->mat;
+    factor.R = rowMajorR;
+    const PermutationMatrix<Dynamic, Dynamic, int>& perm = internals->solver.colsPermutation();
+    factor.colOrder.resize(N);
+    for (size_t j = 0; j < N; j++) {
+      factor.colOrder[j] = (perm.size() == 0) ? j : perm.indices()[j];
+    }
+#endif
+  }
+
+  writeFactorizationHeader<T>(out, FactorizationKind::QR, this->nRows, this->nCols);
+  writeSparseMatrix(out, factor.M);
+  writeSparseMatrix(out, factor.R);
+  writeIndexVector(out, factor.colOrder);
+}
+
+template <typename T>
+std::unique_ptr<Solver<T>> Solver<T>::load(std::string filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("could not open file " + filename + " for reading");
+  }
+  return load(in);
+}
+
+template <typename T>
+std::unique_ptr<Solver<T>> Solver<T>::load(std::istream& in) {
+  size_t nRows, nCols;
+  readFactorizationHeader<T>(in, FactorizationKind::QR, nRows, nCols);
+  std::unique_ptr<Solver<T>> solver(new Solver<T>(nRows, nCols));
+
+  std::unique_ptr<ExplicitQR<T>> factor(new ExplicitQR<T>());
+  factor->M = readSparseMatrix<T>(in);
+  factor->R = readSparseMatrix<T>(in);
+  factor->colOrder = readIndexVector(in);
+
+  size_t mRows = solver->underdetermined ? nCols : nRows;
+  size_t N = solver->underdetermined ? nRows : nCols;
+  bool valid = (size_t)factor->M.rows() == mRows && (size_t)factor->M.cols() == N && (size_t)factor->R.rows() == N &&
+               (size_t)factor->R.cols() == N && factor->colOrder.size() == N;
+  for (int64_t j : factor->colOrder) {
+    valid = valid && j >= 0 && (size_t)j < N;
+  }
+  if (!valid) {
+    throw std::runtime_error("corrupt factorization file");
+  }
+
+  solver->internals->loadedFactor = std::move(factor);
+  return solver;
+}
+
 // Explicit instantiations
 template class Solver<double>;
 template class Solver<float>;
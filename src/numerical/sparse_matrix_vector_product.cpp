@@ -0,0 +1,310 @@
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
+
+#include "geometrycentral/utilities/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace geometrycentral {
+
+namespace {
+
+std::atomic<size_t> spmvThreadCount{0};
+
+// Below this many nonzeros per thread, the cost of starting threads outweighs the parallel speedup
+const size_t minNonZerosPerThread = 1 << 16;
+
+size_t threadsForProduct(size_t nNonZeros) {
+  size_t nThreads = getSpMVThreadCount();
+  return std::max<size_t>(1, std::min(nThreads, nNonZeros / minNonZerosPerThread));
+}
+
+// Split [0, nItems) into nChunks ranges of roughly equal work, given the cumulative work before each item (with
+// nItems + 1 entries). Returns nChunks + 1 boundaries.
+template <typename I>
+std::vector<size_t> balancedChunks(const I* cumulativeWork, size_t nItems, size_t nChunks) {
+  std::vector<size_t> bounds(nChunks + 1);
+  bounds[0] = 0;
+  bounds[nChunks] = nItems;
+  double totalWork = static_cast<double>(cumulativeWork[nItems]);
+  for (size_t iChunk = 1; iChunk < nChunks; iChunk++) {
+    I target = static_cast<I>(totalWork * iChunk / nChunks);
+    size_t ind = std::lower_bound(cumulativeWork, cumulativeWork + nItems + 1, target) - cumulativeWork;
+    bounds[iChunk] = std::max(bounds[iChunk - 1], std::min(ind, nItems));
+  }
+  return bounds;
+}
+
+// acc += a * b. Written out for complex numbers, since the standard operator includes checks for infinities which
+// prevent the loops below from vectorizing.
+template <typename T>
+inline void multiplyAdd(T& acc, const T& a, const T& b) {
+  acc += a * b;
+}
+template <>
+inline void multiplyAdd(std::complex<double>& acc, const std::complex<double>& a, const std::complex<double>& b) {
+  acc = std::complex<double>(acc.real() + a.real() * b.real() - a.imag() * b.imag(),
+                             acc.imag() + a.real() * b.imag() + a.imag() * b.real());
+}
+
+// Products for a range of rows of a CSR matrix
+template <typename T>
+void csrRows(const Eigen::SparseMatrix<T, Eigen::RowMajor>& A, const T* x, T* y, size_t rowStart, size_t rowEnd) {
+  const int* rowPtr = A.outerIndexPtr();
+  const int* cols = A.innerIndexPtr();
+  const T* vals = A.valuePtr();
+  for (size_t i = rowStart; i < rowEnd; i++) {
+    T acc = 0;
+    for (int k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+      multiplyAdd(acc, vals[k], x[cols[k]]);
+    }
+    y[i] = acc;
+  }
+}
+
+// Products for the rows of a SELL slice. Up to the length of the slice's shortest row every lane holds an entry, and the
+// inner loop over the C rows is independent across rows and vectorizes (with gathers from x). Past that, lanes are
+// masked by row length, so padding is never read.
+template <typename T, size_t C>
+struct SellSliceKernel {
+  static void apply(const T* vals, const int* cols, const int* lengths, size_t fullWidth, size_t width, const T* x,
+                    T* acc) {
+    for (size_t r = 0; r < C; r++) acc[r] = 0;
+    for (size_t k = 0; k < fullWidth; k++) {
+      const T* v = vals + k * C;
+      const int* c = cols + k * C;
+      for (size_t r = 0; r < C; r++) {
+        acc[r] += v[r] * x[c[r]];
+      }
+    }
+    for (size_t k = fullWidth; k < width; k++) {
+      for (size_t r = 0; r < C; r++) {
+        if (static_cast<int>(k) < lengths[r]) {
+          acc[r] += vals[k * C + r] * x[cols[k * C + r]];
+        }
+      }
+    }
+  }
+};
+
+// Complex slices accumulate real and imaginary parts in separate lanes
+template <size_t C>
+struct SellSliceKernel<std::complex<double>, C> {
+  static void apply(const std::complex<double>* vals, const int* cols, const int* lengths, size_t fullWidth,
+                    size_t width, const std::complex<double>* x, std::complex<double>* acc) {
+    double accRe[C], accIm[C];
+    for (size_t r = 0; r < C; r++) {
+      accRe[r] = 0.;
+      accIm[r] = 0.;
+    }
+    const double* v = reinterpret_cast<const double*>(vals);
+    const double* xd = reinterpret_cast<const double*>(x);
+    for (size_t k = 0; k < fullWidth; k++) {
+      const int* c = cols + k * C;
+      for (size_t r = 0; r < C; r++) {
+        double vRe = v[2 * (k * C + r)];
+        double vIm = v[2 * (k * C + r) + 1];
+        double xRe = xd[2 * c[r]];
+        double xIm = xd[2 * c[r] + 1];
+        accRe[r] += vRe * xRe - vIm * xIm;
+        accIm[r] += vRe * xIm + vIm * xRe;
+      }
+    }
+    for (size_t r = 0; r < C; r++) {
+      acc[r] = std::complex<double>(accRe[r], accIm[r]);
+    }
+    for (size_t k = fullWidth; k < width; k++) {
+      for (size_t r = 0; r < C; r++) {
+        if (static_cast<int>(k) < lengths[r]) {
+          multiplyAdd(acc[r], vals[k * C + r], x[cols[k * C + r]]);
+        }
+      }
+    }
+  }
+};
+
+} // namespace
+
+void setSpMVThreadCount(size_t nThreads) { spmvThreadCount = nThreads; }
+
+size_t getSpMVThreadCount() {
+  size_t nThreads = spmvThreadCount;
+  if (nThreads == 0) {
+    nThreads = hardwareThreadCount();
+  }
+  return nThreads;
+}
+
+template <typename T>
+const size_t PackedSparseMatrix<T>::SELL_C;
+template <typename T>
+const size_t PackedSparseMatrix<T>::SELL_SIGMA;
+
+template <typename T>
+PackedSparseMatrix<T>::PackedSparseMatrix() {}
+
+template <typename T>
+PackedSparseMatrix<T>::PackedSparseMatrix(const SparseMatrix<T>& mat, SpMVLayout layout)
+    : nRows(mat.rows()), nCols(mat.cols()), nNonZeros(mat.nonZeros()), storageLayout(layout) {
+
+  if (storageLayout == SpMVLayout::Auto) {
+    bool isComplex = Eigen::NumTraits<T>::IsComplex;
+    storageLayout = isComplex ? SpMVLayout::CSR : SpMVLayout::SELL;
+  }
+
+  // Build CSR, which is also the starting point for SELL
+  Eigen::SparseMatrix<T, Eigen::RowMajor> rowMajor = mat;
+  rowMajor.makeCompressed();
+
+  if (storageLayout == SpMVLayout::CSR) {
+    csr = std::move(rowMajor);
+    return;
+  }
+
+  // === SELL
+
+  const int* rowPtr = rowMajor.outerIndexPtr();
+  auto rowLength = [&](int i) { return rowPtr[i + 1] - rowPtr[i]; };
+
+  // Sort rows by decreasing length within each window, so that rows in a slice have similar lengths
+  sellRows.resize(nRows);
+  std::iota(sellRows.begin(), sellRows.end(), 0);
+  for (size_t windowStart = 0; windowStart < nRows; windowStart += SELL_SIGMA) {
+    size_t windowEnd = std::min(nRows, windowStart + SELL_SIGMA);
+    std::stable_sort(sellRows.begin() + windowStart, sellRows.begin() + windowEnd,
+                     [&](int a, int b) { return rowLength(a) > rowLength(b); });
+  }
+
+  // Lay out slices, padded to their longest row. Padding holds a sentinel column of -1, and is skipped using the row
+  // lengths.
+  size_t nSlices = (nRows + SELL_C - 1) / SELL_C;
+  sellLengths.assign(nSlices * SELL_C, 0);
+  for (size_t r = 0; r < nRows; r++) {
+    sellLengths[r] = rowLength(sellRows[r]);
+  }
+  sliceStart.resize(nSlices + 1);
+  sliceStart[0] = 0;
+  sliceFullWidth.resize(nSlices);
+  for (size_t s = 0; s < nSlices; s++) {
+    const int* lengths = &sellLengths[s * SELL_C];
+    int width = *std::max_element(lengths, lengths + SELL_C);
+    sliceFullWidth[s] = *std::min_element(lengths, lengths + SELL_C);
+    sliceStart[s + 1] = sliceStart[s] + width * SELL_C;
+  }
+
+  sellCols.assign(sliceStart[nSlices], -1);
+  sellValues.assign(sliceStart[nSlices], T(0));
+  for (size_t s = 0; s < nSlices; s++) {
+    for (size_t r = 0; r < SELL_C && s * SELL_C + r < nRows; r++) {
+      int row = sellRows[s * SELL_C + r];
+      for (int k = 0; k < rowLength(row); k++) {
+        size_t ind = sliceStart[s] + k * SELL_C + r;
+        sellCols[ind] = rowMajor.innerIndexPtr()[rowPtr[row] + k];
+        sellValues[ind] = rowMajor.valuePtr()[rowPtr[row] + k];
+      }
+    }
+  }
+}
+
+template <typename T>
+void PackedSparseMatrix<T>::multiply(Vector<T>& y, const Vector<T>& x) const {
+
+  // Check some sanity
+  if ((size_t)x.rows() != nCols) {
+    throw std::logic_error("Vector is not the right length");
+  }
+
+  y.resize(nRows);
+  const T* xPtr = x.data();
+  T* yPtr = y.data();
+  size_t nChunks = threadsForProduct(nNonZeros);
+
+  if (storageLayout == SpMVLayout::CSR) {
+    std::vector<size_t> bounds = balancedChunks(csr.outerIndexPtr(), nRows, nChunks);
+    parallelForChunks(nChunks, [&](size_t iChunk) { csrRows(csr, xPtr, yPtr, bounds[iChunk], bounds[iChunk + 1]); });
+    return;
+  }
+
+  size_t nSlices = sliceStart.size() - 1;
+  std::vector<size_t> bounds = balancedChunks(sliceStart.data(), nSlices, nChunks);
+  parallelForChunks(nChunks, [&](size_t iChunk) {
+    T acc[SELL_C];
+    for (size_t s = bounds[iChunk]; s < bounds[iChunk + 1]; s++) {
+      size_t width = (sliceStart[s + 1] - sliceStart[s]) / SELL_C;
+      SellSliceKernel<T, SELL_C>::apply(&sellValues[sliceStart[s]], &sellCols[sliceStart[s]], &sellLengths[s * SELL_C],
+                                        sliceFullWidth[s], width, xPtr, acc);
+      for (size_t r = 0; r < SELL_C && s * SELL_C + r < nRows; r++) {
+        yPtr[sellRows[s * SELL_C + r]] = acc[r];
+      }
+    }
+  });
+}
+
+template <typename T>
+Vector<T> PackedSparseMatrix<T>::operator*(const Vector<T>& x) const {
+  Vector<T> y;
+  multiply(y, x);
+  return y;
+}
+
+template <typename T>
+size_t PackedSparseMatrix<T>::memoryUsage() const {
+  if (storageLayout == SpMVLayout::CSR) {
+    return csr.nonZeros() * (sizeof(T) + sizeof(int)) + (csr.outerSize() + 1) * sizeof(int);
+  }
+  return sellValues.size() * (sizeof(T) + sizeof(int)) + sliceStart.size() * sizeof(size_t) +
+         sliceFullWidth.size() * sizeof(int) + (sellRows.size() + sellLengths.size()) * sizeof(int);
+}
+
+template <typename T>
+void sparseMatrixVectorProduct(const SparseMatrix<T>& A, const Vector<T>& x, Vector<T>& y) {
+
+  // Check some sanity
+  if (x.rows() != A.cols()) {
+    throw std::logic_error("Vector is not the right length");
+  }
+
+  size_t nChunks = A.isCompressed() ? threadsForProduct(A.nonZeros()) : 1;
+  if (nChunks == 1) {
+    y = A * x;
+    return;
+  }
+
+  // Each thread handles a range of columns, scattering into its own copy of the output, and the copies are summed
+  // afterwards
+  size_t N = A.rows();
+  std::vector<size_t> bounds = balancedChunks(A.outerIndexPtr(), A.cols(), nChunks);
+  std::vector<Vector<T>> partials(nChunks);
+  parallelForChunks(nChunks, [&](size_t iChunk) {
+    Vector<T>& partial = partials[iChunk];
+    partial = Vector<T>::Zero(N);
+    const int* colPtr = A.outerIndexPtr();
+    const int* rows = A.innerIndexPtr();
+    const T* vals = A.valuePtr();
+    for (size_t j = bounds[iChunk]; j < bounds[iChunk + 1]; j++) {
+      T xj = x[j];
+      for (int k = colPtr[j]; k < colPtr[j + 1]; k++) {
+        multiplyAdd(partial[rows[k]], vals[k], xj);
+      }
+    }
+  });
+
+  y = partials[0];
+  for (size_t iChunk = 1; iChunk < nChunks; iChunk++) {
+    y += partials[iChunk];
+  }
+}
+
+
+// Explicit instantiations
+template class PackedSparseMatrix<float>;
+template class PackedSparseMatrix<double>;
+template class PackedSparseMatrix<std::complex<double>>;
+
+template void sparseMatrixVectorProduct(const SparseMatrix<float>& A, const Vector<float>& x, Vector<float>& y);
+template void sparseMatrixVectorProduct(const SparseMatrix<double>& A, const Vector<double>& x, Vector<double>& y);
+template void sparseMatrixVectorProduct(const SparseMatrix<std::complex<double>>& A,
+                                        const Vector<std::complex<double>>& x, Vector<std::complex<double>>& y);
+
+} // namespace geometrycentral
@@ -1,5 +1,6 @@
 #include "geometrycentral/numerical/linear_solvers.h"
 
+#include "geometrycentral/numerical/factorization_io.h"
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 
 #ifdef GC_HAVE_SUITESPARSE
@@ -7,12 +8,47 @@
 #include <umfpack.h>
 #endif
 
+#include <fstream>
+
+// Eigen's SparseLU has no public accessor for its factors, so saving reads them from the matrixL() and matrixU()
+// expression objects. Their layout is the same in Eigen 3.2 through 3.4; with other versions (and without
+// Suitesparse), LU factorizations cannot be saved.
+#define GC_EIGEN_SPARSELU_FACTORS_READABLE (EIGEN_VERSION_AT_LEAST(3, 2, 0) && !EIGEN_VERSION_AT_LEAST(3, 4, 90))
+
 using namespace Eigen;
 
 namespace geometrycentral {
 
+// A factorization P R A Q = L U, held explicitly, where R is a diagonal row scaling. This is the form in which
+// factorizations are saved, and loaded solvers solve with it directly.
+template <typename T>
+struct ExplicitLU {
+  Vector<T> rowScale;            // diagonal of R
+  std::vector<int64_t> rowOrder; // row i of P R A Q is (scaled) row rowOrder[i] of A
+  std::vector<int64_t> colOrder; // column j of P R A Q is column colOrder[j] of A
+  SparseMatrix<T> L;             // unit lower triangular (the diagonal, if present, is ignored)
+  SparseMatrix<T> U;             // upper triangular
+
+  void solve(Vector<T>& x, const Vector<T>& rhs) const {
+    size_t N = rowOrder.size();
+    Vector<T> y(N);
+    for (size_t i = 0; i < N; i++) y[i] = rowScale[rowOrder[i]] * rhs[rowOrder[i]];
+    L.template triangularView<Eigen::UnitLower>().solveInPlace(y);
+    U.template triangularView<Eigen::Upper>().solveInPlace(y);
+    x.resize(N);
+    for (size_t j = 0; j < N; j++) x[colOrder[j]] = y[j];
+  }
+
+  size_t memoryUsage() const {
+    return (L.nonZeros() + U.nonZeros()) * (sizeof(T) + sizeof(int)) + rowScale.size() * sizeof(T) +
+           (rowOrder.size() + colOrder.size()) * sizeof(int64_t);
+  }
+};
+
 template <typename T>
 struct SquareSolverInternals {
+  std::unique_ptr<ExplicitLU<T>> loadedFactor; // a factorization loaded from a file, used in place of the one below
+
 #ifdef GC_HAVE_SUITESPARSE
   CholmodContext context;
   cholmod_sparse* cMat = nullptr;
@@ -110,6 +146,120 @@ void umfSolve<std::complex<double>>(size_t N, cholmod_sparse* mat, void* numeric
                    numericFac, NULL, NULL);
 }
 
+// = Size of the factorization
+template <typename T>
+size_t umfFactorNonzeros(void* numericFac);
+
+template <>
+size_t umfFactorNonzeros<double>(void* numericFac) {
+  SuiteSparse_long lnz, unz, nRow, nCol, nzUDiag;
+  umfpack_dl_get_lunz(&lnz, &unz, &nRow, &nCol, &nzUDiag, numericFac);
+  return lnz + unz;
+}
+template <>
+size_t umfFactorNonzeros<float>(void* numericFac) {
+  return umfFactorNonzeros<double>(numericFac);
+}
+template <>
+size_t umfFactorNonzeros<std::complex<double>>(void* numericFac) {
+  SuiteSparse_long lnz, unz, nRow, nCol, nzUDiag;
+  umfpack_zl_get_lunz(&lnz, &unz, &nRow, &nCol, &nzUDiag, numericFac);
+  return lnz + unz;
+}
+
+// = Extracting the factorization
+template <typename T>
+ExplicitLU<T> umfExplicitFactor(size_t N, void* numericFac) {
+  typedef typename SOLVER_ENTRYTYPE<T>::type EntryT;
+  const bool isComplex = std::is_same<EntryT, std::complex<double>>::value;
+
+  SuiteSparse_long lnz, unz, nRow, nCol, nzUDiag;
+  if (isComplex) {
+    umfpack_zl_get_lunz(&lnz, &unz, &nRow, &nCol, &nzUDiag, numericFac);
+  } else {
+    umfpack_dl_get_lunz(&lnz, &unz, &nRow, &nCol, &nzUDiag, numericFac);
+  }
+
+  // L comes back in compressed row form, and U in compressed column form
+  std::vector<SuiteSparse_long> Lp(N + 1), Lj(lnz), Up(N + 1), Ui(unz), P(N), Q(N);
+  std::vector<EntryT> Lx(lnz), Ux(unz), Dx(N);
+  std::vector<double> Rs(N);
+  SuiteSparse_long doRecip;
+  if (isComplex) {
+    umfpack_zl_get_numeric(&Lp[0], &Lj[0], (double*)&Lx[0], NULL, &Up[0], &Ui[0], (double*)&Ux[0], NULL, &P[0], &Q[0],
+                           (double*)&Dx[0], NULL, &doRecip, &Rs[0], numericFac);
+  } else {
+    umfpack_dl_get_numeric(&Lp[0], &Lj[0], (double*)&Lx[0], &Up[0], &Ui[0], (double*)&Ux[0], &P[0], &Q[0],
+                           (double*)&Dx[0], &doRecip, &Rs[0], numericFac);
+  }
+
+  ExplicitLU<T> factor;
+  factor.rowScale = Vector<T>(N);
+  for (size_t i = 0; i < N; i++) {
+    factor.rowScale[i] = static_cast<T>(doRecip ? Rs[i] : 1. / Rs[i]);
+  }
+  factor.rowOrder.assign(P.begin(), P.end());
+  factor.colOrder.assign(Q.begin(), Q.end());
+  std::vector<Eigen::Triplet<T>> lTriplets, uTriplets;
+  for (size_t i = 0; i < N; i++) {
+    for (SuiteSparse_long p = Lp[i]; p < Lp[i + 1]; p++) {
+      lTriplets.emplace_back(i, Lj[p], static_cast<T>(Lx[p]));
+    }
+  }
+  for (size_t j = 0; j < N; j++) {
+    for (SuiteSparse_long p = Up[j]; p < Up[j + 1]; p++) {
+      uTriplets.emplace_back(Ui[p], j, static_cast<T>(Ux[p]));
+    }
+  }
+  factor.L = SparseMatrix<T>(N, N);
+  factor.L.setFromTriplets(lTriplets.begin(), lTriplets.end());
+  factor.U = SparseMatrix<T>(N, N);
+  factor.U.setFromTriplets(uTriplets.begin(), uTriplets.end());
+  return factor;
+}
+
+#elif GC_EIGEN_SPARSELU_FACTORS_READABLE
+
+// Extract the factorization held by Eigen's solver, which stores L and the diagonal blocks of U in a supernodal
+// matrix, and the rest of U separately
+template <typename T>
+ExplicitLU<T> eigenExplicitFactor(Eigen::SparseLU<SparseMatrix<T>>& solver) {
+  typedef typename Eigen::SparseLU<SparseMatrix<T>>::SCMatrix SCMatrix;
+  typedef Eigen::MappedSparseMatrix<T, Eigen::ColMajor, typename SparseMatrix<T>::StorageIndex> UMatrix;
+  const SCMatrix& supernodalL = solver.matrixL().m_mapL;
+  const UMatrix& restOfU = solver.matrixU().m_mapU;
+
+  size_t N = solver.rows();
+  std::vector<Eigen::Triplet<T>> lTriplets, uTriplets;
+  for (size_t j = 0; j < N; j++) {
+    for (typename SCMatrix::InnerIterator it(supernodalL, j); it; ++it) {
+      if ((size_t)it.row() > j) {
+        lTriplets.emplace_back(it.row(), j, it.value());
+      } else {
+        uTriplets.emplace_back(it.row(), j, it.value());
+      }
+    }
+    for (typename UMatrix::InnerIterator it(restOfU, j); it; ++it) {
+      // (this matrix holds U(row, j) at column j, row it.index())
+      uTriplets.emplace_back(it.index(), j, it.value());
+    }
+  }
+
+  ExplicitLU<T> factor;
+  factor.rowScale = Vector<T>::Ones(N);
+  factor.rowOrder.resize(N);
+  factor.colOrder.resize(N);
+  for (size_t i = 0; i < N; i++) {
+    factor.rowOrder[solver.rowsPermutation().indices()[i]] = i;
+    factor.colOrder[solver.colsPermutation().indices()[i]] = i;
+  }
+  factor.L = SparseMatrix<T>(N, N);
+  factor.L.setFromTriplets(lTriplets.begin(), lTriplets.end());
+  factor.U = SparseMatrix<T>(N, N);
+  factor.U.setFromTriplets(uTriplets.begin(), uTriplets.end());
+  return factor;
+}
+
 #endif
 
 } // namespace
@@ -150,6 +300,10 @@ SquareSolver<T>::SquareSolver(SparseMatrix<T>& mat) : LinearSolver<T>(mat), inte
 #endif
 };
 
+template <typename T>
+SquareSolver<T>::SquareSolver(size_t nRows, size_t nCols)
+    : LinearSolver<T>(nRows, nCols), internals(new SquareSolverInternals<T>()) {}
+
 template <typename T>
 Vector<T> SquareSolver<T>::solve(const Vector<T>& rhs) {
   Vector<T> out;
@@ -170,6 +324,12 @@ void SquareSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
   checkFinite(rhs);
 #endif
 
+  // Loaded version
+  if (internals->loadedFactor) {
+    internals->loadedFactor->solve(x, rhs);
+    return;
+  }
+
   // Suitesparse version
 #ifdef GC_HAVE_SUITESPARSE
 
@@ -188,6 +348,135 @@ void SquareSolver<T>::solve(Vector<T>& x, const Vector<T>& rhs) {
 #endif
 }
 
+template <typename T>
+void SquareSolver<T>::solve(DenseMatrix<T>& x, const DenseMatrix<T>& rhs) {
+
+  size_t N = this->nRows;
+  size_t K = rhs.cols();
+
+  // Check some sanity
+  if ((size_t)rhs.rows() != N) {
+    throw std::logic_error("Matrix is not the right size");
+  }
+#ifndef GC_NLINALG_DEBUG
+  checkFinite(rhs);
+#endif
+
+  // Loaded factorizations (and UMFPACK) solve one column at a time
+  bool byColumn = internals->loadedFactor != nullptr;
+#ifdef GC_HAVE_SUITESPARSE
+  byColumn = true;
+#endif
+  if (byColumn) {
+    x.resize(N, K);
+    Vector<T> xCol;
+    for (size_t j = 0; j < K; j++) {
+      solve(xCol, rhs.col(j));
+      x.col(j) = xCol;
+    }
+    return;
+  }
+
+#ifndef GC_HAVE_SUITESPARSE
+  x = internals->solver.solve(rhs);
+  if (internals->solver.info() != Eigen::Success) {
+    std::cerr << "Solver error: " << internals->solver.info() << std::endl;
+    std::cerr << "Solver says: " << internals->solver.lastErrorMessage() << std::endl;
+    throw std::invalid_argument("Solve failed");
+  }
+#endif
+}
+
+template <typename T>
+size_t SquareSolver<T>::memoryUsage() {
+  if (internals->loadedFactor) {
+    return internals->loadedFactor->memoryUsage();
+  }
+#ifdef GC_HAVE_SUITESPARSE
+  size_t bytes = internals->cMat->nzmax * (sizeof(typename SOLVER_ENTRYTYPE<T>::type) + sizeof(SuiteSparse_long));
+  bytes += umfFactorNonzeros<T>(internals->numericFactorization) *
+           (sizeof(typename SOLVER_ENTRYTYPE<T>::type) + sizeof(SuiteSparse_long));
+  return bytes;
+#else
+  return (internals->solver.nnzL() + internals->solver.nnzU()) * (sizeof(T) + sizeof(int));
+#endif
+}
+
+template <typename T>
+void SquareSolver<T>::save(std::string filename) {
+  std::ofstream out(filename, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("could not open file " + filename + " for writing");
+  }
+  save(out);
+}
+
+template <typename T>
+void SquareSolver<T>::save(std::ostream& out) {
+#if !defined(GC_HAVE_SUITESPARSE) && !GC_EIGEN_SPARSELU_FACTORS_READABLE
+  if (!internals->loadedFactor) {
+    throw std::runtime_error("saving LU factorizations requires Suitesparse, or Eigen 3.2 to 3.4");
+  }
+#endif
+  writeFactorizationHeader<T>(out, FactorizationKind::LU, this->nRows, this->nCols);
+
+  auto writeFactor = [&](const ExplicitLU<T>& factor) {
+    writeVector(out, factor.rowScale);
+    writeIndexVector(out, factor.rowOrder);
+    writeIndexVector(out, factor.colOrder);
+    writeSparseMatrix(out, factor.L);
+    writeSparseMatrix(out, factor.U);
+  };
+
+  if (internals->loadedFactor) {
+    writeFactor(*internals->loadedFactor);
+    return;
+  }
+#ifdef GC_HAVE_SUITESPARSE
+  writeFactor(umfExplicitFactor<T>(this->nRows, internals->numericFactorization));
+#elif GC_EIGEN_SPARSELU_FACTORS_READABLE
+  writeFactor(eigenExplicitFactor(internals->solver));
+#endif
+}
+
+template <typename T>
+std::unique_ptr<SquareSolver<T>> SquareSolver<T>::load(std::string filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("could not open file " + filename + " for reading");
+  }
+  return load(in);
+}
+
+template <typename T>
+std::unique_ptr<SquareSolver<T>> SquareSolver<T>::load(std::istream& in) {
+  size_t nRows, nCols;
+  readFactorizationHeader<T>(in, FactorizationKind::LU, nRows, nCols);
+  std::unique_ptr<SquareSolver<T>> solver(new SquareSolver<T>(nRows, nCols));
+
+  std::unique_ptr<ExplicitLU<T>> factor(new ExplicitLU<T>());
+  factor->rowScale = readVector<T>(in);
+  factor->rowOrder = readIndexVector(in);
+  factor->colOrder = readIndexVector(in);
+  factor->L = readSparseMatrix<T>(in);
+  factor->U = readSparseMatrix<T>(in);
+
+  size_t N = nRows;
+  bool valid = nRows == nCols && (size_t)factor->rowScale.size() == N && factor->rowOrder.size() == N &&
+               factor->colOrder.size() == N && (size_t)factor->L.rows() == N && (size_t)factor->L.cols() == N &&
+               (size_t)factor->U.rows() == N && (size_t)factor->U.cols() == N;
+  for (size_t i = 0; valid && i < N; i++) {
+    valid = factor->rowOrder[i] >= 0 && (size_t)factor->rowOrder[i] < N && factor->colOrder[i] >= 0 &&
+            (size_t)factor->colOrder[i] < N;
+  }
+  if (!valid) {
+    throw std::runtime_error("corrupt factorization file");
+  }
+
+  solver->internals->loadedFactor = std::move(factor);
+  return solver;
+}
+
 template <typename T>
 Vector<T> solveSquare(SparseMatrix<T>& A, const Vector<T>& rhs) {
   SquareSolver<T> s(A);
@@ -214,5 +214,59 @@ template void toEigen(cholmod_dense* cVec, CholmodContext& context, Eigen::Matri
 template void toEigen(cholmod_dense* cVec, CholmodContext& context,
                       Eigen::Matrix<std::complex<double>, Eigen::Dynamic, 1>& xOut);
 
+// Convert a dense matrix. Both sides are column-major, with a leading dimension equal to the number of rows.
+template <typename T>
+cholmod_dense* toCholmod(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& A, CholmodContext& context) {
+
+  size_t N = A.rows();
+  size_t K = A.cols();
+
+  // Cholmod always uses double precision
+  typedef typename std::conditional<std::is_same<T, float>::value, double, T>::type SCALAR_TYPE;
+  int xtype = Eigen::NumTraits<T>::IsComplex ? CHOLMOD_COMPLEX : CHOLMOD_REAL;
+
+  cholmod_dense* cMat = cholmod_l_allocate_dense(N, K, N, xtype, context);
+  SCALAR_TYPE* cMatS = (SCALAR_TYPE*)cMat->x;
+  for (size_t j = 0; j < K; j++) {
+    for (size_t i = 0; i < N; i++) {
+      cMatS[i + j * N] = A(i, j);
+    }
+  }
+
+  return cMat;
+}
+template cholmod_dense* toCholmod(const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>& A,
+                                  CholmodContext& context);
+template cholmod_dense* toCholmod(const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic>& A,
+                                  CholmodContext& context);
+template cholmod_dense* toCholmod(const Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>& A,
+                                  CholmodContext& context);
+
+// Convert a dense matrix
+template <typename T>
+void toEigen(cholmod_dense* cMat, CholmodContext& context, Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>& AOut) {
+
+  size_t N = cMat->nrow;
+  size_t K = cMat->ncol;
+  size_t d = cMat->d;
+
+  AOut = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>(N, K);
+
+  typedef typename std::conditional<std::is_same<T, float>::value, double, T>::type SCALAR_TYPE;
+
+  SCALAR_TYPE* cMatS = (SCALAR_TYPE*)cMat->x;
+  for (size_t j = 0; j < K; j++) {
+    for (size_t i = 0; i < N; i++) {
+      AOut(i, j) = cMatS[i + j * d];
+    }
+  }
+}
+template void toEigen(cholmod_dense* cMat, CholmodContext& context,
+                      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>& AOut);
+template void toEigen(cholmod_dense* cMat, CholmodContext& context,
+                      Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic>& AOut);
+template void toEigen(cholmod_dense* cMat, CholmodContext& context,
+                      Eigen::Matrix<std::complex<double>, Eigen::Dynamic, Eigen::Dynamic>& AOut);
+
 } // namespace geometrycentral
 #endif
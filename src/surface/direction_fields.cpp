@@ -42,111 +42,58 @@ VertexData<Vector2> computeSmoothestVertexDirectionField(IntrinsicGeometryInterf
   return toReturn;
 }
 
-/*
 VertexData<Vector2> computeSmoothestBoundaryAlignedVertexDirectionField(IntrinsicGeometryInterface& geometry,
                                                                         int nSym) {
   HalfedgeMesh& mesh = geometry.mesh;
 
-
   if (!mesh.hasBoundary()) {
     throw std::logic_error("tried to compute smoothest boundary aligned direction field on a mesh without boundary");
   }
 
-  geometry.requireVertexGalerkinMassMatrix();
+  geometry.requireVertexIndices();
   geometry.requireVertexConnectionLaplacian();
   geometry.requireHalfedgeVectorsInVertex();
 
-  // Mass matrix
-  SparseMatrix<std::complex<double>> massMatrix = geometry.vertexGalerkinMassMatrix.cast<std::complex<double>>();
-
   // Energy matrix
   SparseMatrix<std::complex<double>> energyMatrix = geometry.vertexConnectionLaplacian;
 
-  // Compute the boundary values
-  VertexData<std::complex<double>> boundaryValues(mesh);
-  VertexData<char> isBoundary(mesh, false);
+  // Compute the boundary values, aligned with the boundary normal
+  size_t N = mesh.nVertices();
+  Vector<std::complex<double>> boundaryValues = Vector<std::complex<double>>::Zero(N);
+  Vector<bool> isBoundary = Vector<bool>::Constant(N, false);
   for (Vertex v : mesh.vertices()) {
-    if (v.isBoundary()) {
-      isBoundary[v] = true;
+    if (!v.isBoundary()) continue;
+    size_t iV = geometry.vertexIndices[v];
+    isBoundary[iV] = true;
 
-      // Find incoming and outgoing boundary vectors as tangent
-      Halfedge heBoundaryA = v.halfedge();
-      Halfedge heBoundaryB = heBoundaryA.twin().next();
+    // Find incoming and outgoing boundary vectors as tangent
+    Halfedge heBoundaryA = v.halfedge();
+    Halfedge heBoundaryB = heBoundaryA.twin().next();
 
-      Vector2 vecA = geometry.halfedgeVectorsInVertex[heBoundaryA];
-      Vector2 vecB = geometry.halfedgeVectorsInVertex[heBoundaryB];
+    Vector2 vecA = geometry.halfedgeVectorsInVertex[heBoundaryA];
+    Vector2 vecB = geometry.halfedgeVectorsInVertex[heBoundaryB];
 
-      Vector2 tangentV = unit(-vecA + vecB);
-      Vector2 normalV = tangentV.rotate90();
+    Vector2 tangentV = unit(-vecA + vecB);
+    Vector2 normalV = tangentV.rotate90();
 
-      boundaryValues[v] = normalV.pow(nSym);
-    } else {
-      boundaryValues[v] = 0;
-    }
+    boundaryValues[iV] = std::complex<double>(normalV.pow(nSym));
   }
-  Vector<std::complex<double>> b = boundaryValues.toVector();
-  Vector<char> isBoundaryVec = isBoundary.toVector();
-
-  // Block decompose problem
-
-
-  // Compute the actual solution
-  std::cout << "Solving linear problem..." << std::endl;
-
-  // Store the solution here
-  Eigen::VectorXcd solution;
-
-  // If requested, align to principal curvatures
-  if (alignCurvature) {
-
-    geometry.requirePrincipalDirections();
-
-    Eigen::VectorXcd dirVec(nInterior);
-    for (Vertex v : mesh.vertices()) {
-      if (v.isBoundary()) {
-        continue;
-      }
-
-      Vector2 directionVal = geometry.principalDirections[v];
-      if (nSym == 4) {
-        directionVal = std::pow(directionVal, 2);
-      }
 
-      // Normalize the curvature vectors. By doing so, we lose the property of adjusting the strength of the alignment
-      // based on the strength of the curvature, but resolve any scaling issues between the magnitude of the normals and
-      // the magnitude of the desired field.  Be careful when interpreting this as opposed to the usual direction field
-      // optimization.
-      dirVec[geometry.interiorVertexIndices[v]] = directionVal / std::abs(directionVal);
-    }
-
-    double t = 0.01; // this is something of a magical constant, see "Globally
-                     // Optimal Direction Fields", eqn 9
-
-    Eigen::VectorXcd RHS = massMatrix * (t * dirVec + b);
-    Eigen::SparseMatrix<std::complex<double>, Eigen::ColMajor> LHS = energyMatrix;
-    solution = solveSquare(LHS, RHS);
-  }
-  // Otherwise find the general closest solution
-  else {
-    std::cout << "Solving smoothest field dirichlet problem..." << std::endl;
-    Eigen::SparseMatrix<std::complex<double>, Eigen::ColMajor> LHS = energyMatrix;
-    Eigen::VectorXcd RHS = massMatrix * b;
-    solution = solveSquare(LHS, RHS);
-  }
+  // The smoothest field with these boundary values solves the Dirichlet problem for the connection Laplacian. (The
+  // connection Laplacian is not necessarily positive definite without a Delaunay mesh, so factor with LU.)
+  DirichletSolver<std::complex<double>> solver(energyMatrix, isBoundary, false);
+  Vector<std::complex<double>> solution = solver.solveHomogeneous(boundaryValues);
 
-  // Copy the result to a VertexData vector for both the boudary and interior
-  VertexData<Vector2> toReturn(*mesh);
+  // Copy the result to a VertexData vector
+  VertexData<Vector2> toReturn(mesh);
   for (Vertex v : mesh.vertices()) {
-    if (v.isBoundary()) {
-      toReturn[v] = boundaryValues[v];
-    } else {
-      toReturn[v] = unit(solution[geometry.interiorVertexIndices[v]]);
-    }
+    toReturn[v] = unit(Vector2::fromComplex(solution[geometry.vertexIndices[v]]));
   }
 
   return toReturn;
 }
 
+/*
 // Helpers for computing face-based direction fields
 namespace {
 
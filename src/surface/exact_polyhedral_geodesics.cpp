@@ -1,105 +1,148 @@
 #include "geometrycentral/surface/exact_polyhedral_geodesics.h"
 
-#include <queue>
-#include <tuple>
-
-using std::cout;
-using std::endl;
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
 
 namespace geometrycentral {
 namespace surface {
 
-ExactPolyhedralGeodesics::ExactPolyhedralGeodesics(EdgeLengthGeometry* geom_) : geom(geom_) {
-  mesh = geom->mesh;
-  clear();
+ExactPolyhedralGeodesics::ExactPolyhedralGeodesics(IntrinsicGeometryInterface& geom)
+    : mesh(geom.mesh), splitInfos(mesh), vertInfos(mesh), isTarget(mesh, false) {
+
+  geom.requireEdgeLengths();
+  geom.requireVertexAngleSums();
+
+  edgeLengths = geom.edgeLengths;
+  isSaddle = VertexData<char>(mesh, false);
+  for (Vertex v : mesh.vertices()) {
+    isSaddle[v] = v.isBoundary() || geom.vertexAngleSums[v] > 2. * M_PI;
+  }
+
+  geom.unrequireEdgeLengths();
+  geom.unrequireVertexAngleSums();
 }
 
 void ExactPolyhedralGeodesics::addSource(Vertex v) { srcVerts.push_back(v); }
 
+void ExactPolyhedralGeodesics::clearSources() { srcVerts.clear(); }
+
 void ExactPolyhedralGeodesics::clear() {
-  while (not winQ.empty()) winQ.pop();
-  while (not pseudoSrcQ.empty()) pseudoSrcQ.pop();
-
-  splitInfos = HalfedgeData<SplitInfo>(*mesh);
-  vertInfos = VertexData<VertInfo>(*mesh);
-
-  for (Halfedge he : mesh->halfedges()) {
-    splitInfos[he].dist = std::numeric_limits<double>::infinity();
-    splitInfos[he].x = std::numeric_limits<double>::infinity();
-    splitInfos[he].pseudoSrc = Vertex();
-    splitInfos[he].src = Vertex();
-    splitInfos[he].level = -1;
-  }
+  winQ.clear();
+  pseudoSrcQ.clear();
+  windowPool.clear();
+  freeWindowSlots.clear();
 
-  for (Vertex v : mesh->vertices()) {
-    vertInfos[v].birthTime = -1;
-    vertInfos[v].dist = std::numeric_limits<double>::infinity();
-    vertInfos[v].enterHalfedge = Halfedge();
-    vertInfos[v].isSource = false;
-    vertInfos[v].pseudoSrc = Vertex();
-    vertInfos[v].src = Vertex();
+  for (Vertex v : touchedVertices) {
+    vertInfos[v] = VertInfo();
   }
-
-  srcVerts.clear();
-
-  storedWindows.clear();
-  keptFaces.clear();
-  allWindows = HalfedgeData<std::list<Window>>(*mesh);
-  keptAllWindows = false;
+  for (Halfedge he : touchedHalfedges) {
+    splitInfos[he] = SplitInfo();
+  }
+  touchedVertices.clear();
+  touchedHalfedges.clear();
 
   numOfWinGen = 0;
   maxWinQSize = 0;
   maxPseudoQSize = 0;
   totalCalcVertNum = 0;
-  geodesicRadius = std::numeric_limits<double>::infinity();
-  geodesicRadiusReached = false;
+}
+
+void ExactPolyhedralGeodesics::setVertexDistance(Vertex v, double dist) {
+  bool firstReached = vertInfos[v].dist == std::numeric_limits<double>::infinity();
+  if (firstReached) {
+    touchedVertices.push_back(v);
+  }
+  vertInfos[v].dist = dist;
+
+  // Distances only decrease, so the largest distance ever given to a target bounds the current ones. The bound only
+  // counts once every target has been reached.
+  if (isTarget[v]) {
+    if (firstReached) nTargetsUnreached--;
+    targetDistanceMax = std::max(targetDistanceMax, dist);
+    if (nTargetsUnreached == 0) targetDistanceBound = targetDistanceMax;
+  }
+}
+
+void ExactPolyhedralGeodesics::pushWindow(const Window& win) {
+  size_t slot;
+  if (freeWindowSlots.empty()) {
+    slot = windowPool.size();
+    windowPool.push_back(win);
+  } else {
+    slot = freeWindowSlots.back();
+    freeWindowSlots.pop_back();
+    windowPool[slot] = win;
+  }
+  winQ.emplace_back(win.minDist, slot);
+  std::push_heap(winQ.begin(), winQ.end(), std::greater<std::pair<double, size_t>>());
+  numOfWinGen++;
+}
+
+void ExactPolyhedralGeodesics::popWindow(Window& win) {
+  std::pop_heap(winQ.begin(), winQ.end(), std::greater<std::pair<double, size_t>>());
+  size_t slot = winQ.back().second;
+  winQ.pop_back();
+  win = windowPool[slot];
+  freeWindowSlots.push_back(slot);
+}
+
+void ExactPolyhedralGeodesics::pushPseudoWindow(const PseudoWindow& pseudoWin) {
+  pseudoSrcQ.push_back(pseudoWin);
+  std::push_heap(pseudoSrcQ.begin(), pseudoSrcQ.end());
+}
+
+void ExactPolyhedralGeodesics::popPseudoWindow() {
+  std::pop_heap(pseudoSrcQ.begin(), pseudoSrcQ.end());
+  pseudoSrcQ.pop_back();
 }
 
 // TODO: allow arbitrary surface points as input
-void ExactPolyhedralGeodesics::initialize() {
-  // initialize
-  for (auto v : srcVerts) {
+void ExactPolyhedralGeodesics::initialize(const std::vector<Vertex>& sourceVerts) {
+  for (Vertex v : sourceVerts) {
     for (Halfedge he : v.outgoingHalfedges()) {
-      Halfedge oppHE = he.next();
-
-      Window win;
-      win.halfedge = oppHE;
-      win.b0 = 0.;
-      win.b1 = geom->edgeLengths[oppHE.edge()];
-      win.d0 = geom->edgeLengths[he.edge()];
-      win.d1 = geom->edgeLengths[oppHE.next().edge()];
-      win.pseudoSrcDist = 0.;
-      win.computeMinDist();
-      win.src = v;
-      win.pseudoSrc = v;
-      win.pseudoSrcBirthTime = 0;
-      win.level = 0;
-      winQ.push(win);
-      numOfWinGen += 1;
+      if (he.isInterior()) {
+        Halfedge oppHE = he.next();
+
+        Window win;
+        win.halfedge = oppHE;
+        win.b0 = 0.;
+        win.b1 = edgeLengths[oppHE.edge()];
+        win.d0 = edgeLengths[he.edge()];
+        win.d1 = edgeLengths[oppHE.next().edge()];
+        win.pseudoSrcDist = 0.;
+        win.computeMinDist();
+        win.src = v;
+        win.pseudoSrc = v;
+        win.pseudoSrcBirthTime = 0;
+        win.level = 0;
+        pushWindow(win);
+      }
 
       Vertex oppV = he.twin().vertex();
-      if (geom->edgeLengths[he.edge()] < vertInfos[oppV].dist) {
+      if (edgeLengths[he.edge()] < vertInfos[oppV].dist) {
         vertInfos[oppV].birthTime = 0;
-        vertInfos[oppV].dist = geom->edgeLengths[he.edge()];
+        setVertexDistance(oppV, edgeLengths[he.edge()]);
         vertInfos[oppV].enterHalfedge = he.twin();
         vertInfos[oppV].src = v;
         vertInfos[oppV].pseudoSrc = v;
 
         // only need to create a new pseudoWin if the vertex is hyperbolic
-        if (geom->vertexAngleDefects[oppV] > 0.) continue;
+        if (!isSaddle[oppV]) continue;
 
         PseudoWindow pseudoWin;
         pseudoWin.v = oppV;
-        pseudoWin.dist = geom->edgeLengths[he.edge()];
+        pseudoWin.dist = edgeLengths[he.edge()];
         pseudoWin.src = v;
         pseudoWin.pseudoSrc = v;
         pseudoWin.pseudoSrcBirthTime = vertInfos[oppV].birthTime;
         pseudoWin.level = 0;
-        pseudoSrcQ.push(pseudoWin);
+        pushPseudoWindow(pseudoWin);
       }
     }
     vertInfos[v].birthTime = 0;
-    vertInfos[v].dist = 0.;
+    setVertexDistance(v, 0.);
     vertInfos[v].enterHalfedge = Halfedge();
     vertInfos[v].isSource = true;
     vertInfos[v].src = v;
@@ -108,32 +151,34 @@ void ExactPolyhedralGeodesics::initialize() {
 }
 
 bool ExactPolyhedralGeodesics::isValidWindow(const Window& win, bool isLeftChild) {
-  if (win.b1 <= win.b0) return false;
+  // discard empty windows, and slivers left by roundoff (whose unfolded source is meaningless)
+  double l0 = edgeLengths[win.halfedge.edge()];
+  if (!(win.b1 - win.b0 > REL_ERR * l0)) return false;
+
   // apply ICH's filter
   Vertex v1 = win.halfedge.vertex();
   Vertex v2 = win.halfedge.twin().vertex();
   Vertex v3 = win.halfedge.next().twin().vertex();
-  double l0 = geom->edgeLengths[win.halfedge.edge()];
-  double l1 = geom->edgeLengths[win.halfedge.next().edge()];
-  double l2 = geom->edgeLengths[win.halfedge.next().next().edge()];
+  double l1 = edgeLengths[win.halfedge.next().edge()];
+  double l2 = edgeLengths[win.halfedge.next().next().edge()];
 
-  Vector2 p1{0.0, 0.0}, p2{l0, 0.0}, p3;
+  Vector2 p3;
   p3.x = (l2 * l2 + l0 * l0 - l1 * l1) / (2.0 * l0);
   p3.y = sqrt(fabs(l2 * l2 - p3.x * p3.x));
 
   Vector2 A{win.b0, 0.0}, B{win.b1, 0.0};
   Vector2 src2D = win.flattenedSrc();
   if (win.pseudoSrcDist + norm(src2D - B) > vertInfos[v1].dist + win.b1 &&
-      (win.pseudoSrcDist + norm(src2D - B)) / (vertInfos[v1].dist + win.b1) - 1.0 > 0.0) {
+      (win.pseudoSrcDist + norm(src2D - B)) / (vertInfos[v1].dist + win.b1) - 1.0 > REL_ERR) {
     return false;
   }
   if (win.pseudoSrcDist + norm(src2D - A) > vertInfos[v2].dist + l0 - win.b0 &&
-      (win.pseudoSrcDist + norm(src2D - A)) / (vertInfos[v2].dist + l0 - win.b0) - 1.0 > 0.0) {
+      (win.pseudoSrcDist + norm(src2D - A)) / (vertInfos[v2].dist + l0 - win.b0) - 1.0 > REL_ERR) {
     return false;
   }
   if (isLeftChild) {
     if (win.pseudoSrcDist + norm(src2D - A) > vertInfos[v3].dist + norm(p3 - A) &&
-        (win.pseudoSrcDist + norm(src2D - A)) / (vertInfos[v3].dist + norm(p3 - A)) - 1.0 > 0.0) {
+        (win.pseudoSrcDist + norm(src2D - A)) / (vertInfos[v3].dist + norm(p3 - A)) - 1.0 > REL_ERR) {
       return false;
     }
   } else {
@@ -149,8 +194,8 @@ void ExactPolyhedralGeodesics::buildWindow(const Window& pWin, Halfedge& he, dou
                                            const Vector2& v1, Window& win) {
   Vector2 src2D = pWin.flattenedSrc();
   win.halfedge = he;
-  win.b0 = (1 - t0) * geom->edgeLengths[he.edge()];
-  win.b1 = (1 - t1) * geom->edgeLengths[he.edge()];
+  win.b0 = (1 - t0) * edgeLengths[he.edge()];
+  win.b1 = (1 - t1) * edgeLengths[he.edge()];
   win.d0 = norm(src2D - (t0 * v0 + (1 - t0) * v1));
   win.d1 = norm(src2D - (t1 * v0 + (1 - t1) * v1));
   win.pseudoSrcDist = pWin.pseudoSrcDist;
@@ -169,7 +214,7 @@ double ExactPolyhedralGeodesics::intersect(const Vector2& v0, const Vector2& v1,
 
 void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
   Halfedge he0 = win.halfedge.twin();
-  if (he0 == Halfedge()) return;
+  if (!he0.isInterior()) return;
 
   Halfedge he1 = he0.next();
   Halfedge he2 = he1.next();
@@ -178,9 +223,9 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
   Vector2 src2D = win.flattenedSrc();
   Vector2 left{win.b0, 0.}, right{win.b1, 0.};
 
-  double l0 = geom->edgeLengths[he0.edge()];
-  double l1 = geom->edgeLengths[he1.edge()];
-  double l2 = geom->edgeLengths[he2.edge()];
+  double l0 = edgeLengths[he0.edge()];
+  double l1 = edgeLengths[he1.edge()];
+  double l2 = edgeLengths[he2.edge()];
 
   Vector2 v0{0., 0.}, v1{l0, 0.}, v2;
   v2.x = (l1 * l1 + l0 * l0 - l2 * l2) / (2. * l0);
@@ -190,8 +235,12 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
   Window leftChildWin, rightChildWin;
   bool hasLeftChild = true, hasRightChild = true;
 
+  // the vertex opposite counts as inside the window when the ray to it passes through an endpoint (up to roundoff),
+  // since otherwise a shortest path along an edge or through a vertex would never reach it
+  double eps = REL_ERR * l0;
+
   // only generate right window
-  if (interX <= left.x) {
+  if (interX < left.x - eps) {
     hasLeftChild = false;
     double t0 = intersect(src2D, left, v2, v1);
     double t1 = intersect(src2D, right, v2, v1);
@@ -201,7 +250,7 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
   }
 
   // only generate left window
-  else if (interX >= right.x) {
+  else if (interX > right.x + eps) {
     hasRightChild = false;
     double t0 = intersect(src2D, left, v0, v2);
     double t1 = intersect(src2D, right, v0, v2);
@@ -221,6 +270,9 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
     // else {
     {
       if (directDist + win.pseudoSrcDist < splitInfos[he0].dist) {
+        if (splitInfos[he0].dist == std::numeric_limits<double>::infinity()) {
+          touchedHalfedges.push_back(he0);
+        }
         splitInfos[he0].dist = directDist + win.pseudoSrcDist;
         splitInfos[he0].pseudoSrc = win.pseudoSrc;
         splitInfos[he0].src = win.src;
@@ -229,20 +281,13 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
       }
 
       if (directDist + win.pseudoSrcDist < vertInfos[oppV].dist) {
-        if (vertInfos[oppV].dist == std::numeric_limits<double>::infinity()) {
-          ++totalCalcVertNum;
-        }
-        if (directDist + win.pseudoSrcDist >= geodesicRadius) {
-          geodesicRadiusReached = true;
-        }
-
         vertInfos[oppV].birthTime++;
-        vertInfos[oppV].dist = directDist + win.pseudoSrcDist;
+        setVertexDistance(oppV, directDist + win.pseudoSrcDist);
         vertInfos[oppV].enterHalfedge = he0;
         vertInfos[oppV].src = win.src;
         vertInfos[oppV].pseudoSrc = win.pseudoSrc;
 
-        if (geom->vertexAngleDefects[oppV] < 0.) {
+        if (isSaddle[oppV]) {
           PseudoWindow pseudoWin;
           pseudoWin.v = oppV;
           pseudoWin.dist = vertInfos[oppV].dist;
@@ -250,7 +295,7 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
           pseudoWin.pseudoSrc = win.pseudoSrc;
           pseudoWin.pseudoSrcBirthTime = vertInfos[oppV].birthTime;
           pseudoWin.level = win.level + 1;
-          pseudoSrcQ.push(pseudoWin);
+          pushPseudoWindow(pseudoWin);
         }
       }
     }
@@ -265,64 +310,59 @@ void ExactPolyhedralGeodesics::propogateWindow(const Window& win) {
       if (not isValidWindow(rightChildWin, false)) hasRightChild = false;
     }
   }
-  if (hasLeftChild) {
-    numOfWinGen += 1;
-    winQ.push(leftChildWin);
-  }
-  if (hasRightChild) {
-    numOfWinGen += 1;
-    winQ.push(rightChildWin);
-  }
+  if (hasLeftChild) pushWindow(leftChildWin);
+  if (hasRightChild) pushWindow(rightChildWin);
 }
 
 void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrc(const PseudoWindow& pseudoWin) {
+  Vertex v = pseudoWin.v;
   Halfedge startHe, endHe;
 
-  if (vertInfos[pseudoWin.v].enterHalfedge == Halfedge() && vertInfos[pseudoWin.v].birthTime != -1) {
-    startHe = pseudoWin.v.halfedge();
+  if (vertInfos[v].enterHalfedge == Halfedge() && vertInfos[v].birthTime != -1) {
+    startHe = v.halfedge();
     endHe = startHe;
-  } else if (vertInfos[pseudoWin.v].enterHalfedge.vertex() == pseudoWin.v)
+  } else if (vertInfos[v].enterHalfedge.vertex() == v)
     generateSubWinsForPseudoSrcFromPseudoSrc(pseudoWin, startHe, endHe);
-  else if (vertInfos[pseudoWin.v].enterHalfedge.next().twin().vertex() == pseudoWin.v)
+  else if (vertInfos[v].enterHalfedge.next().twin().vertex() == v)
     generateSubWinsForPseudoSrcFromWindow(pseudoWin, startHe, endHe);
   else
     assert(false);
 
-  // generate windows
-  do {
+  auto generateWindow = [&](Halfedge he) {
     Window win;
-    win.halfedge = startHe.next();
+    win.halfedge = he.next();
     win.b0 = 0.;
-    win.b1 = geom->edgeLengths[win.halfedge.edge()];
-    win.d0 = geom->edgeLengths[startHe.edge()];
-    win.d1 = geom->edgeLengths[win.halfedge.next().edge()];
+    win.b1 = edgeLengths[win.halfedge.edge()];
+    win.d0 = edgeLengths[he.edge()];
+    win.d1 = edgeLengths[win.halfedge.next().edge()];
     win.pseudoSrcDist = pseudoWin.dist;
     win.computeMinDist();
     win.src = pseudoWin.src;
-    win.pseudoSrc = pseudoWin.v;
+    win.pseudoSrc = v;
     win.pseudoSrcBirthTime = pseudoWin.pseudoSrcBirthTime;
     win.level = pseudoWin.level + 1;
-    winQ.push(win);
-    numOfWinGen += 1;
+    pushWindow(win);
+  };
 
-    startHe = startHe.next().next().twin();
-  } while (startHe != endHe);
+  // generate windows in the faces between startHe and endHe; if the fan around the vertex was cut short by the
+  // boundary, generate them in every face (windows which cannot carry a shortest path are filtered out later)
+  if (v.isBoundary() || startHe == Halfedge() || endHe == Halfedge()) {
+    for (Halfedge he : v.outgoingHalfedges()) {
+      if (he.isInterior()) generateWindow(he);
+    }
+  } else {
+    do {
+      generateWindow(startHe);
+      startHe = startHe.next().next().twin();
+    } while (startHe != endHe);
+  }
 
-  Vertex vx = pseudoWin.v;
-  for (Halfedge he : vx.outgoingHalfedges()) {
+  for (Halfedge he : v.outgoingHalfedges()) {
     Vertex oppV = he.twin().vertex();
 
-    // if( geom->vertexAngleDefects[oppV] > 0. ) continue;
-    if (vertInfos[oppV].dist < pseudoWin.dist + geom->edgeLengths[he.edge()]) continue;
+    if (vertInfos[oppV].dist < pseudoWin.dist + edgeLengths[he.edge()]) continue;
 
-    if (vertInfos[oppV].dist == std::numeric_limits<double>::infinity()) {
-      totalCalcVertNum += 1;
-    }
-    if (pseudoWin.dist + geom->edgeLengths[he.edge()] >= geodesicRadius) {
-      geodesicRadiusReached = true;
-    }
-
-    vertInfos[oppV].dist = pseudoWin.dist + geom->edgeLengths[he.edge()];
+    setVertexDistance(oppV, pseudoWin.dist + edgeLengths[he.edge()]);
     vertInfos[oppV].birthTime += 1;
     vertInfos[oppV].enterHalfedge = he.twin();
     vertInfos[oppV].src = pseudoWin.src;
@@ -335,7 +375,7 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrc(const PseudoWindow& p
     childPseudoWin.pseudoSrc = pseudoWin.v;
     childPseudoWin.pseudoSrcBirthTime = vertInfos[oppV].birthTime;
     childPseudoWin.level = pseudoWin.level;
-    pseudoSrcQ.push(childPseudoWin);
+    pushPseudoWindow(childPseudoWin);
   }
 }
 
@@ -345,11 +385,10 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromWindow(const Pseud
   Halfedge he1 = he0.next();
   Halfedge he2 = he1.next();
 
-  double l0 = geom->edgeLengths[he0.edge()];
-  double l1 = geom->edgeLengths[he1.edge()];
-  double l2 = geom->edgeLengths[he2.edge()];
+  double l0 = edgeLengths[he0.edge()];
+  double l1 = edgeLengths[he1.edge()];
+  double l2 = edgeLengths[he2.edge()];
 
-  Vertex pseudoSrc = pseudoWin.src;
   Vector2 enterPt;
   enterPt.x = l0 - splitInfos[he0].x;
   enterPt.y = 0.;
@@ -374,12 +413,12 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromWindow(const Pseud
   startHe = Halfedge();
   endHe = Halfedge();
   Halfedge currHe = he1.twin();
-  while (angleFromLeft < M_PI && currHe != Halfedge()) {
+  while (angleFromLeft < M_PI && currHe.isInterior()) {
     Halfedge oppHe = currHe.next();
     Halfedge nextHe = oppHe.next();
-    double L0 = geom->edgeLengths[currHe.edge()];
-    double L1 = geom->edgeLengths[nextHe.edge()];
-    double L2 = geom->edgeLengths[oppHe.edge()];
+    double L0 = edgeLengths[currHe.edge()];
+    double L1 = edgeLengths[nextHe.edge()];
+    double L2 = edgeLengths[oppHe.edge()];
     double currAngle = (L0 * L0 + L1 * L1 - L2 * L2) / (2. * L0 * L1);
     if (currAngle > 1.)
       currAngle = 1.;
@@ -389,15 +428,15 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromWindow(const Pseud
     angleFromLeft += currAngle;
     currHe = nextHe.twin();
   }
-  if (currHe != Halfedge()) startHe = currHe.twin().next();
+  if (currHe.isInterior()) startHe = currHe.twin().next();
 
   currHe = he2.twin();
-  while (angleFromRight < M_PI && currHe != Halfedge()) {
+  while (angleFromRight < M_PI && currHe.isInterior()) {
     Halfedge nextHe = currHe.next();
     Halfedge oppHe = nextHe.next();
-    double L0 = geom->edgeLengths[currHe.edge()];
-    double L1 = geom->edgeLengths[nextHe.edge()];
-    double L2 = geom->edgeLengths[oppHe.edge()];
+    double L0 = edgeLengths[currHe.edge()];
+    double L1 = edgeLengths[nextHe.edge()];
+    double L2 = edgeLengths[oppHe.edge()];
     double currAngle = (L0 * L0 + L1 * L1 - L2 * L2) / (2. * L0 * L1);
     if (currAngle > 1.)
       currAngle = 1.;
@@ -407,22 +446,21 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromWindow(const Pseud
     angleFromRight += currAngle;
     currHe = nextHe.twin();
   }
-  if (currHe != Halfedge()) endHe = currHe.twin().next().next().twin();
+  if (currHe.isInterior()) endHe = currHe.twin().next().next().twin();
 }
 
 void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromPseudoSrc(const PseudoWindow& pseudoWin,
                                                                         Halfedge& startHe, Halfedge& endHe) {
-  Vertex pseudoSrc = pseudoWin.v;
   double angleFromLeft = 0., angleFromRight = 0.;
   startHe = Halfedge();
   endHe = Halfedge();
   Halfedge currHe = vertInfos[pseudoWin.v].enterHalfedge;
-  while (angleFromLeft < M_PI && currHe != Halfedge()) {
+  while (angleFromLeft < M_PI && currHe.isInterior()) {
     Halfedge oppHe = currHe.next();
     Halfedge nextHe = oppHe.next();
-    double L0 = geom->edgeLengths[currHe.edge()];
-    double L1 = geom->edgeLengths[nextHe.edge()];
-    double L2 = geom->edgeLengths[oppHe.edge()];
+    double L0 = edgeLengths[currHe.edge()];
+    double L1 = edgeLengths[nextHe.edge()];
+    double L2 = edgeLengths[oppHe.edge()];
     double currAngle = (L0 * L0 + L1 * L1 - L2 * L2) / (2. * L0 * L1);
     if (currAngle > 1.)
       currAngle = 1.;
@@ -432,15 +470,15 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromPseudoSrc(const Ps
     angleFromLeft += currAngle;
     currHe = nextHe.twin();
   }
-  if (currHe != Halfedge()) startHe = currHe.twin().next();
+  if (currHe.isInterior()) startHe = currHe.twin().next();
 
   currHe = vertInfos[pseudoWin.v].enterHalfedge.twin();
-  while (angleFromRight < M_PI && currHe != Halfedge()) {
+  while (angleFromRight < M_PI && currHe.isInterior()) {
     Halfedge nextHe = currHe.next();
     Halfedge oppHe = nextHe.next();
-    double L0 = geom->edgeLengths[currHe.edge()];
-    double L1 = geom->edgeLengths[nextHe.edge()];
-    double L2 = geom->edgeLengths[oppHe.edge()];
+    double L0 = edgeLengths[currHe.edge()];
+    double L1 = edgeLengths[nextHe.edge()];
+    double L2 = edgeLengths[oppHe.edge()];
     double currAngle = (L0 * L0 + L1 * L1 - L2 * L2) / (2. * L0 * L1);
     if (currAngle > 1.)
       currAngle = 1.;
@@ -450,50 +488,101 @@ void ExactPolyhedralGeodesics::generateSubWinsForPseudoSrcFromPseudoSrc(const Ps
     angleFromRight += currAngle;
     currHe = nextHe.twin();
   }
-  if (currHe != Halfedge()) endHe = currHe.twin().next().next().twin();
+  if (currHe.isInterior()) endHe = currHe.twin().next().next().twin();
 }
 
-VertexData<double> ExactPolyhedralGeodesics::computeDistance() {
-  geom->requireEdgeLengths();
-  geom->requireVertexAngleDefects();
-  geom->requireVertexIndices();
+VertexData<double> ExactPolyhedralGeodesics::computeDistance() { return computeDistance(srcVerts); }
 
-  initialize();
+VertexData<double> ExactPolyhedralGeodesics::computeDistance(Vertex v) {
+  return computeDistance(std::vector<Vertex>{v});
+}
 
-  while (not winQ.empty() || not pseudoSrcQ.empty()) {
-    maxWinQSize = fmax(maxWinQSize, winQ.size());
-    maxPseudoQSize = fmax(maxPseudoQSize, pseudoSrcQ.size());
+VertexData<double> ExactPolyhedralGeodesics::computeDistance(const std::vector<Vertex>& sourceVerts) {
+  propagate(sourceVerts);
 
-    while (not winQ.empty() && winQ.top().pseudoSrc != Vertex() &&
-           winQ.top().pseudoSrcBirthTime != vertInfos[winQ.top().pseudoSrc].birthTime)
-      winQ.pop();
+  VertexData<double> dists(mesh, std::numeric_limits<double>::infinity());
+  for (Vertex v : touchedVertices) {
+    if (vertInfos[v].dist <= finalDistance) dists[v] = vertInfos[v].dist;
+  }
+  return dists;
+}
 
-    while (not pseudoSrcQ.empty() && winQ.top().pseudoSrc != Vertex() &&
-           (int)pseudoSrcQ.top().pseudoSrcBirthTime != vertInfos[pseudoSrcQ.top().v].birthTime)
-      pseudoSrcQ.pop();
+std::vector<std::pair<Vertex, double>>
+ExactPolyhedralGeodesics::computeDistanceReached(const std::vector<Vertex>& sourceVerts) {
+  propagate(sourceVerts);
 
-    if (not winQ.empty() && (pseudoSrcQ.empty() || winQ.top().minDist < pseudoSrcQ.top().dist)) {
-      Window win = winQ.top();
-      winQ.pop();
-      if (win.level > (int)mesh->nFaces()) continue;
+  std::vector<std::pair<Vertex, double>> result;
+  for (Vertex v : touchedVertices) {
+    if (vertInfos[v].dist <= finalDistance) result.emplace_back(v, vertInfos[v].dist);
+  }
+  std::sort(result.begin(), result.end(),
+            [](const std::pair<Vertex, double>& a, const std::pair<Vertex, double>& b) { return a.second < b.second; });
+  return result;
+}
+
+void ExactPolyhedralGeodesics::propagate(const std::vector<Vertex>& sourceVerts) {
+  auto start = std::chrono::steady_clock::now();
+
+  clear();
+  nTargetsUnreached = 0;
+  for (Vertex t : targets) {
+    if (!isTarget[t]) {
+      isTarget[t] = true;
+      nTargetsUnreached++;
+    }
+  }
+  targetDistanceMax = 0.;
+  targetDistanceBound = std::numeric_limits<double>::infinity();
+  initialize(sourceVerts);
+
+  // Windows are processed in order of their distance, and each one only lowers distances to at least that. Once the
+  // nearest window left is past some distance, the distance to every vertex below it is final.
+  finalDistance = maxDistance;
+  Window win;
+  while (!winQ.empty() || !pseudoSrcQ.empty()) {
+    maxWinQSize = std::max(maxWinQSize, winQ.size());
+    maxPseudoQSize = std::max(maxPseudoQSize, pseudoSrcQ.size());
+
+    // discard windows and pseudo-windows whose pseudo-source has since been reached by a shorter path
+    while (!winQ.empty()) {
+      const Window& top = windowPool[winQ.front().second];
+      if (top.pseudoSrc == Vertex() || top.pseudoSrcBirthTime == vertInfos[top.pseudoSrc].birthTime) break;
+      popWindow(win);
+    }
+    while (!pseudoSrcQ.empty() &&
+           (int)pseudoSrcQ.front().pseudoSrcBirthTime != vertInfos[pseudoSrcQ.front().v].birthTime) {
+      popPseudoWindow();
+    }
+    if (winQ.empty() && pseudoSrcQ.empty()) break;
+
+    // stop early, once past the maximum distance or the farthest target
+    double nextDist = std::min(winQ.empty() ? std::numeric_limits<double>::infinity() : winQ.front().first,
+                               pseudoSrcQ.empty() ? std::numeric_limits<double>::infinity() : pseudoSrcQ.front().dist);
+    if (nextDist > maxDistance || (!targets.empty() && nextDist >= targetDistanceBound)) {
+      finalDistance = std::min(nextDist, maxDistance);
+      break;
+    }
 
-      Halfedge twin = win.halfedge.twin();
+    if (!winQ.empty() && (pseudoSrcQ.empty() || winQ.front().first < pseudoSrcQ.front().dist)) {
+      // pop into a local copy, since propagating pushes new windows into the pool
+      popWindow(win);
+      if (win.level > (int)mesh.nFaces()) continue;
       propogateWindow(win);
-    } else if (not pseudoSrcQ.empty() && (winQ.empty() || winQ.top().minDist >= pseudoSrcQ.top().dist)) {
-      PseudoWindow pseudoWin = pseudoSrcQ.top();
-      pseudoSrcQ.pop();
-      if (pseudoWin.level >= (unsigned)mesh->nFaces()) continue;
+    } else {
+      PseudoWindow pseudoWin = pseudoSrcQ.front();
+      popPseudoWindow();
+      if (pseudoWin.level >= (unsigned)mesh.nFaces()) continue;
       generateSubWinsForPseudoSrc(pseudoWin);
     }
-
-    if (geodesicRadiusReached) break;
   }
 
-  VertexData<double> dists(*mesh);
-  for (Vertex v : mesh->vertices()) {
-    dists[v] = vertInfos[v].dist;
+  for (Vertex t : targets) {
+    isTarget[t] = false;
   }
-  return dists;
+  totalCalcVertNum = touchedVertices.size();
+  windowMemory = windowPool.capacity() * sizeof(Window) + freeWindowSlots.capacity() * sizeof(size_t) +
+                 winQ.capacity() * sizeof(std::pair<double, size_t>) + pseudoSrcQ.capacity() * sizeof(PseudoWindow);
+  propagationTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
 } // namespace surface
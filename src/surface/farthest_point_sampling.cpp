@@ -0,0 +1,126 @@
+#include "geometrycentral/surface/farthest_point_sampling.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace geometrycentral {
+namespace surface {
+
+FarthestPointSampler::FarthestPointSampler(IntrinsicGeometryInterface& geom_, double tCoef)
+    : geom(geom_), mesh(geom_.mesh), ownedSolver(new HeatMethodDistanceSolver(geom_, tCoef)), solver(*ownedSolver),
+      distance(geom_.mesh, std::numeric_limits<double>::infinity()), labels(geom_.mesh, INVALID_IND) {
+  initialize();
+}
+
+FarthestPointSampler::FarthestPointSampler(IntrinsicGeometryInterface& geom_, HeatMethodDistanceSolver& solver_)
+    : geom(geom_), mesh(geom_.mesh), solver(solver_), distance(geom_.mesh, std::numeric_limits<double>::infinity()),
+      labels(geom_.mesh, INVALID_IND) {
+  initialize();
+}
+
+void FarthestPointSampler::initialize() {
+  geom.requireFaceAreas();
+  surfaceArea = 0.;
+  for (Face f : mesh.faces()) {
+    surfaceArea += geom.faceAreas[f];
+  }
+  geom.unrequireFaceAreas();
+
+  // Every vertex starts infinitely far from the (empty) set of samples
+  rebuildQueue();
+}
+
+Vertex FarthestPointSampler::addSample() {
+  if (mesh.nVertices() == 0) {
+    throw std::logic_error("cannot add a sample to a mesh with no vertices");
+  }
+  Vertex v = mesh.vertex(0);
+  if (!samples.empty()) {
+    popStaleEntries();
+    v = farthest.top().second;
+  }
+  addSample(v);
+  return v;
+}
+
+void FarthestPointSampler::addSample(Vertex v) {
+
+  // Only vertices closer to the new sample than the covering radius can change
+  double radius = coveringRadius();
+  size_t iSample = samples.size();
+  samples.push_back(v);
+
+  if (localUpdates && M_PI * radius * radius < localAreaFraction * surfaceArea) {
+    for (const std::pair<Vertex, double>& p : solver.computeDistanceWithinRadius(v, radius)) {
+      updateDistance(p.first, p.second, iSample);
+    }
+    nLocalSolves++;
+  } else {
+    VertexData<double> newDist = solver.computeDistance(v);
+    for (Vertex u : mesh.vertices()) {
+      updateDistance(u, newDist[u], iSample);
+    }
+    nGlobalSolves++;
+  }
+  updateDistance(v, 0., iSample);
+
+  // Drop stale entries once they make up most of the queue
+  if (farthest.size() > 4 * mesh.nVertices()) {
+    rebuildQueue();
+  }
+}
+
+void FarthestPointSampler::rebuildQueue() {
+  std::vector<Entry> entries;
+  for (Vertex u : mesh.vertices()) {
+    entries.emplace_back(distance[u], u);
+  }
+  farthest = std::priority_queue<Entry>(std::less<Entry>(), std::move(entries));
+}
+
+std::vector<Vertex> FarthestPointSampler::addSamples(size_t n) {
+  std::vector<Vertex> newSamples;
+  for (size_t i = 0; i < n; i++) {
+    newSamples.push_back(addSample());
+  }
+  return newSamples;
+}
+
+double FarthestPointSampler::coveringRadius() {
+  popStaleEntries();
+  if (farthest.empty()) return 0.;
+  return farthest.top().first;
+}
+
+std::vector<std::pair<size_t, size_t>> FarthestPointSampler::cellAdjacency() const {
+  std::vector<std::pair<size_t, size_t>> adjacency;
+  for (Edge e : mesh.edges()) {
+    size_t a = labels[e.halfedge().vertex()];
+    size_t b = labels[e.halfedge().twin().vertex()];
+    if (a != b && a != INVALID_IND && b != INVALID_IND) {
+      adjacency.emplace_back(std::min(a, b), std::max(a, b));
+    }
+  }
+  std::sort(adjacency.begin(), adjacency.end());
+  adjacency.erase(std::unique(adjacency.begin(), adjacency.end()), adjacency.end());
+  return adjacency;
+}
+
+void FarthestPointSampler::updateDistance(Vertex v, double d, size_t iSample) {
+  d = std::max(d, 0.);
+  if (d < distance[v]) {
+    distance[v] = d;
+    labels[v] = iSample;
+    farthest.emplace(d, v);
+  }
+}
+
+void FarthestPointSampler::popStaleEntries() {
+  while (!farthest.empty() && farthest.top().first != distance[farthest.top().second]) {
+    farthest.pop();
+  }
+}
+
+} // namespace surface
+} // namespace geometrycentral
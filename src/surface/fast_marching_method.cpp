@@ -1,119 +1,424 @@
 #include "geometrycentral/surface/fast_marching_method.h"
 
-#include <queue>
-#include <tuple>
+#include "geometrycentral/utilities/parallel.h"
+
+#include <algorithm>
+#include <stdexcept>
 
 
 namespace geometrycentral {
 namespace surface {
 
-VertexData<double> FMMDistance(Geometry<Euclidean>* geometry,
+VertexData<double> FMMDistance(IntrinsicGeometryInterface& geom,
                                const std::vector<std::pair<Vertex, double>>& initialDistances) {
+  FastMarchingDistanceSolver solver(geom);
+  return solver.computeDistance(initialDistances);
+}
+
+VertexData<double> FMMDistance(HalfedgeMesh& mesh, const std::vector<std::pair<Vertex, double>>& initialDistances,
+                               const EdgeData<double>& edgeLengths, const CornerData<double>& cornerAngles) {
+  FastMarchingDistanceSolver solver(mesh, edgeLengths, cornerAngles);
+  return solver.computeDistance(initialDistances);
+}
 
-  HalfedgeMesh* mesh = geometry->getMesh();
 
-  // Necessary geometric quantities
-  EdgeData<double> edgeLengths;
-  geometry->getEdgeLengths(edgeLengths);
-  HalfedgeData<double> oppAngles;
-  geometry->getHalfedgeAngles(oppAngles);
+FastMarchingDistanceSolver::FastMarchingDistanceSolver(IntrinsicGeometryInterface& geom)
+    : mesh(geom.mesh), frontier(geom.mesh.nVertices()) {
+  geom.requireEdgeLengths();
+  geom.requireCornerAngles();
+  geom.requireVertexIndices();
 
-  return FMMDistance(mesh, initialDistances, edgeLengths, oppAngles);
-}
+  buildTables(geom.edgeLengths, geom.cornerAngles, geom.vertexIndices);
 
-VertexData<double> FMMDistance(HalfedgeMesh* mesh, const std::vector<std::pair<Vertex, double>>& initialDistances,
-                               const EdgeData<double>& edgeLengths, const HalfedgeData<double>& oppAngles) {
+  geom.unrequireEdgeLengths();
+  geom.unrequireCornerAngles();
+  geom.unrequireVertexIndices();
+}
 
-  typedef std::pair<double, Vertex> Entry;
+FastMarchingDistanceSolver::FastMarchingDistanceSolver(HalfedgeMesh& mesh_, const EdgeData<double>& edgeLengths,
+                                                       const CornerData<double>& cornerAngles)
+    : mesh(mesh_), frontier(mesh_.nVertices()) {
+  buildTables(edgeLengths, cornerAngles, mesh.getVertexIndices());
+}
 
-  // Initialize
-  VertexData<double> distances(*mesh, std::numeric_limits<double>::infinity());
-  VertexData<char> finalized(*mesh, false);
+void FastMarchingDistanceSolver::buildTables(const EdgeData<double>& edgeLengths,
+                                             const CornerData<double>& cornerAngles,
+                                             const VertexData<size_t>& vertexIndices_) {
 
-  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontierPQ;
-  for (auto& x : initialDistances) {
-    frontierPQ.push(std::make_pair(x.second, x.first));
+  if (!mesh.isTriangular()) {
+    throw std::logic_error("fast marching requires a triangle mesh");
   }
-  size_t nFound = 0;
-  size_t nVert = mesh->nVertices();
 
-  // Search
-  while (nFound < nVert && !frontierPQ.empty()) {
+  size_t N = mesh.nVertices();
+  vertexIndices = vertexIndices_;
+  vertices.resize(N);
+  neighborStart.assign(N + 1, 0);
+  triangleStart.assign(N + 1, 0);
+  neighbors.clear();
+  triangles.clear();
+  neighbors.reserve(mesh.nHalfedges());
+  triangles.reserve(mesh.nInteriorHalfedges());
+
+  std::vector<Vertex> vertsByIndex(N);
+  for (Vertex v : mesh.vertices()) {
+    vertsByIndex[vertexIndices[v]] = v;
+  }
 
-    // Pop the nearest element
-    Entry currPair = frontierPQ.top();
-    frontierPQ.pop();
-    Vertex currV = currPair.second;
-    double currDist = currPair.first;
+  for (size_t iV = 0; iV < N; iV++) {
+    Vertex v = vertsByIndex[iV];
+    vertices[iV] = v;
 
+    for (Halfedge he : v.outgoingHalfedges()) {
+      neighbors.push_back(Neighbor{vertexIndices[he.twin().vertex()], edgeLengths[he.edge()]});
 
-    // Accept it if not stale
-    if (finalized[currV]) {
-      continue;
+      // The triangle (v, A, B) to the left of this halfedge
+      if (he.isInterior()) {
+        Halfedge heA = he.next();
+        Halfedge heB = heA.next();
+        Triangle t;
+        t.vertexA = vertexIndices[heA.vertex()];
+        t.vertexB = vertexIndices[heB.vertex()];
+        t.lengthA = edgeLengths[he.edge()];
+        t.lengthB = edgeLengths[heB.edge()];
+        t.lengthAB = edgeLengths[heA.edge()];
+        t.angleA = cornerAngles[heA.corner()];
+        t.angleB = cornerAngles[heB.corner()];
+        t.angle = cornerAngles[he.corner()];
+        triangles.push_back(t);
+      }
     }
-    distances[currV] = currDist;
-    finalized[currV] = true;
-    nFound++;
 
+    neighborStart[iV + 1] = neighbors.size();
+    triangleStart[iV + 1] = triangles.size();
+  }
 
-    // Add any eligible neighbors
-    for (Halfedge he : currV.incomingHalfedges()) {
-      Vertex neighVert = he.vertex();
+  distance.assign(N, std::numeric_limits<double>::infinity());
+  finalized.assign(N, false);
+  isTarget.assign(N, false);
+  activeRound.assign(N, 0);
 
-      // Add with length
-      if (!finalized[neighVert]) {
-        double newDist = currDist + edgeLengths[he.edge()];
-        if (newDist < distances[neighVert]) {
-          frontierPQ.push(std::make_pair(currDist + edgeLengths[he.edge()], neighVert));
-          distances[neighVert] = newDist;
-        }
-        continue;
+  double lengthSum = 0.;
+  for (const Neighbor& n : neighbors) {
+    lengthSum += n.length;
+  }
+  meanEdgeLength = lengthSum / std::max<size_t>(neighbors.size(), 1);
+}
+
+VertexData<double> FastMarchingDistanceSolver::computeDistance(const Vertex& sourceVert) {
+  return computeDistance(std::vector<std::pair<Vertex, double>>{std::make_pair(sourceVert, 0.)});
+}
+
+VertexData<double> FastMarchingDistanceSolver::computeDistance(const std::vector<Vertex>& sourceVerts) {
+  std::vector<std::pair<Vertex, double>> initialDistances;
+  for (Vertex v : sourceVerts) {
+    initialDistances.emplace_back(v, 0.);
+  }
+  return computeDistance(initialDistances);
+}
+
+VertexData<double>
+FastMarchingDistanceSolver::computeDistance(const std::vector<std::pair<Vertex, double>>& initialDistances) {
+  march(initialDistances);
+
+  VertexData<double> result(mesh, std::numeric_limits<double>::infinity());
+  for (size_t iV : reached) {
+    result[vertices[iV]] = distance[iV];
+  }
+  return result;
+}
+
+std::vector<std::pair<Vertex, double>>
+FastMarchingDistanceSolver::computeDistanceReached(const std::vector<std::pair<Vertex, double>>& initialDistances) {
+  march(initialDistances);
+
+  std::vector<std::pair<Vertex, double>> result;
+  result.reserve(reached.size());
+  for (size_t iV : reached) {
+    result.emplace_back(vertices[iV], distance[iV]);
+  }
+  return result;
+}
+
+void FastMarchingDistanceSolver::resetState() {
+  for (size_t iV : touched) {
+    distance[iV] = std::numeric_limits<double>::infinity();
+    finalized[iV] = false;
+  }
+  touched.clear();
+  reached.clear();
+  frontier.clear();
+  nReached = 0;
+  nUpdates = 0;
+  nRounds = 0;
+}
+
+void FastMarchingDistanceSolver::update(size_t iV, double newDist) {
+  if (!(newDist < distance[iV])) return;
+  if (distance[iV] == std::numeric_limits<double>::infinity()) {
+    touched.push_back(iV);
+  }
+  distance[iV] = newDist;
+  frontier.insertOrDecrease(iV, newDist);
+  nUpdates++;
+}
+
+void FastMarchingDistanceSolver::march(const std::vector<std::pair<Vertex, double>>& initialDistances) {
+
+  // Clear out the previous query
+  resetState();
+
+  for (const std::pair<Vertex, double>& x : initialDistances) {
+    update(vertexIndices[x.first], x.second);
+  }
+
+  size_t nTargetsLeft = 0;
+  for (Vertex v : targets) {
+    size_t iV = vertexIndices[v];
+    if (!isTarget[iV]) {
+      isTarget[iV] = true;
+      nTargetsLeft++;
+    }
+  }
+
+  // Search
+  while (!frontier.empty() && frontier.topKey() <= maxDistance) {
+
+    // Finalize the nearest vertex
+    size_t iCurr = frontier.pop();
+    double currDist = distance[iCurr];
+    finalized[iCurr] = true;
+    reached.push_back(iCurr);
+    if (isTarget[iCurr] && --nTargetsLeft == 0) break;
+
+    // Update neighbors along edges
+    for (size_t i = neighborStart[iCurr]; i < neighborStart[iCurr + 1]; i++) {
+      const Neighbor& n = neighbors[i];
+      if (!finalized[n.vertex]) {
+        update(n.vertex, currDist + n.length);
       }
+    }
 
-      // Check the third point of the "left" triangle straddling this edge
-      if (he.isInterior()) {
-        Vertex newVert = he.next().next().vertex();
-        if (!finalized[newVert]) {
-
-          // Compute the distance
-          double lenB = edgeLengths[he.next().next().edge()];
-          double distB = currDist;
-          double lenA = edgeLengths[he.next().edge()];
-          double distA = distances[neighVert];
-          double theta = oppAngles[he];
-          double newDist = eikonalDistanceSubroutine(lenA, lenB, theta, distA, distB);
-
-          if (newDist < distances[newVert]) {
-            frontierPQ.push(std::make_pair(newDist, newVert));
-            distances[newVert] = newDist;
+    // Update the third vertex of each triangle whose other two vertices are now finalized
+    for (size_t i = triangleStart[iCurr]; i < triangleStart[iCurr + 1]; i++) {
+      const Triangle& t = triangles[i];
+      bool finalA = finalized[t.vertexA];
+      bool finalB = finalized[t.vertexB];
+      if (finalA && !finalB) {
+        update(t.vertexB, eikonalDistanceSubroutine(t.lengthB, t.lengthAB, t.angleB, distance[t.vertexA], currDist));
+      } else if (finalB && !finalA) {
+        update(t.vertexA, eikonalDistanceSubroutine(t.lengthA, t.lengthAB, t.angleA, distance[t.vertexB], currDist));
+      }
+    }
+  }
+  nReached = reached.size();
+
+  for (Vertex v : targets) {
+    isTarget[vertexIndices[v]] = false;
+  }
+}
+
+VertexData<double>
+FastMarchingDistanceSolver::computeDistanceParallel(const std::vector<std::pair<Vertex, double>>& initialDistances) {
+  marchParallel(initialDistances);
+
+  VertexData<double> result(mesh, std::numeric_limits<double>::infinity());
+  for (size_t iV : reached) {
+    result[vertices[iV]] = distance[iV];
+  }
+  return result;
+}
+
+void FastMarchingDistanceSolver::marchParallel(const std::vector<std::pair<Vertex, double>>& initialDistances) {
+
+  // Clear out the previous query, and start a new round so that no vertex is active
+  resetState();
+  round++;
+  active.clear();
+  onProbation.clear();
+
+  for (const std::pair<Vertex, double>& x : initialDistances) {
+    size_t iV = vertexIndices[x.first];
+    if (!(x.second < distance[iV])) continue;
+    if (distance[iV] == std::numeric_limits<double>::infinity()) {
+      touched.push_back(iV);
+    }
+    distance[iV] = x.second;
+    if (activeRound[iV] != round) {
+      activeRound[iV] = round;
+      active.push_back(iV);
+      onProbation.push_back(false);
+    }
+  }
+  newDistance.resize(active.size());
+  bandLimit = std::numeric_limits<double>::infinity();
+
+  size_t nThreadsUsed = nThreads == 0 ? hardwareThreadCount() : nThreads;
+  chunks.resize(nThreadsUsed);
+
+  auto serialRound = [&]() {
+    size_t n = active.size();
+    solveActive(0, n);
+    commitActive(0, n, chunks[0]);
+    mergeActive();
+  };
+
+  if (nThreadsUsed == 1) {
+    while (!active.empty()) {
+      serialRound();
+    }
+  } else {
+
+    // The threads step through rounds together, each taking a contiguous range of the active vertices (or nothing,
+    // when there are too few active vertices to keep them all busy). Rounds too small to split at all, such as those
+    // near the sources, run on the first thread alone, while the others wait.
+    const size_t minActivePerThread = 128;
+    ThreadBarrier barrier(nThreadsUsed);
+    bool done = false;
+    size_t nParts = 1;
+    auto runRounds = [&](size_t iChunk) {
+      while (true) {
+        if (iChunk == 0) {
+          while (!active.empty() && active.size() < 2 * minActivePerThread) {
+            serialRound();
           }
+          done = active.empty();
+          nParts = std::min(nThreadsUsed, active.size() / minActivePerThread);
         }
+        if (!barrier.wait() || done) return;
+
+        size_t n = active.size();
+        size_t start = iChunk < nParts ? n * iChunk / nParts : n;
+        size_t end = iChunk < nParts ? n * (iChunk + 1) / nParts : n;
+        solveActive(start, end);
+        if (!barrier.wait()) return;
+        commitActive(start, end, chunks[iChunk]);
+        if (!barrier.wait()) return;
+
+        if (iChunk == 0) mergeActive();
       }
+    };
+
+    // A thread which throws releases the others from the barrier, and parallelForChunks() passes on the exception
+    parallelForChunks(nThreadsUsed, [&](size_t iChunk) {
+      try {
+        runRounds(iChunk);
+      } catch (...) {
+        barrier.abort();
+        throw;
+      }
+    });
+  }
 
-      // Check the third point of the "right" triangle straddling this edge
-      Halfedge heT = he.twin();
-      if (heT.isInterior()) {
-        Vertex newVert = heT.next().next().vertex();
-        if (!finalized[newVert]) {
-
-          // Compute the distance
-          double lenB = edgeLengths[heT.next().edge()];
-          double distB = currDist;
-          double lenA = edgeLengths[heT.next().next().edge()];
-          double distA = distances[neighVert];
-          double theta = oppAngles[heT];
-          double newDist = eikonalDistanceSubroutine(lenA, lenB, theta, distA, distB);
-
-          if (newDist < distances[newVert]) {
-            frontierPQ.push(std::make_pair(newDist, newVert));
-            distances[newVert] = newDist;
-          }
+  for (size_t iV : touched) {
+    if (distance[iV] <= maxDistance) {
+      reached.push_back(iV);
+    }
+  }
+  nReached = reached.size();
+}
+
+void FastMarchingDistanceSolver::solveActive(size_t start, size_t end) {
+  for (size_t i = start; i < end; i++) {
+    if (!onProbation[i] && distance[active[i]] > bandLimit) {
+      newDistance[i] = std::numeric_limits<double>::quiet_NaN(); // deferred
+    } else {
+      newDistance[i] = solveAt(active[i]);
+    }
+  }
+}
+
+void FastMarchingDistanceSolver::commitActive(size_t start, size_t end, ActiveChunk& chunk) {
+  for (size_t i = start; i < end; i++) {
+    size_t iV = active[i];
+    if (std::isnan(newDistance[i])) {
+      chunk.deferred.push_back(iV);
+    } else if (newDistance[i] < distance[iV]) {
+      chunk.minImproved = std::min(chunk.minImproved, newDistance[i]);
+      if (distance[iV] == std::numeric_limits<double>::infinity()) {
+        chunk.newlyTouched.push_back(iV);
+      }
+      distance[iV] = newDistance[i];
+      chunk.improved.push_back(iV);
+      chunk.nUpdates++;
+    } else if (!onProbation[i] && distance[iV] <= maxDistance) {
+
+      // Settled, so its neighbors might now improve. Other chunks may still be committing their distances, so the
+      // neighbors are filtered by distance when merging.
+      for (size_t j = neighborStart[iV]; j < neighborStart[iV + 1]; j++) {
+        size_t iN = neighbors[j].vertex;
+        if (activeRound[iN] != round) {
+          chunk.neighbors.push_back(std::make_pair(iN, distance[iV]));
         }
       }
     }
   }
+}
 
-  return distances;
+void FastMarchingDistanceSolver::mergeActive() {
+  round++;
+  active.clear();
+  onProbation.clear();
+  double minDist = std::numeric_limits<double>::infinity();
+  for (ActiveChunk& chunk : chunks) {
+    for (size_t iV : chunk.improved) {
+      activeRound[iV] = round;
+      active.push_back(iV);
+      onProbation.push_back(false);
+    }
+    for (size_t iV : chunk.deferred) {
+      activeRound[iV] = round;
+      active.push_back(iV);
+      onProbation.push_back(false);
+      minDist = std::min(minDist, distance[iV]);
+    }
+    minDist = std::min(minDist, chunk.minImproved);
+  }
+  bandLimit = minDist + bandWidth * meanEdgeLength;
+  for (ActiveChunk& chunk : chunks) {
+    for (const std::pair<size_t, double>& n : chunk.neighbors) {
+      // Only neighbors farther away could improve, since an update is never smaller than the distances it comes from
+      size_t iV = n.first;
+      if (activeRound[iV] != round && distance[iV] > n.second) {
+        activeRound[iV] = round;
+        active.push_back(iV);
+        onProbation.push_back(true);
+      }
+    }
+    touched.insert(touched.end(), chunk.newlyTouched.begin(), chunk.newlyTouched.end());
+    nUpdates += chunk.nUpdates;
+
+    chunk.improved.clear();
+    chunk.deferred.clear();
+    chunk.minImproved = std::numeric_limits<double>::infinity();
+    chunk.neighbors.clear();
+    chunk.newlyTouched.clear();
+    chunk.nUpdates = 0;
+  }
+  newDistance.resize(active.size());
+  nRounds++;
+}
+
+double FastMarchingDistanceSolver::solveAt(size_t iV) const {
+  double best = std::numeric_limits<double>::infinity();
+  for (size_t i = neighborStart[iV]; i < neighborStart[iV + 1]; i++) {
+    best = std::min(best, distance[neighbors[i].vertex] + neighbors[i].length);
+  }
+
+  for (size_t i = triangleStart[iV]; i < triangleStart[iV + 1]; i++) {
+    const Triangle& t = triangles[i];
+    double dA = distance[t.vertexA];
+    double dB = distance[t.vertexB];
+
+    // The update through a triangle is no smaller than the smaller of the two distances. Otherwise, call the
+    // subroutine as fast marching would have, when the farther of the two vertices was finalized.
+    if (!(std::min(dA, dB) < best) || std::max(dA, dB) == std::numeric_limits<double>::infinity()) continue;
+    if (dA <= dB) {
+      best = std::min(best, eikonalDistanceSubroutine(t.lengthB, t.lengthA, t.angle, dA, dB));
+    } else {
+      best = std::min(best, eikonalDistanceSubroutine(t.lengthA, t.lengthB, t.angle, dB, dA));
+    }
+  }
+  return best;
 }
 
 
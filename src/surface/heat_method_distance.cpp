@@ -1,5 +1,13 @@
 #include "geometrycentral/surface/heat_method_distance.h"
 
+#include "geometrycentral/utilities/parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <queue>
+
 
 namespace geometrycentral {
 namespace surface {
@@ -8,42 +16,284 @@ VertexData<double> heatMethodDistance(IntrinsicGeometryInterface& geom, Vertex v
 	return HeatMethodDistanceSolver(geom).computeDistance(v);
 }
 
-HeatMethodDistanceSolver::HeatMethodDistanceSolver(IntrinsicGeometryInterface& geom_, double tCoef_)
-    : tCoef(tCoef_), mesh(geom_.mesh), geom(geom_)
+ComputeTriangulationDomain::ComputeTriangulationDomain(IntrinsicGeometryInterface& inputGeom,
+                                                       ComputeTriangulation computeTri)
+    : intrinsicTri(computeTri == ComputeTriangulation::Original ? nullptr
+                                                                : new SignpostIntrinsicTriangulation(inputGeom)),
+      geom(intrinsicTri ? *intrinsicTri : inputGeom), mesh(geom.mesh) {
+
+  HalfedgeMesh& inputMesh = inputGeom.mesh;
+
+  // Build the intrinsic triangulation
+  if (computeTri == ComputeTriangulation::IntrinsicDelaunay) {
+    intrinsicTri->flipToDelaunay();
+  } else if (computeTri == ComputeTriangulation::IntrinsicDelaunayRefine) {
+    intrinsicTri->delaunayRefine();
+  }
+
+  // Find the vertex at each input vertex
+  computeVertex = VertexData<Vertex>(inputMesh);
+  computeIndex = VertexData<size_t>(inputMesh);
+  inputVertex.resize(mesh.nVertices());
+  geom.requireVertexIndices();
+  if (intrinsicTri) {
+    for (Vertex v : mesh.vertices()) {
+      const SurfacePoint& loc = intrinsicTri->vertexLocations[v];
+      if (loc.type == SurfacePointType::Vertex) {
+        computeVertex[loc.vertex] = v;
+        computeIndex[loc.vertex] = geom.vertexIndices[v];
+        inputVertex[geom.vertexIndices[v]] = loc.vertex;
+      }
+    }
+
+    inputGeom.requireVertexIndices();
+    interpolationInds.resize(inputMesh.nVertices());
+    for (Vertex v : inputMesh.vertices()) {
+      interpolationInds[inputGeom.vertexIndices[v]] = computeIndex[v];
+    }
+    inputGeom.unrequireVertexIndices();
+  } else {
+    for (Vertex v : mesh.vertices()) {
+      computeVertex[v] = v;
+      computeIndex[v] = geom.vertexIndices[v];
+      inputVertex[geom.vertexIndices[v]] = v;
+    }
+  }
+  geom.unrequireVertexIndices();
+}
+
+
+LocalRegionGrower::LocalRegionGrower(IntrinsicGeometryInterface& geom) {
+  HalfedgeMesh& mesh = geom.mesh;
+  geom.requireVertexIndices();
+  geom.requireFaceIndices();
+  geom.requireEdgeLengths();
+
+  size_t N = mesh.nVertices();
+  neighborStart.resize(N + 1);
+  vertexFaceStart.resize(N + 1);
+  for (Vertex v : mesh.vertices()) {
+    size_t iV = geom.vertexIndices[v];
+    neighborStart[iV] = neighbors.size();
+    vertexFaceStart[iV] = vertexFaces.size();
+    for (Halfedge he : v.outgoingHalfedges()) {
+      neighbors.push_back(geom.vertexIndices[he.twin().vertex()]);
+      neighborDist.push_back(geom.edgeLengths[he.edge()]);
+      if (he.isInterior()) vertexFaces.push_back(geom.faceIndices[he.face()]);
+    }
+  }
+  neighborStart[N] = neighbors.size();
+  vertexFaceStart[N] = vertexFaces.size();
+
+  // Each edge appears once from each end, so this is the mean over edges
+  for (double l : neighborDist) {
+    meanEdgeLength += l;
+  }
+  meanEdgeLength /= std::max<size_t>(neighborDist.size(), 1);
+
+  faceVertices.resize(3 * mesh.nFaces());
+  for (Face f : mesh.faces()) {
+    size_t iF = geom.faceIndices[f];
+    Halfedge he = f.halfedge();
+    for (size_t i = 0; i < 3; i++) {
+      faceVertices[3 * iF + i] = geom.vertexIndices[he.vertex()];
+      he = he.next();
+    }
+  }
+
+  geom.unrequireVertexIndices();
+  geom.unrequireFaceIndices();
+  geom.unrequireEdgeLengths();
+}
+
+void LocalRegionGrower::grow(const std::vector<size_t>& seeds, double growRadius, LocalRegion& region) const {
+
+  region.vertices.clear();
+  region.faces.clear();
+  region.faceVertices.clear();
+  region.localIndex.clear();
+  double searchRadius = graphDistanceSlack * growRadius;
+
+  // Dijkstra along edges from the seeds
+  std::unordered_map<size_t, double> graphDist;
+  typedef std::pair<double, size_t> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> pq;
+  for (size_t iS : seeds) {
+    graphDist[iS] = 0.;
+    pq.emplace(0., iS);
+  }
+  while (!pq.empty()) {
+    double d = pq.top().first;
+    size_t iV = pq.top().second;
+    pq.pop();
+    if (d > graphDist[iV] || !region.localIndex.emplace(iV, region.vertices.size()).second) continue;
+    region.vertices.push_back(iV);
+
+    for (size_t k = neighborStart[iV]; k < neighborStart[iV + 1]; k++) {
+      double nd = d + neighborDist[k];
+      if (nd > searchRadius) continue;
+      std::unordered_map<size_t, double>::iterator it = graphDist.find(neighbors[k]);
+      if (it == graphDist.end() || nd < it->second) {
+        graphDist[neighbors[k]] = nd;
+        pq.emplace(nd, neighbors[k]);
+      }
+    }
+  }
+  region.nInterior = region.vertices.size();
+
+  // All faces touching those vertices, and the remaining vertices of the faces
+  for (size_t i = 0; i < region.nInterior; i++) {
+    size_t iV = region.vertices[i];
+    region.faces.insert(region.faces.end(), vertexFaces.begin() + vertexFaceStart[iV],
+                        vertexFaces.begin() + vertexFaceStart[iV + 1]);
+  }
+  std::sort(region.faces.begin(), region.faces.end());
+  region.faces.erase(std::unique(region.faces.begin(), region.faces.end()), region.faces.end());
+  region.faceVertices.resize(3 * region.faces.size());
+  for (size_t k = 0; k < region.faces.size(); k++) {
+    for (size_t i = 0; i < 3; i++) {
+      size_t iV = faceVertices[3 * region.faces[k] + i];
+      std::pair<std::unordered_map<size_t, size_t>::iterator, bool> ins =
+          region.localIndex.emplace(iV, region.vertices.size());
+      if (ins.second) region.vertices.push_back(iV);
+      region.faceVertices[3 * k + i] = ins.first->second;
+    }
+  }
+}
+
+HeatMethodDistanceSolver::HeatMethodDistanceSolver(IntrinsicGeometryInterface& geom_, double tCoef_,
+                                                   ComputeTriangulation computeTri_)
+    : tCoef(tCoef_), computeTri(computeTri_), mesh(geom_.mesh), geom(geom_), domain(geom_, computeTri_)
 
 {
+  IntrinsicGeometryInterface& cGeom = domain.geom;
+  HalfedgeMesh& cMesh = domain.mesh;
 
   // Compute mean edge length and set shortTime
-  geom.requireEdgeLengths();
-  double meanEdgeLength = 0.;
-  for (Edge e : mesh.edges()) {
-    meanEdgeLength += geom.edgeLengths[e];
+  cGeom.requireEdgeLengths();
+  meanEdgeLength = 0.;
+  for (Edge e : cMesh.edges()) {
+    meanEdgeLength += cGeom.edgeLengths[e];
   }
-  meanEdgeLength /= mesh.nEdges();
+  meanEdgeLength /= cMesh.nEdges();
   shortTime = tCoef * meanEdgeLength * meanEdgeLength;
+  cGeom.unrequireEdgeLengths();
 
 
-  // === Build & factor the linear systems
+  // === Precompute everything else the solves need
 
-  // Mass matrix
-  geom.requireVertexGalerkinMassMatrix();
-  SparseMatrix<double>& M = geom.vertexGalerkinMassMatrix;
+  geom.requireEdgeLengths();
+  edgeLengths = geom.edgeLengths;
+  geom.unrequireEdgeLengths();
 
-  // Laplacian
-  geom.requireCotanLaplacian();
-  SparseMatrix<double>& L = geom.cotanLaplacian;
+  buildFaceOperators();
+  regionGrower = LocalRegionGrower(domain.geom);
+}
 
-  // Heat operator
-  SparseMatrix<double> heatOp = M + shortTime * L;
-  heatSolver.reset(new PositiveDefiniteSolver<double>(heatOp));
+void HeatMethodDistanceSolver::ensureHaveHeatSolver() {
+  std::call_once(heatSolverOnce, [&] {
+    std::lock_guard<std::mutex> lock(geometryMutex);
 
-  // Poisson solver
-  poissonSolver.reset(new PositiveDefiniteSolver<double>(L));
+    // Get the ingredients
+    domain.geom.requireVertexGalerkinMassMatrix();
+    domain.geom.requireCotanLaplacian();
+    SparseMatrix<double>& M = domain.geom.vertexGalerkinMassMatrix;
+    SparseMatrix<double>& L = domain.geom.cotanLaplacian;
 
+    // Build the operator
+    SparseMatrix<double> heatOp = M + shortTime * L;
+    heatSolver = cachedPositiveDefiniteSolver(heatOp);
 
-  geom.unrequireEdgeLengths();
-  geom.unrequireCotanLaplacian();
-  geom.unrequireVertexGalerkinMassMatrix();
+    domain.geom.unrequireVertexGalerkinMassMatrix();
+    domain.geom.unrequireCotanLaplacian();
+  });
+}
+
+void HeatMethodDistanceSolver::ensureHavePoissonSolver() {
+  std::call_once(poissonSolverOnce, [&] {
+    std::lock_guard<std::mutex> lock(geometryMutex);
+
+    // Get the ingredients
+    domain.geom.requireCotanLaplacian();
+    SparseMatrix<double>& L = domain.geom.cotanLaplacian;
+
+    // Build the operator
+    poissonSolver = cachedPositiveDefiniteSolver(L);
+
+    domain.geom.unrequireCotanLaplacian();
+  });
+}
+
+void HeatMethodDistanceSolver::buildFaceOperators() {
+  IntrinsicGeometryInterface& cGeom = domain.geom;
+  HalfedgeMesh& cMesh = domain.mesh;
+
+  cGeom.requireHalfedgeCotanWeights();
+  cGeom.requireHalfedgeVectorsInFace();
+  cGeom.requireEdgeLengths();
+  cGeom.requireFaceAreas();
+  cGeom.requireVertexIndices();
+  cGeom.requireFaceIndices();
+
+  size_t F = cMesh.nFaces();
+  faceOps.nFaces = F;
+  faceOps.cornerVertex.resize(3 * F);
+  faceOps.gradX.resize(3 * F);
+  faceOps.gradY.resize(3 * F);
+  faceOps.divX.resize(3 * F);
+  faceOps.divY.resize(3 * F);
+  faceOps.cotanWeight.resize(3 * F);
+  faceOps.edgeLength.resize(3 * F);
+  faceOps.faceArea.resize(F);
+
+  for (Face f : cMesh.faces()) {
+    size_t iF = cGeom.faceIndices[f];
+    faceOps.faceArea[iF] = cGeom.faceAreas[f];
+
+    // The divergence at the tail of halfedge i gets +dot(w_i, X) from halfedge i, and -dot(w_{i-1}, X) from halfedge
+    // i-1 (whose twin points out of the same vertex), where w_i is the halfedge vector scaled by its cotan weight
+    std::array<Vector2, 3> w;
+    Halfedge he = f.halfedge();
+    for (size_t i = 0; i < 3; i++) {
+      size_t c = i * F + iF;
+      Vector2 ePerp = cGeom.halfedgeVectorsInFace[he.next()].rotate90();
+      faceOps.cornerVertex[c] = cGeom.vertexIndices[he.vertex()];
+      faceOps.gradX[c] = ePerp.x;
+      faceOps.gradY[c] = ePerp.y;
+      faceOps.cotanWeight[c] = cGeom.halfedgeCotanWeights[he];
+      faceOps.edgeLength[c] = cGeom.edgeLengths[he.edge()];
+      w[i] = cGeom.halfedgeCotanWeights[he] * cGeom.halfedgeVectorsInFace[he];
+      he = he.next();
+    }
+    for (size_t i = 0; i < 3; i++) {
+      size_t c = i * F + iF;
+      Vector2 d = w[i] - w[(i + 2) % 3];
+      faceOps.divX[c] = d.x;
+      faceOps.divY[c] = d.y;
+    }
+  }
+
+  // Corners incident on each vertex, so that the divergence can be gathered per vertex
+  size_t N = cMesh.nVertices();
+  faceOps.vertexCornerStart.assign(N + 1, 0);
+  for (size_t c = 0; c < 3 * F; c++) {
+    faceOps.vertexCornerStart[faceOps.cornerVertex[c] + 1]++;
+  }
+  for (size_t iV = 0; iV < N; iV++) {
+    faceOps.vertexCornerStart[iV + 1] += faceOps.vertexCornerStart[iV];
+  }
+  faceOps.vertexCorners.resize(3 * F);
+  std::vector<size_t> fill(faceOps.vertexCornerStart.begin(), faceOps.vertexCornerStart.end() - 1);
+  for (size_t c = 0; c < 3 * F; c++) {
+    faceOps.vertexCorners[fill[faceOps.cornerVertex[c]]++] = c;
+  }
+
+  cGeom.unrequireHalfedgeCotanWeights();
+  cGeom.unrequireHalfedgeVectorsInFace();
+  cGeom.unrequireEdgeLengths();
+  cGeom.unrequireFaceAreas();
+  cGeom.unrequireVertexIndices();
+  cGeom.unrequireFaceIndices();
 }
 
 
@@ -67,62 +317,381 @@ VertexData<double> HeatMethodDistanceSolver::computeDistance(const SurfacePoint&
 }
 
 VertexData<double> HeatMethodDistanceSolver::computeDistance(const std::vector<SurfacePoint>& sourcePoints) {
-  geom.requireHalfedgeCotanWeights();
-  geom.requireHalfedgeVectorsInFace();
-  geom.requireEdgeLengths();
-  geom.requireVertexIndices();
-
 
   // === Build RHS
-  VertexData<double> rhs(mesh, 0.);
-  for (const SurfacePoint& p : sourcePoints) {
-    SurfacePoint faceP = p.inSomeFace();
+  Vector<double> rhsVec;
+  sourceHeat(sourcePoints, rhsVec);
+
+  // === Solve heat
+  ensureHaveHeatSolver();
+  Vector<double> heatVec = heatSolver.solve(rhsVec);
+
+  // === Normalize in each face and evaluate divergence, split across threads on large meshes
+  Vector<double> divergenceVec;
+  normalizedGradientDivergence(heatVec, divergenceVec);
+
+  // === Integrate divergence to get distance
+  Vector<double> distVec = integrateDivergence(divergenceVec);
+
+  // ===  Shift distance to put zero at the source set
+  shiftToSources(sourcePoints, distVec);
+
+  return VertexData<double>(mesh, domain.toInput(distVec));
+}
+
+DenseMatrix<float> HeatMethodDistanceSolver::computeDistanceBatch(const std::vector<Vertex>& sourceVerts) {
+  std::vector<SurfacePoint> surfacePoints;
+  for (Vertex v : sourceVerts) {
+    surfacePoints.emplace_back(v);
+  }
+  return computeDistanceBatch(surfacePoints);
+}
+
+DenseMatrix<float> HeatMethodDistanceSolver::computeDistanceBatch(const std::vector<SurfacePoint>& sourcePoints) {
+  DenseMatrix<float> result(sourcePoints.size(), mesh.nVertices());
+  computeDistanceBatch(sourcePoints, [&](size_t iSource, const Vector<double>& dist) {
+    result.row(iSource) = dist.transpose().cast<float>();
+  });
+  return result;
+}
+
+QuantizedDistanceMatrix
+HeatMethodDistanceSolver::computeDistanceBatchQuantized(const std::vector<Vertex>& sourceVerts) {
+  std::vector<SurfacePoint> surfacePoints;
+  for (Vertex v : sourceVerts) {
+    surfacePoints.emplace_back(v);
+  }
+  return computeDistanceBatchQuantized(surfacePoints);
+}
+
+QuantizedDistanceMatrix
+HeatMethodDistanceSolver::computeDistanceBatchQuantized(const std::vector<SurfacePoint>& sourcePoints) {
+  QuantizedDistanceMatrix result;
+  result.nSources = sourcePoints.size();
+  result.nVertices = mesh.nVertices();
+  result.values.resize(result.nSources * result.nVertices);
+  result.scale.resize(result.nSources);
+
+  const double maxQuantized = std::numeric_limits<uint16_t>::max();
+  computeDistanceBatch(sourcePoints, [&](size_t iSource, const Vector<double>& dist) {
+    // Distances are clamped at zero, since the heat method can give tiny negative values near the source
+    double maxDist = std::max(dist.maxCoeff(), 0.);
+    float scale = maxDist > 0. ? static_cast<float>(maxDist / maxQuantized) : 1.f;
+    result.scale[iSource] = scale;
+    uint16_t* row = &result.values[iSource * result.nVertices];
+    for (size_t iV = 0; iV < result.nVertices; iV++) {
+      double q = std::round(std::max(dist[iV], 0.) / scale);
+      row[iV] = static_cast<uint16_t>(std::min(q, maxQuantized));
+    }
+  });
+
+  return result;
+}
+
+void HeatMethodDistanceSolver::computeDistanceBatch(const std::vector<SurfacePoint>& sourcePoints,
+                                                    const std::function<void(size_t, const Vector<double>&)>& store) {
+
+  size_t nSources = sourcePoints.size();
+  size_t N = domain.mesh.nVertices();
+  size_t blockSize = std::max<size_t>(1, batchBlockSize);
+  ensureHaveHeatSolver();
+  ensureHavePoissonSolver();
+
+  DenseMatrix<double> rhs, heat, divergence, dist;
+  for (size_t blockStart = 0; blockStart < nSources; blockStart += blockSize) {
+    size_t K = std::min(blockSize, nSources - blockStart);
+
+    // === Build RHS, one column per source
+    rhs = DenseMatrix<double>::Zero(N, K);
+    for (size_t j = 0; j < K; j++) {
+      const SurfacePoint& p = sourcePoints[blockStart + j];
+      Vector<double> rhsCol;
+      sourceHeat({p}, rhsCol);
+      rhs.col(j) = rhsCol;
+    }
+
+    // === Solve heat for the whole block
+    heatSolver.solve(heat, rhs);
+
+    // === Normalize in each face and evaluate divergence, with sources split across threads
+    divergence.resize(N, K);
+    parallelFor(K, nThreads, [&](size_t j) {
+      Vector<double> divergenceCol;
+      normalizedGradientDivergence(heat.col(j), divergenceCol, 1);
+      divergence.col(j) = divergenceCol;
+    });
+
+    // === Integrate divergence to get distance
+    poissonSolver.solve(dist, divergence);
+
+    // ===  Shift distance to put zero at each source, and hand off the result
+    parallelFor(K, nThreads, [&](size_t j) {
+      Vector<double> distCol = dist.col(j);
+      shiftToSources({sourcePoints[blockStart + j]}, distCol);
+      store(blockStart + j, domain.toInput(distCol));
+    });
+  }
+}
+
+std::vector<std::pair<Vertex, double>>
+HeatMethodDistanceSolver::computeDistanceWithinRadius(const Vertex& sourceVert, double maxRadius) {
+  return computeDistanceWithinRadius(SurfacePoint(sourceVert), maxRadius);
+}
+
+std::vector<std::pair<Vertex, double>>
+HeatMethodDistanceSolver::computeDistanceWithinRadius(const SurfacePoint& sourcePoint, double maxRadius) {
 
-    // Set initial values at the three adjacent vertices
+  if (!(maxRadius >= 0.)) {
+    throw std::logic_error("maxRadius must be non-negative");
+  }
+
+  // The vertices of the compute triangulation where heat is placed, with their weights
+  std::vector<SurfacePoint> sourcePoints{sourcePoint};
+  std::vector<std::pair<size_t, double>> seeds;
+  std::vector<size_t> seedInds;
+  {
+    SurfacePoint faceP = sourcePoint.inSomeFace();
     Halfedge he = faceP.face.halfedge();
-    rhs[he.vertex()] += faceP.faceCoords.x;
-    rhs[he.next().vertex()] += faceP.faceCoords.y;
-    rhs[he.next().next().vertex()] += faceP.faceCoords.z;
+    for (int i = 0; i < 3; i++) {
+      seeds.emplace_back(domain.computeIndex[he.vertex()], faceP.faceCoords[i]);
+      seedInds.push_back(seeds.back().first);
+      he = he.next();
+    }
   }
-  Vector<double> rhsVec = rhs.toVector();
 
+  // Solve on a region around the ball, or globally if that region would be too large (see LocalRegionGrower)
+  LocalRegion region;
+  Vector<double> dist;
+  bool fits = regionGrower.growAndSolve(seedInds, maxRadius, region, [&](const LocalRegion& grown) {
+    solveLocalDistance(sourcePoints, seeds, grown, dist);
+    double minBoundaryDist = std::numeric_limits<double>::infinity();
+    for (size_t i = grown.nInterior; i < grown.vertices.size(); i++) {
+      minBoundaryDist = std::min(minBoundaryDist, dist[i]);
+    }
+    return minBoundaryDist;
+  });
+
+  if (!fits) {
+    VertexData<double> globalDist = computeDistance(sourcePoint);
+    std::vector<std::pair<Vertex, double>> result;
+    for (Vertex v : mesh.vertices()) {
+      if (globalDist[v] <= maxRadius) result.emplace_back(v, std::max(globalDist[v], 0.));
+    }
+    return result;
+  }
 
-  // === Solve heat
-  Vector<double> heatVec = heatSolver->solve(rhsVec);
+  std::vector<std::pair<Vertex, double>> result;
+  for (size_t i = 0; i < region.vertices.size(); i++) {
+    Vertex v = domain.inputVertex[region.vertices[i]];
+    if (dist[i] <= maxRadius && v != Vertex()) {
+      result.emplace_back(v, std::max(dist[i], 0.));
+    }
+  }
+  return result;
+}
 
+void HeatMethodDistanceSolver::solveLocalDistance(const std::vector<SurfacePoint>& sourcePoints,
+                                                  const std::vector<std::pair<size_t, double>>& seeds,
+                                                  const LocalRegion& region, Vector<double>& dist) {
 
-  // === Normalize in each face and evaluate divergence
-  Vector<double> divergenceVec = Vector<double>::Zero(mesh.nVertices());
-  for (Face f : mesh.faces()) {
+  size_t F = faceOps.nFaces;
+  size_t nRegion = region.vertices.size();
+  size_t nInterior = region.nInterior;
 
-    Vector2 gradUDir = Vector2::zero(); // warning, wrong magnitude because we don't care
-    for (Halfedge he : f.adjacentHalfedges()) {
-      Vector2 ePerp = geom.halfedgeVectorsInFace[he.next()].rotate90();
-      gradUDir += ePerp * heatVec(geom.vertexIndices[he.vertex()]);
+  // The distance is pinned to zero at the seed with the most weight (and shifted afterwards), which makes the Poisson
+  // problem on the region non-singular
+  size_t pinSeed = 0;
+  for (size_t i = 1; i < seeds.size(); i++) {
+    if (seeds[i].second > seeds[pinSeed].second) pinSeed = i;
+  }
+  size_t pin = region.localIndex.at(seeds[pinSeed].first);
+  auto poissonIndex = [&](size_t i) { return i < pin ? i : i - 1; };
+
+  // === Build the local systems
+  // The heat problem has zero boundary values on the vertices outside the interior, while the Poisson problem uses
+  // the whole region, with natural (Neumann) boundary conditions.
+  std::vector<Eigen::Triplet<double>> heatTriplets, poissonTriplets;
+  auto addHeat = [&](size_t i, size_t j, double val) {
+    if (i < nInterior && j < nInterior) heatTriplets.emplace_back(i, j, val);
+  };
+  auto addPoisson = [&](size_t i, size_t j, double val) {
+    if (i != pin && j != pin) poissonTriplets.emplace_back(poissonIndex(i), poissonIndex(j), val);
+  };
+  for (size_t k = 0; k < region.faces.size(); k++) {
+    size_t f = region.faces[k];
+    double area = faceOps.faceArea[f];
+    for (size_t i = 0; i < 3; i++) {
+      size_t c = i * F + f;
+      size_t a = region.faceVertices[3 * k + i];
+      size_t b = region.faceVertices[3 * k + (i + 1) % 3];
+      double w = faceOps.cotanWeight[c];
+
+      // Galerkin mass matrix, and the cotan Laplacian for this halfedge
+      addHeat(a, a, area / 6. + shortTime * w);
+      addHeat(b, b, shortTime * w);
+      addHeat(a, b, area / 12. - shortTime * w);
+      addHeat(b, a, area / 12. - shortTime * w);
+      addPoisson(a, a, w);
+      addPoisson(b, b, w);
+      addPoisson(a, b, -w);
+      addPoisson(b, a, -w);
     }
+  }
+  SparseMatrix<double> heatOp(nInterior, nInterior);
+  heatOp.setFromTriplets(heatTriplets.begin(), heatTriplets.end());
+  SparseMatrix<double> poissonOp(nRegion - 1, nRegion - 1);
+  poissonOp.setFromTriplets(poissonTriplets.begin(), poissonTriplets.end());
+
+  // Local factorizations are only used by this query, so they are built directly rather than through the cache
+  PositiveDefiniteSolver<double> localHeatSolver(heatOp);
 
-    gradUDir = gradUDir.normalize();
+  // === Solve heat
+  Vector<double> rhs = Vector<double>::Zero(nInterior);
+  for (const std::pair<size_t, double>& s : seeds) {
+    rhs[region.localIndex.at(s.first)] += s.second;
+  }
+  Vector<double> heatInterior = localHeatSolver.solve(rhs);
+  Vector<double> heat = Vector<double>::Zero(nRegion);
+  heat.head(nInterior) = heatInterior;
 
-    for (Halfedge he : f.adjacentHalfedges()) {
-      double val = geom.halfedgeCotanWeights[he] * dot(geom.halfedgeVectorsInFace[he], gradUDir);
-      divergenceVec[geom.vertexIndices[he.vertex()]] += val;
-      divergenceVec[geom.vertexIndices[he.twin().vertex()]] += -val;
+  // === Normalize in each face and evaluate divergence
+  Vector<double> divergence = Vector<double>::Zero(nRegion);
+  for (size_t k = 0; k < region.faces.size(); k++) {
+    size_t f = region.faces[k];
+    const size_t* inds = &region.faceVertices[3 * k];
+    double gx = 0., gy = 0.;
+    for (size_t i = 0; i < 3; i++) {
+      size_t c = i * F + f;
+      gx += faceOps.gradX[c] * heat[inds[i]];
+      gy += faceOps.gradY[c] * heat[inds[i]];
+    }
+    double norm2 = gx * gx + gy * gy;
+    double scale = norm2 > 0. ? 1. / std::sqrt(norm2) : 0.;
+    for (size_t i = 0; i < 3; i++) {
+      size_t c = i * F + f;
+      divergence[inds[i]] += scale * (faceOps.divX[c] * gx + faceOps.divY[c] * gy);
     }
   }
 
   // === Integrate divergence to get distance
-  Vector<double> distVec = poissonSolver->solve(divergenceVec);
+  PositiveDefiniteSolver<double> localPoissonSolver(poissonOp);
+  Vector<double> poissonRHS(nRegion - 1);
+  for (size_t i = 0; i < nRegion; i++) {
+    if (i != pin) poissonRHS[poissonIndex(i)] = divergence[i];
+  }
+  Vector<double> poissonSol = localPoissonSolver.solve(poissonRHS);
+  dist.resize(nRegion);
+  for (size_t i = 0; i < nRegion; i++) {
+    dist[i] = (i == pin) ? 0. : poissonSol[poissonIndex(i)];
+  }
 
+  // === Shift distance to put zero at the source
+  double shift = sourceDistanceShift(sourcePoints, [&](size_t iV) { return dist[region.localIndex.at(iV)]; });
+  dist = dist.array() + shift;
+}
 
-  // ===  Shift distance to put zero at the source set
+std::vector<std::pair<size_t, double>>
+HeatMethodDistanceSolver::sourceVertexWeights(const std::vector<SurfacePoint>& sourcePoints) const {
+  std::vector<std::pair<size_t, double>> weights;
+  for (const SurfacePoint& p : sourcePoints) {
+    SurfacePoint faceP = p.inSomeFace();
+
+    // Heat goes to the three adjacent vertices
+    Halfedge he = faceP.face.halfedge();
+    weights.emplace_back(domain.computeIndex[he.vertex()], faceP.faceCoords.x);
+    weights.emplace_back(domain.computeIndex[he.next().vertex()], faceP.faceCoords.y);
+    weights.emplace_back(domain.computeIndex[he.next().next().vertex()], faceP.faceCoords.z);
+  }
+  return weights;
+}
+
+void HeatMethodDistanceSolver::sourceHeat(const std::vector<SurfacePoint>& sourcePoints, Vector<double>& rhs) const {
+  rhs = Vector<double>::Zero(domain.mesh.nVertices());
+  for (const std::pair<size_t, double>& w : sourceVertexWeights(sourcePoints)) {
+    rhs[w.first] += w.second;
+  }
+}
+
+void HeatMethodDistanceSolver::normalizedGradientDivergence(const Vector<double>& heat, Vector<double>& divergence) {
+  normalizedGradientDivergence(heat, divergence, kernelThreads());
+}
+
+Vector<double> HeatMethodDistanceSolver::integrateDivergence(const Vector<double>& divergence) {
+  ensureHavePoissonSolver();
+  return poissonSolver.solve(divergence);
+}
+
+void HeatMethodDistanceSolver::shiftToSources(const std::vector<SurfacePoint>& sourcePoints,
+                                              Vector<double>& dist) const {
+  double shift = sourceDistanceShift(sourcePoints, [&](size_t iV) { return dist[iV]; });
+  dist = dist.array() + shift;
+}
+
+void HeatMethodDistanceSolver::normalizedGradientDivergence(const Vector<double>& heat, Vector<double>& divergence,
+                                                            size_t nKernelThreads) {
+  size_t F = faceOps.nFaces;
+  size_t N = domain.mesh.nVertices();
+  const size_t* cv = faceOps.cornerVertex.data();
+  const double* gX = faceOps.gradX.data();
+  const double* gY = faceOps.gradY.data();
+  const double* dX = faceOps.divX.data();
+  const double* dY = faceOps.divY.data();
+  const double* u = heat.data();
+
+  // Normalized gradient in each face, and its contribution to the divergence at each corner
+  std::vector<double> cornerDivergence(3 * F);
+  double* cd = cornerDivergence.data();
+  parallelForRanges(F, nKernelThreads, [&](size_t start, size_t end) {
+    for (size_t f = start; f < end; f++) {
+      double u0 = u[cv[f]];
+      double u1 = u[cv[F + f]];
+      double u2 = u[cv[2 * F + f]];
+      double gx = gX[f] * u0 + gX[F + f] * u1 + gX[2 * F + f] * u2;
+      double gy = gY[f] * u0 + gY[F + f] * u1 + gY[2 * F + f] * u2;
+
+      // (faces where the heat is flat, e.g. where it underflowed to zero, contribute nothing)
+      double norm2 = gx * gx + gy * gy;
+      double scale = norm2 > 0. ? 1. / std::sqrt(norm2) : 0.;
+      gx *= scale;
+      gy *= scale;
+
+      cd[f] = dX[f] * gx + dY[f] * gy;
+      cd[F + f] = dX[F + f] * gx + dY[F + f] * gy;
+      cd[2 * F + f] = dX[2 * F + f] * gx + dY[2 * F + f] * gy;
+    }
+  });
+
+  // Gather the corners at each vertex
+  divergence.resize(N);
+  const size_t* start = faceOps.vertexCornerStart.data();
+  const size_t* corners = faceOps.vertexCorners.data();
+  parallelForRanges(N, nKernelThreads, [&](size_t vStart, size_t vEnd) {
+    for (size_t iV = vStart; iV < vEnd; iV++) {
+      double sum = 0.;
+      for (size_t k = start[iV]; k < start[iV + 1]; k++) {
+        sum += cd[corners[k]];
+      }
+      divergence[iV] = sum;
+    }
+  });
+}
+
+size_t HeatMethodDistanceSolver::kernelThreads() const {
+  const size_t minFacesPerThread = 1 << 14;
+  size_t maxThreads = (nThreads == 0) ? hardwareThreadCount() : nThreads;
+  return std::max<size_t>(1, std::min(maxThreads, faceOps.nFaces / minFacesPerThread));
+}
+
+double HeatMethodDistanceSolver::sourceDistanceShift(const std::vector<SurfacePoint>& sourcePoints,
+                                                     const std::function<double(size_t)>& distAtComputeIndex) const {
 
   // Helper to measure distance between two points, given their barycentric coordinates
-  auto baryDist = [&](Vector3 b1, Vector3 b2, const std::array<double, 3>& edgeLengths) {
+  auto baryDist = [&](Vector3 b1, Vector3 b2, const std::array<double, 3>& lengths) {
     // Shindler & Chen 2012, Barycentric Coordinates in Olympiad Geometry, Section 3.2
     Vector3 bVec = b2 - b1;
     double d2 = 0;
     for (int i = 0; i < 3; i++) {
-      d2 += edgeLengths[i] * edgeLengths[i] * bVec[i] * bVec[(i + 1) % 3];
+      d2 += lengths[i] * lengths[i] * bVec[i] * bVec[(i + 1) % 3];
     }
     return std::sqrt(-d2);
   };
@@ -133,8 +702,8 @@ VertexData<double> HeatMethodDistanceSolver::computeDistance(const std::vector<S
     SurfacePoint faceP = p.inSomeFace();
 
     Halfedge he0 = faceP.face.halfedge();
-    std::array<double, 3> edgeLengths{geom.edgeLengths[he0.edge()], geom.edgeLengths[he0.next().edge()],
-                                      geom.edgeLengths[he0.next().next().edge()]};
+    std::array<double, 3> faceEdgeLengths{edgeLengths[he0.edge()], edgeLengths[he0.next().edge()],
+                                          edgeLengths[he0.next().next().edge()]};
 
 
     int i = 0;
@@ -143,8 +712,8 @@ VertexData<double> HeatMethodDistanceSolver::computeDistance(const std::vector<S
       Vector3 targetP = Vector3::zero();
       targetP[i] = 1.;
 
-      double expectedDistAtVert = baryDist(faceP.faceCoords, targetP, edgeLengths);
-      double actDistAtVert = distVec[geom.vertexIndices[he.vertex()]];
+      double expectedDistAtVert = baryDist(faceP.faceCoords, targetP, faceEdgeLengths);
+      double actDistAtVert = distAtComputeIndex(domain.computeIndex[he.vertex()]);
 
       double w = faceP.faceCoords[i];
       distDiffAtSource += (actDistAtVert - expectedDistAtVert) * w;
@@ -155,17 +724,128 @@ VertexData<double> HeatMethodDistanceSolver::computeDistance(const std::vector<S
   }
   distDiffAtSource /= weightSum;
 
-  double shift = -distDiffAtSource;
-  distVec = distVec.array() + shift;
+  return -distDiffAtSource;
+}
 
-  geom.unrequireHalfedgeVectorsInFace();
-  geom.unrequireHalfedgeCotanWeights();
-  geom.requireEdgeLengths();
-  geom.unrequireVertexIndices();
+Vector<float> QuantizedDistanceMatrix::row(size_t iSource) const {
+  Vector<float> out(nVertices);
+  for (size_t iV = 0; iV < nVertices; iV++) {
+    out[iV] = scale[iSource] * values[iSource * nVertices + iV];
+  }
+  return out;
+}
+
+size_t QuantizedDistanceMatrix::memoryUsage() const {
+  return values.size() * sizeof(uint16_t) + scale.size() * sizeof(float);
+}
+
+
+
+
+SpectralHeatMethodDistanceSolver::SpectralHeatMethodDistanceSolver(IntrinsicGeometryInterface& geom_,
+                                                                   size_t nEigenpairs_, double tCoef_,
+                                                                   double truncationTimeCoef_)
+    : nEigenpairs(std::min(nEigenpairs_, geom_.mesh.nVertices())), tCoef(tCoef_),
+      truncationTimeCoef(truncationTimeCoef_), mesh(geom_.mesh), geom(geom_), distanceSolver(geom_, tCoef_) {
+
+  if (nEigenpairs == 0) {
+    throw std::logic_error("spectral heat method distance needs at least one eigenpair");
+  }
+
+  // Copy the eigenbasis, storing each vertex's coefficients contiguously, so that evaluating the basis at every vertex
+  // streams through memory once
+  geom.requireLaplaceBeltramiEigenbasis(nEigenpairs);
+  geom.requireVertexLumpedMassMatrix();
+  geom.requireFaceAreas();
+  eigenvalues = geom.laplaceBeltramiEigenvalues.head(nEigenpairs);
+  eigenvectors = geom.laplaceBeltramiEigenvectors.leftCols(nEigenpairs).cast<float>();
+  vertexMass = geom.vertexLumpedMassMatrix.diagonal();
+  double surfaceArea = 0.;
+  for (Face f : mesh.faces()) {
+    surfaceArea += geom.faceAreas[f];
+  }
+  geom.unrequireLaplaceBeltramiEigenbasis();
+  geom.unrequireVertexLumpedMassMatrix();
+  geom.unrequireFaceAreas();
+
+  // Eigenvalues which are zero up to roundoff belong to the constant functions on each component (measured as for
+  // SpectralDescriptorSolver)
+  double maxEigenvalue = eigenvalues[nEigenpairs - 1];
+  double zeroTolerance = 1e-8 * std::max(maxEigenvalue, 1. / surfaceArea);
+  firstNonzero = 0;
+  while (firstNonzero < nEigenpairs && eigenvalues[firstNonzero] <= zeroTolerance) {
+    firstNonzero++;
+  }
+
+  // A truncated basis cannot represent a short heat flow: the truncation error rings across the surface, and swamps
+  // the heat far from the source (where it is tiny), scrambling the gradient there. The error decays like
+  // exp(-maxEigenvalue t), and the heat at distance d like exp(-d^2 / 4t), so the flow must last longer for larger
+  // surfaces and smaller bases. The default constant was chosen by comparison with the heat method on a few meshes.
+  heatTime = distanceSolver.heatFlowTime();
+  if (maxEigenvalue > zeroTolerance) {
+    heatTime = std::max(heatTime, truncationTimeCoef * std::sqrt(surfaceArea / maxEigenvalue));
+  }
+  heatFilter = (-heatTime * eigenvalues.array().max(0.)).exp();
+}
+
+VertexData<double> SpectralHeatMethodDistanceSolver::computeDistance(const Vertex& sourceVert) {
+  return computeDistance(std::vector<SurfacePoint>{SurfacePoint(sourceVert)});
+}
+
+VertexData<double> SpectralHeatMethodDistanceSolver::computeDistance(const std::vector<Vertex>& sourceVerts) {
+  std::vector<SurfacePoint> surfacePoints;
+  for (Vertex v : sourceVerts) {
+    surfacePoints.emplace_back(v);
+  }
+  return computeDistance(surfacePoints);
+}
+
+VertexData<double> SpectralHeatMethodDistanceSolver::computeDistance(const SurfacePoint& sourcePoint) {
+  return computeDistance(std::vector<SurfacePoint>{sourcePoint});
+}
+
+VertexData<double> SpectralHeatMethodDistanceSolver::computeDistance(const std::vector<SurfacePoint>& sourcePoints) {
+
+  // === Project the sources onto the eigenbasis (touching only the rows at the sources), and flow heat
+  Vector<double> coefs = Vector<double>::Zero(nEigenpairs);
+  for (const std::pair<size_t, double>& w : distanceSolver.sourceVertexWeights(sourcePoints)) {
+    coefs += w.second * eigenvectors.row(w.first).transpose().cast<double>();
+  }
+  Vector<double> heatVec = (eigenvectors * heatFilter.cwiseProduct(coefs).cast<float>()).cast<double>();
+
+  // === Normalize in each face and evaluate divergence
+  Vector<double> divergenceVec;
+  distanceSolver.normalizedGradientDivergence(heatVec, divergenceVec);
+
+  // === Integrate divergence to get distance
+  Vector<double> distVec;
+  if (spectralPoisson) {
+    // L phi_i = lambda_i M phi_i with phi^T M phi = I, so L^-1 (up to a constant) is sum_i phi_i phi_i^T / lambda_i
+    Vector<double> divCoefs = (eigenvectors.transpose() * divergenceVec.cast<float>()).cast<double>();
+    for (size_t i = 0; i < nEigenpairs; i++) {
+      divCoefs[i] = (i < firstNonzero) ? 0. : divCoefs[i] / eigenvalues[i];
+    }
+    distVec = (eigenvectors * divCoefs.cast<float>()).cast<double>();
+  } else {
+    distVec = distanceSolver.integrateDivergence(divergenceVec);
+  }
+
+  // === Shift distance to put zero at the source set
+  distanceSolver.shiftToSources(sourcePoints, distVec);
 
   return VertexData<double>(mesh, distVec);
 }
 
+VertexData<double> SpectralHeatMethodDistanceSolver::computeHeatFlow(const VertexData<double>& initial, double t) {
+  if (!(t >= 0.)) {
+    throw std::logic_error("heat flow time must be non-negative");
+  }
+
+  // The eigenvectors are orthonormal with respect to the mass matrix, so the coefficients are phi^T M u
+  Vector<double> coefs = (eigenvectors.transpose() * vertexMass.cwiseProduct(initial.toVector()).cast<float>()).cast<double>();
+  coefs = coefs.cwiseProduct((-t * eigenvalues.array().max(0.)).exp().matrix());
+  return VertexData<double>(mesh, Vector<double>((eigenvectors * coefs.cast<float>()).cast<double>()));
+}
 
 } // namespace surface
 } // namespace geometrycentral
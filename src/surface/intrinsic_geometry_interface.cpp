@@ -1,7 +1,10 @@
 #include "geometrycentral/surface/intrinsic_geometry_interface.h"
 
+#include "geometrycentral/numerical/linear_solvers.h"
 //#include "geometrycentral/surface/discrete_operators.h"
 
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <limits>
 
@@ -39,7 +42,11 @@ IntrinsicGeometryInterface::IntrinsicGeometryInterface(HalfedgeMesh& mesh_) :
 
   // DEC operators need some extra work since 8 members are grouped under one require
   DECOperatorArray{&hodge0, &hodge0Inverse, &hodge1, &hodge1Inverse, &hodge2, &hodge2Inverse, &d0, &d1},
-  DECOperatorsQ(&DECOperatorArray, std::bind(&IntrinsicGeometryInterface::computeDECOperators, this), quantities)
+  DECOperatorsQ(&DECOperatorArray, std::bind(&IntrinsicGeometryInterface::computeDECOperators, this), quantities),
+
+  // Likewise, the eigenbasis manages both eigenvalues and eigenvectors
+  laplaceBeltramiEigenbasisPair(&laplaceBeltramiEigenvalues, &laplaceBeltramiEigenvectors),
+  laplaceBeltramiEigenbasisQ(&laplaceBeltramiEigenbasisPair, std::bind(&IntrinsicGeometryInterface::computeLaplaceBeltramiEigenbasis, this), quantities)
 
 
   { }
@@ -603,5 +610,178 @@ void IntrinsicGeometryInterface::computeDECOperators() {
 void IntrinsicGeometryInterface::requireDECOperators() { DECOperatorsQ.require(); }
 void IntrinsicGeometryInterface::unrequireDECOperators() { DECOperatorsQ.unrequire(); }
 
+
+// Laplace-Beltrami eigenbasis
+void IntrinsicGeometryInterface::computeLaplaceBeltramiEigenbasis() {
+  cotanLaplacianQ.ensureHave();
+  vertexLumpedMassMatrixQ.ensureHave();
+
+  // If this is a fresh computation, discard any stale basis. Otherwise we are extending the existing basis, and only
+  // need to compute the new eigenpairs.
+  if (!laplaceBeltramiEigenbasisQ.computed) {
+    laplaceBeltramiEigenvalues = Eigen::VectorXd();
+    laplaceBeltramiEigenvectors = Eigen::MatrixXd();
+  }
+
+  size_t nHeld = laplaceBeltramiEigenvectors.cols();
+  if (nHeld >= laplaceBeltramiEigenbasisSize) return;
+
+  if (!extendSmallestKEigenpairsPositiveDefinite(cotanLaplacian, vertexLumpedMassMatrix, laplaceBeltramiEigenvalues,
+                                                 laplaceBeltramiEigenvectors, laplaceBeltramiEigenbasisSize - nHeld)) {
+    throw std::runtime_error("Laplace-Beltrami eigensolver did not converge");
+  }
+}
+void IntrinsicGeometryInterface::requireLaplaceBeltramiEigenbasis(size_t k) {
+  if (k > mesh.nVertices()) {
+    throw std::logic_error("cannot require more Laplace-Beltrami eigenpairs than there are vertices");
+  }
+
+  laplaceBeltramiEigenbasisSize = std::max(laplaceBeltramiEigenbasisSize, k);
+
+  // Grow an existing basis if needed
+  if (laplaceBeltramiEigenbasisQ.computed &&
+      static_cast<size_t>(laplaceBeltramiEigenvectors.cols()) < laplaceBeltramiEigenbasisSize) {
+    computeLaplaceBeltramiEigenbasis();
+  }
+
+  laplaceBeltramiEigenbasisQ.require();
+}
+void IntrinsicGeometryInterface::unrequireLaplaceBeltramiEigenbasis() {
+  laplaceBeltramiEigenbasisQ.unrequire();
+
+  // Once nothing requires the basis, forget the sizes that were asked for, so that a basis computed again after it is
+  // cleared only has the eigenpairs which are required then
+  if (laplaceBeltramiEigenbasisQ.requireCount == 0) {
+    laplaceBeltramiEigenbasisSize = 0;
+  }
+}
+
+uint64_t IntrinsicGeometryInterface::laplaceBeltramiEigenbasisFingerprint() {
+  edgeLengthsQ.ensureHave();
+
+  // FNV-1a over the bits of every edge length, in edge order, so any change to a length (or to their order) gives a
+  // different hash
+  uint64_t hash = 14695981039346656037ull;
+  auto hashBytes = [&](const void* data, size_t nBytes) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < nBytes; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  uint64_t nEdges = mesh.nEdges();
+  hashBytes(&nEdges, sizeof(nEdges));
+  for (Edge e : mesh.edges()) {
+    double l = edgeLengths[e];
+    if (l == 0.) l = 0.; // treat -0 as 0
+    hashBytes(&l, sizeof(l));
+  }
+  return hash;
+}
+
+namespace {
+const char eigenbasisFileMagic[8] = {'G', 'C', 'L', 'B', 'E', 'I', 'G', '\0'};
+const uint32_t eigenbasisFileVersion = 2;
+} // namespace
+
+void IntrinsicGeometryInterface::writeLaplaceBeltramiEigenbasis(std::string filename) {
+  if (!laplaceBeltramiEigenbasisQ.computed) {
+    throw std::logic_error("no Laplace-Beltrami eigenbasis to write; require it first");
+  }
+
+  std::ofstream outStream(filename, std::ios::out | std::ios::binary);
+  if (!outStream) {
+    throw std::runtime_error("couldn't open file " + filename);
+  }
+
+  // Header
+  uint64_t nVerts = laplaceBeltramiEigenvectors.rows();
+  uint64_t nEigs = laplaceBeltramiEigenvectors.cols();
+  uint64_t fingerprint = laplaceBeltramiEigenbasisFingerprint();
+  outStream.write(eigenbasisFileMagic, sizeof(eigenbasisFileMagic));
+  outStream.write(reinterpret_cast<const char*>(&eigenbasisFileVersion), sizeof(eigenbasisFileVersion));
+  outStream.write(reinterpret_cast<const char*>(&nVerts), sizeof(nVerts));
+  outStream.write(reinterpret_cast<const char*>(&nEigs), sizeof(nEigs));
+  outStream.write(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+
+  // Data
+  outStream.write(reinterpret_cast<const char*>(laplaceBeltramiEigenvalues.data()), nEigs * sizeof(double));
+  outStream.write(reinterpret_cast<const char*>(laplaceBeltramiEigenvectors.data()), nVerts * nEigs * sizeof(double));
+
+  if (!outStream) {
+    throw std::runtime_error("error while writing file " + filename);
+  }
+}
+
+void IntrinsicGeometryInterface::readLaplaceBeltramiEigenbasis(std::string filename) {
+
+  std::ifstream inStream(filename, std::ios::in | std::ios::binary);
+  if (!inStream) {
+    throw std::runtime_error("couldn't open file " + filename);
+  }
+
+  // Header
+  char magic[sizeof(eigenbasisFileMagic)];
+  uint32_t version;
+  uint64_t nVerts, nEigs;
+  uint64_t fingerprint;
+  auto readOrThrow = [&](void* data, size_t nBytes) {
+    inStream.read(static_cast<char*>(data), nBytes);
+    if (!inStream) {
+      throw std::runtime_error("file " + filename + " ended unexpectedly");
+    }
+  };
+  readOrThrow(magic, sizeof(magic));
+  if (std::memcmp(magic, eigenbasisFileMagic, sizeof(magic)) != 0) {
+    throw std::runtime_error("file " + filename + " is not a Laplace-Beltrami eigenbasis");
+  }
+  readOrThrow(&version, sizeof(version));
+  if (version != eigenbasisFileVersion) {
+    throw std::runtime_error("file " + filename + " has unsupported eigenbasis format version " +
+                             std::to_string(version));
+  }
+  readOrThrow(&nVerts, sizeof(nVerts));
+  readOrThrow(&nEigs, sizeof(nEigs));
+  readOrThrow(&fingerprint, sizeof(fingerprint));
+
+  // Make sure the basis belongs to this geometry
+  if (nVerts != mesh.nVertices() || fingerprint != laplaceBeltramiEigenbasisFingerprint()) {
+    throw std::runtime_error("eigenbasis in file " + filename + " was computed on a different geometry");
+  }
+
+  // Check the sizes before allocating for them: there are at most as many eigenpairs as vertices, and the rest of the
+  // file must hold all of them
+  if (nEigs > nVerts) {
+    throw std::runtime_error("corrupt eigenbasis in file " + filename + " (more eigenpairs than vertices)");
+  }
+  std::streampos dataStart = inStream.tellg();
+  inStream.seekg(0, std::ios::end);
+  std::streampos fileEnd = inStream.tellg();
+  inStream.seekg(dataStart);
+  if (!inStream || dataStart == std::streampos(-1) || fileEnd == std::streampos(-1) ||
+      static_cast<uint64_t>(fileEnd - dataStart) != (nVerts + 1) * nEigs * sizeof(double)) {
+    throw std::runtime_error("corrupt eigenbasis in file " + filename + " (wrong length)");
+  }
+
+  // Data
+  Eigen::VectorXd evals(nEigs);
+  Eigen::MatrixXd evecs(nVerts, nEigs);
+  readOrThrow(evals.data(), nEigs * sizeof(double));
+  readOrThrow(evecs.data(), nVerts * nEigs * sizeof(double));
+
+  // Keep whichever basis is larger
+  if (laplaceBeltramiEigenbasisQ.computed && static_cast<uint64_t>(laplaceBeltramiEigenvectors.cols()) >= nEigs) {
+    return;
+  }
+  laplaceBeltramiEigenvalues = evals;
+  laplaceBeltramiEigenvectors = evecs;
+  laplaceBeltramiEigenbasisQ.computed = true;
+
+  // If a larger basis is already required, grow to match
+  if (nEigs < laplaceBeltramiEigenbasisSize && laplaceBeltramiEigenbasisQ.requireCount > 0) {
+    computeLaplaceBeltramiEigenbasis();
+  }
+}
+
 } // namespace surface
 } // namespace geometrycentral
@@ -46,13 +46,13 @@ SignpostIntrinsicTriangulation::SignpostIntrinsicTriangulation(IntrinsicGeometry
     Halfedge firstHe = v.halfedge();
     Halfedge currHe = firstHe;
     do {
-      double cornerAngle = cornerAngles[currHe.corner()];
       intrinsicHalfedgeDirections[currHe] = runningAngle;
-      runningAngle += cornerAngle;
 
+      // (the last halfedge at a boundary vertex has no corner)
       if (!currHe.isInterior()) {
         break;
       }
+      runningAngle += cornerAngles[currHe.corner()];
       currHe = currHe.next().next().twin();
     } while (currHe != firstHe);
 
@@ -0,0 +1,179 @@
+#include "geometrycentral/surface/spectral_descriptors.h"
+
+#include "geometrycentral/utilities/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace geometrycentral {
+namespace surface {
+
+DenseMatrix<double> heatKernelSignature(IntrinsicGeometryInterface& geom, size_t nScales, size_t nEigenpairs) {
+  SpectralDescriptorSolver solver(geom, nEigenpairs);
+  return solver.computeHeatKernelSignature(solver.defaultHeatKernelTimes(nScales));
+}
+
+DenseMatrix<double> waveKernelSignature(IntrinsicGeometryInterface& geom, size_t nScales, size_t nEigenpairs) {
+  SpectralDescriptorSolver solver(geom, nEigenpairs);
+  return solver.computeWaveKernelSignature(solver.defaultWaveKernelLogEnergies(nScales),
+                                           solver.defaultWaveKernelSigma(nScales));
+}
+
+SpectralDescriptorSolver::SpectralDescriptorSolver(IntrinsicGeometryInterface& geom_, size_t nEigenpairs_)
+    : geom(geom_), nEigenpairs(std::min(nEigenpairs_, geom_.mesh.nVertices())) {
+
+  if (nEigenpairs == 0) {
+    throw std::logic_error("spectral descriptors need at least one eigenpair");
+  }
+  geom.requireLaplaceBeltramiEigenbasis(nEigenpairs);
+
+  // Eigenvalues which are zero up to roundoff belong to the constant functions on each component. Roundoff is measured
+  // against the largest eigenvalue, or against 1 / area if that is larger (as it is when every eigenvalue is zero); the
+  // nonzero eigenvalues of any reasonable surface are far above 1e-8 / area.
+  geom.requireFaceAreas();
+  double surfaceArea = 0.;
+  for (Face f : geom.mesh.faces()) {
+    surfaceArea += geom.faceAreas[f];
+  }
+  geom.unrequireFaceAreas();
+  const Eigen::VectorXd& evals = geom.laplaceBeltramiEigenvalues;
+  maxEigenvalue = evals[nEigenpairs - 1];
+  double zeroTolerance = 1e-8 * std::max(maxEigenvalue, 1. / surfaceArea);
+  firstNonzero = 0;
+  while (firstNonzero < nEigenpairs && evals[firstNonzero] <= zeroTolerance) {
+    firstNonzero++;
+  }
+  if (firstNonzero == nEigenpairs) {
+    geom.unrequireLaplaceBeltramiEigenbasis(); // (the destructor will not run)
+    throw std::logic_error("spectral descriptors need at least one nonzero eigenvalue; use more eigenpairs");
+  }
+  minEigenvalue = evals[firstNonzero];
+}
+
+SpectralDescriptorSolver::~SpectralDescriptorSolver() { geom.unrequireLaplaceBeltramiEigenbasis(); }
+
+DenseMatrix<double> SpectralDescriptorSolver::computeHeatKernelSignature(const std::vector<double>& times) {
+  return evaluate(heatKernelWeights(times));
+}
+
+void SpectralDescriptorSolver::computeHeatKernelSignature(
+    const std::vector<double>& times, const std::function<void(size_t, const DenseMatrix<double>&)>& consume) {
+  evaluate(heatKernelWeights(times), consume);
+}
+
+DenseMatrix<double> SpectralDescriptorSolver::computeWaveKernelSignature(const std::vector<double>& logEnergies,
+                                                                         double sigma) {
+  return evaluate(waveKernelWeights(logEnergies, sigma));
+}
+
+void SpectralDescriptorSolver::computeWaveKernelSignature(
+    const std::vector<double>& logEnergies, double sigma,
+    const std::function<void(size_t, const DenseMatrix<double>&)>& consume) {
+  evaluate(waveKernelWeights(logEnergies, sigma), consume);
+}
+
+DenseMatrix<double> SpectralDescriptorSolver::evaluate(const DenseMatrix<double>& weights) {
+
+  // Each block of vertices writes its own rows of the result
+  const Eigen::MatrixXd& phi = geom.laplaceBeltramiEigenvectors;
+  size_t N = phi.rows();
+  size_t nBlocks = (N + blockSize - 1) / blockSize;
+  DenseMatrix<double> result(N, weights.cols());
+  parallelFor(nBlocks, nThreads, [&](size_t iBlock) {
+    size_t start = iBlock * blockSize;
+    size_t n = std::min(blockSize, N - start);
+    result.middleRows(start, n).noalias() = phi.block(start, 0, n, nEigenpairs).array().square().matrix() * weights;
+  });
+  return result;
+}
+
+void SpectralDescriptorSolver::evaluate(const DenseMatrix<double>& weights,
+                                        const std::function<void(size_t, const DenseMatrix<double>&)>& consume) {
+
+  const Eigen::MatrixXd& phi = geom.laplaceBeltramiEigenvectors;
+  size_t N = phi.rows();
+  size_t nBlocks = (N + blockSize - 1) / blockSize;
+
+  // Evaluate one block per thread at a time, then hand them off in order, so that only a few blocks are ever held
+  size_t nBuffers = std::max<size_t>(1, std::min(nThreads == 0 ? hardwareThreadCount() : nThreads, nBlocks));
+  std::vector<DenseMatrix<double>> buffers(nBuffers);
+  for (size_t firstBlock = 0; firstBlock < nBlocks; firstBlock += nBuffers) {
+    size_t nRound = std::min(nBuffers, nBlocks - firstBlock);
+    parallelForChunks(nRound, [&](size_t i) {
+      size_t start = (firstBlock + i) * blockSize;
+      size_t n = std::min(blockSize, N - start);
+      buffers[i].noalias() = phi.block(start, 0, n, nEigenpairs).array().square().matrix() * weights;
+    });
+    for (size_t i = 0; i < nRound; i++) {
+      consume((firstBlock + i) * blockSize, buffers[i]);
+    }
+  }
+}
+
+DenseMatrix<double> SpectralDescriptorSolver::heatKernelWeights(const std::vector<double>& times) {
+  const Eigen::VectorXd& evals = geom.laplaceBeltramiEigenvalues;
+  DenseMatrix<double> weights(nEigenpairs, times.size());
+  for (size_t j = 0; j < times.size(); j++) {
+    if (!(times[j] >= 0.)) {
+      throw std::logic_error("heat kernel signature times must be non-negative");
+    }
+    for (size_t i = 0; i < nEigenpairs; i++) {
+      // Flush weights which are negligible to zero, as arithmetic on denormal numbers is very slow
+      double x = times[j] * std::max(evals[i], 0.);
+      weights(i, j) = x < 600. ? std::exp(-x) : 0.;
+    }
+  }
+  return weights;
+}
+
+DenseMatrix<double> SpectralDescriptorSolver::waveKernelWeights(const std::vector<double>& logEnergies, double sigma) {
+  if (!(sigma > 0.)) {
+    throw std::logic_error("wave kernel signature sigma must be positive");
+  }
+
+  const Eigen::VectorXd& evals = geom.laplaceBeltramiEigenvalues;
+  DenseMatrix<double> weights = DenseMatrix<double>::Zero(nEigenpairs, logEnergies.size());
+  for (size_t j = 0; j < logEnergies.size(); j++) {
+    for (size_t i = firstNonzero; i < nEigenpairs; i++) {
+      double d = logEnergies[j] - std::log(evals[i]);
+      double x = d * d / (2. * sigma * sigma);
+      weights(i, j) = x < 600. ? std::exp(-x) : 0.;
+    }
+
+    // Normalize by the total filter weight, so that the descriptor does not depend on how densely the eigenvalues
+    // sample this energy
+    double total = weights.col(j).sum();
+    if (total > 0.) weights.col(j) /= total;
+  }
+  return weights;
+}
+
+std::vector<double> SpectralDescriptorSolver::defaultHeatKernelTimes(size_t nScales) {
+  double logMin = std::log(4. * std::log(10.) / maxEigenvalue);
+  double logMax = std::log(4. * std::log(10.) / minEigenvalue);
+  std::vector<double> times;
+  for (size_t j = 0; j < nScales; j++) {
+    double s = nScales > 1 ? static_cast<double>(j) / (nScales - 1) : 0.5;
+    times.push_back(std::exp(logMin + s * (logMax - logMin)));
+  }
+  return times;
+}
+
+std::vector<double> SpectralDescriptorSolver::defaultWaveKernelLogEnergies(size_t nScales) {
+  // The energies and their spacing delta span the eigenvalues, less 2 sigma = 14 delta at each end
+  double logMin = std::log(minEigenvalue);
+  double delta = (std::log(maxEigenvalue) - logMin) / (nScales + 27.);
+  std::vector<double> logEnergies;
+  for (size_t j = 0; j < nScales; j++) {
+    logEnergies.push_back(logMin + (14. + j) * delta);
+  }
+  return logEnergies;
+}
+
+double SpectralDescriptorSolver::defaultWaveKernelSigma(size_t nScales) {
+  return 7. * (std::log(maxEigenvalue) - std::log(minEigenvalue)) / (nScales + 27.);
+}
+
+} // namespace surface
+} // namespace geometrycentral
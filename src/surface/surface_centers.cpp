@@ -6,6 +6,10 @@
 
 #include "geometrycentral/utilities/utilities.h"
 
+#include <array>
+#include <limits>
+#include <queue>
+
 namespace geometrycentral {
 namespace surface {
 
@@ -32,154 +36,425 @@ SurfacePoint findCenter(IntrinsicGeometryInterface& geom, VectorHeatMethodSolver
 }
 
 SurfacePoint findCenter(IntrinsicGeometryInterface& geom, const VertexData<double>& distribution, int p) {
-  VectorHeatMethodSolver solver(geom);
-
-  // Forward to the general version
-  return findCenter(geom, solver, distribution, p);
+  SurfaceCenterSolver centerSolver(geom);
+  return centerSolver.findCenter(distribution, p);
 }
 
 
 SurfacePoint findCenter(IntrinsicGeometryInterface& geom, VectorHeatMethodSolver& solver,
                         const VertexData<double>& distribution, int p) {
+  SurfaceCenterSolver centerSolver(geom, solver);
+  return centerSolver.findCenter(distribution, p);
+}
 
-  if (p != 1 && p != 2) {
-    throw std::logic_error("only p=1 or p=2 is supported");
-  }
 
+namespace {
+// = A few parameters
+const double initialStepSize = 1.0;
+const int maxLineSearchIters = 8;
+const double convergeThresh = 1 / 3.; // convergence once step is this fraction of face size
+} // namespace
+
+// The state of one center. Each evaluation of a log map at the pending point (first the initial guess, then candidate
+// steps) advances the Weiszfeld iteration and line search by one move, and sets the next pending point.
+struct SurfaceCenterSolver::CenterState {
+  int p;
+
+  // The distribution, restricted to its support
+  std::vector<Vertex> supportVerts;
+  std::vector<size_t> supportInds;
+  std::vector<double> supportWeights;
+
+  // The current center, and the energy, update direction, and largest distance to the support there
+  bool haveCenter = false;
+  SurfacePoint center;
+  double energy = 0.;
+  Vector2 update = Vector2::zero();
+  double supportRadius = 0.; // (before the first evaluation, an upper bound from graph distances)
+
+  // Whether log maps are computed within a radius of the pending point, rather than over the whole surface. The two
+  // approximate the log map differently, so every point of a center is evaluated in the same way: once a center needs a
+  // global log map, it stays global, and its current center is evaluated again before comparing energies.
+  bool local = false;
+
+  // Line search
+  double stepSize = initialStepSize;
+  int lineSearchIter = 0;
+  int iter = 0;
+  Vector2 stepVec = Vector2::zero();
+
+  // The point where a log map is needed next, its face vertices, and the coefficients which take the log maps at those
+  // vertices to the log map at the point
+  SurfacePoint pending;
+  std::array<Vertex, 3> pendingVerts;
+  std::array<Vector2, 3> pendingCoefs;
+
+  bool done = false;
+};
+
+
+SurfaceCenterSolver::SurfaceCenterSolver(IntrinsicGeometryInterface& geom_)
+    : geom(geom_), mesh(geom_.mesh), ownedSolver(new VectorHeatMethodSolver(geom_)), solver(*ownedSolver),
+      localLogMap(geom_.mesh, Vector2::zero()), localHits(geom_.mesh, 0),
+      graphDist(geom_.mesh, std::numeric_limits<double>::infinity()) {
+  geom.requireFaceAreas();
+  geom.requireEdgeLengths();
+  geom.requireHalfedgeVectorsInVertex();
+  geom.requireHalfedgeVectorsInFace();
+  geom.requireVertexIndices();
 
-  HalfedgeMesh& mesh = geom.mesh;
+  surfaceArea = 0.;
+  for (Face f : mesh.faces()) {
+    surfaceArea += geom.faceAreas[f];
+  }
+  meshDiameter = std::sqrt(surfaceArea); // an approximate mesh diameter, used as a parameter in the p=1 case
+}
 
+SurfaceCenterSolver::SurfaceCenterSolver(IntrinsicGeometryInterface& geom_, VectorHeatMethodSolver& solver_)
+    : geom(geom_), mesh(geom_.mesh), solver(solver_), localLogMap(geom_.mesh, Vector2::zero()),
+      localHits(geom_.mesh, 0), graphDist(geom_.mesh, std::numeric_limits<double>::infinity()) {
   geom.requireFaceAreas();
+  geom.requireEdgeLengths();
   geom.requireHalfedgeVectorsInVertex();
   geom.requireHalfedgeVectorsInFace();
+  geom.requireVertexIndices();
 
-  SurfacePoint initialGuess;
-
-  // Reasonable initial guess: the vertex with the most stuff at it
-  // double biggestVal = -std::numeric_limits<double>::infinity();
-  // for (Vertex v : mesh.vertices()) {
-  // if (distribution[v] > biggestVal) {
-  // biggestVal = distribution[v];
-  // initialGuess = SurfacePoint(v);
-  //}
-  //}
-
-  // Random initial guess
-  initialGuess = SurfacePoint(mesh.vertex(randomIndex(mesh.nVertices())));
-
-  // Compute an approximate mesh diameter to use as parameter in the p=1 case
-  double meshDiameter = 1.;
-  if (p == 1) {
-    double surfaceArea = 0.;
-    for (Face f : mesh.faces()) {
-      surfaceArea += geom.faceAreas[f];
-    }
-    meshDiameter = std::sqrt(surfaceArea);
+  surfaceArea = 0.;
+  for (Face f : mesh.faces()) {
+    surfaceArea += geom.faceAreas[f];
   }
+  meshDiameter = std::sqrt(surfaceArea);
+}
 
+SurfaceCenterSolver::~SurfaceCenterSolver() {
+  geom.unrequireFaceAreas();
+  geom.unrequireEdgeLengths();
+  geom.unrequireHalfedgeVectorsInVertex();
+  geom.unrequireHalfedgeVectorsInFace();
+  geom.unrequireVertexIndices();
+}
 
-  // = A few parameters
-  int maxIters = 100;
-  double initialStepSize = 1.0;
-  double p1DistanceEps = 1e-9 * meshDiameter; // soften the fraction in p = 1 case to avoid divide by 0
-  double convergeThresh = 1 / 3.;             // convergence once step is this fraction of face size
-  double faceMapThreshold = 10.;              // switch from using per-vertex maps to sub-vertex
-                                              //    accurate maps. units of local face length scale.
+SurfacePoint SurfaceCenterSolver::findCenter(const VertexData<double>& distribution, int p) {
+  return findCenters({distribution}, p)[0];
+}
 
+SurfacePoint SurfaceCenterSolver::findCenter(const VertexData<double>& distribution, const SurfacePoint& initialGuess,
+                                             int p) {
+  return findCenters({distribution}, {initialGuess}, p)[0];
+}
 
-  auto evalEnergyAndUpdate = [&](SurfacePoint aboutPoint) -> std::tuple<double, Vector2> {
-    // Compute the current log map
-    // Solve at the face point
-    VertexData<Vector2> logmap = solver.computeLogMap(aboutPoint);
+std::vector<SurfacePoint> SurfaceCenterSolver::findCenters(const std::vector<VertexData<double>>& distributions,
+                                                           int p) {
+  return findCenters(distributions, std::vector<SurfacePoint>(distributions.size()), p);
+}
 
-    // Evaluate energy and update step
-    double thisEnergy = 0.;
-    Vector2 thisUpdate = Vector2::zero();
-    double updateWeightSum = 0.;
-    for (Vertex v : mesh.vertices()) {
-      if (distribution[v] == 0.) continue;
+std::vector<SurfacePoint> SurfaceCenterSolver::findCenters(const std::vector<VertexData<double>>& distributions,
+                                                           const std::vector<SurfacePoint>& initialGuesses, int p) {
 
-      Vector2 pointCoord = logmap[v];
-      double dist2 = pointCoord.norm2();
+  if (p != 1 && p != 2) {
+    throw std::logic_error("only p=1 or p=2 is supported");
+  }
+  if (initialGuesses.size() != distributions.size()) {
+    throw std::logic_error("must have one initial guess per distribution");
+  }
 
-      if (p == 1) {
-        double dist = std::sqrt(dist2);
-        double w = distribution[v];
+  nIterations = 0;
+  nLogMaps = 0;
+  nLocalLogMaps = 0;
 
-        // Energy
-        thisEnergy += dist * w;
+  std::vector<CenterState> states(distributions.size());
+  for (size_t i = 0; i < distributions.size(); i++) {
+    initialize(states[i], distributions[i], initialGuesses[i], p);
+  }
 
-        // Update
-        thisUpdate += w * pointCoord / (dist + p1DistanceEps);
-        updateWeightSum += w / (dist + p1DistanceEps);
+  // Each round, evaluate a log map at the pending point of every unfinished center. Those whose support is known to be
+  // small are evaluated on their own within a radius, and the rest together.
+  while (true) {
+    std::vector<CenterState*> globalStates;
+    for (CenterState& state : states) {
+      if (state.done) continue;
+      if (state.local && evaluateLocal(state)) continue;
+      globalStates.push_back(&state);
+    }
+    bool anyActive = !globalStates.empty();
+    for (CenterState& state : states) {
+      anyActive = anyActive || !state.done;
+    }
+    if (!anyActive) break;
+    evaluateGlobal(globalStates);
+  }
 
-      } else if (p == 2) {
-        double w = distribution[v];
+  std::vector<SurfacePoint> centers;
+  for (CenterState& state : states) {
+    centers.push_back(state.center);
+  }
+  return centers;
+}
 
-        // Energy
-        thisEnergy += dist2 * w;
+void SurfaceCenterSolver::initialize(CenterState& state, const VertexData<double>& distribution,
+                                     const SurfacePoint& initialGuess, int p) {
+  state.p = p;
+  state.local = restrictToSupport;
+
+  // Initial guess, if none is given: next to the vertex with the most stuff at it. The guess is moved off of the vertex
+  // into an adjacent face, since the Weiszfeld step for p = 1 vanishes at points of the support.
+  bool haveGuess = !(initialGuess.type == SurfacePointType::Vertex && initialGuess.vertex == Vertex());
+  Vertex biggestVert;
+  double biggestVal = 0.;
+  for (Vertex v : mesh.vertices()) {
+    if (distribution[v] == 0.) continue;
+    state.supportVerts.push_back(v);
+    state.supportInds.push_back(geom.vertexIndices[v]);
+    state.supportWeights.push_back(distribution[v]);
+    if (distribution[v] > biggestVal || biggestVert == Vertex()) {
+      biggestVal = distribution[v];
+      biggestVert = v;
+    }
+  }
+  if (state.supportVerts.empty()) {
+    throw std::logic_error("distribution must be nonzero somewhere");
+  }
 
-        // Update
-        thisUpdate += w * pointCoord;
-        updateWeightSum += w;
+  SurfacePoint guess = initialGuess;
+  if (!haveGuess) {
+    for (Halfedge he : biggestVert.outgoingHalfedges()) {
+      if (he.isInterior()) {
+        guess = SurfacePoint(he.face(), Vector3::constant(1. / 3.));
+        break;
       }
     }
-    thisUpdate /= updateWeightSum;
+  }
 
-    return std::make_tuple(thisEnergy, thisUpdate);
-  };
+  setPending(state, guess.inSomeFace());
+  state.supportRadius = graphRadius(state);
+}
 
+double SurfaceCenterSolver::graphRadius(const CenterState& state) {
 
-  // === Perform Weiszfeld iterations
-  SurfacePoint currCenter = initialGuess.inSomeFace();
+  // Dijkstra along edges from the vertices of the pending face (each starting at the length of the longest edge of the
+  // face, which bounds its distance from the point), until every vertex of the support is reached. Graph distances are
+  // never shorter than geodesic ones.
+  double maxEdgeLength = 0.;
+  for (Edge e : state.pending.face.adjacentEdges()) {
+    maxEdgeLength = std::max(maxEdgeLength, geom.edgeLengths[e]);
+  }
+  for (Vertex v : state.supportVerts) {
+    localHits[v] = 1;
+  }
 
-  bool converged = false;
-  for (int i = 0; i < maxIters; i++) {
+  std::vector<Vertex> touched;
+  typedef std::pair<double, Vertex> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> pq;
+  for (Vertex v : state.pendingVerts) {
+    if (graphDist[v] > maxEdgeLength) {
+      graphDist[v] = maxEdgeLength;
+      touched.push_back(v);
+      pq.emplace(maxEdgeLength, v);
+    }
+  }
+  size_t nRemaining = state.supportVerts.size();
+  double radius = 0.;
+  while (!pq.empty() && nRemaining > 0) {
+    double d = pq.top().first;
+    Vertex v = pq.top().second;
+    pq.pop();
+    if (d > graphDist[v]) continue;
+    if (localHits[v] == 1) {
+      localHits[v] = 0;
+      nRemaining--;
+      radius = d;
+    }
+    for (Halfedge he : v.outgoingHalfedges()) {
+      Vertex vn = he.twin().vertex();
+      double nd = d + geom.edgeLengths[he.edge()];
+      if (nd < graphDist[vn]) {
+        if (graphDist[vn] == std::numeric_limits<double>::infinity()) touched.push_back(vn);
+        graphDist[vn] = nd;
+        pq.emplace(nd, vn);
+      }
+    }
+  }
 
-    // Compute energy and update
-    double energyBefore;
-    Vector2 updateVec;
-    std::tie(energyBefore, updateVec) = evalEnergyAndUpdate(currCenter);
+  // Reset the scratch space (support vertices which were never reached are on other components)
+  for (Vertex v : touched) {
+    graphDist[v] = std::numeric_limits<double>::infinity();
+  }
+  for (Vertex v : state.supportVerts) {
+    localHits[v] = 0;
+  }
+  return nRemaining == 0 ? radius : std::numeric_limits<double>::infinity();
+}
 
-    // Line search
-    double stepSize = initialStepSize;
-    for (int lineSearchIter = 0; lineSearchIter < 8; lineSearchIter++) {
+void SurfaceCenterSolver::setPending(CenterState& state, SurfacePoint point) {
+  state.pending = point;
+  int iC = 0;
+  for (Halfedge he : point.face.adjacentHalfedges()) {
+    // Change of basis to bring the log map at each vertex to the face
+    Vector2 rot = (geom.halfedgeVectorsInFace[he] / geom.halfedgeVectorsInVertex[he]).normalize();
+    state.pendingVerts[iC] = he.vertex();
+    state.pendingCoefs[iC] = point.faceCoords[iC] * rot;
+    iC++;
+  }
+}
 
-      // Try taking a step
-      Vector2 stepVec = updateVec * stepSize;
-      TraceGeodesicResult traceResult = traceGeodesic(geom, currCenter, stepVec, true);
-      SurfacePoint candidatePoint = traceResult.endPoint.inSomeFace();
+void SurfaceCenterSolver::evaluate(CenterState& state, const std::function<Vector2(size_t)>& logMapAtSupport) {
 
-      // Compute new energy
-      double newEnergy = std::get<0>(evalEnergyAndUpdate(candidatePoint));
+  // Evaluate energy and update step
+  double p1DistanceEps = 1e-9 * meshDiameter; // soften the fraction in p = 1 case to avoid divide by 0
+  double newEnergy = 0.;
+  Vector2 newUpdate = Vector2::zero();
+  double updateWeightSum = 0.;
+  double maxDist = 0.;
+  for (size_t k = 0; k < state.supportVerts.size(); k++) {
+    Vector2 pointCoord = logMapAtSupport(k);
+    double dist2 = pointCoord.norm2();
+    double w = state.supportWeights[k];
+    maxDist = std::max(maxDist, std::sqrt(dist2));
+
+    if (state.p == 1) {
+      double dist = std::sqrt(dist2);
+      newEnergy += dist * w;
+      newUpdate += w * pointCoord / (dist + p1DistanceEps);
+      updateWeightSum += w / (dist + p1DistanceEps);
+    } else {
+      newEnergy += dist2 * w;
+      newUpdate += w * pointCoord;
+      updateWeightSum += w;
+    }
+  }
+  newUpdate /= updateWeightSum;
+
+  // The first evaluation is at the initial guess
+  if (!state.haveCenter) {
+    state.haveCenter = true;
+    state.center = state.pending;
+    state.energy = newEnergy;
+    state.update = newUpdate;
+    state.supportRadius = maxDist;
+    propose(state);
+    return;
+  }
 
-      // Check for convergence
-      double faceScale = std::sqrt(geom.faceAreas[currCenter.inSomeFace().face]);
-      if (stepVec.norm() < convergeThresh * faceScale) {
-        converged = true;
-        break;
-      }
+  // Accept the step if good. The evaluation at the new center gives the next update, and the line search starts
+  // from twice the step which worked.
+  if (newEnergy < state.energy) {
+    state.center = state.pending;
+    state.energy = newEnergy;
+    state.update = newUpdate;
+    state.supportRadius = maxDist;
+    state.iter++;
+    state.lineSearchIter = 0;
+    state.stepSize = std::min(initialStepSize, 2. * state.stepSize);
+    nIterations++;
+    propose(state);
+    return;
+  }
 
-      // Accept step if good
-      if (newEnergy < energyBefore) {
-        currCenter = candidatePoint;
-        break;
-      }
+  // Otherwise decrease step size and repeat
+  state.stepSize *= 0.5;
+  state.lineSearchIter++;
+  if (state.lineSearchIter >= maxLineSearchIters) {
+    state.done = true;
+    return;
+  }
+  propose(state);
+}
 
-      // Otherwise decrease step size and repeat
-      stepSize *= 0.5;
-    }
+void SurfaceCenterSolver::propose(CenterState& state) {
+  if (state.iter >= maxIters) {
+    state.done = true;
+    return;
+  }
 
-    if (converged) {
-      break;
-    }
+  // Check for convergence
+  state.stepVec = state.update * state.stepSize;
+  double faceScale = std::sqrt(geom.faceAreas[state.center.face]);
+  if (state.stepVec.norm() < convergeThresh * faceScale) {
+    state.done = true;
+    return;
   }
 
-  geom.unrequireFaceAreas();
-  geom.unrequireHalfedgeVectorsInVertex();
-  geom.unrequireHalfedgeVectorsInFace();
+  // Try taking a step
+  TraceGeodesicResult traceResult = traceGeodesic(geom, state.center, state.stepVec);
+  setPending(state, traceResult.endPoint.inSomeFace());
+}
 
-  return currCenter;
+bool SurfaceCenterSolver::evaluateLocal(CenterState& state) {
+
+  // Every point of the support is within this radius of the pending point (with a margin of a few edges, since the
+  // distances are approximate)
+  double maxEdgeLength = 0.;
+  for (Edge e : state.pending.face.adjacentEdges()) {
+    maxEdgeLength = std::max(maxEdgeLength, geom.edgeLengths[e]);
+  }
+  double radius = state.supportRadius + state.stepVec.norm() + 2. * maxEdgeLength;
+  if (M_PI * radius * radius > localAreaFraction * surfaceArea) {
+    switchToGlobal(state);
+    return false;
+  }
+
+  std::vector<std::pair<Vertex, Vector2>> logMap = solver.computeLogMapWithinRadius(state.pending, radius);
+  for (const std::pair<Vertex, Vector2>& p : logMap) {
+    localLogMap[p.first] = p.second;
+    localHits[p.first] = 1;
+  }
+  nLocalLogMaps++;
+
+  // Fall back on a global log map if the patch somehow missed part of the support
+  bool coversSupport = true;
+  for (Vertex v : state.supportVerts) {
+    coversSupport = coversSupport && localHits[v] == 1;
+  }
+  if (coversSupport) {
+    evaluate(state, [&](size_t k) { return localLogMap[state.supportVerts[k]]; });
+  } else {
+    switchToGlobal(state);
+  }
+
+  for (const std::pair<Vertex, Vector2>& p : logMap) {
+    localLogMap[p.first] = Vector2::zero();
+    localHits[p.first] = 0;
+  }
+  return coversSupport;
+}
+
+void SurfaceCenterSolver::switchToGlobal(CenterState& state) {
+  state.local = false;
+
+  // The energy at the current center came from a local log map, so evaluate it again rather than comparing the next
+  // trial point against it
+  if (state.haveCenter) {
+    state.haveCenter = false;
+    setPending(state, state.center);
+  }
+}
+
+void SurfaceCenterSolver::evaluateGlobal(const std::vector<CenterState*>& states) {
+
+  // Log maps at the face vertices of the pending points, for as many centers as fit in one block of the solver
+  size_t centersPerBatch = std::max<size_t>(1, solver.batchBlockSize / 3);
+  for (size_t batchStart = 0; batchStart < states.size(); batchStart += centersPerBatch) {
+    size_t batchEnd = std::min(states.size(), batchStart + centersPerBatch);
+
+    std::vector<Vertex> sources;
+    for (size_t i = batchStart; i < batchEnd; i++) {
+      for (Vertex v : states[i]->pendingVerts) {
+        sources.push_back(v);
+      }
+    }
+    LogMapMatrix logMaps = solver.computeLogMapBatch(sources);
+    nLogMaps += batchEnd - batchStart;
+
+    for (size_t i = batchStart; i < batchEnd; i++) {
+      CenterState& state = *states[i];
+      size_t iSource = 3 * (i - batchStart);
+      evaluate(state, [&](size_t k) {
+        size_t iV = state.supportInds[k];
+        return state.pendingCoefs[0] * logMaps(iSource, iV) + state.pendingCoefs[1] * logMaps(iSource + 1, iV) +
+               state.pendingCoefs[2] * logMaps(iSource + 2, iV);
+      });
+    }
+  }
 }
 
 } // namespace surface
@@ -1,72 +1,80 @@
 #include "geometrycentral/surface/vector_heat_method.h"
 
+#include "geometrycentral/utilities/parallel.h"
+
+#include <algorithm>
+
 namespace geometrycentral {
 namespace surface {
 
-VectorHeatMethodSolver::VectorHeatMethodSolver(IntrinsicGeometryInterface& geom_, double tCoef_)
-    : tCoef(tCoef_), mesh(geom_.mesh), geom(geom_)
+VectorHeatMethodSolver::VectorHeatMethodSolver(IntrinsicGeometryInterface& geom_, double tCoef_,
+                                               ComputeTriangulation computeTri_)
+    : tCoef(tCoef_), computeTri(computeTri_), mesh(geom_.mesh), geom(geom_), domain(geom_, computeTri_)
 
 {
-  geom.requireEdgeLengths();
-  geom.requireVertexLumpedMassMatrix();
+  IntrinsicGeometryInterface& cGeom = domain.geom;
+  HalfedgeMesh& cMesh = domain.mesh;
+
+  cGeom.requireEdgeLengths();
+  cGeom.requireVertexLumpedMassMatrix();
 
   // Compute mean edge length and set shortTime
-  double meanEdgeLength = 0.;
-  for (Edge e : mesh.edges()) {
-    meanEdgeLength += geom.edgeLengths[e];
+  meanEdgeLength = 0.;
+  for (Edge e : cMesh.edges()) {
+    meanEdgeLength += cGeom.edgeLengths[e];
   }
-  meanEdgeLength /= mesh.nEdges();
+  meanEdgeLength /= cMesh.nEdges();
   shortTime = tCoef * meanEdgeLength * meanEdgeLength;
 
   // We always want the mass matrix
-  massMat = geom.vertexLumpedMassMatrix;
+  massMat = cGeom.vertexLumpedMassMatrix;
 
-  geom.unrequireVertexLumpedMassMatrix();
-  geom.unrequireEdgeLengths();
+  cGeom.unrequireVertexLumpedMassMatrix();
+  cGeom.unrequireEdgeLengths();
 }
 
 
 void VectorHeatMethodSolver::ensureHaveScalarHeatSolver() {
-  if (scalarHeatSolver != nullptr) return;
+  if (scalarHeatSolver) return;
 
   // Get the ingredients
-  geom.requireCotanLaplacian();
-  SparseMatrix<double>& L = geom.cotanLaplacian;
+  domain.geom.requireCotanLaplacian();
+  SparseMatrix<double>& L = domain.geom.cotanLaplacian;
 
   // Build the operator
   SparseMatrix<double> heatOp = massMat + shortTime * L;
-  scalarHeatSolver.reset(new PositiveDefiniteSolver<double>(heatOp));
+  scalarHeatSolver = cachedPositiveDefiniteSolver(heatOp);
 
-  geom.unrequireCotanLaplacian();
+  domain.geom.unrequireCotanLaplacian();
 }
 
 void VectorHeatMethodSolver::ensureHaveVectorHeatSolver() {
-  if (vectorHeatSolver != nullptr) return;
+  if (vectorHeatSolver) return;
 
   // Get the ingredients
-  geom.requireVertexConnectionLaplacian();
-  SparseMatrix<std::complex<double>>& Lconn = geom.vertexConnectionLaplacian;
+  domain.geom.requireVertexConnectionLaplacian();
+  SparseMatrix<std::complex<double>>& Lconn = domain.geom.vertexConnectionLaplacian;
 
   // Build the operator
   SparseMatrix<std::complex<double>> vectorOp = massMat.cast<std::complex<double>>() + shortTime * Lconn;
-  vectorHeatSolver.reset(new SquareSolver<std::complex<double>>(vectorOp)); // not necessarily SPD without Delaunay
+  vectorHeatSolver = cachedSquareSolver(vectorOp); // not necessarily SPD without Delaunay
   // vectorHeatSolver.reset(new PositiveDefiniteSolver<std::complex<double>>(vectorOp));
 
-  geom.unrequireVertexConnectionLaplacian();
+  domain.geom.unrequireVertexConnectionLaplacian();
 }
 
 
 void VectorHeatMethodSolver::ensureHavePoissonSolver() {
-  if (poissonSolver != nullptr) return;
+  if (poissonSolver) return;
 
   // Get the ingredients
-  geom.requireCotanLaplacian();
-  SparseMatrix<double>& L = geom.cotanLaplacian;
+  domain.geom.requireCotanLaplacian();
+  SparseMatrix<double>& L = domain.geom.cotanLaplacian;
 
   // Build the operator
-  poissonSolver.reset(new PositiveDefiniteSolver<double>(L));
+  poissonSolver = cachedPositiveDefiniteSolver(L);
 
-  geom.unrequireCotanLaplacian();
+  domain.geom.unrequireCotanLaplacian();
 }
 
 VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::tuple<Vertex, double>>& sources) {
@@ -87,11 +95,9 @@ VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::t
 
   ensureHaveScalarHeatSolver();
 
-  geom.requireVertexIndices();
-
   // === Build the RHS
-  Vector<double> dataRHS = Vector<double>::Zero(mesh.nVertices());
-  Vector<double> indicatorRHS = Vector<double>::Zero(mesh.nVertices());
+  Vector<double> dataRHS = Vector<double>::Zero(domain.mesh.nVertices());
+  Vector<double> indicatorRHS = Vector<double>::Zero(domain.mesh.nVertices());
 
   for (auto tup : sources) {
     SurfacePoint point = std::get<0>(tup);
@@ -101,7 +107,7 @@ VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::t
     Halfedge he = facePoint.face.halfedge();
 
     { // First adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.x;
       dataRHS[vInd] += w * value;
       indicatorRHS[vInd] += w;
@@ -109,7 +115,7 @@ VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::t
     he = he.next();
 
     { // Second adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.y;
       dataRHS[vInd] += w * value;
       indicatorRHS[vInd] += w;
@@ -117,7 +123,7 @@ VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::t
     he = he.next();
 
     { // Third adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.z;
       dataRHS[vInd] += w * value;
       indicatorRHS[vInd] += w;
@@ -126,15 +132,13 @@ VertexData<double> VectorHeatMethodSolver::extendScalar(const std::vector<std::t
 
 
   // == Solve the systems
-  Vector<double> dataSol = scalarHeatSolver->solve(dataRHS);
-  Vector<double> indicatorSol = scalarHeatSolver->solve(indicatorRHS);
+  Vector<double> dataSol = scalarHeatSolver.solve(dataRHS);
+  Vector<double> indicatorSol = scalarHeatSolver.solve(indicatorRHS);
 
 
   // == Combine results
   Vector<double> interpResult = dataSol.array() / indicatorSol.array();
-  VertexData<double> result(mesh, interpResult);
-
-  geom.unrequireVertexIndices();
+  VertexData<double> result(mesh, domain.toInput(interpResult));
 
   return result;
 }
@@ -146,8 +150,6 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
     return VertexData<Vector2>(mesh, Vector2::undefined());
   }
 
-  geom.requireVertexIndices();
-
 
   // === Setup work
 
@@ -163,7 +165,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
   // === Build the RHS
 
-  Vector<std::complex<double>> dirRHS = Vector<std::complex<double>>::Zero(mesh.nVertices());
+  Vector<std::complex<double>> dirRHS = Vector<std::complex<double>>::Zero(domain.mesh.nVertices());
 
   // Accumulate magnitude data for scalar problem
   std::vector<std::tuple<SurfacePoint, double>> magnitudeSources;
@@ -180,7 +182,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
     Halfedge he = facePoint.face.halfedge();
 
     { // First adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.x;
       dirRHS[vInd] += w * unitVec;
     }
@@ -188,7 +190,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
 
     { // Second adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.y;
       dirRHS[vInd] += w * unitVec;
     }
@@ -196,7 +198,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
 
     { // Third adjacent vertex
-      size_t vInd = geom.vertexIndices[he.vertex()];
+      size_t vInd = domain.computeIndex[he.vertex()];
       double w = facePoint.faceCoords.z;
       dirRHS[vInd] += w * unitVec;
     }
@@ -205,7 +207,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
   // == Solve the system
 
-  Vector<std::complex<double>> vecSolution = vectorHeatSolver->solve(dirRHS);
+  Vector<std::complex<double>> vecSolution = vectorHeatSolver.solve(dirRHS);
 
 
   // == Get the magnitude right
@@ -219,7 +221,7 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
     // Copy to output vector
     for (Vertex v : mesh.vertices()) {
-      result[v] = Vector2::fromComplex(vecSolution[geom.vertexIndices[v]]);
+      result[v] = Vector2::fromComplex(vecSolution[domain.computeIndex[v]]);
     }
   } else {
     // For multiple sources, need to interpolate magnitudes
@@ -229,181 +231,478 @@ VectorHeatMethodSolver::transportTangentVectors(const std::vector<std::tuple<Sur
 
     // Scale and copy to result
     for (Vertex v : mesh.vertices()) {
-      Vector2 dir = Vector2::fromComplex(vecSolution[geom.vertexIndices[v]]).normalize();
+      Vector2 dir = Vector2::fromComplex(vecSolution[domain.computeIndex[v]]).normalize();
       result[v] = dir * interpMags[v];
     }
   }
 
-
-  geom.unrequireVertexIndices();
   return result;
 }
 
 
 VertexData<Vector2> VectorHeatMethodSolver::computeLogMap(const Vertex& sourceVert, double vertexDistanceShift) {
-  geom.requireFaceAreas();
-  geom.requireEdgeLengths();
-  geom.requireCornerAngles();
-  geom.requireEdgeCotanWeights();
-  geom.requireHalfedgeVectorsInVertex();
-  geom.requireTransportVectorsAlongHalfedge();
-  geom.requireVertexIndices();
-
-
-  // Make sure systems have been built and factored
-  ensureHaveVectorHeatSolver();
-  ensureHavePoissonSolver();
+  return computeLogMaps({sourceVert}, vertexDistanceShift)[0];
+}
 
-  // === Solve for "radial" field
+LogMapMatrix VectorHeatMethodSolver::computeLogMapBatch(const std::vector<Vertex>& sourceVerts) {
+  LogMapMatrix result;
+  result.nSources = sourceVerts.size();
+  result.nVertices = mesh.nVertices();
+  result.x.resize(result.nSources * result.nVertices);
+  result.y.resize(result.nSources * result.nVertices);
 
-  // Build rhs
-  Vector<std::complex<double>> radialRHS = Vector<std::complex<double>>::Zero(mesh.nVertices());
-  addVertexOutwardBall(sourceVert, radialRHS);
+  std::vector<size_t> sourceInds;
+  for (Vertex v : sourceVerts) {
+    sourceInds.push_back(domain.computeIndex[v]);
+  }
 
-  // Solve
-  Vector<std::complex<double>> radialSol = vectorHeatSolver->solve(radialRHS);
+  computeLogMapBatch(sourceInds, 0., [&](size_t iSource, const Vector<std::complex<double>>& logMap) {
+    Vector<std::complex<double>> logMapOnInput = domain.toInput(logMap);
+    float* x = &result.x[iSource * result.nVertices];
+    float* y = &result.y[iSource * result.nVertices];
+    for (size_t iV = 0; iV < result.nVertices; iV++) {
+      x[iV] = static_cast<float>(logMapOnInput[iV].real());
+      y[iV] = static_cast<float>(logMapOnInput[iV].imag());
+    }
+  });
 
-  // Normalize
-  radialSol = (radialSol.array() / radialSol.array().abs());
-  radialSol[geom.vertexIndices[sourceVert]] = 0.;
+  return result;
+}
 
+std::vector<VertexData<Vector2>> VectorHeatMethodSolver::computeLogMaps(const std::vector<Vertex>& sourceVerts,
+                                                                        double vertexDistanceShift) {
+  std::vector<size_t> sourceInds;
+  for (Vertex v : sourceVerts) {
+    sourceInds.push_back(domain.computeIndex[v]);
+  }
 
-  // === Solve for "horizontal" field
+  std::vector<VertexData<Vector2>> results(sourceVerts.size(), VertexData<Vector2>(mesh));
+  computeLogMapBatch(sourceInds, vertexDistanceShift,
+                     [&](size_t iSource, const Vector<std::complex<double>>& logMap) {
+                       VertexData<Vector2>& result = results[iSource];
+                       for (Vertex v : mesh.vertices()) {
+                         result[v] = Vector2::fromComplex(logMap[domain.computeIndex[v]]);
+                       }
+                     });
+  return results;
+}
 
-  // Build rhs
-  Vector<std::complex<double>> horizontalRHS = Vector<std::complex<double>>::Zero(mesh.nVertices());
-  horizontalRHS[geom.vertexIndices[sourceVert]] += 1.0;
+void VectorHeatMethodSolver::computeLogMapBatch(
+    const std::vector<size_t>& sourceInds, double vertexDistanceShift,
+    const std::function<void(size_t, const Vector<std::complex<double>>&)>& store) {
 
-  // Solve
-  Vector<std::complex<double>> horizontalSol = vectorHeatSolver->solve(horizontalRHS);
+  // Make sure systems have been built and factored
+  ensureHaveVectorHeatSolver();
+  ensureHavePoissonSolver();
+  ensureHaveLogMapOperators();
+  const LogMapOperators& ops = *logMapOps;
+
+  size_t nSources = sourceInds.size();
+  size_t N = domain.mesh.nVertices();
+  size_t nHalfedges = ops.tail.size();
+  size_t blockSize = std::max<size_t>(1, batchBlockSize);
+
+  DenseMatrix<std::complex<double>> rhs, fields;
+  DenseMatrix<double> divergence, distance;
+  for (size_t blockStart = 0; blockStart < nSources; blockStart += blockSize) {
+    size_t K = std::min(blockSize, nSources - blockStart);
+
+    // === Build the right hand sides: the "radial" fields in the first K columns, and the "horizontal" fields in the
+    // next K
+    rhs = DenseMatrix<std::complex<double>>::Zero(N, 2 * K);
+    for (size_t j = 0; j < K; j++) {
+      size_t iSource = sourceInds[blockStart + j];
+      rhs(iSource, j) += ops.ballCenter[iSource];
+      for (size_t k = ops.ballStart[iSource]; k < ops.ballStart[iSource + 1]; k++) {
+        rhs(ops.ballVertices[k], j) += ops.ballValues[k];
+      }
+      rhs(iSource, K + j) += 1.0;
+    }
 
-  // Normalize
-  horizontalSol = (horizontalSol.array() / horizontalSol.array().abs());
+    // === Solve for all of the fields at once
+    vectorHeatSolver.solve(fields, rhs);
+
+    // === Normalize the fields, and integrate the radial field to get distance, with sources split across threads
+    divergence.resize(N, K);
+    parallelFor(K, nThreads, [&](size_t j) {
+      auto radial = fields.col(j);
+      auto horizontal = fields.col(K + j);
+      radial = radial.array() / radial.array().abs();
+      radial[sourceInds[blockStart + j]] = 0.;
+      horizontal = horizontal.array() / horizontal.array().abs();
+
+      // The divergence is a sum over halfedges of the cotan weight times the integral of the radial field along the
+      // halfedge (negated, due to the sign of the Laplacian)
+      auto div = divergence.col(j);
+      div.setZero();
+      for (size_t iHe = 0; iHe < nHalfedges; iHe++) {
+        std::complex<double> vectAtEdge = 0.5 * (radial[ops.tail[iHe]] + ops.tipToTail[iHe] * radial[ops.tip[iHe]]);
+        double fieldAlongEdge = (vectAtEdge * std::conj(ops.edgeVector[iHe])).real();
+        div[ops.tail[iHe]] += -ops.cotanWeight[iHe] * fieldAlongEdge;
+      }
+    });
+
+    poissonSolver.solve(distance, divergence);
+
+    // === Combine distance and angle to get cartesian result, and hand it off
+    parallelFor(K, nThreads, [&](size_t j) {
+      size_t iSource = sourceInds[blockStart + j];
+      double shift = vertexDistanceShift - distance(iSource, j);
+      Vector<std::complex<double>> logMap(N);
+      for (size_t iV = 0; iV < N; iV++) {
+        std::complex<double> logDir = fields(iV, j) / fields(iV, K + j);
+        logMap[iV] = logDir * (distance(iV, j) + shift);
+      }
+      store(blockStart + j, logMap);
+    });
+  }
+}
 
+std::vector<std::pair<Vertex, Vector2>> VectorHeatMethodSolver::computeLogMapWithinRadius(const Vertex& sourceVert,
+                                                                                         double maxRadius) {
+  return computeLocalLogMap({domain.computeIndex[sourceVert]}, {Vector2{1., 0.}}, maxRadius);
+}
 
-  // === Integrate radial field to get distance
+std::vector<std::pair<Vertex, Vector2>> VectorHeatMethodSolver::computeLogMapWithinRadius(const SurfacePoint& sourceP,
+                                                                                         double maxRadius) {
 
-  // Build the right hand sign (divergence term)
-  Vector<double> divergenceVec = Vector<double>::Zero(mesh.nVertices());
-  for (Halfedge he : mesh.halfedges()) {
+  // Combine the log maps at the adjacent vertices, as in computeLogMap()
+  std::vector<size_t> sourceInds;
+  std::vector<Vector2> coefs;
+  switch (sourceP.type) {
+  case SurfacePointType::Vertex: {
+    return computeLogMapWithinRadius(sourceP.vertex, maxRadius);
+  }
+  case SurfacePointType::Edge: {
+    geom.requireHalfedgeVectorsInVertex();
+    Halfedge he = sourceP.edge.halfedge();
+    sourceInds = {domain.computeIndex[he.vertex()], domain.computeIndex[he.twin().vertex()]};
+    coefs = {(1. - sourceP.tEdge) * geom.halfedgeVectorsInVertex[he].inv().normalize(),
+             -sourceP.tEdge * geom.halfedgeVectorsInVertex[he.twin()].inv().normalize()};
+    geom.unrequireHalfedgeVectorsInVertex();
+    break;
+  }
+  case SurfacePointType::Face: {
+    geom.requireHalfedgeVectorsInVertex();
+    geom.requireHalfedgeVectorsInFace();
+    int iC = 0;
+    for (Halfedge he : sourceP.face.adjacentHalfedges()) {
+      sourceInds.push_back(domain.computeIndex[he.vertex()]);
+      coefs.push_back(sourceP.faceCoords[iC] *
+                      (geom.halfedgeVectorsInFace[he] / geom.halfedgeVectorsInVertex[he]).normalize());
+      iC++;
+    }
+    geom.unrequireHalfedgeVectorsInVertex();
+    geom.unrequireHalfedgeVectorsInFace();
+    break;
+  }
+  }
 
-    // Build the vector which is the average vector along the edge, in the basis of the tail vertex
-    Vector2 radAtTail = Vector2::fromComplex(radialSol[geom.vertexIndices[he.vertex()]]);
-    Vector2 radAtTip = Vector2::fromComplex(radialSol[geom.vertexIndices[he.twin().vertex()]]);
-    Vector2 radTipAtTail = geom.transportVectorsAlongHalfedge[he.twin()] * radAtTip;
+  return computeLocalLogMap(sourceInds, coefs, maxRadius);
+}
 
-    // Integrate the edge vector along the edge
-    Vector2 vectAtEdge = 0.5 * (radAtTail + radTipAtTail);
-    double fieldAlongEdge = dot(vectAtEdge, geom.halfedgeVectorsInVertex[he]);
+std::vector<std::pair<Vertex, Vector2>>
+VectorHeatMethodSolver::computeLocalLogMap(const std::vector<size_t>& sourceInds, const std::vector<Vector2>& coefs,
+                                           double maxRadius) {
 
-    // Contrbution to divergence is cotan times that integral
-    // (negative since we want negative divergence due to Laplacian sign)
-    double weight = geom.edgeCotanWeights[he.edge()];
-    divergenceVec[geom.vertexIndices[he.vertex()]] += -weight * fieldAlongEdge;
+  if (!(maxRadius >= 0.)) {
+    throw std::logic_error("maxRadius must be non-negative");
   }
 
-  // Integrate to get distance
-  Vector<double> distance = poissonSolver->solve(divergenceVec);
-
-  // Shift distance to be zero at the source
-  distance = distance.array() + (vertexDistanceShift - distance[geom.vertexIndices[sourceVert]]);
+  ensureHaveLogMapOperators();
+
+  // Solve on a region around the ball, or globally if that region would be too large (see LocalRegionGrower)
+  LocalRegion patch;
+  DenseMatrix<std::complex<double>> logMaps;
+  Vector<std::complex<double>> logMap;
+  bool fits = logMapOps->regionGrower.growAndSolve(sourceInds, maxRadius, patch, [&](const LocalRegion& grown) {
+    solveLocalLogMaps(sourceInds, grown, logMaps);
+    logMap = Vector<std::complex<double>>::Zero(grown.vertices.size());
+    for (size_t j = 0; j < sourceInds.size(); j++) {
+      logMap += static_cast<std::complex<double>>(coefs[j]) * logMaps.col(j);
+    }
+    double minBoundaryDist = std::numeric_limits<double>::infinity();
+    for (size_t i = grown.nInterior; i < grown.vertices.size(); i++) {
+      minBoundaryDist = std::min(minBoundaryDist, std::abs(logMap[i]));
+    }
+    return minBoundaryDist;
+  });
+
+  if (!fits) {
+    DenseMatrix<std::complex<double>> globalLogMaps(domain.mesh.nVertices(), sourceInds.size());
+    computeLogMapBatch(sourceInds, 0., [&](size_t iSource, const Vector<std::complex<double>>& sourceLogMap) {
+      globalLogMaps.col(iSource) = sourceLogMap;
+    });
+    Vector<std::complex<double>> globalLogMap = Vector<std::complex<double>>::Zero(domain.mesh.nVertices());
+    for (size_t j = 0; j < sourceInds.size(); j++) {
+      globalLogMap += static_cast<std::complex<double>>(coefs[j]) * globalLogMaps.col(j);
+    }
+    VertexData<std::complex<double>> inputLogMap(mesh, domain.toInput(globalLogMap));
+    std::vector<std::pair<Vertex, Vector2>> result;
+    for (Vertex v : mesh.vertices()) {
+      if (std::abs(inputLogMap[v]) <= maxRadius) result.emplace_back(v, Vector2::fromComplex(inputLogMap[v]));
+    }
+    return result;
+  }
 
+  std::vector<std::pair<Vertex, Vector2>> result;
+  for (size_t i = 0; i < patch.vertices.size(); i++) {
+    Vertex v = domain.inputVertex[patch.vertices[i]];
+    if (std::abs(logMap[i]) <= maxRadius && v != Vertex()) {
+      result.emplace_back(v, Vector2::fromComplex(logMap[i]));
+    }
+  }
+  return result;
+}
 
-  // Combine distance and angle to get cartesian result
-  VertexData<Vector2> result(mesh);
-  for (Vertex v : mesh.vertices()) {
-    size_t vInd = geom.vertexIndices[v];
+void VectorHeatMethodSolver::solveLocalLogMaps(const std::vector<size_t>& sourceInds, const LocalRegion& patch,
+                                               DenseMatrix<std::complex<double>>& logMaps) {
+
+  const LogMapOperators& ops = *logMapOps;
+  size_t nPatch = patch.vertices.size();
+  size_t K = sourceInds.size();
+
+  // The distance is pinned to zero at the first source, which makes the Poisson problem on the patch non-singular. The
+  // divergence of each radial field sums to zero, so each distance is then correct up to a constant, which is fixed
+  // afterwards.
+  size_t pin = patch.localIndex.at(sourceInds[0]);
+  auto poissonIndex = [&](size_t i) { return i < pin ? i : i - 1; };
+
+  // === Build the local systems
+  // All problems use the patch as a mesh with boundary, i.e. with natural (Neumann) boundary conditions. Each face
+  // contributes the cotan weight and connection of its halfedges, and a third of its area to the lumped mass at each
+  // corner, which matches the global operators at vertices whose faces are all in the patch.
+  std::vector<Eigen::Triplet<std::complex<double>>> vectorTriplets;
+  std::vector<Eigen::Triplet<double>> poissonTriplets;
+  auto addPoisson = [&](size_t i, size_t j, double val) {
+    if (i != pin && j != pin) poissonTriplets.emplace_back(poissonIndex(i), poissonIndex(j), val);
+  };
+  for (size_t k = 0; k < patch.faces.size(); k++) {
+    for (size_t i = 0; i < 3; i++) {
+      size_t iHe = ops.faceHalfedges[3 * patch.faces[k] + i];
+      size_t a = patch.faceVertices[3 * k + i];
+      size_t b = patch.faceVertices[3 * k + (i + 1) % 3];
+      double w = ops.halfedgeCotanWeight[iHe];
+      double mass = ops.faceArea[iHe] / 3.;
+
+      vectorTriplets.emplace_back(a, a, mass + shortTime * w);
+      vectorTriplets.emplace_back(b, b, shortTime * w);
+      vectorTriplets.emplace_back(a, b, -shortTime * w * ops.tipToTail[iHe]);
+      vectorTriplets.emplace_back(b, a, -shortTime * w * ops.tipToTail[ops.twin[iHe]]);
+      addPoisson(a, a, w);
+      addPoisson(b, b, w);
+      addPoisson(a, b, -w);
+      addPoisson(b, a, -w);
+    }
+  }
+  SparseMatrix<std::complex<double>> vectorOp(nPatch, nPatch);
+  vectorOp.setFromTriplets(vectorTriplets.begin(), vectorTriplets.end());
+  SparseMatrix<double> poissonOp(nPatch - 1, nPatch - 1);
+  poissonOp.setFromTriplets(poissonTriplets.begin(), poissonTriplets.end());
+
+  // === Solve for the radial fields in the first K columns, and the horizontal fields in the next K
+  DenseMatrix<std::complex<double>> rhs = DenseMatrix<std::complex<double>>::Zero(nPatch, 2 * K);
+  for (size_t j = 0; j < K; j++) {
+    size_t iSource = sourceInds[j];
+    rhs(patch.localIndex.at(iSource), j) += ops.ballCenter[iSource];
+    for (size_t k = ops.ballStart[iSource]; k < ops.ballStart[iSource + 1]; k++) {
+      rhs(patch.localIndex.at(ops.ballVertices[k]), j) += ops.ballValues[k];
+    }
+    rhs(patch.localIndex.at(iSource), K + j) += 1.0;
+  }
 
-    std::complex<double> logDir = radialSol[vInd] / horizontalSol[vInd];
-    Vector2 logCoord = Vector2::fromComplex(logDir) * distance[vInd];
-    result[v] = logCoord;
+  // The patch's factorizations are only used by this query, so they are built directly rather than through the cache
+  DenseMatrix<std::complex<double>> fields;
+  SquareSolver<std::complex<double>>(vectorOp).solve(fields, rhs);
+
+  // === Normalize, and take the divergence of each radial field, face by face
+  DenseMatrix<double> divergence = DenseMatrix<double>::Zero(nPatch - 1, K);
+  for (size_t j = 0; j < K; j++) {
+    auto radial = fields.col(j);
+    auto horizontal = fields.col(K + j);
+    radial = radial.array() / radial.array().abs();
+    radial[patch.localIndex.at(sourceInds[j])] = 0.;
+    horizontal = horizontal.array() / horizontal.array().abs();
+
+    // The radial field along halfedge iHe, which runs from local vertex a to b
+    auto fieldAlong = [&](size_t iHe, size_t a, size_t b) {
+      std::complex<double> vectAtEdge = 0.5 * (radial[a] + ops.tipToTail[iHe] * radial[b]);
+      return (vectAtEdge * std::conj(ops.edgeVector[iHe])).real();
+    };
+    for (size_t k = 0; k < patch.faces.size(); k++) {
+      for (size_t i = 0; i < 3; i++) {
+        size_t iHe = ops.faceHalfedges[3 * patch.faces[k] + i];
+        double w = ops.halfedgeCotanWeight[iHe];
+        size_t a = patch.faceVertices[3 * k + i];
+        size_t b = patch.faceVertices[3 * k + (i + 1) % 3];
+        if (a != pin) divergence(poissonIndex(a), j) += -w * fieldAlong(iHe, a, b);
+        if (b != pin) divergence(poissonIndex(b), j) += -w * fieldAlong(ops.twin[iHe], b, a);
+      }
+    }
   }
 
-  return result;
+  // === Integrate divergence to get distance
+  DenseMatrix<double> poissonSol;
+  PositiveDefiniteSolver<double>(poissonOp).solve(poissonSol, divergence);
+
+  // === Combine distance and angle, with distance zero at each source
+  logMaps.resize(nPatch, K);
+  for (size_t j = 0; j < K; j++) {
+    auto distAt = [&](size_t i) { return i == pin ? 0. : poissonSol(poissonIndex(i), j); };
+    double shift = -distAt(patch.localIndex.at(sourceInds[j]));
+    for (size_t i = 0; i < nPatch; i++) {
+      logMaps(i, j) = fields(i, j) / fields(i, K + j) * (distAt(i) + shift);
+    }
+  }
 }
 
+void VectorHeatMethodSolver::ensureHaveLogMapOperators() {
+  if (logMapOps != nullptr) return;
+
+  IntrinsicGeometryInterface& cGeom = domain.geom;
+  HalfedgeMesh& cMesh = domain.mesh;
+  cGeom.requireFaceAreas();
+  cGeom.requireEdgeLengths();
+  cGeom.requireCornerAngles();
+  cGeom.requireEdgeCotanWeights();
+  cGeom.requireHalfedgeVectorsInVertex();
+  cGeom.requireTransportVectorsAlongHalfedge();
+  cGeom.requireVertexIndices();
+  cGeom.requireHalfedgeCotanWeights();
 
-void VectorHeatMethodSolver::addVertexOutwardBall(Vertex vert, Vector<std::complex<double>>& distGradRHS) {
+  std::unique_ptr<LogMapOperators> ops(new LogMapOperators());
+  size_t N = cMesh.nVertices();
 
-  // see Vector Heat Method, Appendix A
+  // === The right hand side for the radial field from each vertex (see Vector Heat Method, Appendix A)
 
   // Height of triangle with tip at he.vertex()
   auto heightInTriangle = [&](Halfedge he) {
-    double area = geom.faceAreas[he.face()];
-    double base = geom.edgeLengths[he.next().edge()];
+    double area = cGeom.faceAreas[he.face()];
+    double base = cGeom.edgeLengths[he.next().edge()];
     return 2.0 * area / base;
   };
 
-  // Contribution to distance gradient right hand side
-
-  size_t vInd = geom.vertexIndices[vert];
-  for (Halfedge he : vert.outgoingHalfedges()) {
-    Vertex vn = he.twin().vertex();
-    size_t vnInd = geom.vertexIndices[vn];
+  ops->ballCenter.assign(N, 0.);
+  ops->ballStart.assign(N + 1, 0);
+  for (Vertex vert : cMesh.vertices()) {
+    size_t vInd = cGeom.vertexIndices[vert];
+    ops->ballStart[vInd] = ops->ballVertices.size();
 
+    for (Halfedge he : vert.outgoingHalfedges()) {
+      Vertex vn = he.twin().vertex();
+      std::complex<double> valAtNeighbor = 0.;
 
-    // he side
-    if (he.isInterior()) {
-      double h = heightInTriangle(he.next());
-      // double theta = halfedgeOppositeAngles[he.next()];
-      double theta = geom.cornerAngles[he.corner()];
+      // he side
+      if (he.isInterior()) {
+        double h = heightInTriangle(he.next());
+        double theta = cGeom.cornerAngles[he.corner()];
 
-      Vector2 valInEdgeBasis{-theta * std::sin(theta) / (2.0 * h),
-                             (theta * std::cos(theta) - std::sin(theta)) / (2.0 * h)};
+        Vector2 valInEdgeBasis{-theta * std::sin(theta) / (2.0 * h),
+                               (theta * std::cos(theta) - std::sin(theta)) / (2.0 * h)};
 
+        valAtNeighbor +=
+            static_cast<std::complex<double>>(valInEdgeBasis * cGeom.halfedgeVectorsInVertex[he.twin()].normalize());
+      }
 
-      distGradRHS[vnInd] +=
-          static_cast<std::complex<double>>(valInEdgeBasis * geom.halfedgeVectorsInVertex[he.twin()].normalize());
-    }
+      // he.twin() side
+      if (he.twin().isInterior()) {
+        double h = heightInTriangle(he.twin());
+        double theta = cGeom.cornerAngles[he.twin().next().corner()];
 
-    // he.twin() side
-    if (he.twin().isInterior()) {
-      double h = heightInTriangle(he.twin());
-      // double theta = halfedgeOppositeAngles[he.twin().next().next()];
-      double theta = geom.cornerAngles[he.twin().next().corner()];
+        Vector2 valInEdgeBasis{-theta * std::sin(theta) / (2.0 * h),
+                               -(theta * std::cos(theta) - std::sin(theta)) / (2.0 * h)};
 
-      Vector2 valInEdgeBasis{-theta * std::sin(theta) / (2.0 * h),
-                             -(theta * std::cos(theta) - std::sin(theta)) / (2.0 * h)};
+        valAtNeighbor +=
+            static_cast<std::complex<double>>(valInEdgeBasis * cGeom.halfedgeVectorsInVertex[he.twin()].normalize());
+      }
 
-      distGradRHS[vnInd] +=
-          static_cast<std::complex<double>>(valInEdgeBasis * geom.halfedgeVectorsInVertex[he.twin()].normalize());
-    }
+      ops->ballVertices.push_back(cGeom.vertexIndices[vn]);
+      ops->ballValues.push_back(valAtNeighbor);
 
-    // Contribution  to center vert
-    if (he.isInterior()) {
-      double h = heightInTriangle(he);
-      double theta = geom.cornerAngles[he.corner()];
-      double gamma = geom.cornerAngles[he.next().corner()];
-      double alpha = M_PI / 2.0 - gamma;
+      // Contribution to center vert
+      if (he.isInterior()) {
+        double h = heightInTriangle(he);
+        double theta = cGeom.cornerAngles[he.corner()];
+        double gamma = cGeom.cornerAngles[he.next().corner()];
+        double alpha = M_PI / 2.0 - gamma;
 
+        Vector2 valInEdgeBasis{-(theta * std::cos(alpha) + std::cos(alpha - theta) * std::sin(theta)) / (2.0 * h),
+                               -(std::cos(alpha) - std::cos(alpha - 2 * theta) + 2 * theta * std::sin(alpha)) /
+                                   (4.0 * h)};
 
-      Vector2 valInEdgeBasis{-(theta * std::cos(alpha) + std::cos(alpha - theta) * std::sin(theta)) / (2.0 * h),
-                             -(std::cos(alpha) - std::cos(alpha - 2 * theta) + 2 * theta * std::sin(alpha)) /
-                                 (4.0 * h)};
+        ops->ballCenter[vInd] +=
+            static_cast<std::complex<double>>(valInEdgeBasis * cGeom.halfedgeVectorsInVertex[he].normalize());
+      }
+    }
+  }
+  ops->ballStart[N] = ops->ballVertices.size();
+
+  // === Per-halfedge data for the divergence of the radial field
+  for (Halfedge he : cMesh.halfedges()) {
+    ops->tail.push_back(cGeom.vertexIndices[he.vertex()]);
+    ops->tip.push_back(cGeom.vertexIndices[he.twin().vertex()]);
+    ops->tipToTail.push_back(static_cast<std::complex<double>>(cGeom.transportVectorsAlongHalfedge[he.twin()]));
+    ops->edgeVector.push_back(static_cast<std::complex<double>>(cGeom.halfedgeVectorsInVertex[he]));
+    ops->cotanWeight.push_back(cGeom.edgeCotanWeights[he.edge()]);
+  }
 
-      distGradRHS[vInd] +=
-          static_cast<std::complex<double>>(valInEdgeBasis * geom.halfedgeVectorsInVertex[he].normalize());
+  // === Per-halfedge connectivity and weights for problems on patches
+  HalfedgeData<size_t> heInd(cMesh);
+  FaceData<size_t> fInd(cMesh);
+  size_t iHe = 0;
+  for (Halfedge he : cMesh.halfedges()) heInd[he] = iHe++;
+  size_t iF = 0;
+  for (Face f : cMesh.faces()) {
+    fInd[f] = iF++;
+    for (Halfedge he : f.adjacentHalfedges()) {
+      ops->faceHalfedges.push_back(heInd[he]);
+    }
+  }
+  for (Halfedge he : cMesh.halfedges()) {
+    bool interior = he.isInterior();
+    ops->twin.push_back(heInd[he.twin()]);
+    ops->face.push_back(interior ? fInd[he.face()] : INVALID_IND);
+    ops->length.push_back(cGeom.edgeLengths[he.edge()]);
+    ops->halfedgeCotanWeight.push_back(interior ? cGeom.halfedgeCotanWeights[he] : 0.);
+    ops->faceArea.push_back(interior ? cGeom.faceAreas[he.face()] : 0.);
+  }
+  ops->outgoingStart.assign(N + 1, 0);
+  for (Vertex vert : cMesh.vertices()) {
+    size_t vInd = cGeom.vertexIndices[vert];
+    ops->outgoingStart[vInd] = ops->outgoing.size();
+    for (Halfedge he : vert.outgoingHalfedges()) {
+      ops->outgoing.push_back(heInd[he]);
     }
   }
+  ops->outgoingStart[N] = ops->outgoing.size();
+  ops->regionGrower = LocalRegionGrower(cGeom);
+
+  cGeom.unrequireFaceAreas();
+  cGeom.unrequireEdgeLengths();
+  cGeom.unrequireCornerAngles();
+  cGeom.unrequireEdgeCotanWeights();
+  cGeom.unrequireHalfedgeVectorsInVertex();
+  cGeom.unrequireTransportVectorsAlongHalfedge();
+  cGeom.unrequireVertexIndices();
+  cGeom.unrequireHalfedgeCotanWeights();
+
+  logMapOps = std::move(ops);
 }
 
 VertexData<Vector2> VectorHeatMethodSolver::computeLogMap(const SurfacePoint& sourceP) {
-  geom.requireHalfedgeVectorsInVertex();
-  geom.requireHalfedgeVectorsInFace();
 
   switch (sourceP.type) {
   case SurfacePointType::Vertex: {
-
     return computeLogMap(sourceP.vertex);
-    break;
   }
   case SurfacePointType::Edge: {
     geom.requireHalfedgeVectorsInVertex();
 
     // Compute logmaps at both adjacent vertices
     Halfedge he = sourceP.edge.halfedge();
-    VertexData<Vector2> logmapTail = computeLogMap(he.vertex());
-    VertexData<Vector2> logmapTip = computeLogMap(he.twin().vertex());
+    std::vector<VertexData<Vector2>> logmaps = computeLogMaps({he.vertex(), he.twin().vertex()});
+    const VertexData<Vector2>& logmapTail = logmaps[0];
+    const VertexData<Vector2>& logmapTip = logmaps[1];
 
     // Changes of basis
     Vector2 tailRot = geom.halfedgeVectorsInVertex[he].inv().normalize();
@@ -417,26 +716,30 @@ VertexData<Vector2> VectorHeatMethodSolver::computeLogMap(const SurfacePoint& so
     }
 
     geom.unrequireHalfedgeVectorsInVertex();
-    break;
+    return resultMap;
   }
   case SurfacePointType::Face: {
     geom.requireHalfedgeVectorsInVertex();
     geom.requireHalfedgeVectorsInFace();
 
+    // Compute logmaps at the adjacent vertices
+    std::vector<Vertex> faceVerts;
+    for (Halfedge he : sourceP.face.adjacentHalfedges()) {
+      faceVerts.push_back(he.vertex());
+    }
+    std::vector<VertexData<Vector2>> logmaps = computeLogMaps(faceVerts);
+
     // Accumulate result from adjcent halfedges
     VertexData<Vector2> resultMap(mesh, Vector2::zero());
     int iC = 0;
     for (Halfedge he : sourceP.face.adjacentHalfedges()) {
 
-      // Commpute logmap at vertex
-      VertexData<Vector2> logmapVert = computeLogMap(he.vertex());
-
       // Compute change of basis to bring it back to the face
       Vector2 rot = (geom.halfedgeVectorsInFace[he] / geom.halfedgeVectorsInVertex[he]).normalize();
 
       // Accumulate in face fesult
       for (Vertex v : mesh.vertices()) {
-        resultMap[v] += sourceP.faceCoords[iC] * rot * logmapVert[v];
+        resultMap[v] += sourceP.faceCoords[iC] * rot * logmaps[iC][v];
       }
       iC++;
     }
@@ -445,7 +748,6 @@ VertexData<Vector2> VectorHeatMethodSolver::computeLogMap(const SurfacePoint& so
     geom.unrequireHalfedgeVectorsInVertex();
     geom.unrequireHalfedgeVectorsInFace();
     return resultMap;
-    break;
   }
   }
 
@@ -453,5 +755,7 @@ VertexData<Vector2> VectorHeatMethodSolver::computeLogMap(const SurfacePoint& so
   return VertexData<Vector2>();
 }
 
+size_t LogMapMatrix::memoryUsage() const { return (x.size() + y.size()) * sizeof(float); }
+
 } // namespace surface
 } // namespace geometrycentral
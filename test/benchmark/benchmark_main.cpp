@@ -0,0 +1,81 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/halfedge_factories.h"
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+std::tuple<std::unique_ptr<HalfedgeMesh>, std::unique_ptr<VertexPositionGeometry>> makeGridMesh(size_t n) {
+  std::vector<Vector3> positions;
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < n; j++) {
+      double u = static_cast<double>(i) / (n - 1);
+      double v = static_cast<double>(j) / (n - 1);
+      positions.push_back(Vector3{u, v, 0.1 * std::sin(3. * u) * std::cos(2. * v)});
+    }
+  }
+  std::vector<std::vector<size_t>> triangles;
+  for (size_t i = 0; i + 1 < n; i++) {
+    for (size_t j = 0; j + 1 < n; j++) {
+      size_t v00 = i * n + j;
+      size_t v10 = (i + 1) * n + j;
+      size_t v01 = i * n + j + 1;
+      size_t v11 = (i + 1) * n + j + 1;
+      triangles.push_back({v00, v10, v11});
+      triangles.push_back({v00, v11, v01});
+    }
+  }
+  return makeHalfedgeAndGeometry(triangles, positions);
+}
+
+// Usage: geometry-central-benchmarks [benchmark name, or "all"] [mesh file]
+int main(int argc, char** argv) {
+
+  std::map<std::string, std::function<void(std::string)>> benchmarks = {
+      {"concurrent_solve", concurrentSolveBenchmark},
+      {"spmv", spmvBenchmark},
+      {"complex_factorization", complexFactorizationBenchmark},
+      {"heat_distance_batch", heatDistanceBatchBenchmark},
+      {"heat_distance_intrinsic", heatDistanceIntrinsicBenchmark},
+      {"heat_distance_local", heatDistanceLocalBenchmark},
+      {"heat_distance_spectral", heatDistanceSpectralBenchmark},
+      {"log_map_batch", logMapBatchBenchmark},
+      {"log_map_local", logMapLocalBenchmark},
+      {"farthest_point_sampling", farthestPointSamplingBenchmark},
+      {"surface_centers", surfaceCentersBenchmark},
+      {"spectral_descriptors", spectralDescriptorsBenchmark},
+      {"fast_marching", fastMarchingBenchmark},
+      {"fast_marching_parallel", fastMarchingParallelBenchmark},
+      {"exact_geodesics", exactGeodesicsBenchmark},
+  };
+
+  std::string name = (argc > 1) ? argv[1] : "all";
+  std::string meshPath = (argc > 2) ? argv[2] : std::string(GC_TEST_ASSETS_ABS_PATH) + "/spot.ply";
+
+  bool found = false;
+  for (auto& benchmark : benchmarks) {
+    if (name == "all" || name == benchmark.first) {
+      cout << "=== Benchmark: " << benchmark.first << " (on " << meshPath << ")" << endl;
+      benchmark.second(meshPath);
+      found = true;
+    }
+  }
+
+  if (!found) {
+    cout << "Unknown benchmark '" << name << "'. Available benchmarks are:" << endl;
+    for (auto& benchmark : benchmarks) {
+      cout << "  " << benchmark.first << endl;
+    }
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/vertex_position_geometry.h"
+
+#include <memory>
+#include <string>
+#include <tuple>
+
+// Performance benchmarks. These print timings rather than checking results, and are not run as part of the tests.
+// Each takes the path to a mesh to run on.
+
+void concurrentSolveBenchmark(std::string meshPath);
+void spmvBenchmark(std::string meshPath);
+void complexFactorizationBenchmark(std::string meshPath);
+void heatDistanceBatchBenchmark(std::string meshPath);
+void heatDistanceIntrinsicBenchmark(std::string meshPath);
+void heatDistanceLocalBenchmark(std::string meshPath);
+void heatDistanceSpectralBenchmark(std::string meshPath);
+void logMapBatchBenchmark(std::string meshPath);
+void logMapLocalBenchmark(std::string meshPath);
+void farthestPointSamplingBenchmark(std::string meshPath);
+void surfaceCentersBenchmark(std::string meshPath);
+void spectralDescriptorsBenchmark(std::string meshPath);
+void fastMarchingBenchmark(std::string meshPath);
+void fastMarchingParallelBenchmark(std::string meshPath);
+void exactGeodesicsBenchmark(std::string meshPath);
+
+// A synthetic triangulated n x n grid, gently curved so that it is not planar
+std::tuple<std::unique_ptr<geometrycentral::surface::HalfedgeMesh>,
+           std::unique_ptr<geometrycentral::surface::VertexPositionGeometry>>
+makeGridMesh(size_t n);
@@ -0,0 +1,85 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/numerical/linear_solvers.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+namespace {
+
+template <typename T>
+void benchmarkSolver(std::string method, SparseMatrix<T>& mat, const Vector<T>& rhs, FactorStructure structure) {
+  START_TIMING(factor)
+  PositiveDefiniteSolver<T> solver(mat, FactorPrecision::Full, structure);
+  long long factorTime = FINISH_TIMING(factor);
+
+  Vector<T> x;
+  const size_t nSolves = 10;
+  START_TIMING(solve)
+  for (size_t i = 0; i < nSolves; i++) {
+    solver.solve(x, rhs);
+  }
+  long long solveTime = FINISH_TIMING(solve) / nSolves;
+
+  cout << std::setw(30) << method << std::setw(12) << mat.nonZeros() << std::setw(14) << pretty_time(factorTime)
+       << std::setw(14) << pretty_time(solveTime) << std::setw(12) << std::fixed << std::setprecision(1)
+       << solver.memoryUsage() / 1e6 << " MB" << endl;
+}
+
+// The vector heat operator M + t L of a mesh, where L is the connection Laplacian
+void benchmarkMesh(std::string name, HalfedgeMesh& mesh, VertexPositionGeometry& geometry) {
+  geometry.requireVertexConnectionLaplacian();
+  geometry.requireVertexLumpedMassMatrix();
+  geometry.requireEdgeLengths();
+  double meanEdgeLength = 0.;
+  for (Edge e : mesh.edges()) {
+    meanEdgeLength += geometry.edgeLengths[e];
+  }
+  meanEdgeLength /= mesh.nEdges();
+
+  SparseMatrix<std::complex<double>> heatOp =
+      geometry.vertexLumpedMassMatrix.cast<std::complex<double>>() +
+      meanEdgeLength * meanEdgeLength * geometry.vertexConnectionLaplacian;
+  Vector<std::complex<double>> rhs = Vector<std::complex<double>>::Random(heatOp.rows());
+
+  SparseMatrix<double> realHeatOp = complexToReal(heatOp);
+  Vector<double> realRHS = complexToReal(rhs);
+
+  cout << "  " << name << ": " << heatOp.rows() << " vertices" << endl;
+  benchmarkSolver("complex, simplicial", heatOp, rhs, FactorStructure::Simplicial);
+  benchmarkSolver("complex, supernodal", heatOp, rhs, FactorStructure::Supernodal);
+  benchmarkSolver("real embedding, simplicial", realHeatOp, realRHS, FactorStructure::Simplicial);
+  benchmarkSolver("real embedding, supernodal", realHeatOp, realRHS, FactorStructure::Supernodal);
+}
+
+} // namespace
+
+// Factoring the complex vector heat operator natively, versus as the 2N x 2N real system from complexToReal()
+void complexFactorizationBenchmark(std::string meshPath) {
+#ifndef GC_HAVE_SUITESPARSE
+  cout << "  (without Suitesparse, supernodal factorizations are simplicial)" << endl;
+#endif
+  cout << std::setw(30) << "method" << std::setw(12) << "nonzeros" << std::setw(14) << "factor" << std::setw(14)
+       << "solve" << std::setw(15) << "memory" << endl;
+
+  {
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = loadMesh(meshPath);
+    benchmarkMesh("input mesh", *mesh, *geometry);
+  }
+
+  for (size_t n : {100, 300}) {
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = makeGridMesh(n);
+    benchmarkMesh(std::to_string(n) + "x" + std::to_string(n) + " grid", *mesh, *geometry);
+  }
+}
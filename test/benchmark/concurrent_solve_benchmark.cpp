@@ -0,0 +1,77 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/numerical/linear_solvers.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+// Throughput of solves with a single shared factorization (of the heat operator, as in the heat method), as the number
+// of threads solving concurrently grows.
+void concurrentSolveBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  geometry->requireCotanLaplacian();
+  geometry->requireVertexLumpedMassMatrix();
+  geometry->requireEdgeLengths();
+  double meanEdgeLength = 0.;
+  for (Edge e : mesh->edges()) {
+    meanEdgeLength += geometry->edgeLengths[e];
+  }
+  meanEdgeLength /= mesh->nEdges();
+  SparseMatrix<double> heatOp =
+      geometry->vertexLumpedMassMatrix + meanEdgeLength * meanEdgeLength * geometry->cotanLaplacian;
+
+  START_TIMING(factor)
+  PositiveDefiniteSolver<double> solver(heatOp);
+  cout << "  factored " << heatOp.rows() << " x " << heatOp.cols() << " matrix in " << pretty_time(FINISH_TIMING(factor))
+       << endl;
+
+  const size_t solvesPerThread = 64;
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+  cout << std::setw(10) << "threads" << std::setw(16) << "solves/sec" << std::setw(12) << "speedup" << endl;
+  double baseline = -1.;
+  for (size_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+
+    // Right hand sides are generated up front, so that only solves are timed
+    std::vector<std::vector<Vector<double>>> rhs(nThreads);
+    for (size_t iThread = 0; iThread < nThreads; iThread++) {
+      for (size_t iSolve = 0; iSolve < solvesPerThread; iSolve++) {
+        rhs[iThread].push_back(Vector<double>::Random(heatOp.rows()));
+      }
+    }
+
+    START_TIMING(solves)
+    std::vector<std::thread> threads;
+    for (size_t iThread = 0; iThread < nThreads; iThread++) {
+      threads.emplace_back([&, iThread]() {
+        Vector<double> x;
+        for (const Vector<double>& b : rhs[iThread]) {
+          solver.solve(x, b);
+        }
+      });
+    }
+    for (std::thread& t : threads) {
+      t.join();
+    }
+    long long elapsed = FINISH_TIMING(solves);
+
+    double solvesPerSecond = (nThreads * solvesPerThread) / (std::max(elapsed, 1ll) * 1e-6);
+    if (baseline < 0.) baseline = solvesPerSecond;
+    cout << std::setw(10) << nThreads << std::setw(16) << std::fixed << std::setprecision(1) << solvesPerSecond
+         << std::setw(11) << std::setprecision(2) << solvesPerSecond / baseline << "x" << endl;
+  }
+}
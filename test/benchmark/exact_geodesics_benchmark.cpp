@@ -0,0 +1,160 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/exact_polyhedral_geodesics.h"
+#include "geometrycentral/surface/fast_marching_method.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+// Exact polyhedral geodesics from single sources: repeated queries on one solver (which reuse the window pool), the
+// cost and size of the window propagation, a comparison with fast marching, and then queries which stop early. On a
+// flat grid the exact distance is the Euclidean distance, which checks the result.
+void exactGeodesicsBenchmark(std::string meshPath) {
+
+  // === Flat grid, against Euclidean distance
+  {
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> curved;
+    std::tie(mesh, curved) = makeGridMesh(64);
+    VertexData<Vector3> positions = curved->inputVertexPositions;
+    for (Vertex v : mesh->vertices()) {
+      positions[v].z = 0.;
+    }
+    VertexPositionGeometry flat(*mesh, positions);
+
+    ExactPolyhedralGeodesics solver(flat);
+    double maxErr = 0.;
+    for (Vertex s : {mesh->vertex(0), mesh->vertex(mesh->nVertices() / 2 + 32)}) {
+      VertexData<double> dist = solver.computeDistance(s);
+      for (Vertex v : mesh->vertices()) {
+        maxErr = std::max(maxErr, std::abs(dist[v] - norm(positions[v] - positions[s])));
+      }
+    }
+    cout << "  flat " << mesh->nVertices() << " vertex grid: max difference from Euclidean distance " << maxErr << endl;
+  }
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  const size_t nSources = 4;
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(build)
+  ExactPolyhedralGeodesics solver(*geometry);
+  cout << "  solver construction: " << pretty_time(FINISH_TIMING(build)) << endl;
+
+  // === Exact distance, the first query growing the window pool
+  std::vector<VertexData<double>> exact;
+  size_t nWindows = 0, maxQueued = 0;
+  long long firstTime = 0;
+  START_TIMING(exact)
+  for (Vertex v : sources) {
+    START_TIMING(query)
+    exact.push_back(solver.computeDistance(v));
+    long long queryTime = FINISH_TIMING(query);
+    if (exact.size() == 1) {
+      firstTime = queryTime;
+      cout << "  first query: " << pretty_time(firstTime) << ", window storage " << solver.windowMemory / 1024
+           << " KB" << endl;
+    }
+    nWindows += solver.numOfWinGen;
+    maxQueued = std::max(maxQueued, solver.maxWinQSize);
+  }
+  long long exactTime = FINISH_TIMING(exact);
+  cout << "  exact geodesics: " << pretty_time(exactTime / nSources) << " per source, "
+       << static_cast<double>(nWindows) / nSources / mesh->nVertices() << " windows per vertex, at most " << maxQueued
+       << " queued, window storage " << solver.windowMemory / 1024 << " KB" << endl;
+
+  // === Repeated queries from the same source
+  const size_t nRepeats = 2;
+  START_TIMING(repeat)
+  for (size_t i = 0; i < nRepeats; i++) {
+    solver.computeDistance(sources[0]);
+  }
+  long long repeatTime = FINISH_TIMING(repeat);
+  cout << "  repeated query: " << pretty_time(repeatTime / nRepeats) << " ("
+       << static_cast<double>(firstTime) / std::max(repeatTime / static_cast<long long>(nRepeats), 1ll)
+       << "x over the first), of which propagation " << pretty_time(static_cast<long long>(1e6 * solver.propagationTime))
+       << endl;
+
+  // === Fast marching, which mostly overestimates distance (but can fall slightly short, across obtuse triangles)
+  FastMarchingDistanceSolver fmm(*geometry);
+  double maxOver = 0., meanOver = 0., maxUnder = 0.;
+  START_TIMING(fmm)
+  for (size_t i = 0; i < nSources; i++) {
+    VertexData<double> approx = fmm.computeDistance(sources[i]);
+    for (Vertex v : mesh->vertices()) {
+      if (exact[i][v] == 0.) continue;
+      double rel = approx[v] / exact[i][v] - 1.;
+      maxOver = std::max(maxOver, rel);
+      maxUnder = std::max(maxUnder, -rel);
+      meanOver += rel;
+    }
+  }
+  long long fmmTime = FINISH_TIMING(fmm);
+  meanOver /= nSources * (mesh->nVertices() - 1);
+  cout << "  fast marching: " << pretty_time(fmmTime / nSources) << " per source ("
+       << static_cast<double>(exactTime) / std::max(fmmTime, 1ll) << "x faster), relative error mean " << meanOver
+       << ", max " << maxOver << " over and " << maxUnder << " under" << endl;
+
+  // === Early exit at a maximum distance
+  double maxDist = 0.;
+  for (Vertex v : mesh->vertices()) {
+    maxDist = std::max(maxDist, exact[0][v]);
+  }
+  solver.maxDistance = 0.;
+  solver.computeDistanceReached({sources[0]}); // untimed, to reset the state left by the full queries
+  double maxDiff = 0.;
+  for (double fraction : {0.01, 0.1}) {
+    solver.maxDistance = fraction * maxDist;
+    size_t nReached = 0;
+    START_TIMING(ball)
+    for (size_t i = 0; i < nSources; i++) {
+      std::vector<std::pair<Vertex, double>> ball = solver.computeDistanceReached({sources[i]});
+      nReached += ball.size();
+      for (const std::pair<Vertex, double>& entry : ball) {
+        maxDiff = std::max(maxDiff, std::abs(entry.second - exact[i][entry.first]));
+      }
+    }
+    long long ballTime = FINISH_TIMING(ball);
+    cout << "  within " << fraction << " of the largest distance: " << pretty_time(ballTime / nSources) << " per source ("
+         << static_cast<double>(exactTime) / std::max(ballTime, 1ll) << "x over a full query), " << nReached / nSources
+         << " vertices reached" << endl;
+  }
+  solver.maxDistance = std::numeric_limits<double>::infinity();
+
+  // === Early exit at a target (a vertex at a tenth of the largest distance from each source)
+  size_t nReached = 0;
+  long long targetTime = 0;
+  for (size_t i = 0; i < nSources; i++) {
+    Vertex target = sources[i];
+    for (Vertex v : mesh->vertices()) {
+      if (std::abs(exact[i][v] - 0.1 * maxDist) < std::abs(exact[i][target] - 0.1 * maxDist)) target = v;
+    }
+    solver.targets = {target};
+    START_TIMING(target)
+    VertexData<double> dist = solver.computeDistance(sources[i]);
+    targetTime += FINISH_TIMING(target);
+    nReached += solver.totalCalcVertNum;
+    maxDiff = std::max(maxDiff, std::abs(dist[target] - exact[i][target]));
+  }
+  solver.targets.clear();
+  cout << "  to a single target:  " << pretty_time(targetTime / nSources) << " per source ("
+       << static_cast<double>(exactTime) / std::max(targetTime, 1ll) << "x over a full query), " << nReached / nSources
+       << " vertices touched, max difference from full queries " << maxDiff << endl;
+}
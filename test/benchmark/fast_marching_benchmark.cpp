@@ -0,0 +1,199 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/fast_marching_method.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/parallel.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+namespace {
+
+// The previous implementation: a priority queue with lazy deletion (pushing a new entry whenever a distance decreases,
+// and skipping stale entries when they are popped), navigating the mesh directly.
+VertexData<double> lazyDeletionFMM(HalfedgeMesh& mesh, Vertex source, const EdgeData<double>& edgeLengths,
+                                   const CornerData<double>& cornerAngles, size_t& nPushes) {
+  typedef std::pair<double, Vertex> Entry;
+  VertexData<double> distances(mesh, std::numeric_limits<double>::infinity());
+  VertexData<char> finalized(mesh, false);
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontierPQ;
+  frontierPQ.push(std::make_pair(0., source));
+  nPushes = 1;
+
+  while (!frontierPQ.empty()) {
+    Entry currPair = frontierPQ.top();
+    frontierPQ.pop();
+    Vertex currV = currPair.second;
+    double currDist = currPair.first;
+    if (finalized[currV]) continue;
+    distances[currV] = currDist;
+    finalized[currV] = true;
+
+    for (Halfedge he : currV.incomingHalfedges()) {
+      Vertex neighVert = he.vertex();
+      if (!finalized[neighVert]) {
+        double newDist = currDist + edgeLengths[he.edge()];
+        if (newDist < distances[neighVert]) {
+          frontierPQ.push(std::make_pair(newDist, neighVert));
+          distances[neighVert] = newDist;
+          nPushes++;
+        }
+        continue;
+      }
+      for (Halfedge heF : {he, he.twin()}) {
+        if (!heF.isInterior()) continue;
+        Halfedge heOpp = heF.next().next();
+        Vertex newVert = heOpp.vertex();
+        if (finalized[newVert]) continue;
+        bool left = heF == he;
+        double lenA = edgeLengths[(left ? heF.next() : heOpp).edge()];
+        double lenB = edgeLengths[(left ? heOpp : heF.next()).edge()];
+        double newDist =
+            eikonalDistanceSubroutine(lenA, lenB, cornerAngles[heOpp.corner()], distances[neighVert], currDist);
+        if (newDist < distances[newVert]) {
+          frontierPQ.push(std::make_pair(newDist, newVert));
+          distances[newVert] = newDist;
+          nPushes++;
+        }
+      }
+    }
+  }
+  return distances;
+}
+
+} // namespace
+
+// Fast marching from single sources: the previous lazy-deletion implementation against FastMarchingDistanceSolver,
+// then queries which stop early.
+void fastMarchingBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+  geometry->requireEdgeLengths();
+  geometry->requireCornerAngles();
+
+  const size_t nSources = 8;
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(build)
+  FastMarchingDistanceSolver solver(*geometry);
+  cout << "  solver construction: " << pretty_time(FINISH_TIMING(build)) << endl;
+
+  // === Full queries
+  std::vector<VertexData<double>> reference;
+  size_t nPushes = 0, nPushesTotal = 0;
+  START_TIMING(lazy)
+  for (Vertex v : sources) {
+    reference.push_back(lazyDeletionFMM(*mesh, v, geometry->edgeLengths, geometry->cornerAngles, nPushes));
+    nPushesTotal += nPushes;
+  }
+  long long lazyTime = FINISH_TIMING(lazy);
+
+  std::vector<VertexData<double>> result;
+  size_t nUpdatesTotal = 0;
+  START_TIMING(solve)
+  for (Vertex v : sources) {
+    result.push_back(solver.computeDistance(v));
+    nUpdatesTotal += solver.nUpdates;
+  }
+  long long solveTime = FINISH_TIMING(solve);
+
+  double maxDiff = 0., maxDist = 0.;
+  for (size_t i = 0; i < nSources; i++) {
+    for (Vertex v : mesh->vertices()) {
+      maxDiff = std::max(maxDiff, std::abs(result[i][v] - reference[i][v]));
+      maxDist = std::max(maxDist, reference[i][v]);
+    }
+  }
+  cout << "  lazy deletion queue: " << pretty_time(lazyTime / nSources) << " per source, "
+       << static_cast<double>(nPushesTotal) / nSources / mesh->nVertices() << " pushes per vertex" << endl;
+  cout << "  solver:              " << pretty_time(solveTime / nSources) << " per source ("
+       << static_cast<double>(lazyTime) / std::max(solveTime, 1ll) << "x), "
+       << static_cast<double>(nUpdatesTotal) / nSources / mesh->nVertices()
+       << " updates per vertex, max difference " << maxDiff / maxDist << " (relative)" << endl;
+
+  // === Early exit at a maximum distance
+  for (double fraction : {0.01, 0.1}) {
+    solver.maxDistance = fraction * maxDist;
+    size_t nReached = 0;
+    START_TIMING(ball)
+    for (Vertex v : sources) {
+      std::vector<std::pair<Vertex, double>> ball = solver.computeDistanceReached({std::make_pair(v, 0.)});
+      nReached += ball.size();
+    }
+    long long ballTime = FINISH_TIMING(ball);
+    cout << "  within " << fraction << " of the largest distance: " << pretty_time(ballTime / nSources) << " per source, "
+         << nReached / nSources << " vertices reached" << endl;
+  }
+  solver.maxDistance = std::numeric_limits<double>::infinity();
+
+  // === Early exit at a target (the next source along)
+  size_t nReached = 0;
+  START_TIMING(target)
+  for (size_t i = 0; i < nSources; i++) {
+    solver.targets = {sources[(i + 1) % nSources]};
+    solver.computeDistanceReached({std::make_pair(sources[i], 0.)});
+    nReached += solver.nReached;
+  }
+  long long targetTime = FINISH_TIMING(target);
+  solver.targets.clear();
+  cout << "  to a single target:  " << pretty_time(targetTime / nSources) << " per source, " << nReached / nSources
+       << " vertices reached" << endl;
+}
+
+// Strong scaling of the parallel solve (the fast iterative method) from a single source, against serial fast marching.
+void fastMarchingParallelBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  FastMarchingDistanceSolver solver(*geometry);
+  std::vector<std::pair<Vertex, double>> source{std::make_pair(mesh->vertex(0), 0.)};
+  cout << "  hardware threads: " << hardwareThreadCount() << ", mesh with " << mesh->nVertices() << " vertices"
+       << endl;
+
+  START_TIMING(serial)
+  VertexData<double> serial = solver.computeDistance(source);
+  long long serialTime = FINISH_TIMING(serial);
+  double maxDist = 0.;
+  for (Vertex v : mesh->vertices()) {
+    maxDist = std::max(maxDist, serial[v]);
+  }
+  cout << "  fast marching: " << pretty_time(serialTime) << endl;
+
+  long long oneThreadTime = 0;
+  for (size_t nThreads = 1; nThreads <= 64; nThreads *= 2) {
+    solver.nThreads = nThreads;
+    START_TIMING(parallel)
+    VertexData<double> parallel = solver.computeDistanceParallel(source);
+    long long parallelTime = FINISH_TIMING(parallel);
+    if (nThreads == 1) oneThreadTime = parallelTime;
+
+    double maxDiff = 0.;
+    for (Vertex v : mesh->vertices()) {
+      maxDiff = std::max(maxDiff, std::abs(parallel[v] - serial[v]));
+    }
+    cout << "  " << nThreads << " threads: " << pretty_time(parallelTime) << " ("
+         << static_cast<double>(oneThreadTime) / std::max(parallelTime, 1ll) << "x over 1 thread, "
+         << static_cast<double>(serialTime) / std::max(parallelTime, 1ll) << "x over fast marching), " << solver.nRounds
+         << " rounds, " << static_cast<double>(solver.nUpdates) / mesh->nVertices()
+         << " updates per vertex, max difference " << maxDiff / maxDist << " (relative)" << endl;
+  }
+}
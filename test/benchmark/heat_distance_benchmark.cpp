@@ -0,0 +1,452 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/farthest_point_sampling.h"
+#include "geometrycentral/surface/halfedge_factories.h"
+#include "geometrycentral/surface/heat_method_distance.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/surface/vector_heat_method.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+// Distances from many individual source vertices, computed one at a time and in batches.
+void heatDistanceBatchBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  HeatMethodDistanceSolver solver(*geometry);
+
+  const size_t nSources = std::min<size_t>(256, mesh->nVertices());
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(sequential)
+  std::vector<VertexData<double>> sequential;
+  for (Vertex v : sources) {
+    sequential.push_back(solver.computeDistance(v));
+  }
+  long long sequentialTime = FINISH_TIMING(sequential);
+  cout << "  one at a time:     " << pretty_time(sequentialTime) << endl;
+
+  START_TIMING(batch)
+  DenseMatrix<float> batch = solver.computeDistanceBatch(sources);
+  long long batchTime = FINISH_TIMING(batch);
+  cout << "  batched:           " << pretty_time(batchTime) << "  (" << batch.size() * sizeof(float) / (1 << 20)
+       << " MB)" << endl;
+
+  START_TIMING(quantized)
+  QuantizedDistanceMatrix quantized = solver.computeDistanceBatchQuantized(sources);
+  long long quantizedTime = FINISH_TIMING(quantized);
+  cout << "  batched quantized: " << pretty_time(quantizedTime) << "  (" << quantized.memoryUsage() / (1 << 20)
+       << " MB)" << endl;
+
+  // Agreement with the one-at-a-time distances, relative to the largest distance
+  double maxDist = 0., batchError = 0., quantizedError = 0.;
+  for (size_t i = 0; i < nSources; i++) {
+    for (size_t iV = 0; iV < mesh->nVertices(); iV++) {
+      double d = sequential[i][iV];
+      maxDist = std::max(maxDist, d);
+      batchError = std::max(batchError, std::abs(batch(i, iV) - d));
+      quantizedError = std::max(quantizedError, std::abs(quantized(i, iV) - std::max(d, 0.)));
+    }
+  }
+  cout << "  max relative error: batched " << batchError / maxDist << ", quantized " << quantizedError / maxDist << endl;
+  cout << "  speedup: " << static_cast<double>(sequentialTime) / std::max(batchTime, 1ll) << "x" << endl;
+}
+
+
+namespace {
+
+const char* computeTriangulationName(ComputeTriangulation computeTri) {
+  switch (computeTri) {
+  case ComputeTriangulation::Original:
+    return "original";
+  case ComputeTriangulation::IntrinsicDelaunay:
+    return "intrinsic Delaunay";
+  case ComputeTriangulation::IntrinsicDelaunayRefine:
+    return "intrinsic Delaunay refine";
+  }
+  return "";
+}
+
+} // namespace
+
+// Accuracy and cost of the heat method on the input triangulation and on intrinsic triangulations. Accuracy is measured
+// on a flat, strongly sheared grid (whose triangles are very obtuse), where the exact distance is the Euclidean
+// distance. Costs are measured on the given mesh.
+void heatDistanceIntrinsicBenchmark(std::string meshPath) {
+
+  { // Sheared grid
+    const size_t n = 60;
+    const double shear = 3.;
+    std::vector<Vector3> positions;
+    for (size_t i = 0; i < n; i++) {
+      for (size_t j = 0; j < n; j++) {
+        double u = static_cast<double>(i) / (n - 1);
+        double v = static_cast<double>(j) / (n - 1);
+        positions.push_back(Vector3{u + shear * v, v, 0.});
+      }
+    }
+    std::vector<std::vector<size_t>> triangles;
+    for (size_t i = 0; i + 1 < n; i++) {
+      for (size_t j = 0; j + 1 < n; j++) {
+        size_t v00 = i * n + j;
+        size_t v10 = (i + 1) * n + j;
+        size_t v01 = i * n + j + 1;
+        size_t v11 = (i + 1) * n + j + 1;
+        triangles.push_back({v00, v10, v11});
+        triangles.push_back({v00, v11, v01});
+      }
+    }
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = makeHalfedgeAndGeometry(triangles, positions);
+    geometry->requireVertexPositions();
+
+    cout << "  sheared " << n << " x " << n << " grid, mean relative error from the center:" << endl;
+    Vertex source = mesh->vertex((n / 2) * n + n / 2);
+    for (ComputeTriangulation computeTri : {ComputeTriangulation::Original, ComputeTriangulation::IntrinsicDelaunay}) {
+      HeatMethodDistanceSolver solver(*geometry, 1.0, computeTri);
+      VertexData<double> dist = solver.computeDistance(source);
+      double errSum = 0.;
+      for (Vertex v : mesh->vertices()) {
+        if (v == source) continue;
+        double exact = norm(geometry->vertexPositions[v] - geometry->vertexPositions[source]);
+        errSum += std::abs(dist[v] - exact) / exact;
+      }
+      cout << "    " << computeTriangulationName(computeTri) << ": " << errSum / (mesh->nVertices() - 1) << endl;
+    }
+  }
+
+  { // Costs on the given mesh
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = loadMesh(meshPath);
+
+    cout << "  mesh with " << mesh->nVertices() << " vertices:" << endl;
+    for (ComputeTriangulation computeTri :
+         {ComputeTriangulation::Original, ComputeTriangulation::IntrinsicDelaunay,
+          ComputeTriangulation::IntrinsicDelaunayRefine}) {
+      try {
+        START_TIMING(construct)
+        HeatMethodDistanceSolver solver(*geometry, 1.0, computeTri);
+        long long constructTime = FINISH_TIMING(construct);
+
+        START_TIMING(query)
+        VertexData<double> dist = solver.computeDistance(mesh->vertex(0));
+        long long queryTime = FINISH_TIMING(query);
+
+        VectorHeatMethodSolver vectorSolver(*geometry, 1.0, computeTri);
+        START_TIMING(logMap)
+        VertexData<Vector2> logMap = vectorSolver.computeLogMap(mesh->vertex(0));
+        long long logMapTime = FINISH_TIMING(logMap);
+
+        cout << "    " << computeTriangulationName(computeTri) << ": construct " << pretty_time(constructTime)
+             << ", distance " << pretty_time(queryTime) << ", log map " << pretty_time(logMapTime) << endl;
+      } catch (const std::runtime_error& e) {
+        cout << "    " << computeTriangulationName(computeTri) << ": not supported (" << e.what() << ")" << endl;
+      }
+    }
+  }
+}
+
+
+// Distances within a radius of the source, computed on a local region and by a global solve. Radii are measured in
+// mean edge lengths.
+void heatDistanceLocalBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  geometry->requireEdgeLengths();
+  double meanEdgeLength = 0.;
+  for (Edge e : mesh->edges()) {
+    meanEdgeLength += geometry->edgeLengths[e];
+  }
+  meanEdgeLength /= mesh->nEdges();
+
+  HeatMethodDistanceSolver solver(*geometry);
+
+  const size_t nSources = std::min<size_t>(32, mesh->nVertices());
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(global)
+  std::vector<VertexData<double>> globalDist;
+  for (Vertex v : sources) {
+    globalDist.push_back(solver.computeDistance(v));
+  }
+  long long globalTime = FINISH_TIMING(global);
+  cout << "  global solves: " << pretty_time(globalTime / nSources) << " per source" << endl;
+
+  for (double radiusInEdges : {5., 10., 20.}) {
+    double radius = radiusInEdges * meanEdgeLength;
+
+    START_TIMING(local)
+    std::vector<std::vector<std::pair<Vertex, double>>> localDist;
+    for (Vertex v : sources) {
+      localDist.push_back(solver.computeDistanceWithinRadius(v, radius));
+    }
+    long long localTime = FINISH_TIMING(local);
+
+    // Difference from the global solution inside the ball (in mean edge lengths), and the size of the ball found by
+    // each. Neither solution is exact; the difference is a bound on how much truncation changes the result.
+    double diffSum = 0.;
+    size_t nFound = 0, nGlobal = 0;
+    for (size_t i = 0; i < nSources; i++) {
+      for (const std::pair<Vertex, double>& p : localDist[i]) {
+        diffSum += std::abs(p.second - globalDist[i][p.first]);
+      }
+      nFound += localDist[i].size();
+      for (Vertex v : mesh->vertices()) {
+        if (globalDist[i][v] <= radius) nGlobal++;
+      }
+    }
+    cout << "  radius " << radiusInEdges << " edges: " << pretty_time(localTime / nSources) << " per source, "
+         << nFound / nSources << " vertices per ball (global: " << nGlobal / nSources
+         << "), mean difference " << diffSum / std::max<size_t>(nFound, 1) / meanEdgeLength << " edges" << endl;
+  }
+}
+
+
+// Approximate distances from a truncated eigenbasis, compared to the heat method (both in cost per source, and in
+// the difference of the distances, relative to the mean distance).
+void heatDistanceSpectralBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  const size_t nSources = std::min<size_t>(16, mesh->nVertices());
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  HeatMethodDistanceSolver solver(*geometry);
+  solver.computeDistance(sources[0]); // factor outside the timings
+  std::vector<VertexData<double>> exact;
+  START_TIMING(exact)
+  for (Vertex v : sources) {
+    exact.push_back(solver.computeDistance(v));
+  }
+  long long exactTime = FINISH_TIMING(exact);
+  cout << "  heat method: " << pretty_time(exactTime / nSources) << " per source" << endl;
+
+  for (size_t nEigenpairs : {25, 50, 100, 200}) {
+    if (nEigenpairs > mesh->nVertices() / 2) break;
+
+    START_TIMING(basis)
+    geometry->requireLaplaceBeltramiEigenbasis(nEigenpairs);
+    long long basisTime = FINISH_TIMING(basis);
+
+    SpectralHeatMethodDistanceSolver spectralSolver(*geometry, nEigenpairs);
+    spectralSolver.computeDistance(sources[0]); // factor outside the timings
+    for (bool spectralPoisson : {false, true}) {
+      spectralSolver.spectralPoisson = spectralPoisson;
+      double diff = 0., total = 0.;
+      START_TIMING(spectral)
+      for (size_t i = 0; i < nSources; i++) {
+        VertexData<double> dist = spectralSolver.computeDistance(sources[i]);
+        diff += (dist.toVector() - exact[i].toVector()).cwiseAbs().sum();
+        total += exact[i].toVector().cwiseAbs().sum();
+      }
+      long long spectralTime = FINISH_TIMING(spectral);
+      cout << "  " << nEigenpairs << " eigenpairs" << (spectralPoisson ? ", spectral Poisson: " : ":                  ")
+           << pretty_time(spectralTime / nSources) << " per source, mean difference " << 100. * diff / total << "%"
+           << "  (basis " << pretty_time(basisTime) << ")" << endl;
+    }
+  }
+}
+
+// Log maps from many individual source vertices, computed one at a time and in batches.
+void logMapBatchBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  VectorHeatMethodSolver solver(*geometry);
+
+  const size_t nSources = std::min<size_t>(128, mesh->nVertices());
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(sequential)
+  std::vector<VertexData<Vector2>> sequential;
+  for (Vertex v : sources) {
+    sequential.push_back(solver.computeLogMap(v));
+  }
+  long long sequentialTime = FINISH_TIMING(sequential);
+  cout << "  one at a time: " << pretty_time(sequentialTime) << endl;
+
+  START_TIMING(batch)
+  LogMapMatrix batch = solver.computeLogMapBatch(sources);
+  long long batchTime = FINISH_TIMING(batch);
+  cout << "  batched:       " << pretty_time(batchTime) << "  (" << batch.memoryUsage() / (1 << 20) << " MB)" << endl;
+
+  // Agreement with the one-at-a-time log maps, relative to the largest distance
+  double maxNorm = 0., batchError = 0.;
+  for (size_t i = 0; i < nSources; i++) {
+    for (size_t iV = 0; iV < mesh->nVertices(); iV++) {
+      Vector2 l = sequential[i][iV];
+      maxNorm = std::max(maxNorm, norm(l));
+      batchError = std::max(batchError, norm(batch(i, iV) - l));
+    }
+  }
+  cout << "  max relative error: " << batchError / maxNorm << endl;
+  cout << "  speedup: " << static_cast<double>(sequentialTime) / std::max(batchTime, 1ll) << "x" << endl;
+}
+
+
+// Log maps within a radius of individual source vertices, solved on patches, compared to global log maps.
+void logMapLocalBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  geometry->requireEdgeLengths();
+  double meanEdgeLength = 0.;
+  for (Edge e : mesh->edges()) {
+    meanEdgeLength += geometry->edgeLengths[e];
+  }
+  meanEdgeLength /= mesh->nEdges();
+
+  VectorHeatMethodSolver solver(*geometry);
+
+  const size_t nSources = std::min<size_t>(32, mesh->nVertices());
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < nSources; i++) {
+    sources.push_back(mesh->vertex(i * mesh->nVertices() / nSources));
+  }
+  cout << "  " << nSources << " sources on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  START_TIMING(global)
+  std::vector<VertexData<Vector2>> globalLogMaps;
+  for (Vertex v : sources) {
+    globalLogMaps.push_back(solver.computeLogMap(v));
+  }
+  long long globalTime = FINISH_TIMING(global);
+  cout << "  global solves: " << pretty_time(globalTime / nSources) << " per source" << endl;
+
+  for (double radiusInEdges : {5., 10., 20.}) {
+    double radius = radiusInEdges * meanEdgeLength;
+
+    START_TIMING(local)
+    std::vector<std::vector<std::pair<Vertex, Vector2>>> localLogMaps;
+    for (Vertex v : sources) {
+      localLogMaps.push_back(solver.computeLogMapWithinRadius(v, radius));
+    }
+    long long localTime = FINISH_TIMING(local);
+
+    // Difference from the global log map inside the ball (in mean edge lengths)
+    double diffSum = 0.;
+    size_t nFound = 0;
+    for (size_t i = 0; i < nSources; i++) {
+      for (const std::pair<Vertex, Vector2>& p : localLogMaps[i]) {
+        diffSum += norm(p.second - globalLogMaps[i][p.first]);
+      }
+      nFound += localLogMaps[i].size();
+    }
+    cout << "  radius " << radiusInEdges << " edges: " << pretty_time(localTime / nSources) << " per source, "
+         << nFound / nSources << " vertices per patch, mean difference "
+         << diffSum / std::max<size_t>(nFound, 1) / meanEdgeLength << " edges" << endl;
+  }
+}
+
+
+// Farthest point sampling, with distances from each new sample over the whole surface, and only within the ball it can
+// affect.
+void farthestPointSamplingBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  HeatMethodDistanceSolver solver(*geometry);
+  solver.computeDistance(mesh->vertex(0)); // factor outside the timings
+
+  const size_t nSamples = std::min<size_t>(2000, mesh->nVertices() / 20);
+  cout << "  " << nSamples << " samples on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  FarthestPointSampler globalSampler(*geometry, solver);
+  globalSampler.localUpdates = false;
+  START_TIMING(global)
+  globalSampler.addSamples(nSamples);
+  long long globalTime = FINISH_TIMING(global);
+  cout << "  global updates: " << pretty_time(globalTime) << ", covering radius " << globalSampler.coveringRadius()
+       << endl;
+
+  FarthestPointSampler localSampler(*geometry, solver);
+  START_TIMING(local)
+  localSampler.addSamples(nSamples);
+  long long localTime = FINISH_TIMING(local);
+  cout << "  local updates:  " << pretty_time(localTime) << ", covering radius " << localSampler.coveringRadius()
+       << "  (" << localSampler.nGlobalSolves << " global and " << localSampler.nLocalSolves << " local solves)"
+       << endl;
+
+  // Agreement between the two
+  size_t nSameSamples = 0, nSameLabels = 0;
+  for (size_t i = 0; i < nSamples; i++) {
+    if (globalSampler.getSamples()[i] == localSampler.getSamples()[i]) nSameSamples++;
+  }
+  for (Vertex v : mesh->vertices()) {
+    if (globalSampler.getLabels()[v] == localSampler.getLabels()[v]) nSameLabels++;
+  }
+  cout << "  identical samples: " << nSameSamples << " / " << nSamples << ", identical labels: " << nSameLabels
+       << " / " << mesh->nVertices() << ", adjacent cells: " << localSampler.cellAdjacency().size() << endl;
+
+  // The samplers' own distances are only as accurate as their updates, so also compare how well each set of samples
+  // covers the surface by a common measure: the mean and largest distance along edges to a sample
+  geometry->requireEdgeLengths();
+  auto graphCoverage = [&](const std::vector<Vertex>& samples) {
+    VertexData<double> dist(*mesh, std::numeric_limits<double>::infinity());
+    typedef std::pair<double, Vertex> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> pq;
+    for (Vertex s : samples) {
+      dist[s] = 0.;
+      pq.emplace(0., s);
+    }
+    while (!pq.empty()) {
+      Entry top = pq.top();
+      pq.pop();
+      if (top.first > dist[top.second]) continue;
+      for (Halfedge he : top.second.outgoingHalfedges()) {
+        double d = top.first + geometry->edgeLengths[he.edge()];
+        if (d < dist[he.twin().vertex()]) {
+          dist[he.twin().vertex()] = d;
+          pq.emplace(d, he.twin().vertex());
+        }
+      }
+    }
+    Vector<double> distVec = dist.toVector();
+    return std::to_string(distVec.mean()) + " / " + std::to_string(distVec.maxCoeff());
+  };
+  cout << "  mean / max distance along edges to a sample: global " << graphCoverage(globalSampler.getSamples())
+       << ", local " << graphCoverage(localSampler.getSamples()) << endl;
+  cout << "  speedup: " << static_cast<double>(globalTime) / std::max(localTime, 1ll) << "x" << endl;
+}
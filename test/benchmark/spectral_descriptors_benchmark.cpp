@@ -0,0 +1,104 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/surface/spectral_descriptors.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+// Heat and wave kernel signatures from a cached eigenbasis: evaluated one vertex and one scale at a time, and all at
+// once with SpectralDescriptorSolver (both into one matrix, and streamed in blocks).
+void spectralDescriptorsBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  const size_t nEigenpairs = std::min<size_t>(200, mesh->nVertices() / 2);
+  const size_t nScales = 100;
+  START_TIMING(eigenbasis)
+  geometry->requireLaplaceBeltramiEigenbasis(nEigenpairs);
+  cout << "  " << nEigenpairs << " eigenpairs on a mesh with " << mesh->nVertices() << " vertices: "
+       << pretty_time(FINISH_TIMING(eigenbasis)) << " (computed once, not included below)" << endl;
+
+  SpectralDescriptorSolver solver(*geometry, nEigenpairs);
+  std::vector<double> times = solver.defaultHeatKernelTimes(nScales);
+  std::vector<double> logEnergies = solver.defaultWaveKernelLogEnergies(nScales);
+  double sigma = solver.defaultWaveKernelSigma(nScales);
+  const Eigen::VectorXd& evals = geometry->laplaceBeltramiEigenvalues;
+  const Eigen::MatrixXd& phi = geometry->laplaceBeltramiEigenvectors;
+  size_t N = mesh->nVertices();
+
+  // === Heat kernel signature
+  DenseMatrix<double> hksScalar(N, nScales);
+  START_TIMING(hksScalar)
+  for (size_t iV = 0; iV < N; iV++) {
+    for (size_t j = 0; j < nScales; j++) {
+      double sum = 0.;
+      for (size_t i = 0; i < nEigenpairs; i++) {
+        sum += std::exp(-std::max(evals[i], 0.) * times[j]) * phi(iV, i) * phi(iV, i);
+      }
+      hksScalar(iV, j) = sum;
+    }
+  }
+  long long hksScalarTime = FINISH_TIMING(hksScalar);
+
+  START_TIMING(hks)
+  DenseMatrix<double> hks = solver.computeHeatKernelSignature(times);
+  long long hksTime = FINISH_TIMING(hks);
+
+  double hksDiff = (hks - hksScalar).cwiseAbs().maxCoeff() / hksScalar.cwiseAbs().maxCoeff();
+  cout << "  HKS, " << nScales << " times: scalar loop " << pretty_time(hksScalarTime) << ", solver "
+       << pretty_time(hksTime) << " (" << static_cast<double>(hksScalarTime) / std::max(hksTime, 1ll)
+       << "x), max relative difference " << hksDiff << endl;
+
+  // === Wave kernel signature
+  DenseMatrix<double> wksScalar(N, nScales);
+  START_TIMING(wksScalar)
+  for (size_t iV = 0; iV < N; iV++) {
+    for (size_t j = 0; j < nScales; j++) {
+      double sum = 0., total = 0.;
+      for (size_t i = 1; i < nEigenpairs; i++) {
+        double d = logEnergies[j] - std::log(evals[i]);
+        double w = std::exp(-d * d / (2. * sigma * sigma));
+        sum += w * phi(iV, i) * phi(iV, i);
+        total += w;
+      }
+      wksScalar(iV, j) = sum / total;
+    }
+  }
+  long long wksScalarTime = FINISH_TIMING(wksScalar);
+
+  START_TIMING(wks)
+  DenseMatrix<double> wks = solver.computeWaveKernelSignature(logEnergies, sigma);
+  long long wksTime = FINISH_TIMING(wks);
+
+  double wksDiff = (wks - wksScalar).cwiseAbs().maxCoeff() / wksScalar.cwiseAbs().maxCoeff();
+  cout << "  WKS, " << nScales << " energies: scalar loop " << pretty_time(wksScalarTime) << ", solver "
+       << pretty_time(wksTime) << " (" << static_cast<double>(wksScalarTime) / std::max(wksTime, 1ll)
+       << "x), max relative difference " << wksDiff << endl;
+
+  // === Streaming, reducing each block to per-scale sums rather than storing it
+  Eigen::VectorXd streamedSums = Eigen::VectorXd::Zero(nScales);
+  size_t nStreamed = 0;
+  START_TIMING(stream)
+  solver.computeHeatKernelSignature(times, [&](size_t firstVertex, const DenseMatrix<double>& block) {
+    if (firstVertex != nStreamed) throw std::runtime_error("blocks out of order");
+    streamedSums += block.colwise().sum().transpose();
+    nStreamed += block.rows();
+  });
+  long long streamTime = FINISH_TIMING(stream);
+  double streamDiff = (streamedSums - hks.colwise().sum().transpose()).cwiseAbs().maxCoeff() /
+                      hks.colwise().sum().cwiseAbs().maxCoeff();
+  cout << "  HKS streamed in blocks of " << solver.blockSize << ": " << pretty_time(streamTime) << ", " << nStreamed
+       << " vertices, max relative difference of sums " << streamDiff << endl;
+}
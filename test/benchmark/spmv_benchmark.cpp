@@ -0,0 +1,83 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+namespace {
+
+// Average time per call of f, in microseconds, repeating for at least a fraction of a second
+template <typename F>
+double timePerCall(F f) {
+  f(); // warm up
+  size_t nCalls = 0;
+  START_TIMING(calls)
+  long long elapsed = 0;
+  do {
+    f();
+    nCalls++;
+    elapsed = FINISH_TIMING(calls);
+  } while (elapsed < 200000);
+  return static_cast<double>(elapsed) / nCalls;
+}
+
+template <typename T>
+void benchmarkMatrix(std::string name, const SparseMatrix<T>& mat) {
+  cout << "  " << name << ": " << mat.rows() << " x " << mat.cols() << ", " << mat.nonZeros() << " nonzeros" << endl;
+
+  Vector<T> x = Vector<T>::Random(mat.cols());
+  Vector<T> y;
+  Eigen::SparseMatrix<T, Eigen::RowMajor> rowMajor = mat;
+  PackedSparseMatrix<T> csr(mat, SpMVLayout::CSR);
+  PackedSparseMatrix<T> sell(mat, SpMVLayout::SELL);
+
+  double eigenTime = timePerCall([&]() { y = mat * x; });
+  auto report = [&](std::string method, double time) {
+    cout << std::setw(34) << method << std::setw(12) << std::fixed << std::setprecision(1) << time << " us"
+         << std::setw(10) << std::setprecision(2) << eigenTime / time << "x" << endl;
+  };
+
+  report("Eigen (column major)", eigenTime);
+  report("Eigen (row major)", timePerCall([&]() { y = rowMajor * x; }));
+  report("sparseMatrixVectorProduct", timePerCall([&]() { sparseMatrixVectorProduct(mat, x, y); }));
+  report("PackedSparseMatrix (CSR)", timePerCall([&]() { csr.multiply(y, x); }));
+  report("PackedSparseMatrix (SELL)", timePerCall([&]() { sell.multiply(y, x); }));
+}
+
+void benchmarkMesh(std::string name, VertexPositionGeometry& geometry) {
+  geometry.requireCotanLaplacian();
+  geometry.requireVertexConnectionLaplacian();
+  benchmarkMatrix(name + " cotan Laplacian", geometry.cotanLaplacian);
+  benchmarkMatrix(name + " connection Laplacian", geometry.vertexConnectionLaplacian);
+}
+
+} // namespace
+
+// Sparse matrix-vector products with the Laplacians of a mesh and of large synthetic meshes, with the library's kernels
+// compared to Eigen's default product.
+void spmvBenchmark(std::string meshPath) {
+  cout << "  using " << getSpMVThreadCount() << " threads" << endl;
+  cout << std::setw(34) << "method" << std::setw(15) << "time" << std::setw(11) << "speedup" << endl;
+
+  {
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = loadMesh(meshPath);
+    benchmarkMesh("input mesh", *geometry);
+  }
+
+  for (size_t n : {300, 1000}) {
+    std::unique_ptr<HalfedgeMesh> mesh;
+    std::unique_ptr<VertexPositionGeometry> geometry;
+    std::tie(mesh, geometry) = makeGridMesh(n);
+    benchmarkMesh(std::to_string(n) + "x" + std::to_string(n) + " grid", *geometry);
+  }
+}
@@ -0,0 +1,91 @@
+#include "benchmarks.h"
+
+#include "geometrycentral/surface/heat_method_distance.h"
+#include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/surface/surface_centers.h"
+#include "geometrycentral/surface/vector_heat_method.h"
+#include "geometrycentral/utilities/timing.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+// Centers of many small clusters of vertices, as when clustering: one at a time with log maps over the whole surface,
+// and together with log maps restricted to the clusters.
+void surfaceCentersBenchmark(std::string meshPath) {
+
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = loadMesh(meshPath);
+
+  geometry->requireEdgeLengths();
+  double meanEdgeLength = 0.;
+  for (Edge e : mesh->edges()) {
+    meanEdgeLength += geometry->edgeLengths[e];
+  }
+  meanEdgeLength /= mesh->nEdges();
+
+  // Each cluster is the set of vertices within a few edges of a seed, weighted to pull the center off the seed
+  const size_t nClusters = std::min<size_t>(64, mesh->nVertices());
+  std::vector<VertexData<double>> clusters;
+  {
+    HeatMethodDistanceSolver distanceSolver(*geometry);
+    for (size_t i = 0; i < nClusters; i++) {
+      Vertex seed = mesh->vertex(i * mesh->nVertices() / nClusters);
+      VertexData<double> cluster(*mesh, 0.);
+      for (const std::pair<Vertex, double>& p : distanceSolver.computeDistanceWithinRadius(seed, 4. * meanEdgeLength)) {
+        cluster[p.first] = 1. + (p.first.getIndex() % 3);
+      }
+      clusters.push_back(cluster);
+    }
+  }
+  cout << "  " << nClusters << " clusters on a mesh with " << mesh->nVertices() << " vertices" << endl;
+
+  VectorHeatMethodSolver solver(*geometry);
+  SurfaceCenterSolver centerSolver(*geometry, solver);
+  solver.computeLogMap(mesh->vertex(0)); // factor outside the timings
+
+  for (int p : {2, 1}) {
+    cout << "  p = " << p << endl;
+
+    centerSolver.restrictToSupport = false;
+    START_TIMING(sequential)
+    std::vector<SurfacePoint> sequential;
+    size_t nLogMaps = 0;
+    for (const VertexData<double>& cluster : clusters) {
+      sequential.push_back(centerSolver.findCenter(cluster, p));
+      nLogMaps += centerSolver.nLogMaps;
+    }
+    long long sequentialTime = FINISH_TIMING(sequential);
+    cout << "    one at a time, global log maps: " << pretty_time(sequentialTime) << "  (" << nLogMaps << " log maps)"
+         << endl;
+
+    auto report = [&](std::string name, const std::vector<SurfacePoint>& centers, long long time) {
+      // Agreement with the one-at-a-time centers, in mean edge lengths
+      double maxDiff = 0.;
+      for (size_t i = 0; i < nClusters; i++) {
+        Vector3 a = sequential[i].interpolate(geometry->inputVertexPositions);
+        Vector3 b = centers[i].interpolate(geometry->inputVertexPositions);
+        maxDiff = std::max(maxDiff, norm(a - b) / meanEdgeLength);
+      }
+      cout << "    " << name << pretty_time(time) << "  (" << centerSolver.nLogMaps << " global and "
+           << centerSolver.nLocalLogMaps << " restricted log maps, " << centerSolver.nIterations
+           << " steps), speedup " << static_cast<double>(sequentialTime) / std::max(time, 1ll)
+           << "x, max difference " << maxDiff << " edges" << endl;
+    };
+
+    START_TIMING(batch)
+    std::vector<SurfacePoint> batch = centerSolver.findCenters(clusters, p);
+    report("batched, global log maps:       ", batch, FINISH_TIMING(batch));
+
+    centerSolver.restrictToSupport = true;
+    START_TIMING(restricted)
+    std::vector<SurfacePoint> restricted = centerSolver.findCenters(clusters, p);
+    report("batched, restricted log maps:   ", restricted, FINISH_TIMING(restricted));
+  }
+}
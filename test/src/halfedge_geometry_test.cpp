@@ -14,7 +14,10 @@
 
 #include "gtest/gtest.h"
 
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <unordered_set>
 
@@ -812,6 +815,82 @@ TEST_F(HalfedgeGeometrySuite, DECOperators) {
   dimensionCheck(geometry.d1, mesh.nFaces(), mesh.nEdges());
 }
 
+TEST_F(HalfedgeGeometrySuite, LaplaceBeltramiEigenbasis) {
+
+  auto asset = getAsset("lego.ply");
+  HalfedgeMesh& mesh = *asset.mesh;
+  IntrinsicGeometryInterface& geometry = *asset.geometry;
+
+  geometry.requireLaplaceBeltramiEigenbasis(10);
+  EXPECT_EQ(geometry.laplaceBeltramiEigenvalues.rows(), 10);
+  EXPECT_EQ(geometry.laplaceBeltramiEigenvectors.rows(), (long int)mesh.nVertices());
+  EXPECT_EQ(geometry.laplaceBeltramiEigenvectors.cols(), 10);
+  EXPECT_NEAR(geometry.laplaceBeltramiEigenvalues(0), 0., 1e-6);
+  for (long int i = 1; i < 10; i++) {
+    EXPECT_GE(geometry.laplaceBeltramiEigenvalues(i), geometry.laplaceBeltramiEigenvalues(i - 1));
+  }
+
+  // Growing keeps the existing eigenpairs
+  Eigen::MatrixXd firstEvecs = geometry.laplaceBeltramiEigenvectors;
+  Eigen::VectorXd firstEvals = geometry.laplaceBeltramiEigenvalues;
+  geometry.requireLaplaceBeltramiEigenbasis(20);
+  EXPECT_EQ(geometry.laplaceBeltramiEigenvectors.cols(), 20);
+  EXPECT_EQ((geometry.laplaceBeltramiEigenvectors.leftCols(10) - firstEvecs).norm(), 0.);
+  EXPECT_GE(geometry.laplaceBeltramiEigenvalues(10), geometry.laplaceBeltramiEigenvalues(9) - 1e-6);
+
+  // Round trip through a file
+  std::string filename = "test_laplace_beltrami_eigenbasis.bin";
+  geometry.writeLaplaceBeltramiEigenbasis(filename);
+  auto otherAsset = getAsset("lego.ply");
+  IntrinsicGeometryInterface& otherGeometry = *otherAsset.geometry;
+  otherGeometry.readLaplaceBeltramiEigenbasis(filename);
+  otherGeometry.requireLaplaceBeltramiEigenbasis(15);
+  EXPECT_EQ(otherGeometry.laplaceBeltramiEigenvectors.cols(), 20);
+  EXPECT_EQ((otherGeometry.laplaceBeltramiEigenvectors - geometry.laplaceBeltramiEigenvectors).norm(), 0.);
+
+  // A different geometry rejects the file
+  auto wrongAsset = getAsset("bob_small.ply");
+  EXPECT_THROW(wrongAsset.geometry->readLaplaceBeltramiEigenbasis(filename), std::runtime_error);
+
+  // So does the same mesh with one vertex moved very slightly
+  auto movedAsset = getAsset("lego.ply");
+  movedAsset.geometry->inputVertexPositions[movedAsset.mesh->vertex(0)] += Vector3{1e-9, 0., 0.};
+  EXPECT_THROW(movedAsset.geometry->readLaplaceBeltramiEigenbasis(filename), std::runtime_error);
+
+  // Corrupt files are rejected before anything is allocated or loaded: a truncated file, and one whose header claims
+  // far too many eigenpairs (the count sits after the 8 byte magic string, 4 byte version, and 8 byte vertex count)
+  std::string bytes;
+  {
+    std::ifstream in(filename, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::string corruptFilename = "test_laplace_beltrami_eigenbasis_corrupt.bin";
+  auto writeCorrupt = [&](const std::string& corruptBytes) {
+    std::ofstream out(corruptFilename, std::ios::binary);
+    out.write(corruptBytes.data(), corruptBytes.size());
+  };
+  auto corruptAsset = getAsset("lego.ply");
+  writeCorrupt(bytes.substr(0, bytes.size() - 8));
+  EXPECT_THROW(corruptAsset.geometry->readLaplaceBeltramiEigenbasis(corruptFilename), std::runtime_error);
+  writeCorrupt(bytes.substr(0, 20));
+  EXPECT_THROW(corruptAsset.geometry->readLaplaceBeltramiEigenbasis(corruptFilename), std::runtime_error);
+  std::string hugeCount = bytes;
+  uint64_t nEigs = uint64_t(1) << 60;
+  hugeCount.replace(20, sizeof(nEigs), reinterpret_cast<const char*>(&nEigs), sizeof(nEigs));
+  writeCorrupt(hugeCount);
+  EXPECT_THROW(corruptAsset.geometry->readLaplaceBeltramiEigenbasis(corruptFilename), std::runtime_error);
+  std::remove(corruptFilename.c_str());
+  std::remove(filename.c_str());
+
+  // Once the basis is no longer required and is cleared, requiring it again computes only what is asked for
+  geometry.unrequireLaplaceBeltramiEigenbasis();
+  geometry.unrequireLaplaceBeltramiEigenbasis();
+  geometry.purgeQuantities();
+  geometry.requireLaplaceBeltramiEigenbasis(5);
+  EXPECT_EQ(geometry.laplaceBeltramiEigenvectors.cols(), 5);
+  EXPECT_LT((geometry.laplaceBeltramiEigenvalues - firstEvals.head(5)).norm(), 1e-6 * firstEvals.norm());
+}
+
 TEST_F(HalfedgeGeometrySuite, EdgeDihedralAngles) {
   auto asset = getAsset("lego.ply");
   HalfedgeMesh& mesh = *asset.mesh;
@@ -1,15 +1,25 @@
+#include "geometrycentral/numerical/factorization_cache.h"
+#include "geometrycentral/numerical/factorization_io.h"
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 #include "geometrycentral/numerical/linear_solvers.h"
+#include "geometrycentral/numerical/sparse_matrix_vector_product.h"
 #include "geometrycentral/surface/meshio.h"
+#include "geometrycentral/utilities/parallel.h"
 #include "geometrycentral/utilities/timing.h"
 
 #include "load_test_meshes.h"
 
 #include "gtest/gtest.h"
 
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
 
@@ -412,6 +422,793 @@ TEST_F(LinearAlgebraTestSuite, TestLDLTSolvers) {
 }
 
 
+TEST_F(LinearAlgebraTestSuite, TestLDLTUpdate) {
+
+  SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+  Vector<double> rhs = randomVector<double>(mat.rows());
+  PositiveDefiniteSolver<double> solver(mat);
+
+  // Low-rank updates need Suitesparse; otherwise every update refactors
+#ifdef GC_HAVE_SUITESPARSE
+  bool expectLowRank = true;
+#else
+  bool expectLowRank = false;
+#endif
+
+  { // rank-2 change to a single edge, which is always cheaper than refactoring
+    SparseMatrix<double>::InnerIterator it(mat, 7);
+    if (it.row() == it.col()) ++it;
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.emplace_back(it.row(), it.col(), -0.05);
+    triplets.emplace_back(it.col(), it.row(), -0.05);
+    triplets.emplace_back(it.row(), it.row(), 0.05);
+    triplets.emplace_back(it.col(), it.col(), 0.05);
+    SparseMatrix<double> delta(mat.rows(), mat.cols());
+    delta.setFromTriplets(triplets.begin(), triplets.end());
+
+    EXPECT_EQ(solver.updateFactorization(delta), expectLowRank);
+    mat += delta;
+    Vector<double> x = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x, rhs), 1e-6);
+  }
+
+  { // change confined to the existing pattern: perturb a few rows, keeping the matrix positive definite
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (int j : {5, 17, 42}) {
+      for (SparseMatrix<double>::InnerIterator it(mat, j); it; ++it) {
+        if (it.row() == it.col()) continue;
+        double w = randomFromRange<double>(-0.05, 0.05);
+        triplets.emplace_back(it.row(), it.col(), w);
+        triplets.emplace_back(it.col(), it.row(), w);
+        triplets.emplace_back(it.row(), it.row(), std::abs(w));
+        triplets.emplace_back(it.col(), it.col(), std::abs(w));
+      }
+    }
+    SparseMatrix<double> delta(mat.rows(), mat.cols());
+    delta.setFromTriplets(triplets.begin(), triplets.end());
+
+    bool lowRank = solver.updateFactorization(delta);
+    if (!expectLowRank) EXPECT_FALSE(lowRank);
+    mat += delta;
+    Vector<double> x = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x, rhs), 1e-6);
+  }
+
+  { // change which adds new entries to the pattern
+    size_t N = mat.rows();
+    std::vector<Eigen::Triplet<double>> triplets;
+    triplets.emplace_back(0, N - 1, -0.3);
+    triplets.emplace_back(N - 1, 0, -0.3);
+    triplets.emplace_back(0, 0, 0.5);
+    triplets.emplace_back(N - 1, N - 1, 0.5);
+    SparseMatrix<double> delta(N, N);
+    delta.setFromTriplets(triplets.begin(), triplets.end());
+
+    bool lowRank = solver.updateFactorization(delta);
+    if (!expectLowRank) EXPECT_FALSE(lowRank);
+    mat += delta;
+    Vector<double> x = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x, rhs), 1e-6);
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestLDLTMixedPrecision) {
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    Vector<double> rhs = randomVector<double>(mat.rows());
+
+    PositiveDefiniteSolver<double> solver(mat, FactorPrecision::Mixed);
+    EXPECT_TRUE(solver.usesMixedPrecision());
+
+    // refinement recovers double accuracy
+    Vector<double> x1 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x1, rhs), 1e-10 * rhs.norm());
+    EXPECT_GT(solver.lastRefinementIterations, 0);
+    EXPECT_TRUE(solver.usesMixedPrecision());
+    EXPECT_FALSE(solver.lastSolveUsedFullPrecision);
+
+    // an unreachable tolerance makes refinement stall, and that solve falls back on full precision
+    solver.refinementTolerance = 0.;
+    Vector<double> x2 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x2, rhs), 1e-10 * rhs.norm());
+    EXPECT_TRUE(solver.lastSolveUsedFullPrecision);
+    EXPECT_TRUE(solver.usesMixedPrecision());
+
+    // ...but later solves still use single precision
+    solver.refinementTolerance = 1e-10;
+    Vector<double> x3 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x3, rhs), 1e-10 * rhs.norm());
+    EXPECT_FALSE(solver.lastSolveUsedFullPrecision);
+    EXPECT_GT(solver.lastRefinementIterations, 0);
+
+    // refactoring drops the full precision fallback, which is recomputed when needed
+    SparseMatrix<double> delta = 0.1 * identityMatrix<double>(mat.rows());
+    solver.updateFactorization(delta);
+    mat += delta;
+    solver.refinementTolerance = 0.;
+    Vector<double> x4 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x4, rhs), 1e-10 * rhs.norm());
+    EXPECT_TRUE(solver.lastSolveUsedFullPrecision);
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    Vector<std::complex<double>> rhs = randomVector<std::complex<double>>(mat.rows());
+
+    PositiveDefiniteSolver<std::complex<double>> solver(mat, FactorPrecision::Mixed);
+    EXPECT_TRUE(solver.usesMixedPrecision());
+
+    Vector<std::complex<double>> x1 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x1, rhs), 1e-10 * rhs.norm());
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestLDLTSupernodal) {
+
+#ifdef GC_HAVE_SUITESPARSE
+  FactorStructure expectedStructure = FactorStructure::Supernodal;
+#else
+  FactorStructure expectedStructure = FactorStructure::Simplicial; // (supernodal requires Suitesparse)
+#endif
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    Vector<double> rhs = randomVector<double>(mat.rows());
+
+    PositiveDefiniteSolver<double> solver(mat, FactorPrecision::Full, FactorStructure::Supernodal);
+    EXPECT_EQ(solver.factorStructure(), expectedStructure);
+    Vector<double> x = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x, rhs), 1e-6);
+
+    // updates refactor the matrix
+    SparseMatrix<double> delta(mat.rows(), mat.cols());
+    delta.insert(3, 3) = 1.;
+    solver.updateFactorization(delta);
+    SparseMatrix<double> updated = mat + delta;
+    x = solver.solve(rhs);
+    EXPECT_LT(residual(updated, x, rhs), 1e-6);
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    Vector<std::complex<double>> rhs = randomVector<std::complex<double>>(mat.rows());
+
+    PositiveDefiniteSolver<std::complex<double>> solver(mat, FactorPrecision::Full, FactorStructure::Supernodal);
+    EXPECT_EQ(solver.factorStructure(), expectedStructure);
+    Vector<std::complex<double>> x = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x, rhs), 1e-6);
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestLDLTMultipleRHS) {
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    DenseMatrix<double> rhs = DenseMatrix<double>::Random(mat.rows(), 5);
+    PositiveDefiniteSolver<double> solver(mat);
+    DenseMatrix<double> x;
+    solver.solve(x, rhs);
+    ASSERT_EQ(x.cols(), 5);
+    for (long j = 0; j < rhs.cols(); j++) {
+      Vector<double> xCol = x.col(j);
+      Vector<double> rhsCol = rhs.col(j);
+      EXPECT_LT(residual(mat, xCol, rhsCol), 1e-6);
+    }
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    DenseMatrix<std::complex<double>> rhs = DenseMatrix<std::complex<double>>::Random(mat.rows(), 3);
+    PositiveDefiniteSolver<std::complex<double>> solver(mat);
+    DenseMatrix<std::complex<double>> x;
+    solver.solve(x, rhs);
+    for (long j = 0; j < rhs.cols(); j++) {
+      Vector<std::complex<double>> xCol = x.col(j);
+      Vector<std::complex<double>> rhsCol = rhs.col(j);
+      EXPECT_LT(residual(mat, xCol, rhsCol), 1e-6);
+    }
+  }
+
+  { // mixed precision solves column by column
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    DenseMatrix<double> rhs = DenseMatrix<double>::Random(mat.rows(), 2);
+    PositiveDefiniteSolver<double> solver(mat, FactorPrecision::Mixed);
+    DenseMatrix<double> x;
+    solver.solve(x, rhs);
+    for (long j = 0; j < rhs.cols(); j++) {
+      Vector<double> xCol = x.col(j);
+      Vector<double> rhsCol = rhs.col(j);
+      EXPECT_LT(residual(mat, xCol, rhsCol), 1e-6);
+    }
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestFactorizationCache) {
+
+  clearFactorizationCache();
+  size_t oldBudget = getFactorizationCacheBudget();
+  size_t oldHits = getFactorizationCacheStats().hits;
+
+  SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+  Vector<double> rhs = randomVector<double>(mat.rows());
+
+  // identical matrices share a factorization
+  SparseMatrix<double> matCopy = mat;
+  SharedSolver<PositiveDefiniteSolver<double>> solver1 = cachedPositiveDefiniteSolver(mat);
+  SharedSolver<PositiveDefiniteSolver<double>> solver2 = cachedPositiveDefiniteSolver(matCopy);
+  EXPECT_EQ(solver1, solver2);
+  EXPECT_EQ(getFactorizationCacheStats().hits, oldHits + 1);
+  EXPECT_EQ(getFactorizationCacheStats().nEntries, 1);
+  EXPECT_GT(getFactorizationCacheMemoryUsage(), 0);
+  EXPECT_LT(residual(mat, solver2.solve(rhs), rhs), 1e-6);
+
+  // different matrices and solver types do not
+  matCopy.coeffRef(0, 0) += 1.;
+  SharedSolver<PositiveDefiniteSolver<double>> solver3 = cachedPositiveDefiniteSolver(matCopy);
+  EXPECT_NE(solver1, solver3);
+  EXPECT_LT(residual(matCopy, solver3.solve(rhs), rhs), 1e-6);
+  SharedSolver<SquareSolver<double>> solver4 = cachedSquareSolver(mat);
+  EXPECT_EQ(getFactorizationCacheStats().nEntries, 3);
+
+  // evicted solvers remain valid
+  setFactorizationCacheBudget(0);
+  EXPECT_EQ(getFactorizationCacheStats().nEntries, 0);
+  EXPECT_EQ(getFactorizationCacheMemoryUsage(), 0);
+  EXPECT_LT(residual(mat, solver1.solve(rhs), rhs), 1e-6);
+  EXPECT_LT(residual(mat, solver4.solve(rhs), rhs), 1e-6);
+  setFactorizationCacheBudget(oldBudget);
+
+  // one-off eigensolves do not pin their factorizations in the cache
+  SparseMatrix<double> mass = identityMatrix<double>(mat.rows());
+  smallestEigenvectorPositiveDefinite(mat, mass, 5);
+  smallestEigenvectorSquare(mat, mass, 5);
+  largestEigenvector(mat, mass, 5);
+  EXPECT_EQ(getFactorizationCacheStats().nEntries, 0);
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestFactorizationSaveLoad) {
+
+  { // positive definite
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    Vector<std::complex<double>> rhs = randomVector<std::complex<double>>(mat.rows());
+    PositiveDefiniteSolver<std::complex<double>> solver(mat);
+
+    std::stringstream stream;
+    solver.save(stream);
+    std::unique_ptr<PositiveDefiniteSolver<std::complex<double>>> loaded =
+        PositiveDefiniteSolver<std::complex<double>>::load(stream);
+    EXPECT_LT(residual(mat, loaded->solve(rhs), rhs), 1e-6);
+
+    // loaded solvers can be saved again, and updated
+    std::stringstream stream2;
+    loaded->save(stream2);
+    EXPECT_EQ(stream.str(), stream2.str());
+    SparseMatrix<std::complex<double>> delta(mat.rows(), mat.cols());
+    delta.insert(0, 0) = 1.;
+    loaded->updateFactorization(delta);
+    mat += delta;
+    EXPECT_LT(residual(mat, loaded->solve(rhs), rhs), 1e-6);
+  }
+
+  { // positive definite, mixed precision
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    Vector<double> rhs = randomVector<double>(mat.rows());
+    PositiveDefiniteSolver<double> solver(mat, FactorPrecision::Mixed);
+
+    std::stringstream stream;
+    solver.save(stream);
+    std::unique_ptr<PositiveDefiniteSolver<double>> loaded = PositiveDefiniteSolver<double>::load(stream);
+    EXPECT_TRUE(loaded->usesMixedPrecision());
+    EXPECT_LT(residual(mat, loaded->solve(rhs), rhs), 1e-6);
+  }
+
+  { // square
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat.coeffRef(2, 3) += 0.5; // make non-symmetric
+    Vector<double> rhs = randomVector<double>(mat.rows());
+    SquareSolver<double> solver(mat);
+
+    std::stringstream stream;
+    solver.save(stream);
+    std::unique_ptr<SquareSolver<double>> loaded = SquareSolver<double>::load(stream);
+    EXPECT_LT(residual(mat, loaded->solve(rhs), rhs), 1e-6);
+    EXPECT_LT((loaded->solve(rhs) - solver.solve(rhs)).norm(), 1e-8 * rhs.norm());
+
+    // the wrong kind of factorization is rejected
+    std::stringstream stream2(stream.str());
+    EXPECT_THROW(PositiveDefiniteSolver<double>::load(stream2), std::runtime_error);
+
+    // as is a truncated file
+    std::stringstream stream3(stream.str().substr(0, stream.str().size() / 2));
+    EXPECT_THROW(SquareSolver<double>::load(stream3), std::runtime_error);
+  }
+
+  { // corrupt sparse matrices are rejected before they are used
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat = mat.topLeftCorner(50, 50);
+    std::stringstream stream;
+    writeSparseMatrix(stream, mat);
+    std::string bytes = stream.str();
+    size_t innerStart = 3 * sizeof(uint64_t) + (mat.outerSize() + 1) * sizeof(int);
+
+    std::stringstream good(bytes);
+    EXPECT_EQ((readSparseMatrix<double>(good) - mat).norm(), 0.);
+
+    // an inner index out of range
+    std::string badInner = bytes;
+    int outOfRange = 1000;
+    std::memcpy(&badInner[innerStart], &outOfRange, sizeof(int));
+    std::stringstream badInnerStream(badInner);
+    EXPECT_THROW(readSparseMatrix<double>(badInnerStream), std::runtime_error);
+
+    // outer indices which decrease
+    std::string badOuter = bytes;
+    int decreasing = 1 << 20;
+    std::memcpy(&badOuter[3 * sizeof(uint64_t) + sizeof(int)], &decreasing, sizeof(int));
+    std::stringstream badOuterStream(badOuter);
+    EXPECT_THROW(readSparseMatrix<double>(badOuterStream), std::runtime_error);
+
+    // an enormous size, which must not be allocated
+    std::string badSize = bytes;
+    uint64_t huge = uint64_t(1) << 40;
+    std::memcpy(&badSize[2 * sizeof(uint64_t)], &huge, sizeof(uint64_t));
+    std::stringstream badSizeStream(badSize);
+    EXPECT_THROW(readSparseMatrix<double>(badSizeStream), std::runtime_error);
+    std::stringstream badVectorStream(std::string(reinterpret_cast<const char*>(&huge), sizeof(uint64_t)));
+    EXPECT_THROW(readVector<double>(badVectorStream), std::runtime_error);
+  }
+
+  { // QR
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat = mat.topLeftCorner(100, 100);
+#ifndef GC_HAVE_SUITESPARSE
+    // Eigen is really slow, so use a tiny matrix
+    mat = mat.topLeftCorner(10, 10);
+#endif
+    size_t initRows = mat.rows();
+    mat = verticalStack<double>({mat, mat});
+    Vector<double> rhsHalf = randomVector<double>(initRows);
+    Vector<double> rhs(2 * initRows);
+    rhs << rhsHalf, rhsHalf;
+    Solver<double> solver(mat);
+
+    std::stringstream stream;
+    solver.save(stream);
+    std::unique_ptr<Solver<double>> loaded = Solver<double>::load(stream);
+    EXPECT_LT(residual(mat, loaded->solve(rhs), rhs), 1e-6);
+    EXPECT_EQ(loaded->rank(), initRows);
+  }
+
+  { // disk cache
+    clearFactorizationCache();
+    std::string oldDirectory = getFactorizationDiskCacheDirectory();
+    setFactorizationDiskCacheDirectory(::testing::TempDir());
+    FactorizationCacheStats oldStats = getFactorizationCacheStats();
+
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    Vector<double> rhs = randomVector<double>(mat.rows());
+    SharedSolver<SquareSolver<double>> solver1 = cachedSquareSolver(mat);
+    FactorizationCacheStats stats = getFactorizationCacheStats();
+    EXPECT_EQ(stats.diskHits + stats.diskWrites, oldStats.diskHits + oldStats.diskWrites + 1);
+
+    // after dropping the in-memory copy, the factorization is loaded from disk
+    clearFactorizationCache();
+    SharedSolver<SquareSolver<double>> solver2 = cachedSquareSolver(mat);
+    EXPECT_EQ(getFactorizationCacheStats().diskHits, stats.diskHits + 1);
+    EXPECT_NE(solver1, solver2);
+    EXPECT_LT(residual(mat, solver2.solve(rhs), rhs), 1e-6);
+
+    std::ostringstream filename;
+    filename << ::testing::TempDir() << "/" << std::hex << static_cast<uint64_t>(hashMatrix(mat)) << "_lu_f64.gcfact";
+    std::remove(filename.str().c_str());
+    setFactorizationDiskCacheDirectory(oldDirectory);
+    clearFactorizationCache();
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestConcurrentSolves) {
+
+  SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+  SparseMatrix<double> matSquare = mat;
+  matSquare.coeffRef(2, 3) += 0.5; // make non-symmetric
+  PositiveDefiniteSolver<double> solverPSD(mat);
+  PositiveDefiniteSolver<double> solverMixed(mat, FactorPrecision::Mixed);
+  SquareSolver<double> solverSquare(matSquare);
+
+  const size_t nThreads = 4;
+  const size_t nSolvesPerThread = 10;
+  std::vector<Vector<double>> rhs;
+  for (size_t i = 0; i < nThreads * nSolvesPerThread; i++) {
+    rhs.push_back(randomVector<double>(mat.rows()));
+  }
+
+  // Solve with every solver from several threads at once
+  std::vector<Vector<double>> xPSD(rhs.size()), xMixed(rhs.size()), xSquare(rhs.size());
+  std::vector<std::thread> threads;
+  for (size_t iThread = 0; iThread < nThreads; iThread++) {
+    threads.emplace_back([&, iThread]() {
+      for (size_t i = iThread; i < rhs.size(); i += nThreads) {
+        solverPSD.solve(xPSD[i], rhs[i]);
+        solverMixed.solve(xMixed[i], rhs[i]);
+        solverSquare.solve(xSquare[i], rhs[i]);
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  for (size_t i = 0; i < rhs.size(); i++) {
+    EXPECT_LT(residual(mat, xPSD[i], rhs[i]), 1e-6);
+    EXPECT_LT(residual(mat, xMixed[i], rhs[i]), 1e-6);
+    EXPECT_LT(residual(matSquare, xSquare[i], rhs[i]), 1e-6);
+    EXPECT_LT((xPSD[i] - solverPSD.solve(rhs[i])).norm(), 1e-12 * xPSD[i].norm());
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestParallelChunkExceptions) {
+
+  // An exception from any chunk reaches the caller, after every other chunk has finished
+  const size_t nChunks = 4;
+  for (size_t iThrow = 0; iThrow < nChunks; iThrow++) {
+    std::vector<int> ran(nChunks, 0);
+    EXPECT_THROW(parallelForChunks(nChunks,
+                                   [&](size_t iChunk) {
+                                     ran[iChunk] = 1;
+                                     if (iChunk == iThrow) throw std::runtime_error("chunk failed");
+                                   }),
+                 std::runtime_error);
+    for (size_t iChunk = 0; iChunk < nChunks; iChunk++) {
+      EXPECT_EQ(ran[iChunk], 1);
+    }
+  }
+
+  // A chunk which throws while the others wait on a barrier aborts it, rather than leaving them waiting
+  for (size_t iThrow : {size_t(0), nChunks - 1}) {
+    ThreadBarrier barrier(nChunks);
+    std::vector<int> released(nChunks, 0);
+    EXPECT_THROW(parallelForChunks(nChunks,
+                                   [&](size_t iChunk) {
+                                     try {
+                                       if (!barrier.wait()) return;
+                                       if (iChunk == iThrow) throw std::runtime_error("chunk failed");
+                                       released[iChunk] = barrier.wait() ? 1 : 2;
+                                     } catch (...) {
+                                       barrier.abort();
+                                       throw;
+                                     }
+                                   }),
+                 std::runtime_error);
+    for (size_t iChunk = 0; iChunk < nChunks; iChunk++) {
+      EXPECT_EQ(released[iChunk], iChunk == iThrow ? 0 : 2);
+    }
+  }
+
+  // The workers are still usable afterwards
+  std::vector<size_t> squares(1000, 0);
+  parallelFor(squares.size(), nChunks, [&](size_t i) { squares[i] = i * i; });
+  for (size_t i = 0; i < squares.size(); i++) {
+    EXPECT_EQ(squares[i], i * i);
+  }
+}
+
+TEST_F(LinearAlgebraTestSuite, TestDirichletSolver) {
+
+  // Check that constrained entries take their values, and unconstrained rows of the system are satisfied
+  auto checkSolution = [](const SparseMatrix<double>& mat, const Vector<bool>& isConstrained, const Vector<double>& x,
+                          const Vector<double>& rhs, const Vector<double>& values) {
+    Vector<double> r = mat * x - rhs;
+    for (long i = 0; i < x.rows(); i++) {
+      if (isConstrained[i]) {
+        EXPECT_EQ(x[i], values[i]);
+      } else {
+        EXPECT_LT(std::abs(r[i]), 1e-6 * (rhs.norm() + values.norm()));
+      }
+    }
+  };
+
+  SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+  size_t N = mat.rows();
+  Vector<bool> isConstrained(N);
+  for (size_t i = 0; i < N; i++) {
+    isConstrained[i] = (i % 5 == 0);
+  }
+
+  { // Positive definite, with and without the precomputed response
+    DirichletSolver<double> solver(mat, isConstrained);
+    EXPECT_EQ(solver.nConstrained() + solver.nUnconstrained(), N);
+
+    Vector<double> rhs = randomVector<double>(N);
+    Vector<double> values = randomVector<double>(N);
+    Vector<double> x = solver.solve(rhs, values);
+    checkSolution(mat, isConstrained, x, rhs, values);
+
+    solver.precomputeConstraintResponse();
+    Vector<double> xPrecomputed = solver.solve(rhs, values);
+    EXPECT_LT((x - xPrecomputed).norm(), 1e-8 * x.norm());
+
+    Vector<double> xHomogeneous = solver.solveHomogeneous(values);
+    checkSolution(mat, isConstrained, xHomogeneous, Vector<double>::Zero(N), values);
+  }
+
+  { // General square matrix, several problems at once
+    SparseMatrix<double> matSquare = mat;
+    matSquare.coeffRef(2, 3) += 0.5; // make non-symmetric
+    DirichletSolver<double> solver(matSquare, isConstrained, false);
+
+    DenseMatrix<double> rhs = DenseMatrix<double>::Random(N, 3);
+    DenseMatrix<double> values = DenseMatrix<double>::Random(N, 3);
+    DenseMatrix<double> x = solver.solve(rhs, values);
+    for (long j = 0; j < 3; j++) {
+      checkSolution(matSquare, isConstrained, x.col(j), rhs.col(j), values.col(j));
+    }
+  }
+
+  { // Complex
+    SparseMatrix<std::complex<double>> matC = buildSPDTestMatrix<std::complex<double>>();
+    DirichletSolver<std::complex<double>> solver(matC, isConstrained);
+    Vector<std::complex<double>> rhs = randomVector<std::complex<double>>(N);
+    Vector<std::complex<double>> values = randomVector<std::complex<double>>(N);
+    Vector<std::complex<double>> x = solver.solve(rhs, values);
+    Vector<std::complex<double>> r = matC * x - rhs;
+    for (size_t i = 0; i < N; i++) {
+      if (isConstrained[i]) {
+        EXPECT_EQ(x[i], values[i]);
+      } else {
+        EXPECT_LT(std::abs(r[i]), 1e-6 * rhs.norm());
+      }
+    }
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestSparseMatrixVectorProducts) {
+
+  for (SpMVLayout layout : {SpMVLayout::CSR, SpMVLayout::SELL}) {
+
+    { // float
+      SparseMatrix<float> mat = buildSPDTestMatrix<float>();
+      Vector<float> x = randomVector<float>(mat.cols());
+      Vector<float> y = PackedSparseMatrix<float>(mat, layout) * x;
+      EXPECT_LT((y - mat * x).norm(), 1e-5 * y.norm());
+    }
+
+    { // double
+      SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+      Vector<double> x = randomVector<double>(mat.cols());
+      Vector<double> y = PackedSparseMatrix<double>(mat, layout) * x;
+      EXPECT_LT((y - mat * x).norm(), 1e-12 * y.norm());
+    }
+
+    { // complex
+      SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+      Vector<std::complex<double>> x = randomVector<std::complex<double>>(mat.cols());
+      Vector<std::complex<double>> y = PackedSparseMatrix<std::complex<double>>(mat, layout) * x;
+      EXPECT_LT((y - mat * x).norm(), 1e-12 * y.norm());
+    }
+
+    { // rectangular, with empty rows
+      SparseMatrix<double> mat = buildSPDTestMatrix<double>().topRows(100).leftCols(50);
+      Vector<double> x = randomVector<double>(mat.cols());
+      Vector<double> y = PackedSparseMatrix<double>(mat, layout) * x;
+      EXPECT_EQ((size_t)y.rows(), 100);
+      EXPECT_LT((y - mat * x).norm(), 1e-12 * y.norm());
+    }
+
+    { // rows of different lengths, with a non-finite entry in x which only the first row touches
+      std::vector<Eigen::Triplet<double>> triplets;
+      for (int i = 0; i < 20; i++) {
+        for (int j = 1; j <= i % 5 + 1; j++) {
+          triplets.emplace_back(i, (i + j) % 19 + 1, 1.);
+        }
+      }
+      triplets.emplace_back(0, 0, 1.);
+      SparseMatrix<double> mat(20, 20);
+      mat.setFromTriplets(triplets.begin(), triplets.end());
+      Vector<double> x = randomVector<double>(20);
+      x[0] = std::numeric_limits<double>::quiet_NaN();
+      Vector<double> y = PackedSparseMatrix<double>(mat, layout) * x;
+      EXPECT_TRUE(std::isnan(y[0]));
+      EXPECT_LT((y.tail(19) - (mat * x).tail(19)).norm(), 1e-12 * y.tail(19).norm());
+    }
+  }
+
+  { // A matrix large enough to be split across threads
+    size_t N = 100000;
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (size_t i = 0; i < N; i++) {
+      for (size_t k = 0; k < 5; k++) {
+        triplets.emplace_back((i * 7919 + k * 104729) % N, i, randomFromRange<double>(-1., 1.));
+      }
+    }
+    SparseMatrix<double> mat(N, N);
+    mat.setFromTriplets(triplets.begin(), triplets.end());
+    Vector<double> x = randomVector<double>(N);
+    Vector<double> yEigen = mat * x;
+
+    size_t oldThreadCount = getSpMVThreadCount();
+    setSpMVThreadCount(4);
+    Vector<double> yCSR = PackedSparseMatrix<double>(mat, SpMVLayout::CSR) * x;
+    Vector<double> ySELL = PackedSparseMatrix<double>(mat, SpMVLayout::SELL) * x;
+    Vector<double> yColumns;
+    sparseMatrixVectorProduct(mat, x, yColumns);
+
+    // Repeated products reuse the same worker threads
+    PackedSparseMatrix<double> packed(mat);
+    Vector<double> yRepeated;
+    for (int iRep = 0; iRep < 20; iRep++) {
+      packed.multiply(yRepeated, x);
+    }
+    setSpMVThreadCount(oldThreadCount);
+    EXPECT_LT((yRepeated - yEigen).norm(), 1e-12 * yEigen.norm());
+
+    EXPECT_LT((yCSR - yEigen).norm(), 1e-12 * yEigen.norm());
+    EXPECT_LT((ySELL - yEigen).norm(), 1e-12 * yEigen.norm());
+    EXPECT_LT((yColumns - yEigen).norm(), 1e-12 * yEigen.norm());
+  }
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestAMGSolvers) {
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    Vector<double> rhs = randomVector<double>(mat.rows());
+
+    AlgebraicMultigridSolver<double> solver(mat);
+    EXPECT_GT(solver.nLevels(), 1);
+
+    Vector<double> x1 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x1, rhs), 1e-6);
+    EXPECT_LT(solver.lastIterations, 50);
+
+    Vector<double> x2;
+    solver.solve(x2, rhs);
+    EXPECT_LT(residual(mat, x2, rhs), 1e-6);
+
+    // a single V-cycle should already make progress
+    Vector<double> x3;
+    solver.applyPreconditioner(x3, rhs);
+    EXPECT_LT(residual(mat, x3, rhs), 0.5 * rhs.norm());
+
+    // running out of iterations is an error, which still leaves the last iterate and statistics
+    solver.maxIterations = 2;
+    Vector<double> x4;
+    EXPECT_THROW(solver.solve(x4, rhs), std::runtime_error);
+    EXPECT_EQ(solver.lastIterations, 2);
+    EXPECT_GE(solver.lastRelativeResidual, solver.tolerance);
+    EXPECT_NEAR(residual(mat, x4, rhs) / rhs.norm(), solver.lastRelativeResidual, 1e-6);
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    Vector<std::complex<double>> rhs = randomVector<std::complex<double>>(mat.rows());
+
+    AlgebraicMultigridSolver<std::complex<double>> solver(mat);
+    EXPECT_GT(solver.nLevels(), 1);
+
+    Vector<std::complex<double>> x1 = solver.solve(rhs);
+    EXPECT_LT(residual(mat, x1, rhs), 1e-6);
+
+    Vector<std::complex<double>> x2;
+    solver.solve(x2, rhs);
+    EXPECT_LT(residual(mat, x2, rhs), 1e-6);
+  }
+}
+
+TEST_F(LinearAlgebraTestSuite, TestAMGStalledCoarsening) {
+
+  // Off-diagonal entries far too weak to count as strong connections, so the finest level does not coarsen at all,
+  // and is too large to invert densely
+  size_t N = 5000;
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (size_t i = 0; i < N; i++) {
+    triplets.emplace_back(i, i, 1. + 0.5 * std::sin(i));
+    if (i + 1 < N) {
+      triplets.emplace_back(i, i + 1, -0.01);
+      triplets.emplace_back(i + 1, i, -0.01);
+    }
+  }
+  SparseMatrix<double> mat(N, N);
+  mat.setFromTriplets(triplets.begin(), triplets.end());
+  Vector<double> rhs = randomVector<double>(N);
+
+  AlgebraicMultigridSolver<double> solver(mat);
+  EXPECT_EQ(solver.nLevels(), 1);
+
+  Vector<double> x = solver.solve(rhs);
+  EXPECT_LT(residual(mat, x, rhs), 1e-6);
+  EXPECT_LT(solver.lastIterations, 20);
+}
+
+
+TEST_F(LinearAlgebraTestSuite, TestSmallestKEigenpairs) {
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat = mat.topLeftCorner(400, 400);
+    SparseMatrix<double> mass = identityMatrix<double>(mat.rows());
+    size_t k = 8;
+
+    Vector<double> evals;
+    DenseMatrix<double> evecs;
+    std::tie(evals, evecs) = smallestKEigenpairsPositiveDefinite(mat, mass, k);
+
+    EXPECT_EQ(evals.rows(), k);
+    EXPECT_EQ(evecs.cols(), k);
+    for (size_t i = 0; i < k; i++) {
+      Vector<double> v = evecs.col(i);
+      EXPECT_NEAR(v.dot(mass * v), 1., 1e-6);
+      EXPECT_LT(residual(mat, v, Vector<double>(evals(i) * (mass * v))), 1e-5);
+      if (i > 0) {
+        EXPECT_GE(evals(i), evals(i - 1));
+      }
+    }
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    mat = mat.topLeftCorner(400, 400);
+    SparseMatrix<std::complex<double>> mass = identityMatrix<std::complex<double>>(mat.rows());
+    size_t k = 8;
+
+    Vector<double> evals;
+    DenseMatrix<std::complex<double>> evecs;
+    std::tie(evals, evecs) = smallestKEigenpairsPositiveDefinite(mat, mass, k);
+
+    for (size_t i = 0; i < k; i++) {
+      Vector<std::complex<double>> v = evecs.col(i);
+      Vector<std::complex<double>> lambdaMv = evals(i) * (mass * v);
+      EXPECT_LT(residual(mat, v, lambdaMv), 1e-5);
+    }
+  }
+
+  { // non-convergence is reported, not ignored
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat = mat.topLeftCorner(400, 400);
+    SparseMatrix<double> mass = identityMatrix<double>(mat.rows());
+    size_t k = 8;
+
+    Vector<double> evals;
+    DenseMatrix<double> evecs;
+    EXPECT_TRUE(extendSmallestKEigenpairsPositiveDefinite(mat, mass, evals, evecs, k));
+    EXPECT_EQ(evecs.cols(), k);
+    EXPECT_FALSE(extendSmallestKEigenpairsPositiveDefinite(mat, mass, evals, evecs, k, 1e-14, 1));
+    EXPECT_EQ(evecs.cols(), 2 * k);
+    EXPECT_THROW(smallestKEigenpairsPositiveDefinite(mat, mass, k, 1e-14, 1), std::runtime_error);
+  }
+
+  { // a zero eigenvalue (the constant vector of a graph Laplacian) converges too, even on its own
+    size_t N = 400;
+    std::vector<Eigen::Triplet<double>> triplets;
+    for (size_t i = 0; i + 1 < N; i++) {
+      triplets.emplace_back(i, i, 1.);
+      triplets.emplace_back(i + 1, i + 1, 1.);
+      triplets.emplace_back(i, i + 1, -1.);
+      triplets.emplace_back(i + 1, i, -1.);
+    }
+    SparseMatrix<double> mat(N, N);
+    mat.setFromTriplets(triplets.begin(), triplets.end());
+    SparseMatrix<double> mass = identityMatrix<double>(N);
+
+    Vector<double> evals;
+    DenseMatrix<double> evecs;
+    std::tie(evals, evecs) = smallestKEigenpairsPositiveDefinite(mat, mass, 1);
+    EXPECT_NEAR(evals(0), 0., 1e-8);
+    Vector<double> v = evecs.col(0);
+    EXPECT_NEAR(std::abs(v.sum()), std::sqrt(N), 1e-6);
+  }
+}
+
+
 TEST_F(LinearAlgebraTestSuite, TestSquareSolvers) {
 
   { // float
@@ -482,6 +1279,40 @@ TEST_F(LinearAlgebraTestSuite, TestSquareSolvers) {
   }
 }
 
+TEST_F(LinearAlgebraTestSuite, TestSquareSolverMultipleRHS) {
+
+  { // double
+    SparseMatrix<double> mat = buildSPDTestMatrix<double>();
+    mat = mat.topLeftCorner(100, 100);
+    mat.coeffRef(2, 3) += 0.5; // make non-symmetric
+    DenseMatrix<double> rhs = DenseMatrix<double>::Random(mat.rows(), 4);
+    SquareSolver<double> solver(mat);
+    DenseMatrix<double> x;
+    solver.solve(x, rhs);
+    ASSERT_EQ(x.cols(), 4);
+    for (long j = 0; j < rhs.cols(); j++) {
+      Vector<double> xCol = x.col(j);
+      Vector<double> rhsCol = rhs.col(j);
+      EXPECT_LT(residual(mat, xCol, rhsCol), 1e-4);
+    }
+  }
+
+  { // std::complex<double>
+    SparseMatrix<std::complex<double>> mat = buildSPDTestMatrix<std::complex<double>>();
+    mat = mat.topLeftCorner(100, 100);
+    mat.coeffRef(2, 3) += 0.5; // make non-symmetric
+    DenseMatrix<std::complex<double>> rhs = DenseMatrix<std::complex<double>>::Random(mat.rows(), 3);
+    SquareSolver<std::complex<double>> solver(mat);
+    DenseMatrix<std::complex<double>> x;
+    solver.solve(x, rhs);
+    for (long j = 0; j < rhs.cols(); j++) {
+      Vector<std::complex<double>> xCol = x.col(j);
+      Vector<std::complex<double>> rhsCol = rhs.col(j);
+      EXPECT_LT(residual(mat, xCol, rhsCol), 1e-4);
+    }
+  }
+}
+
 TEST_F(LinearAlgebraTestSuite, TestQRSolvers_square) {
 
   { // float
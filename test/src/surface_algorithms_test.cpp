@@ -0,0 +1,957 @@
+#include "geometrycentral/surface/direction_fields.h"
+#include "geometrycentral/surface/exact_polyhedral_geodesics.h"
+#include "geometrycentral/surface/farthest_point_sampling.h"
+#include "geometrycentral/surface/fast_marching_method.h"
+#include "geometrycentral/surface/halfedge_factories.h"
+#include "geometrycentral/surface/halfedge_mesh.h"
+#include "geometrycentral/surface/heat_method_distance.h"
+#include "geometrycentral/surface/signpost_intrinsic_triangulation.h"
+#include "geometrycentral/surface/spectral_descriptors.h"
+#include "geometrycentral/surface/surface_centers.h"
+#include "geometrycentral/surface/vector_heat_method.h"
+#include "geometrycentral/surface/vertex_position_geometry.h"
+
+#include "geometrycentral/numerical/linear_solvers.h"
+
+#include "load_test_meshes.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <string>
+#include <thread>
+
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+using std::cout;
+using std::endl;
+
+class SurfaceAlgorithmsSuite : public MeshAssetSuite {};
+
+namespace {
+
+// A flat n x n grid on the unit square, with the diagonals of its squares alternating in direction
+std::tuple<std::unique_ptr<HalfedgeMesh>, std::unique_ptr<VertexPositionGeometry>> makeFlatGrid(size_t n) {
+  std::vector<Vector3> positions;
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < n; j++) {
+      positions.push_back(Vector3{static_cast<double>(i) / (n - 1), static_cast<double>(j) / (n - 1), 0.});
+    }
+  }
+  std::vector<std::vector<size_t>> triangles;
+  for (size_t i = 0; i + 1 < n; i++) {
+    for (size_t j = 0; j + 1 < n; j++) {
+      size_t v00 = i * n + j;
+      size_t v10 = (i + 1) * n + j;
+      size_t v01 = i * n + j + 1;
+      size_t v11 = (i + 1) * n + j + 1;
+      if ((i + j) % 2 == 0) {
+        triangles.push_back({v00, v10, v11});
+        triangles.push_back({v00, v11, v01});
+      } else {
+        triangles.push_back({v00, v10, v01});
+        triangles.push_back({v10, v11, v01});
+      }
+    }
+  }
+  return makeHalfedgeAndGeometry(triangles, positions);
+}
+
+// A flat grid as above, sheared along x until most of its triangles are obtuse, so it is far from Delaunay
+std::tuple<std::unique_ptr<HalfedgeMesh>, std::unique_ptr<VertexPositionGeometry>> makeShearedGrid(size_t n,
+                                                                                                    double shear) {
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = makeFlatGrid(n);
+  for (Vertex v : mesh->vertices()) {
+    geometry->inputVertexPositions[v].x += shear * geometry->inputVertexPositions[v].y;
+  }
+  geometry->refreshQuantities();
+  return std::make_tuple(std::move(mesh), std::move(geometry));
+}
+
+} // namespace
+
+
+// ============================================================
+// =============== Direction fields
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, BoundaryAlignedDirectionField) {
+  for (MeshAsset& a : boundaryMeshes()) {
+    if (!a.isTriangular) continue;
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    for (int nSym : {1, 4}) {
+      VertexData<Vector2> field = computeSmoothestBoundaryAlignedVertexDirectionField(geometry, nSym);
+
+      // Unit everywhere, and equal to the (nSym-th power of the) outward normal on the boundary. In the tangent space of
+      // a boundary vertex, v.halfedge() points along the boundary at angle 0, and the interior lies at positive angles.
+      Vector2 boundaryValue = Vector2{0., -1.}.pow(nSym);
+      for (Vertex v : mesh.vertices()) {
+        EXPECT_NEAR(norm(field[v]), 1., 1e-6);
+        if (v.isBoundary()) {
+          EXPECT_NEAR(norm(field[v] - boundaryValue), 0., 1e-6);
+        }
+      }
+    }
+  }
+}
+
+
+// ============================================================
+// =============== Heat method distance
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodBatchMatchesSequential) {
+  for (std::string name : {"bob_small.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    HeatMethodDistanceSolver solver(geometry);
+    solver.batchBlockSize = 3; // so that the sources span several blocks, the last one partial
+
+    std::vector<Vertex> sources;
+    for (size_t i = 0; i < 7; i++) {
+      sources.push_back(mesh.vertex(i * mesh.nVertices() / 7));
+    }
+    DenseMatrix<float> batch = solver.computeDistanceBatch(sources);
+    QuantizedDistanceMatrix quantized = solver.computeDistanceBatchQuantized(sources);
+    ASSERT_EQ((size_t)batch.rows(), sources.size());
+    ASSERT_EQ((size_t)batch.cols(), mesh.nVertices());
+    ASSERT_EQ(quantized.nSources, sources.size());
+
+    for (size_t iSource = 0; iSource < sources.size(); iSource++) {
+      VertexData<double> dist = solver.computeDistance(sources[iSource]);
+      double maxDist = dist.toVector().maxCoeff();
+      for (size_t iV = 0; iV < mesh.nVertices(); iV++) {
+        EXPECT_NEAR(batch(iSource, iV), dist[iV], 1e-5 * maxDist);
+        EXPECT_NEAR(quantized(iSource, iV), std::max(dist[iV], 0.), 1e-4 * maxDist);
+      }
+    }
+  }
+}
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodFaceKernelMatchesGeometry) {
+  for (std::string name : {"bob_small.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+    Vertex source = mesh.vertex(mesh.nVertices() / 2);
+
+    // The heat method written directly against the geometry's quantities, normalizing and taking the divergence face
+    // by face
+    geometry.requireEdgeLengths();
+    geometry.requireVertexIndices();
+    geometry.requireCotanLaplacian();
+    geometry.requireVertexGalerkinMassMatrix();
+    geometry.requireHalfedgeVectorsInFace();
+    geometry.requireHalfedgeCotanWeights();
+
+    double meanEdgeLength = 0.;
+    for (Edge e : mesh.edges()) meanEdgeLength += geometry.edgeLengths[e];
+    meanEdgeLength /= mesh.nEdges();
+    SparseMatrix<double> heatOp =
+        geometry.vertexGalerkinMassMatrix + meanEdgeLength * meanEdgeLength * geometry.cotanLaplacian;
+    Vector<double> rhs = Vector<double>::Zero(mesh.nVertices());
+    rhs[geometry.vertexIndices[source]] = 1.;
+    Vector<double> heat = solvePositiveDefinite(heatOp, rhs);
+
+    Vector<double> divergence = Vector<double>::Zero(mesh.nVertices());
+    for (Face f : mesh.faces()) {
+      Vector2 gradDir = Vector2::zero();
+      for (Halfedge he : f.adjacentHalfedges()) {
+        gradDir += geometry.halfedgeVectorsInFace[he.next()].rotate90() * heat[geometry.vertexIndices[he.vertex()]];
+      }
+      gradDir = gradDir.normalize();
+      for (Halfedge he : f.adjacentHalfedges()) {
+        double val = geometry.halfedgeCotanWeights[he] * dot(geometry.halfedgeVectorsInFace[he], gradDir);
+        divergence[geometry.vertexIndices[he.vertex()]] += val;
+        divergence[geometry.vertexIndices[he.twin().vertex()]] -= val;
+      }
+    }
+    PositiveDefiniteSolver<double> poissonSolver(geometry.cotanLaplacian);
+    Vector<double> expected = poissonSolver.solve(divergence);
+    expected = expected.array() - expected[geometry.vertexIndices[source]];
+
+    // The solver's packed per-face operators should give the same distance
+    HeatMethodDistanceSolver solver(geometry);
+    VertexData<double> dist = solver.computeDistance(source);
+    double maxDist = expected.maxCoeff();
+    for (Vertex v : mesh.vertices()) {
+      EXPECT_NEAR(dist[v], expected[geometry.vertexIndices[v]], 1e-8 * maxDist);
+    }
+
+    geometry.unrequireEdgeLengths();
+    geometry.unrequireVertexIndices();
+    geometry.unrequireCotanLaplacian();
+    geometry.unrequireVertexGalerkinMassMatrix();
+    geometry.unrequireHalfedgeVectorsInFace();
+    geometry.unrequireHalfedgeCotanWeights();
+  }
+}
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodWithinRadiusMatchesGlobal) {
+  for (std::string name : {"spot.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    HeatMethodDistanceSolver solver(geometry);
+    Vertex source = mesh.vertex(mesh.nVertices() / 3);
+    VertexData<double> globalDist = solver.computeDistance(source);
+    double maxDist = globalDist.toVector().maxCoeff();
+
+    // A small ball is solved on a local region, and a large one falls back on the global solve
+    for (double fraction : {0.05, 0.1, 0.6}) {
+      double radius = fraction * maxDist;
+      std::vector<std::pair<Vertex, double>> local = solver.computeDistanceWithinRadius(source, radius);
+
+      VertexData<char> inLocal(mesh, false);
+      for (const std::pair<Vertex, double>& p : local) {
+        inLocal[p.first] = true;
+        EXPECT_LE(p.second, radius);
+        EXPECT_NEAR(p.second, globalDist[p.first], 0.05 * radius);
+      }
+
+      // Every vertex well inside the ball is found
+      for (Vertex v : mesh.vertices()) {
+        if (globalDist[v] < 0.9 * radius) {
+          EXPECT_TRUE(inLocal[v]);
+        }
+      }
+    }
+
+    // Queries from several threads at once give the same balls as one at a time
+    double radius = 0.1 * maxDist;
+    std::vector<Vertex> sources;
+    for (size_t i = 0; i < 4; i++) sources.push_back(mesh.vertex(i * mesh.nVertices() / 4));
+    std::vector<std::vector<std::pair<Vertex, double>>> concurrent(sources.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < sources.size(); i++) {
+      threads.emplace_back([&, i] { concurrent[i] = solver.computeDistanceWithinRadius(sources[i], radius); });
+    }
+    for (std::thread& t : threads) t.join();
+    for (size_t i = 0; i < sources.size(); i++) {
+      std::vector<std::pair<Vertex, double>> serial = solver.computeDistanceWithinRadius(sources[i], radius);
+      ASSERT_EQ(concurrent[i].size(), serial.size());
+      for (size_t j = 0; j < serial.size(); j++) {
+        EXPECT_EQ(concurrent[i][j].first, serial[j].first);
+        EXPECT_EQ(concurrent[i][j].second, serial[j].second);
+      }
+    }
+  }
+}
+
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodConcurrentFirstSolves) {
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  // Several threads all needing the (not yet built) factorizations at once
+  HeatMethodDistanceSolver solver(geometry);
+  std::vector<Vertex> sources;
+  for (size_t i = 0; i < 4; i++) sources.push_back(mesh.vertex(i * mesh.nVertices() / 4));
+  std::vector<VertexData<double>> concurrent(sources.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sources.size(); i++) {
+    threads.emplace_back([&, i] { concurrent[i] = solver.computeDistance(sources[i]); });
+  }
+  for (std::thread& t : threads) t.join();
+
+  for (size_t i = 0; i < sources.size(); i++) {
+    VertexData<double> serial = solver.computeDistance(sources[i]);
+    for (Vertex v : mesh.vertices()) {
+      EXPECT_EQ(concurrent[i][v], serial[v]);
+    }
+  }
+}
+
+TEST_F(SurfaceAlgorithmsSuite, SpectralHeatMethodDistance) {
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  EXPECT_THROW(SpectralHeatMethodDistanceSolver(geometry, 0), std::logic_error);
+
+  // The flow time is max(mean_edge_length^2, c sqrt(area / lambda_max))
+  size_t nEigenpairs = 100;
+  geometry.requireLaplaceBeltramiEigenbasis(nEigenpairs);
+  geometry.requireFaceAreas();
+  double lambdaMax = geometry.laplaceBeltramiEigenvalues[nEigenpairs - 1];
+  double area = 0.;
+  for (Face f : mesh.faces()) area += geometry.faceAreas[f];
+  geometry.unrequireFaceAreas();
+
+  HeatMethodDistanceSolver heatSolver(geometry);
+  SpectralHeatMethodDistanceSolver spectralSolver(geometry, nEigenpairs);
+  SpectralHeatMethodDistanceSolver longerSolver(geometry, nEigenpairs, 1.0, 1.0);
+  EXPECT_NEAR(spectralSolver.heatFlowTime(),
+              std::max(heatSolver.heatFlowTime(), 0.5 * std::sqrt(area / lambdaMax)), 1e-12);
+  EXPECT_NEAR(longerSolver.heatFlowTime(), std::max(heatSolver.heatFlowTime(), std::sqrt(area / lambdaMax)), 1e-12);
+  geometry.unrequireLaplaceBeltramiEigenbasis();
+
+  // With the default constant, the distance is close to the heat method's on average (about 10% off on this mesh)
+  Vertex source = mesh.vertex(mesh.nVertices() / 2);
+  VertexData<double> exactish = heatSolver.computeDistance(source);
+  for (bool spectralPoisson : {false, true}) {
+    spectralSolver.spectralPoisson = spectralPoisson;
+    VertexData<double> approx = spectralSolver.computeDistance(source);
+    double meanDiff = 0., meanDist = 0.;
+    for (Vertex v : mesh.vertices()) {
+      meanDiff += std::abs(approx[v] - exactish[v]);
+      meanDist += exactish[v];
+    }
+    EXPECT_LT(meanDiff / meanDist, 0.15);
+  }
+}
+
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodIntrinsicDelaunayOnShearedGrid) {
+
+  // On a flat grid the geodesic distance is the Euclidean distance, which the heat method approximates poorly on the
+  // obtuse triangles of the sheared grid, and better on an intrinsic Delaunay triangulation of it
+  const size_t n = 17;
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = makeShearedGrid(n, 3.);
+  VertexData<Vector3>& pos = geometry->inputVertexPositions;
+  EXPECT_FALSE(SignpostIntrinsicTriangulation(*geometry).isDelaunay());
+
+  Vertex source = mesh->vertex(n * n / 2);
+  auto meanError = [&](const VertexData<double>& dist) {
+    double error = 0.;
+    for (Vertex v : mesh->vertices()) error += std::abs(dist[v] - norm(pos[v] - pos[source]));
+    return error / mesh->nVertices();
+  };
+
+  HeatMethodDistanceSolver originalSolver(*geometry);
+  double originalError = meanError(originalSolver.computeDistance(source));
+
+  HeatMethodDistanceSolver solver(*geometry, 1.0, ComputeTriangulation::IntrinsicDelaunay);
+  VertexData<double> dist = solver.computeDistance(source);
+  EXPECT_EQ(dist.size(), mesh->nVertices());
+  EXPECT_NEAR(dist[source], 0., 1e-12);
+  EXPECT_LT(meanError(dist), 0.5 * originalError);
+
+  // Batches are transferred back to the input vertices too
+  std::vector<Vertex> sources{source, mesh->vertex(0)};
+  DenseMatrix<float> batch = solver.computeDistanceBatch(sources);
+  ASSERT_EQ((size_t)batch.cols(), mesh->nVertices());
+  for (size_t iSource = 0; iSource < sources.size(); iSource++) {
+    VertexData<double> single = solver.computeDistance(sources[iSource]);
+    double maxDist = single.toVector().maxCoeff();
+    for (size_t iV = 0; iV < mesh->nVertices(); iV++) {
+      EXPECT_NEAR(batch(iSource, iV), single[iV], 1e-5 * maxDist);
+    }
+  }
+
+  // Refinement is not supported for meshes with boundary
+  EXPECT_THROW(HeatMethodDistanceSolver(*geometry, 1.0, ComputeTriangulation::IntrinsicDelaunayRefine),
+               std::runtime_error);
+}
+
+TEST_F(SurfaceAlgorithmsSuite, HeatMethodIntrinsicDelaunayRefine) {
+
+  // Refinement adds vertices to the compute triangulation, but results are still on the input vertices. On a mesh as
+  // well shaped as this one, it is no more accurate than the original triangulation.
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  Vertex source = mesh.vertex(mesh.nVertices() / 2);
+  ExactPolyhedralGeodesics exactSolver(geometry);
+  VertexData<double> exact = exactSolver.computeDistance({source});
+
+  HeatMethodDistanceSolver solver(geometry, 1.0, ComputeTriangulation::IntrinsicDelaunayRefine);
+  VertexData<double> dist = solver.computeDistance(source);
+  EXPECT_EQ(dist.size(), mesh.nVertices());
+  EXPECT_NEAR(dist[source], 0., 1e-12);
+  double meanError = 0., meanDist = 0.;
+  for (Vertex v : mesh.vertices()) {
+    meanError += std::abs(dist[v] - exact[v]);
+    meanDist += exact[v];
+  }
+  EXPECT_LT(meanError / meanDist, 0.08); // about 4% off, as is the original triangulation
+}
+
+
+// ============================================================
+// =============== Fast marching
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, FastMarchingEarlyExitMatchesFull) {
+  for (std::string name : {"spot.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    FastMarchingDistanceSolver solver(geometry);
+    Vertex source = mesh.vertex(mesh.nVertices() / 3);
+    VertexData<double> fullDist = solver.computeDistance(source);
+    double maxDist = fullDist.toVector().maxCoeff();
+    EXPECT_EQ(solver.nReached, mesh.nVertices());
+
+    // The one-off function agrees with the solver
+    VertexData<double> oneOff = FMMDistance(geometry, {std::make_pair(source, 0.)});
+    for (Vertex v : mesh.vertices()) {
+      EXPECT_EQ(oneOff[v], fullDist[v]);
+    }
+
+    // A ball query finalizes exactly the vertices within the radius, in order, with the same distances
+    solver.maxDistance = 0.2 * maxDist;
+    std::vector<std::pair<Vertex, double>> ball = solver.computeDistanceReached({std::make_pair(source, 0.)});
+    size_t nInside = 0;
+    for (Vertex v : mesh.vertices()) {
+      if (fullDist[v] <= solver.maxDistance) nInside++;
+    }
+    EXPECT_EQ(ball.size(), nInside);
+    for (size_t i = 0; i < ball.size(); i++) {
+      EXPECT_EQ(ball[i].second, fullDist[ball[i].first]);
+      if (i > 0) EXPECT_LE(ball[i - 1].second, ball[i].second);
+    }
+    VertexData<double> ballDist = solver.computeDistance(source);
+    for (Vertex v : mesh.vertices()) {
+      if (fullDist[v] <= solver.maxDistance) {
+        EXPECT_EQ(ballDist[v], fullDist[v]);
+      } else {
+        EXPECT_EQ(ballDist[v], std::numeric_limits<double>::infinity());
+      }
+    }
+    solver.maxDistance = std::numeric_limits<double>::infinity();
+
+    // A target query stops once the farthest target is reached, with the targets' distances unchanged
+    std::vector<Vertex> targets{ball[ball.size() / 2].first, ball.back().first};
+    solver.targets = targets;
+    VertexData<double> targetDist = solver.computeDistance(source);
+    EXPECT_LE(solver.nReached, ball.size());
+    for (Vertex t : targets) {
+      EXPECT_EQ(targetDist[t], fullDist[t]);
+    }
+    solver.targets.clear();
+
+    // Stopping early leaves nothing behind for the next full query
+    VertexData<double> again = solver.computeDistance(source);
+    for (Vertex v : mesh.vertices()) {
+      EXPECT_EQ(again[v], fullDist[v]);
+    }
+  }
+}
+
+
+TEST_F(SurfaceAlgorithmsSuite, FastIterativeMethodMatchesFastMarching) {
+  for (std::string name : {"spot.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    FastMarchingDistanceSolver solver(geometry);
+    std::vector<std::pair<Vertex, double>> sources{std::make_pair(mesh.vertex(0), 0.),
+                                                   std::make_pair(mesh.vertex(mesh.nVertices() / 2), 0.1)};
+    VertexData<double> serial = solver.computeDistance(sources);
+    double maxDist = serial.toVector().maxCoeff();
+
+    // Any number of threads, including more than there are rounds big enough to split
+    for (size_t nThreads : {1, 2, 3, 8}) {
+      solver.nThreads = nThreads;
+      VertexData<double> parallel = solver.computeDistanceParallel(sources);
+      EXPECT_EQ(solver.nReached, mesh.nVertices());
+      for (Vertex v : mesh.vertices()) {
+        EXPECT_NEAR(parallel[v], serial[v], 1e-12 * maxDist);
+      }
+    }
+
+    // With a maximum distance, the same vertices are reached
+    solver.maxDistance = 0.3 * maxDist;
+    VertexData<double> serialBall = solver.computeDistance(sources);
+    solver.nThreads = 2;
+    VertexData<double> parallelBall = solver.computeDistanceParallel(sources);
+    for (Vertex v : mesh.vertices()) {
+      if (serialBall[v] == std::numeric_limits<double>::infinity()) {
+        EXPECT_EQ(parallelBall[v], std::numeric_limits<double>::infinity());
+      } else {
+        EXPECT_NEAR(parallelBall[v], serialBall[v], 1e-12 * maxDist);
+      }
+    }
+  }
+}
+
+
+// ============================================================
+// =============== Exact polyhedral geodesics
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, ExactGeodesicsFlatGridMatchesEuclidean) {
+
+  // On a flat grid, the exact distance is the Euclidean distance
+  const size_t n = 24;
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = makeFlatGrid(n);
+  VertexData<Vector3>& pos = geometry->inputVertexPositions;
+
+  ExactPolyhedralGeodesics solver(*geometry);
+
+  // From a corner, from an interior vertex, and (reusing the solver) from both at once
+  Vertex corner = mesh->vertex(0);
+  Vertex interior = mesh->vertex(n * n / 2 + n / 3);
+  for (std::vector<Vertex> sources : {std::vector<Vertex>{corner}, std::vector<Vertex>{interior},
+                                      std::vector<Vertex>{corner, interior}}) {
+    VertexData<double> dist = solver.computeDistance(sources);
+    for (Vertex v : mesh->vertices()) {
+      double euclidean = std::numeric_limits<double>::infinity();
+      for (Vertex s : sources) {
+        euclidean = std::min(euclidean, norm(pos[v] - pos[s]));
+      }
+      EXPECT_NEAR(dist[v], euclidean, 1e-9);
+    }
+  }
+}
+
+
+TEST_F(SurfaceAlgorithmsSuite, ExactGeodesicsEarlyExitMatchesFull) {
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  ExactPolyhedralGeodesics solver(geometry);
+  Vertex source = mesh.vertex(mesh.nVertices() / 3);
+  VertexData<double> fullDist = solver.computeDistance(source);
+  double maxDist = fullDist.toVector().maxCoeff();
+
+  // A ball query reaches every vertex within the radius, with its final distance
+  solver.maxDistance = 0.2 * maxDist;
+  std::vector<std::pair<Vertex, double>> ball = solver.computeDistanceReached({source});
+  VertexData<char> inBall(mesh, false);
+  for (size_t i = 0; i < ball.size(); i++) {
+    inBall[ball[i].first] = true;
+    EXPECT_LE(ball[i].second, solver.maxDistance);
+    EXPECT_NEAR(ball[i].second, fullDist[ball[i].first], 1e-12 * maxDist);
+    if (i > 0) EXPECT_LE(ball[i - 1].second, ball[i].second);
+  }
+  for (Vertex v : mesh.vertices()) {
+    if (fullDist[v] <= solver.maxDistance) EXPECT_TRUE(inBall[v]);
+  }
+  solver.maxDistance = std::numeric_limits<double>::infinity();
+
+  // A target query (with a repeated target) gives the targets their final distances, without reaching the whole mesh
+  std::vector<Vertex> targets{ball[ball.size() / 2].first, ball.back().first, ball.back().first};
+  solver.targets = targets;
+  VertexData<double> targetDist = solver.computeDistance(source);
+  EXPECT_LT(solver.totalCalcVertNum, mesh.nVertices());
+  for (Vertex t : targets) {
+    EXPECT_NEAR(targetDist[t], fullDist[t], 1e-12 * maxDist);
+  }
+  solver.targets.clear();
+
+  // Stopping early leaves nothing behind for the next full query
+  VertexData<double> again = solver.computeDistance(source);
+  for (Vertex v : mesh.vertices()) {
+    EXPECT_EQ(again[v], fullDist[v]);
+  }
+}
+
+
+// ============================================================
+// =============== Farthest point sampling
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, FarthestPointSamplingMatchesHeatDistance) {
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  // With global updates, the distance is the minimum of one heat method distance per sample
+  const size_t nSamples = 12;
+  FarthestPointSampler sampler(geometry);
+  sampler.localUpdates = false;
+  std::vector<Vertex> samples = sampler.addSamples(nSamples);
+  EXPECT_EQ(sampler.nGlobalSolves, nSamples);
+
+  HeatMethodDistanceSolver heatSolver(geometry);
+  std::vector<VertexData<double>> sampleDist;
+  for (Vertex s : samples) {
+    sampleDist.push_back(heatSolver.computeDistance(s));
+    sampleDist.back()[s] = 0.;
+  }
+  double maxDist = sampleDist[0].toVector().maxCoeff();
+  const VertexData<double>& dist = sampler.getDistance();
+  const VertexData<size_t>& labels = sampler.getLabels();
+  double coveringRadius = 0.;
+  for (Vertex v : mesh.vertices()) {
+    double minDist = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < nSamples; i++) {
+      minDist = std::min(minDist, std::max(sampleDist[i][v], 0.));
+    }
+    EXPECT_NEAR(dist[v], minDist, 1e-10 * maxDist);
+
+    // The label is a sample at that distance
+    ASSERT_LT(labels[v], nSamples);
+    EXPECT_NEAR(std::max(sampleDist[labels[v]][v], 0.), minDist, 1e-10 * maxDist);
+    coveringRadius = std::max(coveringRadius, dist[v]);
+  }
+  EXPECT_EQ(sampler.coveringRadius(), coveringRadius);
+
+  // Cells are adjacent exactly when an edge connects them, whichever way round
+  std::vector<std::pair<size_t, size_t>> adjacency = sampler.cellAdjacency();
+  std::set<std::pair<size_t, size_t>> edgeAdjacency;
+  for (Edge e : mesh.edges()) {
+    size_t a = labels[e.halfedge().vertex()];
+    size_t b = labels[e.halfedge().twin().vertex()];
+    if (a != b) {
+      edgeAdjacency.emplace(a, b);
+      edgeAdjacency.emplace(b, a);
+    }
+  }
+  EXPECT_EQ(2 * adjacency.size(), edgeAdjacency.size());
+  for (const std::pair<size_t, size_t>& p : adjacency) {
+    EXPECT_LT(p.first, p.second);
+    EXPECT_EQ(edgeAdjacency.count(p), 1u);
+    EXPECT_EQ(edgeAdjacency.count(std::make_pair(p.second, p.first)), 1u);
+  }
+
+  // Updating only within the ball each sample could affect gives nearly the same distance. The local solves have a
+  // boundary where the mesh does not, so they are not exact.
+  FarthestPointSampler localSampler(geometry);
+  localSampler.localAreaFraction = 1.;
+  for (Vertex s : samples) {
+    localSampler.addSample(s);
+  }
+  EXPECT_GT(localSampler.nLocalSolves, 0u);
+  double maxDiff = 0.;
+  for (Vertex v : mesh.vertices()) {
+    maxDiff = std::max(maxDiff, std::abs(localSampler.getDistance()[v] - dist[v]));
+  }
+  EXPECT_LT(maxDiff, 0.02 * maxDist);
+}
+
+
+// ============================================================
+// =============== Vector heat method
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, LogMapBatchMatchesSequential) {
+  for (std::string name : {"spot.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    VectorHeatMethodSolver solver(geometry);
+    std::vector<Vertex> sources;
+    std::vector<VertexData<Vector2>> singles;
+    for (size_t i = 0; i < 7; i++) {
+      sources.push_back(mesh.vertex(i * mesh.nVertices() / 7));
+      singles.push_back(solver.computeLogMap(sources.back()));
+    }
+
+    // One source per block, and blocks of 3 (so that the sources span several blocks, the last one partial)
+    for (size_t blockSize : {1, 3}) {
+      solver.batchBlockSize = blockSize;
+      LogMapMatrix batch = solver.computeLogMapBatch(sources);
+      ASSERT_EQ(batch.nSources, sources.size());
+      ASSERT_EQ(batch.nVertices, mesh.nVertices());
+
+      // The batch is stored as floats. Lengths agree everywhere, but directions only away from the cut locus, where
+      // they are ill-conditioned.
+      for (size_t iSource = 0; iSource < sources.size(); iSource++) {
+        const VertexData<Vector2>& single = singles[iSource];
+        double maxDist = 0.;
+        for (Vertex v : mesh.vertices()) maxDist = std::max(maxDist, norm(single[v]));
+        for (size_t iV = 0; iV < mesh.nVertices(); iV++) {
+          EXPECT_NEAR(norm(batch(iSource, iV)), norm(single[iV]), 1e-5 * maxDist);
+          if (norm(single[iV]) < 0.8 * maxDist) {
+            EXPECT_NEAR(norm(batch(iSource, iV) - single[iV]), 0., 1e-5 * maxDist);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SurfaceAlgorithmsSuite, LogMapWithinRadiusMatchesGlobal) {
+  for (std::string name : {"spot.ply", "lego.ply"}) {
+    MeshAsset a = getAsset(name);
+    a.printThyName();
+    HalfedgeMesh& mesh = *a.mesh;
+    VertexPositionGeometry& geometry = *a.geometry;
+
+    VectorHeatMethodSolver solver(geometry);
+    Vertex sourceVert = mesh.vertex(mesh.nVertices() / 3);
+    SurfacePoint sourceFace(sourceVert.halfedge().face(), Vector3{0.2, 0.3, 0.5});
+
+    for (SurfacePoint source : {SurfacePoint(sourceVert), sourceFace}) {
+      VertexData<Vector2> globalLogMap = solver.computeLogMap(source);
+      double maxDist = 0.;
+      for (Vertex v : mesh.vertices()) maxDist = std::max(maxDist, norm(globalLogMap[v]));
+
+      // A small ball is solved on a local patch, and a large one falls back on the global solve
+      for (double fraction : {0.05, 0.1, 0.6}) {
+        double radius = fraction * maxDist;
+        std::vector<std::pair<Vertex, Vector2>> local = solver.computeLogMapWithinRadius(source, radius);
+        EXPECT_FALSE(local.empty());
+
+        for (const std::pair<Vertex, Vector2>& p : local) {
+          EXPECT_LE(norm(p.second), radius);
+          EXPECT_NEAR(norm(p.second - globalLogMap[p.first]), 0., 0.1 * radius);
+        }
+      }
+    }
+  }
+}
+
+
+TEST_F(SurfaceAlgorithmsSuite, LogMapIntrinsicDelaunayOnShearedGrid) {
+
+  // As for the heat method: on a flat grid the log map's length is the Euclidean distance
+  const size_t n = 17;
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = makeShearedGrid(n, 3.);
+  VertexData<Vector3>& pos = geometry->inputVertexPositions;
+
+  Vertex source = mesh->vertex(n * n / 2);
+  auto meanError = [&](const VertexData<Vector2>& logMap) {
+    double error = 0.;
+    for (Vertex v : mesh->vertices()) error += std::abs(norm(logMap[v]) - norm(pos[v] - pos[source]));
+    return error / mesh->nVertices();
+  };
+
+  VectorHeatMethodSolver originalSolver(*geometry);
+  double originalError = meanError(originalSolver.computeLogMap(source));
+
+  VectorHeatMethodSolver solver(*geometry, 1.0, ComputeTriangulation::IntrinsicDelaunay);
+  VertexData<Vector2> logMap = solver.computeLogMap(source);
+  EXPECT_EQ(logMap.size(), mesh->nVertices());
+  EXPECT_NEAR(norm(logMap[source]), 0., 1e-12);
+  EXPECT_LT(meanError(logMap), 0.5 * originalError);
+
+  // Scalar extension is transferred back too: a constant extends to itself
+  std::vector<std::tuple<Vertex, double>> constant{std::make_tuple(source, 2.)};
+  VertexData<double> extended = solver.extendScalar(constant);
+  EXPECT_EQ(extended.size(), mesh->nVertices());
+  for (Vertex v : mesh->vertices()) EXPECT_NEAR(extended[v], 2., 1e-8);
+
+  // On a closed mesh, refinement adds vertices, but the log map is still on the input vertices, and close to the
+  // original one
+  MeshAsset a = getAsset("spot.ply");
+  VectorHeatMethodSolver spotOriginal(*a.geometry);
+  VectorHeatMethodSolver spotRefined(*a.geometry, 1.0, ComputeTriangulation::IntrinsicDelaunayRefine);
+  Vertex spotSource = a.mesh->vertex(a.mesh->nVertices() / 2);
+  VertexData<Vector2> originalMap = spotOriginal.computeLogMap(spotSource);
+  VertexData<Vector2> refinedMap = spotRefined.computeLogMap(spotSource);
+  EXPECT_EQ(refinedMap.size(), a.mesh->nVertices());
+  double meanDiff = 0., meanDist = 0.;
+  for (Vertex v : a.mesh->vertices()) {
+    meanDiff += std::abs(norm(refinedMap[v]) - norm(originalMap[v]));
+    meanDist += norm(originalMap[v]);
+  }
+  EXPECT_LT(meanDiff / meanDist, 0.05);
+}
+
+
+// ============================================================
+// =============== Surface centers
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, SurfaceCenterOfFlatGridIsCentroid) {
+  const size_t n = 21;
+  std::unique_ptr<HalfedgeMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  std::tie(mesh, geometry) = makeFlatGrid(n);
+  VertexData<Vector3>& pos = geometry->inputVertexPositions;
+
+  // A few weighted points away from the boundary, whose center (for p = 2) is their weighted centroid
+  VertexData<double> distribution(*mesh, 0.);
+  distribution[mesh->vertex(6 * n + 8)] = 1.;
+  distribution[mesh->vertex(12 * n + 7)] = 2.;
+  distribution[mesh->vertex(9 * n + 13)] = 1.;
+  distribution[mesh->vertex(11 * n + 11)] = 1.5;
+  Vector3 centroid = Vector3::zero();
+  double weightSum = 0.;
+  for (Vertex v : mesh->vertices()) {
+    centroid += distribution[v] * pos[v];
+    weightSum += distribution[v];
+  }
+  centroid /= weightSum;
+
+  for (bool restrict : {false, true}) {
+    SurfaceCenterSolver solver(*geometry);
+    solver.restrictToSupport = restrict;
+    solver.localAreaFraction = 1.;
+    SurfacePoint center = solver.findCenter(distribution);
+    EXPECT_LT(norm(center.interpolate(pos) - centroid), 0.5 / (n - 1));
+    if (restrict) {
+      EXPECT_GT(solver.nLocalLogMaps, 0u);
+    } else {
+      EXPECT_EQ(solver.nLocalLogMaps, 0u);
+    }
+  }
+}
+
+TEST_F(SurfaceAlgorithmsSuite, SurfaceCentersBatchMatchesSequential) {
+  MeshAsset a = getAsset("spot.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+  VertexData<Vector3>& pos = geometry.inputVertexPositions;
+  geometry.requireEdgeLengths();
+  double meanEdgeLength = geometry.edgeLengths.toVector().mean();
+  geometry.unrequireEdgeLengths();
+
+  // Small distributions: a few vertices around each of several points, with varying weights
+  std::vector<VertexData<double>> distributions;
+  for (size_t i = 0; i < 7; i++) {
+    Vertex v = mesh.vertex(i * mesh.nVertices() / 7);
+    VertexData<double> distribution(mesh, 0.);
+    distribution[v] = 1.;
+    double w = 0.5;
+    for (Vertex vn : v.adjacentVertices()) {
+      distribution[vn] = w;
+      w += 0.25;
+    }
+    distributions.push_back(distribution);
+  }
+
+  for (bool restrict : {false, true}) {
+    SurfaceCenterSolver solver(geometry);
+    solver.restrictToSupport = restrict;
+    solver.localAreaFraction = 0.2;
+    std::vector<SurfacePoint> batch = solver.findCenters(distributions);
+    if (restrict) {
+      EXPECT_GT(solver.nLocalLogMaps, 0u);
+    }
+
+    ASSERT_EQ(batch.size(), distributions.size());
+    for (size_t i = 0; i < distributions.size(); i++) {
+      SurfacePoint sequential = solver.findCenter(distributions[i]);
+      EXPECT_LT(norm(batch[i].interpolate(pos) - sequential.interpolate(pos)), 0.5 * meanEdgeLength);
+    }
+  }
+
+  // Restricting log maps to the support finds (nearly) the same centers
+  SurfaceCenterSolver globalSolver(geometry);
+  globalSolver.restrictToSupport = false;
+  SurfaceCenterSolver localSolver(geometry);
+  localSolver.localAreaFraction = 0.2;
+  std::vector<SurfacePoint> globalCenters = globalSolver.findCenters(distributions);
+  std::vector<SurfacePoint> localCenters = localSolver.findCenters(distributions);
+  for (size_t i = 0; i < distributions.size(); i++) {
+    double d = norm(globalCenters[i].interpolate(pos) - localCenters[i].interpolate(pos));
+    EXPECT_LT(d, 0.5 * meanEdgeLength);
+  }
+}
+
+
+// ============================================================
+// =============== Spectral descriptors
+// ============================================================
+
+TEST_F(SurfaceAlgorithmsSuite, SpectralDescriptorsNeedEigenpairs) {
+  MeshAsset a = getAsset("bob_small.ply");
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  EXPECT_THROW(SpectralDescriptorSolver(geometry, 0), std::logic_error);
+  EXPECT_THROW(SpectralDescriptorSolver(geometry, 1), std::logic_error); // only the constant eigenvector
+
+  SpectralDescriptorSolver solver(geometry, 10);
+  DenseMatrix<double> hks = solver.computeHeatKernelSignature(solver.defaultHeatKernelTimes(4));
+  EXPECT_EQ((size_t)hks.rows(), a.mesh->nVertices());
+  EXPECT_EQ(hks.cols(), 4);
+}
+
+TEST_F(SurfaceAlgorithmsSuite, SpectralDescriptorsMatchEigenSums) {
+  MeshAsset a = getAsset("bob_small.ply");
+  HalfedgeMesh& mesh = *a.mesh;
+  VertexPositionGeometry& geometry = *a.geometry;
+
+  const size_t nEigenpairs = 20;
+  SpectralDescriptorSolver solver(geometry, nEigenpairs);
+  std::vector<double> times = solver.defaultHeatKernelTimes(5);
+  std::vector<double> logEnergies = solver.defaultWaveKernelLogEnergies(5);
+  double sigma = solver.defaultWaveKernelSigma(5);
+  DenseMatrix<double> hks = solver.computeHeatKernelSignature(times);
+  DenseMatrix<double> wks = solver.computeWaveKernelSignature(logEnergies, sigma);
+  ASSERT_EQ((size_t)hks.rows(), mesh.nVertices());
+  ASSERT_EQ((size_t)wks.rows(), mesh.nVertices());
+
+  // Evaluate the sums directly (the mesh is connected, so only the first eigenvalue is zero)
+  geometry.requireLaplaceBeltramiEigenbasis(nEigenpairs);
+  const Eigen::VectorXd& evals = geometry.laplaceBeltramiEigenvalues;
+  const Eigen::MatrixXd& phi = geometry.laplaceBeltramiEigenvectors;
+  for (size_t iV = 0; iV < mesh.nVertices(); iV++) {
+    for (size_t j = 0; j < times.size(); j++) {
+      double sum = 0.;
+      for (size_t i = 0; i < nEigenpairs; i++) {
+        sum += std::exp(-std::max(evals[i], 0.) * times[j]) * phi(iV, i) * phi(iV, i);
+      }
+      EXPECT_NEAR(hks(iV, j), sum, 1e-10 * sum);
+    }
+    for (size_t j = 0; j < logEnergies.size(); j++) {
+      double sum = 0., totalWeight = 0.;
+      for (size_t i = 1; i < nEigenpairs; i++) {
+        double d = logEnergies[j] - std::log(evals[i]);
+        double w = std::exp(-d * d / (2. * sigma * sigma));
+        sum += w * phi(iV, i) * phi(iV, i);
+        totalWeight += w;
+      }
+      EXPECT_NEAR(wks(iV, j), sum / totalWeight, 1e-10 * sum / totalWeight);
+    }
+  }
+  geometry.unrequireLaplaceBeltramiEigenbasis();
+
+  // The one-off functions use the default scales
+  DenseMatrix<double> hksDefault = heatKernelSignature(geometry, 5, nEigenpairs);
+  EXPECT_LT((hksDefault - hks).norm(), 1e-12 * hks.norm());
+  DenseMatrix<double> wksDefault = waveKernelSignature(geometry, 5, nEigenpairs);
+  EXPECT_LT((wksDefault - wks).norm(), 1e-12 * wks.norm());
+
+  EXPECT_THROW(solver.computeHeatKernelSignature({-1.}), std::logic_error);
+  EXPECT_THROW(solver.computeWaveKernelSignature(logEnergies, 0.), std::logic_error);
+}
+
+TEST_F(SurfaceAlgorithmsSuite, SpectralDescriptorsStreamMatchesBatch) {
+  MeshAsset a = getAsset("bob_small.ply");
+  size_t nVertices = a.mesh->nVertices();
+
+  SpectralDescriptorSolver solver(*a.geometry, 20);
+  solver.blockSize = 37; // so that there are several rounds of blocks, the last block partial
+  solver.nThreads = 3;
+  std::vector<double> times = solver.defaultHeatKernelTimes(4);
+  std::vector<double> logEnergies = solver.defaultWaveKernelLogEnergies(4);
+  double sigma = solver.defaultWaveKernelSigma(4);
+  DenseMatrix<double> hks = solver.computeHeatKernelSignature(times);
+  DenseMatrix<double> wks = solver.computeWaveKernelSignature(logEnergies, sigma);
+
+  // Blocks arrive in order, each starting where the last ended, and together cover every vertex
+  for (bool heat : {true, false}) {
+    const DenseMatrix<double>& batch = heat ? hks : wks;
+    size_t nextVertex = 0;
+    auto consume = [&](size_t firstVertex, const DenseMatrix<double>& block) {
+      EXPECT_EQ(firstVertex, nextVertex);
+      EXPECT_EQ((size_t)block.rows(), std::min(solver.blockSize, nVertices - firstVertex));
+      ASSERT_EQ(block.cols(), batch.cols());
+      EXPECT_LT((block - batch.middleRows(firstVertex, block.rows())).norm(), 1e-12 * batch.norm());
+      nextVertex = firstVertex + block.rows();
+    };
+    if (heat) {
+      solver.computeHeatKernelSignature(times, consume);
+    } else {
+      solver.computeWaveKernelSignature(logEnergies, sigma, consume);
+    }
+    EXPECT_EQ(nextVertex, nVertices);
+  }
+}